@@ -0,0 +1,52 @@
+// Standard library
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+// Platform
+#include <fcntl.h>
+#include <unistd.h>
+
+// client
+#include "client/batch.hpp"
+
+int main (int argc, char ** argv) {
+    pstore::http::batch_options options;
+    char const * manifest = nullptr;
+    for (int arg = 1; arg < argc; ++arg) {
+        if (std::strcmp (argv[arg], "--concurrency") == 0 && arg + 1 < argc) {
+            options.concurrency = static_cast<unsigned> (std::strtoul (argv[++arg], nullptr, 10));
+        } else if (std::strcmp (argv[arg], "--per-host") == 0 && arg + 1 < argc) {
+            options.per_host = static_cast<unsigned> (std::strtoul (argv[++arg], nullptr, 10));
+        } else if (manifest == nullptr && argv[arg][0] != '-') {
+            manifest = argv[arg];
+        } else {
+            std::cerr << "USAGE: " << argv[0]
+                      << " [--concurrency <n>] [--per-host <n>] [<manifest.jsonl>]\n"
+                         "Reads the manifest from stdin if no file is named. Results are "
+                         "written to stdout.\n";
+            return EXIT_FAILURE;
+        }
+    }
+
+    int fd = STDIN_FILENO;
+    if (manifest != nullptr) {
+        fd = ::open (manifest, O_RDONLY | O_CLOEXEC);
+        if (fd == -1) {
+            std::cerr << "Failed to open: " << manifest << " (" << std::strerror (errno) << ")\n";
+            return EXIT_FAILURE;
+        }
+    }
+    pstore::error_or<pstore::http::batch_summary> const summary =
+        pstore::http::run_batch (fd, std::cout, options);
+    if (manifest != nullptr) {
+        ::close (fd);
+    }
+    if (!summary) {
+        std::cerr << "Failed to read the manifest (" << summary.get_error ().message () << ")\n";
+        return EXIT_FAILURE;
+    }
+    std::cerr << summary->requests << " request(s), " << summary->failures << " failed\n";
+    return summary->failures == 0U ? EXIT_SUCCESS : EXIT_FAILURE;
+}
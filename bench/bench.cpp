@@ -0,0 +1,694 @@
+// A load generator. Drives a number of keep-alive connections, each on its own thread, against
+// a URL or an in-process loopback server and reports throughput and the latency distribution of
+// the connect, time-to-first-byte and full-response phases.
+//
+// With --rate, requests are issued on an open-loop schedule: each connection sends at fixed
+// intervals whether or not earlier responses were slow, and latencies are measured from the
+// time at which a request was due rather than when it was actually sent. This avoids the
+// "coordinated omission" which makes a closed-loop generator under-report tail latency.
+//
+// --transport selects how the requests are made: "sync" uses the blocking functions of
+// client.hpp with a thread per connection; "io_uring" divides the connections among --threads
+// threads (by default, one per connection as for sync), each driving its share through a
+// uring_loop; "both" runs one after the other so that they can be compared. "runtime" spreads
+// the connections over the worker threads of a thread-per-core runtime (--threads of them) to
+// show how throughput scales with cores.
+//
+// With the io_uring transport, --timeout sets a deadline for each request and --hedge sends a
+// second copy of any request which is slower than most recent ones, which shows their effect
+// on tail latency.
+//
+// The socket options (--no-delay, --quick-ack, --fast-open, --rcvbuf, --sndbuf and --zero-copy)
+// apply to the sync and io_uring transports' sockets and to the loopback server's, so that
+// each can be measured on its own. Zero-copy affects only the server's writes of large
+// bodies; the client's requests are too small for it.
+
+// Standard library
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+// pstore
+#include "pstore/http/buffered_reader.hpp"
+#include "pstore/http/net_txrx.hpp"
+
+// client
+#include "client/client.hpp"
+#include "client/happy_eyeballs.hpp"
+#include "client/resolver.hpp"
+#include "client/runtime.hpp"
+#include "client/socket_options.hpp"
+#include "client/trace.hpp"
+#include "client/uring_loop.hpp"
+
+// bench
+#include "histogram.hpp"
+#include "loopback_server.hpp"
+
+namespace {
+
+    using namespace pstore;
+    using clock_type = std::chrono::steady_clock;
+
+    enum class transport { sync, io_uring, both, runtime };
+
+    struct options {
+        std::string host;
+        std::string port = "80";
+        std::string path = "/";
+        unsigned connections = 4;
+        /// Requests per second across all connections. 0 means as fast as possible.
+        double rate = 0.0;
+        std::chrono::seconds duration{10};
+        transport how = transport::sync;
+        /// Threads for the io_uring transport and worker threads for the runtime transport.
+        /// 0 means one per connection for io_uring and one per CPU for the runtime.
+        unsigned threads = 0;
+        /// The io_uring transport's deadline for each request. 0 means no deadline.
+        std::chrono::milliseconds timeout{0};
+        /// The io_uring transport's initial hedging delay. 0 disables hedging.
+        std::chrono::milliseconds hedge{0};
+        /// Applied to the client's sockets and the loopback server's.
+        http::socket_options socket;
+
+        bool loopback = false;
+        loopback_server::options server;
+    };
+
+    struct phase_stats {
+        latency_histogram connect;
+        latency_histogram ttfb;
+        latency_histogram response;
+        std::uint64_t requests = 0;
+        std::uint64_t errors = 0;
+        std::uint64_t bytes = 0;
+
+        void merge (phase_stats const & other) {
+            connect.merge (other.connect);
+            ttfb.merge (other.ttfb);
+            response.merge (other.response);
+            requests += other.requests;
+            errors += other.errors;
+            bytes += other.bytes;
+        }
+    };
+
+    std::uint64_t nanoseconds (clock_type::duration const d) {
+        return static_cast<std::uint64_t> (
+            std::max (std::chrono::duration_cast<std::chrono::nanoseconds> (d).count (),
+                      std::chrono::nanoseconds::rep{0}));
+    }
+
+    // Splits http://host[:port][/path].
+    bool parse_url (std::string url, options & opts) {
+        static constexpr char scheme[] = "http://";
+        if (url.compare (0, sizeof (scheme) - 1, scheme) != 0) {
+            return false;
+        }
+        url.erase (0, sizeof (scheme) - 1);
+        auto const slash = url.find ('/');
+        std::string authority = url.substr (0, slash);
+        opts.path = slash == std::string::npos ? "/" : url.substr (slash);
+
+        std::string::size_type colon = std::string::npos;
+        if (!authority.empty () && authority.front () == '[') {
+            // An IPv6 literal.
+            auto const close = authority.find (']');
+            if (close == std::string::npos) {
+                return false;
+            }
+            opts.host = authority.substr (1, close - 1);
+            colon = authority.find (':', close);
+        } else {
+            colon = authority.find (':');
+            opts.host = authority.substr (0, colon);
+        }
+        if (colon != std::string::npos) {
+            opts.port = authority.substr (colon + 1);
+        }
+        return !opts.host.empty () && !opts.port.empty ();
+    }
+
+    void usage (char const * argv0) {
+        std::cerr
+            << "USAGE: " << argv0 << " [options] <http://host[:port][/path]>\n"
+            << "       " << argv0 << " [options] --loopback <fixed|chunked|slow>\n\n"
+            << "  --connections <n>  Number of concurrent connections (default 4)\n"
+            << "  --rate <n>         Requests per second across all connections; 0 sends\n"
+            << "                     each request as soon as the previous one completes\n"
+            << "                     (default 0)\n"
+            << "  --duration <s>     Length of the run in seconds (default 10)\n"
+            << "  --transport <t>    sync, io_uring, both or runtime (default sync)\n"
+            << "  --threads <n>      Threads for the io_uring transport (default: one per\n"
+            << "                     connection) and the runtime transport (default: one\n"
+            << "                     per CPU)\n"
+            << "  --timeout <ms>     io_uring request deadline; 0 for none (default 0)\n"
+            << "  --hedge <ms>       io_uring hedging delay until the 95th percentile is\n"
+            << "                     known; 0 disables hedging (default 0)\n"
+            << "  --no-delay <0|1>   Disable Nagle's algorithm (default 1)\n"
+            << "  --quick-ack <0|1>  Disable delayed acknowledgements (default 0)\n"
+            << "  --fast-open <0|1>  Use TCP Fast Open (default 0)\n"
+            << "  --rcvbuf <n>       Socket receive buffer size; 0 for automatic (default 0)\n"
+            << "  --sndbuf <n>       Socket send buffer size; 0 for automatic (default 0)\n"
+            << "  --zero-copy <0|1>  Send large writes with MSG_ZEROCOPY (default 0)\n"
+            << "  --loopback <mode>  Serve responses from an in-process server\n"
+            << "  --body-size <n>    Loopback response body size in bytes (default 1024)\n"
+            << "  --chunk-size <n>   Loopback chunk and slow-write size (default 4096)\n"
+            << "  --delay <ms>       Delay between slow writes (default 10)\n";
+    }
+
+    bool parse_options (int argc, char ** argv, options & opts) {
+        for (int arg = 1; arg < argc; ++arg) {
+            std::string const name = argv[arg];
+            if (name.compare (0, 2, "--") != 0) {
+                if (!parse_url (name, opts)) {
+                    std::cerr << "Bad URL: " << name << '\n';
+                    return false;
+                }
+                continue;
+            }
+            if (arg + 1 >= argc) {
+                std::cerr << "Missing value for " << name << '\n';
+                return false;
+            }
+            char const * const value = argv[++arg];
+            if (name == "--connections") {
+                opts.connections = static_cast<unsigned> (std::strtoul (value, nullptr, 10));
+            } else if (name == "--rate") {
+                opts.rate = std::strtod (value, nullptr);
+            } else if (name == "--duration") {
+                opts.duration = std::chrono::seconds{std::strtol (value, nullptr, 10)};
+            } else if (name == "--transport") {
+                if (std::strcmp (value, "sync") == 0) {
+                    opts.how = transport::sync;
+                } else if (std::strcmp (value, "io_uring") == 0) {
+                    opts.how = transport::io_uring;
+                } else if (std::strcmp (value, "both") == 0) {
+                    opts.how = transport::both;
+                } else if (std::strcmp (value, "runtime") == 0) {
+                    opts.how = transport::runtime;
+                } else {
+                    std::cerr << "Unknown transport: " << value << '\n';
+                    return false;
+                }
+            } else if (name == "--threads") {
+                opts.threads = static_cast<unsigned> (std::strtoul (value, nullptr, 10));
+            } else if (name == "--timeout") {
+                opts.timeout = std::chrono::milliseconds{std::strtol (value, nullptr, 10)};
+            } else if (name == "--hedge") {
+                opts.hedge = std::chrono::milliseconds{std::strtol (value, nullptr, 10)};
+            } else if (name == "--no-delay") {
+                opts.socket.no_delay = std::strtol (value, nullptr, 10) != 0;
+            } else if (name == "--quick-ack") {
+                opts.socket.quick_ack = std::strtol (value, nullptr, 10) != 0;
+            } else if (name == "--fast-open") {
+                opts.socket.fast_open = std::strtol (value, nullptr, 10) != 0;
+            } else if (name == "--rcvbuf") {
+                opts.socket.receive_buffer = static_cast<int> (std::strtol (value, nullptr, 10));
+            } else if (name == "--sndbuf") {
+                opts.socket.send_buffer = static_cast<int> (std::strtol (value, nullptr, 10));
+            } else if (name == "--zero-copy") {
+                opts.socket.zero_copy = std::strtol (value, nullptr, 10) != 0;
+            } else if (name == "--loopback") {
+                opts.loopback = true;
+                if (std::strcmp (value, "fixed") == 0) {
+                    opts.server.mode = loopback_server::response_mode::fixed;
+                } else if (std::strcmp (value, "chunked") == 0) {
+                    opts.server.mode = loopback_server::response_mode::chunked;
+                } else if (std::strcmp (value, "slow") == 0) {
+                    opts.server.mode = loopback_server::response_mode::slow;
+                } else {
+                    std::cerr << "Unknown loopback mode: " << value << '\n';
+                    return false;
+                }
+            } else if (name == "--body-size") {
+                opts.server.body_size = std::strtoul (value, nullptr, 10);
+            } else if (name == "--chunk-size") {
+                opts.server.chunk_size = std::strtoul (value, nullptr, 10);
+            } else if (name == "--delay") {
+                opts.server.delay = std::chrono::milliseconds{std::strtol (value, nullptr, 10)};
+            } else {
+                std::cerr << "Unknown option: " << name << '\n';
+                return false;
+            }
+        }
+        return opts.connections > 0 && (opts.loopback || !opts.host.empty ());
+    }
+
+    // run connection
+    // ~~~~~~~~~~~~~~
+    /// Issues requests on one connection (reconnecting as necessary) until \p end.
+    void run_connection (options const & opts, http::address_list const & addresses,
+                         clock_type::time_point const start, clock_type::time_point const end,
+                         clock_type::duration const interval, phase_stats & stats) {
+        http::header_block headers;
+        clock_type::time_point first_byte;
+        bool waiting = false;
+
+        // Wraps the network refiller to note when the first byte of a response arrives.
+        auto const refill = [&first_byte, &waiting] (socket_descriptor & fd,
+                                                     gsl::span<std::uint8_t> const & s) {
+            auto result = http::net::refiller (fd, s);
+            if (waiting) {
+                first_byte = clock_type::now ();
+                waiting = false;
+            }
+            return result;
+        };
+
+        http::happy_eyeballs_options connect_options;
+        connect_options.socket = opts.socket;
+
+        std::uint64_t n = 0;
+        while (clock_type::now () < end) {
+            auto const connect_start = clock_type::now ();
+            error_or<socket_descriptor> eo_socket =
+                http::connect_racing (addresses, connect_options);
+            if (!eo_socket) {
+                ++stats.errors;
+                std::this_thread::sleep_for (std::chrono::milliseconds{10});
+                continue;
+            }
+            stats.connect.record (nanoseconds (clock_type::now () - connect_start));
+            socket_descriptor & fd = *eo_socket;
+            auto reader = http::make_socket_reader (refill, http::response_buffer_size);
+
+            for (bool reusable = true; reusable;) {
+                // When the next request is due. In closed-loop mode, that's now.
+                auto const due = interval.count () > 0
+                                     ? start + interval * static_cast<clock_type::rep> (n)
+                                     : clock_type::now ();
+                if (due >= end) {
+                    return;
+                }
+                ++n;
+                std::this_thread::sleep_until (due);
+
+                waiting = true;
+                if (http::http_get (fd, opts.host, opts.port, opts.path)) {
+                    ++stats.errors;
+                    break;
+                }
+                auto eo_status = http::read_status_line (reader, fd);
+                if (!eo_status) {
+                    ++stats.errors;
+                    break;
+                }
+                headers.clear ();
+                auto const eo_headers = http::read_headers (
+                    reader, std::ref (fd),
+                    [&headers] (http::header_info io, std::string const & key,
+                                std::string const & value) {
+                        headers.add (key, value);
+                        return io.handler (key, value);
+                    },
+                    http::header_info ());
+                if (!eo_headers) {
+                    ++stats.errors;
+                    break;
+                }
+                http::status_line const & status = std::get<http::status_line> (*eo_status);
+                auto const eo_body =
+                    http::read_message_body (reader, fd, status.status_code (), headers,
+                                             [] (gsl::span<char const> const &) {});
+                if (!eo_body) {
+                    ++stats.errors;
+                    break;
+                }
+
+                auto const now = clock_type::now ();
+                stats.ttfb.record (nanoseconds (first_byte - due));
+                stats.response.record (nanoseconds (now - due));
+                stats.bytes += std::get<std::size_t> (*eo_body);
+                ++stats.requests;
+                reusable = http::keep_alive (status.http_version (), headers);
+            }
+        }
+    }
+
+    void report_header () {
+        std::cout << std::left << std::setw (14) << "latency (us)" << std::right;
+        for (char const * const column : {"count", "p50", "p90", "p99", "p99.9", "max"}) {
+            std::cout << std::setw (12) << column;
+        }
+        std::cout << '\n';
+    }
+
+    void report (char const * name, latency_histogram const & h) {
+        if (h.count () == 0U) {
+            // A phase which this transport doesn't measure.
+            return;
+        }
+        auto const us = [] (std::uint64_t ns) { return static_cast<double> (ns) / 1000.0; };
+        std::cout << std::left << std::setw (14) << name << std::right << std::setw (12)
+                  << h.count () << std::fixed << std::setprecision (1);
+        for (double const p : {50.0, 90.0, 99.0, 99.9}) {
+            std::cout << std::setw (12) << us (h.percentile (p));
+        }
+        std::cout << std::setw (12) << us (h.max ()) << '\n';
+    }
+
+    // uring threads
+    // ~~~~~~~~~~~~~
+    /// The number of threads used by the io_uring transport. By default, this matches the sync
+    /// transport's thread per connection so that the two are compared like for like.
+    unsigned uring_threads (options const & opts) {
+        return opts.threads == 0U ? opts.connections : std::min (opts.threads, opts.connections);
+    }
+
+    // run uring lanes
+    // ~~~~~~~~~~~~~~~
+    /// Issues requests on the concurrent "lanes" [first_lane, last_lane), all driven by one
+    /// uring_loop on the calling thread, until \p end. Connections are made and reused by the
+    /// loop, which reports the times of each request's phases.
+    void run_uring_lanes (options const & opts, std::shared_ptr<http::resolver> const & resolver,
+                          unsigned const first_lane, unsigned const last_lane,
+                          clock_type::time_point const start, clock_type::time_point const end,
+                          clock_type::duration const interval, phase_stats & stats) {
+        http::uring_loop::options loop_options;
+        // Leave room for connections which are being retired as others replace them.
+        loop_options.max_connections = std::max ((last_lane - first_lane) * 2U, 16U);
+        loop_options.socket = opts.socket;
+        error_or<std::unique_ptr<http::uring_loop>> eo_loop =
+            http::uring_loop::create (loop_options, resolver);
+        if (!eo_loop) {
+            std::cerr << "Failed to create the io_uring loop: " << eo_loop.get_error ().message ()
+                      << '\n';
+            ++stats.errors;
+            return;
+        }
+        http::uring_loop & loop = **eo_loop;
+
+        struct lane {
+            std::uint64_t n = 0;
+            bool busy = false;
+            http::request_trace trace;
+        };
+        std::vector<lane> lanes (last_lane - first_lane);
+        auto const body = [&stats] (gsl::span<char const> const & s) {
+            stats.bytes += static_cast<std::uint64_t> (s.size ());
+        };
+
+        for (;;) {
+            auto const now = clock_type::now ();
+            auto next = clock_type::time_point::max ();
+            bool active = false;
+            for (std::size_t ctr = 0; ctr < lanes.size (); ++ctr) {
+                lane & l = lanes[ctr];
+                if (l.busy) {
+                    active = true;
+                    continue;
+                }
+                // As for run_connection(), with the lanes' schedules staggered.
+                auto const due =
+                    interval.count () > 0
+                        ? start +
+                              interval / opts.connections *
+                                  static_cast<clock_type::rep> (first_lane + ctr) +
+                              interval * static_cast<clock_type::rep> (l.n)
+                        : now;
+                if (due >= end) {
+                    continue;
+                }
+                active = true;
+                if (due > now) {
+                    next = std::min (next, due);
+                    continue;
+                }
+                ++l.n;
+                l.busy = true;
+                l.trace = http::request_trace{};
+                http::uring_loop::request_options request_options;
+                request_options.total = opts.timeout;
+                request_options.hedge = opts.hedge.count () > 0;
+                request_options.hedge_delay = opts.hedge;
+                request_options.trace = &l.trace;
+                std::error_code const erc = loop.async_get (
+                    opts.host, opts.port, opts.path, request_options,
+                    [&stats, &l, due] (std::error_code const e, http::response_parser const &) {
+                        l.busy = false;
+                        if (e) {
+                            ++stats.errors;
+                            return;
+                        }
+                        auto const status_line =
+                            static_cast<std::size_t> (http::phase::status_line);
+                        if (l.trace.started (http::phase::connect)) {
+                            stats.connect.record (
+                                nanoseconds (l.trace.duration (http::phase::connect)));
+                        }
+                        stats.ttfb.record (nanoseconds (l.trace.end[status_line] - due));
+                        stats.response.record (nanoseconds (clock_type::now () - due));
+                        ++stats.requests;
+                    },
+                    body);
+                if (erc) {
+                    l.busy = false;
+                    ++stats.errors;
+                    std::this_thread::sleep_for (std::chrono::milliseconds{10});
+                }
+            }
+            if (!active) {
+                break;
+            }
+            // Wait for a completion or until the next request is due. The timeout has only
+            // millisecond resolution so, if that is sooner, just poll.
+            auto timeout = std::chrono::milliseconds{-1};
+            if (next != clock_type::time_point::max ()) {
+                timeout = std::chrono::duration_cast<std::chrono::milliseconds> (next - now);
+            }
+            if (!loop.run_once (timeout)) {
+                ++stats.errors;
+                break;
+            }
+        }
+    }
+
+    // run uring
+    // ~~~~~~~~~
+    /// Divides opts.connections lanes among uring_threads() threads, each with its own
+    /// uring_loop, and runs them until \p end.
+    void run_uring (options const & opts, std::shared_ptr<http::resolver> const & resolver,
+                    clock_type::time_point const start, clock_type::time_point const end,
+                    clock_type::duration const interval, phase_stats & total) {
+        unsigned const threads = uring_threads (opts);
+        std::vector<phase_stats> stats (threads);
+        std::vector<std::thread> workers;
+        workers.reserve (threads);
+        for (unsigned ctr = 0; ctr < threads; ++ctr) {
+            workers.emplace_back (run_uring_lanes, std::cref (opts), std::cref (resolver),
+                                  opts.connections * ctr / threads,
+                                  opts.connections * (ctr + 1U) / threads, start, end, interval,
+                                  std::ref (stats[ctr]));
+        }
+        for (std::thread & t : workers) {
+            t.join ();
+        }
+        for (phase_stats const & s : stats) {
+            total.merge (s);
+        }
+    }
+
+    // run runtime
+    // ~~~~~~~~~~~
+    /// Issues requests through a runtime until \p end. In closed-loop mode, each of
+    /// opts.connections lanes submits its next request from the completion handler of the
+    /// previous one. Otherwise requests are submitted on schedule from the calling thread,
+    /// whether or not earlier ones have completed. \p stats has an entry for each worker and a
+    /// final one for the calling thread.
+    void run_runtime (options const & opts, std::shared_ptr<http::resolver> const & resolver,
+                      clock_type::time_point const start, clock_type::time_point const end,
+                      clock_type::duration const interval, std::vector<phase_stats> & stats) {
+        http::runtime::options rt_options;
+        rt_options.threads = opts.threads;
+        error_or<std::unique_ptr<http::runtime>> eo_rt =
+            http::runtime::create (rt_options, resolver);
+        if (!eo_rt) {
+            std::cerr << "Failed to start the runtime: " << eo_rt.get_error ().message () << '\n';
+            stats.resize (1);
+            ++stats.back ().errors;
+            return;
+        }
+        http::runtime & rt = **eo_rt;
+        stats.resize (rt.threads () + 1U);
+        // Handlers run on the workers: each records into its own worker's entry.
+        auto const mine = [&rt, &stats] () -> phase_stats & {
+            return stats[rt.current_worker ()];
+        };
+        auto const body = [&mine] (gsl::span<char const> const & s) {
+            mine ().bytes += static_cast<std::uint64_t> (s.size ());
+        };
+
+        std::function<void (clock_type::time_point)> issue;
+        issue = [&] (clock_type::time_point const due) {
+            std::error_code const erc = rt.submit (
+                opts.host, opts.port, opts.path,
+                [&, due] (std::error_code const e, http::response_parser const &) {
+                    phase_stats & s = mine ();
+                    auto const now = clock_type::now ();
+                    if (e) {
+                        ++s.errors;
+                    } else {
+                        s.response.record (nanoseconds (now - due));
+                        ++s.requests;
+                    }
+                    if (interval.count () == 0 && now < end) {
+                        issue (now);
+                    }
+                },
+                body);
+            if (erc) {
+                ++mine ().errors;
+            }
+        };
+
+        if (interval.count () == 0) {
+            for (unsigned ctr = 0; ctr < opts.connections; ++ctr) {
+                issue (clock_type::now ());
+            }
+        } else {
+            // The per-connection interval divided among the connections.
+            auto const spacing = interval / opts.connections;
+            for (std::uint64_t n = 0;; ++n) {
+                auto const due = start + spacing * static_cast<clock_type::rep> (n);
+                if (due >= end) {
+                    break;
+                }
+                std::this_thread::sleep_until (due);
+                issue (due);
+            }
+        }
+        rt.wait ();
+    }
+
+    char const * transport_name (transport const how) noexcept {
+        switch (how) {
+        case transport::sync: return "sync";
+        case transport::io_uring: return "io_uring";
+        case transport::both: return "both";
+        case transport::runtime: return "runtime";
+        }
+        return "";
+    }
+
+    // run
+    // ~~~
+    /// Runs the benchmark on the transport \p how and reports the results.
+    void run (options const & opts, transport const how,
+              std::shared_ptr<http::resolver> const & resolver,
+              http::address_list const & addresses) {
+        // Each connection issues requests at rate / connections per second.
+        clock_type::duration interval{0};
+        if (opts.rate > 0.0) {
+            interval = std::chrono::duration_cast<clock_type::duration> (
+                std::chrono::duration<double> (static_cast<double> (opts.connections) / opts.rate));
+        }
+
+        phase_stats total;
+        auto const start = clock_type::now ();
+        auto const end = start + opts.duration;
+        // The number of threads making requests.
+        auto threads = opts.connections;
+        if (how == transport::io_uring) {
+            threads = uring_threads (opts);
+            run_uring (opts, resolver, start, end, interval, total);
+        } else if (how == transport::runtime) {
+            std::vector<phase_stats> stats;
+            run_runtime (opts, resolver, start, end, interval, stats);
+            threads = static_cast<unsigned> (stats.size () - 1U);
+            for (phase_stats const & s : stats) {
+                total.merge (s);
+            }
+        } else {
+            std::vector<phase_stats> stats (opts.connections);
+            std::vector<std::thread> threads;
+            threads.reserve (opts.connections);
+            for (unsigned ctr = 0; ctr < opts.connections; ++ctr) {
+                // Stagger the connections' schedules so that their requests are evenly spread.
+                auto const offset = interval / opts.connections * ctr;
+                threads.emplace_back (run_connection, std::cref (opts), std::cref (addresses),
+                                      start + offset, end, interval, std::ref (stats[ctr]));
+            }
+            for (std::thread & t : threads) {
+                t.join ();
+            }
+            for (phase_stats const & s : stats) {
+                total.merge (s);
+            }
+        }
+        auto const elapsed = std::chrono::duration<double> (clock_type::now () - start).count ();
+
+        std::cout << "transport: " << transport_name (how) << "  threads: " << threads << '\n'
+                  << "requests: " << total.requests << "  errors: " << total.errors << '\n'
+                  << std::fixed << std::setprecision (1)
+                  << "throughput: " << static_cast<double> (total.requests) / elapsed << " req/s  "
+                  << static_cast<double> (total.bytes) / elapsed / (1024.0 * 1024.0)
+                  << " MiB/s (body)\n\n";
+        report_header ();
+        report ("connect", total.connect);
+        report ("ttfb", total.ttfb);
+        report ("response", total.response);
+    }
+
+} // end anonymous namespace
+
+int main (int argc, char ** argv) {
+    options opts;
+    if (!parse_options (argc, argv, opts)) {
+        usage (argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    std::unique_ptr<loopback_server> server;
+    if (opts.loopback) {
+        opts.server.socket = opts.socket;
+        error_or<std::unique_ptr<loopback_server>> eo_server = loopback_server::start (opts.server);
+        if (!eo_server) {
+            std::cerr << "Failed to start the loopback server: "
+                      << eo_server.get_error ().message () << '\n';
+            return EXIT_FAILURE;
+        }
+        server = std::move (*eo_server);
+        opts.host = "127.0.0.1";
+        opts.port = server->port ();
+    }
+
+    // Resolve once so that DNS isn't part of the measurement. The io_uring loop shares the
+    // resolver and so finds the result in its cache.
+    auto const resolver = std::make_shared<http::resolver> ();
+    http::resolver::result_type const addresses = resolver->resolve (opts.host, opts.port);
+    if (!addresses) {
+        std::cerr << "Failed to resolve " << opts.host << ": "
+                  << addresses.get_error ().message () << '\n';
+        return EXIT_FAILURE;
+    }
+    http::address_list const ordered = http::interleave_families (**addresses);
+
+    if (opts.how == transport::runtime) {
+        // The runtime falls back to epoll by itself.
+        run (opts, transport::runtime, resolver, ordered);
+        return EXIT_SUCCESS;
+    }
+    if (opts.how != transport::sync && !http::uring_loop::supported ()) {
+        std::cerr << "io_uring is not available: using the sync transport\n";
+        opts.how = transport::sync;
+    }
+    if (opts.how != transport::io_uring) {
+        run (opts, transport::sync, resolver, ordered);
+    }
+    if (opts.how == transport::both) {
+        std::cout << '\n';
+    }
+    if (opts.how != transport::sync) {
+        run (opts, transport::io_uring, resolver, ordered);
+    }
+    return EXIT_SUCCESS;
+}
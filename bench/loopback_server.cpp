@@ -0,0 +1,182 @@
+#include "loopback_server.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cerrno>
+#include <cstdio>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+
+namespace {
+
+    using namespace pstore;
+
+    std::error_code last_error () noexcept { return {errno, std::generic_category ()}; }
+
+    // The response outlives every connection, so the sender needn't hold an owner for it.
+    bool send_all (http::zero_copy_sender & sender, char const * first, char const * const last) {
+        return !sender.send (gsl::make_span (first, last), nullptr);
+    }
+
+    // Waits up to 100ms for fd to become readable so that the caller can periodically check
+    // whether the server is stopping.
+    bool wait_readable (socket_descriptor const & fd) {
+        pollfd p{fd.native_handle (), POLLIN, 0};
+        return ::poll (&p, 1, 100) > 0;
+    }
+
+} // end anonymous namespace
+
+// start
+// ~~~~~
+error_or<std::unique_ptr<loopback_server>> loopback_server::start (options const & opts) {
+    using return_type = error_or<std::unique_ptr<loopback_server>>;
+    socket_descriptor fd{::socket (AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0)};
+    if (!fd.valid ()) {
+        return return_type{last_error ()};
+    }
+    int const one = 1;
+    ::setsockopt (fd.native_handle (), SOL_SOCKET, SO_REUSEADDR, &one, sizeof (one));
+    if (opts.socket.fast_open) {
+        // The length of the queue of connections whose handshake is incomplete. The kernel
+        // also needs server support enabled by the net.ipv4.tcp_fastopen sysctl.
+        int const queue = 64;
+        ::setsockopt (fd.native_handle (), IPPROTO_TCP, TCP_FASTOPEN, &queue, sizeof (queue));
+    }
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+    addr.sin_port = 0; // Let the kernel choose.
+    socklen_t len = sizeof (addr);
+    if (::bind (fd.native_handle (), reinterpret_cast<sockaddr const *> (&addr), len) != 0 ||
+        ::listen (fd.native_handle (), SOMAXCONN) != 0 ||
+        ::getsockname (fd.native_handle (), reinterpret_cast<sockaddr *> (&addr), &len) != 0) {
+        return return_type{last_error ()};
+    }
+
+    std::unique_ptr<loopback_server> server{
+        new loopback_server (opts, std::move (fd), std::to_string (ntohs (addr.sin_port)))};
+    server->acceptor_ = std::thread{[s = server.get ()] { s->accept_loop (); }};
+    return return_type{std::move (server)};
+}
+
+loopback_server::loopback_server (options const & opts, socket_descriptor && listener,
+                                  std::string && port)
+        : options_{opts}
+        , listener_{std::move (listener)}
+        , port_{std::move (port)} {
+
+    std::string const body (options_.body_size, 'x');
+    if (options_.mode == response_mode::chunked) {
+        response_ = "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n";
+        head_size_ = response_.length ();
+        std::size_t const chunk_size = std::max (options_.chunk_size, std::size_t{1});
+        for (std::size_t pos = 0; pos < body.length (); pos += chunk_size) {
+            std::size_t const size = std::min (chunk_size, body.length () - pos);
+            std::array<char, 32> hex;
+            std::snprintf (hex.data (), hex.size (), "%zx\r\n", size);
+            response_ += hex.data ();
+            response_.append (body, pos, size);
+            response_ += "\r\n";
+        }
+        response_ += "0\r\n\r\n";
+    } else {
+        response_ = "HTTP/1.1 200 OK\r\nContent-Length: " + std::to_string (body.length ()) +
+                    "\r\n\r\n";
+        head_size_ = response_.length ();
+        response_ += body;
+    }
+}
+
+loopback_server::~loopback_server () noexcept {
+    done_ = true;
+    if (acceptor_.joinable ()) {
+        acceptor_.join ();
+    }
+    // The acceptor has stopped so connections_ can no longer change.
+    for (std::thread & t : connections_) {
+        t.join ();
+    }
+}
+
+// accept loop
+// ~~~~~~~~~~~
+void loopback_server::accept_loop () {
+    while (!done_) {
+        if (!wait_readable (listener_)) {
+            continue;
+        }
+        socket_descriptor fd{::accept4 (listener_.native_handle (), nullptr, nullptr,
+                                        SOCK_CLOEXEC)};
+        if (!fd.valid ()) {
+            continue;
+        }
+        // The connection is already made, so fast_open has no effect.
+        if (http::configure_socket (fd, options_.socket)) {
+            continue;
+        }
+        std::lock_guard<std::mutex> const lock{mutex_};
+        connections_.emplace_back (
+            [this] (socket_descriptor && s) { this->serve (std::move (s)); }, std::move (fd));
+    }
+}
+
+// serve
+// ~~~~~
+void loopback_server::serve (socket_descriptor fd) {
+    http::zero_copy_sender sender{fd};
+    std::string request;
+    std::array<char, 4096> buffer;
+    while (!done_) {
+        if (!wait_readable (fd)) {
+            continue;
+        }
+        ssize_t const r = ::recv (fd.native_handle (), buffer.data (), buffer.size (), 0);
+        if (r <= 0) {
+            return;
+        }
+        request.append (buffer.data (), static_cast<std::size_t> (r));
+        // Answer each complete request head. Requests with bodies aren't expected.
+        for (auto end = request.find ("\r\n\r\n"); end != std::string::npos;
+             end = request.find ("\r\n\r\n")) {
+            std::string head = request.substr (0, end);
+            request.erase (0, end + 4);
+            std::transform (std::begin (head), std::end (head), std::begin (head),
+                            [] (unsigned char c) { return static_cast<char> (std::tolower (c)); });
+            if (!this->respond (sender) || head.find ("connection: close") != std::string::npos) {
+                return;
+            }
+        }
+    }
+}
+
+// respond
+// ~~~~~~~
+bool loopback_server::respond (http::zero_copy_sender & sender) {
+    char const * const first = response_.data ();
+    char const * const last = first + response_.length ();
+    if (options_.mode != response_mode::slow) {
+        return send_all (sender, first, last);
+    }
+
+    std::this_thread::sleep_for (options_.delay);
+    if (!send_all (sender, first, first + head_size_)) {
+        return false;
+    }
+    std::size_t const chunk_size = std::max (options_.chunk_size, std::size_t{1});
+    for (char const * pos = first + head_size_; pos != last && !done_;) {
+        std::this_thread::sleep_for (options_.delay);
+        char const * const end = pos + std::min (chunk_size, static_cast<std::size_t> (last - pos));
+        if (!send_all (sender, pos, end)) {
+            return false;
+        }
+        pos = end;
+    }
+    return true;
+}
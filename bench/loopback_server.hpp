@@ -0,0 +1,82 @@
+#ifndef BENCH_LOOPBACK_SERVER_HPP
+#define BENCH_LOOPBACK_SERVER_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "pstore/adt/error_or.hpp"
+#include "pstore/os/descriptor.hpp"
+
+#include "client/socket_options.hpp"
+
+// loopback server
+// ~~~~~~~~~~~~~~~
+/// A minimal HTTP/1.1 server bound to an ephemeral port on 127.0.0.1 so that benchmark runs are
+/// reproducible without a network. Every GET is answered with a body of the configured size;
+/// the request target is ignored. Each connection is served by its own thread and is kept
+/// alive unless the client asks for it to be closed.
+class loopback_server {
+public:
+    enum class response_mode {
+        /// A Content-Length delimited body sent with the head in one write.
+        fixed,
+        /// A chunked body, using chunks of options::chunk_size bytes.
+        chunked,
+        /// As fixed, but the server waits for options::delay before sending the head and again
+        /// before each chunk_size piece of the body.
+        slow,
+    };
+
+    struct options {
+        response_mode mode = response_mode::fixed;
+        std::size_t body_size = 1024;
+        std::size_t chunk_size = 4096;
+        std::chrono::milliseconds delay{10};
+        /// Applied to each connection. fast_open enables TCP Fast Open on the listening socket
+        /// and zero_copy sends large responses with MSG_ZEROCOPY.
+        pstore::http::socket_options socket;
+    };
+
+    static pstore::error_or<std::unique_ptr<loopback_server>> start (options const & opts);
+
+    loopback_server (loopback_server const &) = delete;
+    loopback_server (loopback_server &&) = delete;
+    /// Stops accepting connections and waits for the connection threads to finish.
+    ~loopback_server () noexcept;
+
+    loopback_server & operator= (loopback_server const &) = delete;
+    loopback_server & operator= (loopback_server &&) = delete;
+
+    /// The port on which the server is listening.
+    std::string const & port () const noexcept { return port_; }
+
+private:
+    loopback_server (options const & opts, pstore::socket_descriptor && listener,
+                     std::string && port);
+
+    void accept_loop ();
+    void serve (pstore::socket_descriptor fd);
+    bool respond (pstore::http::zero_copy_sender & sender);
+
+    options const options_;
+    /// The complete response, built once. For the slow mode, the head is the first
+    /// head_size_ bytes.
+    std::string response_;
+    std::size_t head_size_ = 0;
+
+    pstore::socket_descriptor listener_;
+    std::string const port_;
+    std::atomic<bool> done_{false};
+
+    std::mutex mutex_;
+    std::vector<std::thread> connections_;
+    std::thread acceptor_;
+};
+
+#endif // BENCH_LOOPBACK_SERVER_HPP
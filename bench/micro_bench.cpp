@@ -0,0 +1,358 @@
+// Microbenchmarks for the client's parsing and serialization paths. Responses are read from
+// an in-memory refiller rather than a socket, so the figures exclude the kernel. Each
+// benchmark also reports the number of heap allocations per operation ("allocs/op"), counted
+// by the replacement operator new below, so that an allocation creeping into a hot path
+// shows up as a number rather than as noise in the timings.
+
+// Standard library
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <iterator>
+#include <new>
+#include <string>
+#include <string_view>
+
+// Google Benchmark
+#include <benchmark/benchmark.h>
+
+// pstore
+#include "pstore/http/headers.hpp"
+#include "pstore/http/net_txrx.hpp"
+
+// client
+#include "client/client.hpp"
+#include "client/header_block.hpp"
+#include "client/header_field.hpp"
+#include "client/request_builder.hpp"
+#include "client/socket_reader.hpp"
+
+namespace {
+
+    std::atomic<std::uint64_t> allocations{0};
+
+} // end anonymous namespace
+
+// The allocation hooks, one for ordinary and one for over-aligned types. The array, sized and
+// nothrow forms of new and delete forward to these. (The deletes are not inlined so that GCC
+// doesn't see free() applied to the result of new.)
+void * operator new (std::size_t size) {
+    allocations.fetch_add (1U, std::memory_order_relaxed);
+    if (void * const p = std::malloc (std::max (size, std::size_t{1}))) {
+        return p;
+    }
+    throw std::bad_alloc{};
+}
+__attribute__ ((noinline)) void operator delete (void * p) noexcept { std::free (p); }
+__attribute__ ((noinline)) void operator delete (void * p, std::size_t) noexcept {
+    std::free (p);
+}
+
+void * operator new (std::size_t size, std::align_val_t const al) {
+    allocations.fetch_add (1U, std::memory_order_relaxed);
+    auto const alignment = std::max (static_cast<std::size_t> (al), sizeof (void *));
+    // aligned_alloc() needs a size which is a multiple of the alignment.
+    if (size <= SIZE_MAX - alignment) {
+        std::size_t const rounded = (std::max (size, std::size_t{1}) + alignment - 1U) &
+                                    ~(alignment - 1U);
+        if (void * const p = std::aligned_alloc (alignment, rounded)) {
+            return p;
+        }
+    }
+    throw std::bad_alloc{};
+}
+__attribute__ ((noinline)) void operator delete (void * p, std::align_val_t) noexcept {
+    std::free (p);
+}
+__attribute__ ((noinline)) void operator delete (void * p, std::size_t, std::align_val_t) noexcept {
+    std::free (p);
+}
+
+namespace {
+
+    using namespace pstore;
+
+    // allocation counter
+    // ~~~~~~~~~~~~~~~~~~
+    /// Counts the allocations made between its construction and the call to report().
+    class allocation_counter {
+    public:
+        allocation_counter () noexcept
+                : start_{allocations.load (std::memory_order_relaxed)} {}
+        void report (benchmark::State & state) const {
+            auto const n = allocations.load (std::memory_order_relaxed) - start_;
+            state.counters["allocs/op"] =
+                benchmark::Counter (static_cast<double> (n), benchmark::Counter::kAvgIterations);
+        }
+
+    private:
+        std::uint64_t start_;
+    };
+
+    // memory source
+    // ~~~~~~~~~~~~~
+    /// Plays the part of a keep-alive connection on which the same text arrives over and over.
+    struct memory_source {
+        explicit memory_source (std::string_view t) noexcept
+                : text{t} {}
+        std::string_view text;
+        std::size_t pos = 0;
+    };
+
+    // memory refiller
+    // ~~~~~~~~~~~~~~~
+    /// A socket_reader refill function which copies from a memory_source. It fills the
+    /// buffer as far as the end of the source text, so a reader sees the same sequence of
+    /// refills as it would for a socket which delivered one copy of the text per receive.
+    error_or_n<memory_source &, gsl::span<std::uint8_t>::iterator>
+    memory_refiller (memory_source & src, gsl::span<std::uint8_t> const & s) {
+        using return_type = error_or_n<memory_source &, gsl::span<std::uint8_t>::iterator>;
+        if (src.pos == src.text.size ()) {
+            src.pos = 0;
+        }
+        auto const n = std::min (static_cast<std::size_t> (s.size ()), src.text.size () - src.pos);
+        auto const first = src.text.data () + src.pos;
+        auto const out = std::transform (first, first + n, s.begin (),
+                                         [] (char c) { return static_cast<std::uint8_t> (c); });
+        src.pos += n;
+        return return_type{std::in_place, src, out};
+    }
+
+    auto make_reader () {
+        return http::make_socket_reader<decltype (&memory_refiller), memory_source &> (
+            &memory_refiller, http::response_buffer_size);
+    }
+
+    constexpr char const * status_text = "HTTP/1.1 200 OK\r\n";
+    constexpr char const * header_text = "Server: pstore-http\r\n"
+                                         "Content-Type: text/html; charset=utf-8\r\n"
+                                         "Content-Length: 1234\r\n"
+                                         "Connection: keep-alive\r\n"
+                                         "Cache-Control: no-cache, no-store, must-revalidate\r\n"
+                                         "Date: Fri, 16 Oct 2026 12:00:00 GMT\r\n"
+                                         "\r\n";
+
+    // Reads the headers into a header_block, as read_final_head() does.
+    template <typename Reader>
+    bool read_header_block (Reader & reader, memory_source & src, http::header_block & headers) {
+        headers.clear ();
+        auto const eo_headers = http::read_headers (
+            reader, std::ref (src),
+            [&headers] (http::header_info io, std::string const & key, std::string const & value) {
+                headers.add (key, value);
+                return io.handler (key, value);
+            },
+            http::header_info ());
+        return static_cast<bool> (eo_headers);
+    }
+
+    // read status line
+    // ~~~~~~~~~~~~~~~~
+    void read_status_line (benchmark::State & state) {
+        memory_source src{status_text};
+        auto reader = make_reader ();
+        allocation_counter const counter;
+        for (auto _ : state) {
+            auto eo_status = http::read_status_line (reader, src);
+            if (!eo_status) {
+                state.SkipWithError ("read_status_line failed");
+                break;
+            }
+            benchmark::DoNotOptimize (std::get<http::status_line> (*eo_status).status_code ());
+        }
+        counter.report (state);
+        state.SetBytesProcessed (state.iterations () *
+                                 static_cast<std::int64_t> (src.text.size ()));
+    }
+    BENCHMARK (read_status_line);
+
+    // read headers
+    // ~~~~~~~~~~~~
+    void read_headers (benchmark::State & state) {
+        memory_source src{header_text};
+        auto reader = make_reader ();
+        http::header_block headers;
+        allocation_counter const counter;
+        for (auto _ : state) {
+            if (!read_header_block (reader, src, headers)) {
+                state.SkipWithError ("read_headers failed");
+                break;
+            }
+            benchmark::DoNotOptimize (headers.size ());
+        }
+        counter.report (state);
+        state.SetBytesProcessed (state.iterations () *
+                                 static_cast<std::int64_t> (src.text.size ()));
+    }
+    BENCHMARK (read_headers);
+
+    // parse header block
+    // ~~~~~~~~~~~~~~~~~~
+    /// The single-pass header parser used by response_parser, for comparison with
+    /// read_headers.
+    void parse_header_block (benchmark::State & state) {
+        std::string_view const text{header_text};
+        http::header_block headers;
+        allocation_counter const counter;
+        for (auto _ : state) {
+            headers.clear ();
+            auto const r = http::parse_header_block (
+                text.data (), text.data () + text.size (),
+                [&headers] (http::header_field const & f) { headers.add (f.name, f.value); });
+            if (!r || *r == 0U) {
+                state.SkipWithError ("parse_header_block failed");
+                break;
+            }
+            benchmark::DoNotOptimize (headers.size ());
+        }
+        counter.report (state);
+        state.SetBytesProcessed (state.iterations () * static_cast<std::int64_t> (text.size ()));
+    }
+    BENCHMARK (parse_header_block);
+
+    // str to http status code
+    // ~~~~~~~~~~~~~~~~~~~~~~~
+    void str_to_http_status_code (benchmark::State & state) {
+        constexpr std::string_view codes[] = {"200", "204", "304", "404", "503", "999"};
+        allocation_counter const counter;
+        std::size_t index = 0;
+        for (auto _ : state) {
+            benchmark::DoNotOptimize (http::str_to_http_status_code (codes[index]));
+            index = (index + 1U) % std::size (codes);
+        }
+        counter.report (state);
+    }
+    BENCHMARK (str_to_http_status_code);
+
+    // content length
+    // ~~~~~~~~~~~~~~
+    void content_length (benchmark::State & state) {
+        http::header_block headers;
+        std::string_view const text{header_text};
+        http::parse_header_block (
+            text.data (), text.data () + text.size (),
+            [&headers] (http::header_field const & f) { headers.add (f.name, f.value); });
+        allocation_counter const counter;
+        for (auto _ : state) {
+            error_or<std::size_t> const length = http::content_length (headers);
+            if (!length) {
+                state.SkipWithError ("content_length failed");
+                break;
+            }
+            benchmark::DoNotOptimize (*length);
+        }
+        counter.report (state);
+    }
+    BENCHMARK (content_length);
+
+    // http get
+    // ~~~~~~~~
+    /// Serializes the request that http_get() sends, copying it to a reused string in place
+    /// of the socket.
+    void http_get (benchmark::State & state) {
+        std::string out;
+        allocation_counter const counter;
+        for (auto _ : state) {
+            http::thread_request_builder ()
+                .start ("GET", "/index.html")
+                .host ("www.example.com", "8080")
+                .finish ()
+                .copy_to (out);
+            benchmark::DoNotOptimize (out.data ());
+        }
+        counter.report (state);
+        state.SetBytesProcessed (state.iterations () * static_cast<std::int64_t> (out.size ()));
+    }
+    BENCHMARK (http_get);
+
+    // make get request
+    // ~~~~~~~~~~~~~~~~
+    void make_get_request (benchmark::State & state) {
+        http::header_list headers;
+        headers.push_back (http::header_field{"Host", "www.example.com:8080"});
+        headers.push_back (http::header_field{"Accept-Encoding", "gzip, deflate"});
+        allocation_counter const counter;
+        for (auto _ : state) {
+            std::string const request = http::make_get_request ("/index.html", headers);
+            benchmark::DoNotOptimize (request.data ());
+        }
+        counter.report (state);
+    }
+    BENCHMARK (make_get_request);
+
+    // request key
+    // ~~~~~~~~~~~
+    void request_key (benchmark::State & state) {
+        allocation_counter const counter;
+        for (auto _ : state) {
+            std::string const key = http::request_key ();
+            benchmark::DoNotOptimize (key.data ());
+        }
+        counter.report (state);
+    }
+    BENCHMARK (request_key);
+
+    // read reply
+    // ~~~~~~~~~~
+    /// Reads whole responses as read_reply() does (status line, headers and then the body
+    /// according to its framing) with a body of state.range(0) bytes. When state.range(1) is
+    /// non-zero, the body uses the chunked transfer-coding with chunks of that size.
+    void read_reply (benchmark::State & state) {
+        auto const body_size = static_cast<std::size_t> (state.range (0));
+        auto const chunk_size = static_cast<std::size_t> (state.range (1));
+        std::string text = "HTTP/1.1 200 OK\r\nServer: pstore-http\r\n"
+                           "Content-Type: application/octet-stream\r\n";
+        if (chunk_size == 0U) {
+            text += "Content-Length: " + std::to_string (body_size) + "\r\n\r\n";
+            text.append (body_size, 'x');
+        } else {
+            text += "Transfer-Encoding: chunked\r\n\r\n";
+            char hex[32];
+            for (std::size_t remaining = body_size; remaining > 0U;) {
+                std::size_t const n = std::min (remaining, chunk_size);
+                std::snprintf (hex, sizeof (hex), "%zx\r\n", n);
+                text += hex;
+                text.append (n, 'x');
+                text += "\r\n";
+                remaining -= n;
+            }
+            text += "0\r\n\r\n";
+        }
+
+        memory_source src{text};
+        auto reader = make_reader ();
+        http::header_block headers;
+        std::size_t received = 0;
+        auto const consumer = [&received] (gsl::span<char const> const data) {
+            received += static_cast<std::size_t> (data.size ());
+        };
+        allocation_counter const counter;
+        for (auto _ : state) {
+            auto eo_status = http::read_status_line (reader, src);
+            if (!eo_status || !read_header_block (reader, src, headers)) {
+                state.SkipWithError ("failed to read the response head");
+                break;
+            }
+            auto const sc = std::get<http::status_line> (*eo_status).status_code ();
+            if (!http::read_decoded_body (reader, src, sc, headers, consumer)) {
+                state.SkipWithError ("failed to read the response body");
+                break;
+            }
+        }
+        counter.report (state);
+        benchmark::DoNotOptimize (received);
+        state.SetBytesProcessed (state.iterations () * static_cast<std::int64_t> (text.size ()));
+    }
+    BENCHMARK (read_reply)
+        ->ArgNames ({"body", "chunk"})
+        ->Args ({0, 0})
+        ->Args ({1024, 0})
+        ->Args ({64 * 1024, 0})
+        ->Args ({64 * 1024, 4096});
+
+} // end anonymous namespace
+
+BENCHMARK_MAIN ();
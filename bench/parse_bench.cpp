@@ -0,0 +1,137 @@
+// Compares the single-pass status line and header parsers with the implementation that they
+// replaced: an std::istringstream split of the status line followed by a lookup in an
+// std::unordered_map, and headers copied into std::string objects line by line. The fast
+// path stores the headers in a header_block.
+
+// Standard library
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+
+// client
+#include "client/client.hpp"
+#include "client/header_block.hpp"
+#include "client/header_field.hpp"
+
+namespace {
+
+    using namespace pstore;
+
+    char const * const status_text = "HTTP/1.1 404 Not Found";
+    char const * const header_text = "Server: pstore-http\r\n"
+                                     "Content-Type: text/html; charset=utf-8\r\n"
+                                     "Content-Length: 1234\r\n"
+                                     "Connection: keep-alive\r\n"
+                                     "Cache-Control: no-cache, no-store, must-revalidate\r\n"
+                                     "Date: Fri, 16 Oct 2026 12:00:00 GMT\r\n"
+                                     "\r\n";
+
+    namespace legacy {
+
+#define HTTP_STATUS_CODE(x, y) {#x, http::http_status_code::y},
+        maybe<http::http_status_code> str_to_http_status_code (std::string const & x) {
+            static std::unordered_map<std::string, http::http_status_code> const map{
+                {HTTP_STATUS_CODES}};
+            auto const pos = map.find (x);
+            if (pos == map.end ()) {
+                return {};
+            }
+            return maybe<http::http_status_code>{pos->second};
+        }
+#undef HTTP_STATUS_CODE
+
+        std::size_t status_line (std::string const & s) {
+            std::istringstream is{s};
+            std::string http_version;
+            std::string status_code;
+            std::string reason_phrase;
+            is >> http_version >> status_code >> reason_phrase;
+            auto const sc = str_to_http_status_code (status_code);
+            return sc ? static_cast<std::size_t> (*sc) + reason_phrase.length () : 0U;
+        }
+
+        std::size_t headers (std::string const & block) {
+            std::unordered_map<std::string, std::string> headers;
+            std::string::size_type pos = 0;
+            for (;;) {
+                auto const eol = block.find ("\r\n", pos);
+                std::string const line = block.substr (pos, eol - pos);
+                pos = eol + 2;
+                if (line.empty ()) {
+                    break;
+                }
+                auto const colon = line.find (':');
+                std::string key = line.substr (0, colon);
+                std::transform (std::begin (key), std::end (key), std::begin (key),
+                                [] (char c) {
+                                    return static_cast<char> (
+                                        std::tolower (static_cast<unsigned char> (c)));
+                                });
+                auto const value_pos = line.find_first_not_of (' ', colon + 1);
+                headers[key] = line.substr (value_pos);
+            }
+            return headers.size ();
+        }
+
+    } // end namespace legacy
+
+    std::size_t fast_status_line (std::string const & s) {
+        error_or<http::status_line> const sl = http::parse_status_line (s);
+        return sl ? static_cast<std::size_t> (sl->status_code ()) + sl->reason_phrase ().length ()
+                  : 0U;
+    }
+
+    // Parses and stores the headers, as response_parser does. The block's storage is reused
+    // from one response to the next.
+    std::size_t fast_headers (std::string const & block) {
+        static http::header_block headers;
+        headers.clear ();
+        auto const r = http::parse_header_block (
+            block.data (), block.data () + block.length (),
+            [] (http::header_field const & f) { headers.add (f.name, f.value); });
+        return r ? headers.size () : 0U;
+    }
+
+    template <typename Function>
+    double time_per_op (Function f, std::string const & input, unsigned iterations) {
+        std::size_t sink = 0;
+        auto const start = std::chrono::steady_clock::now ();
+        for (auto ctr = 0U; ctr < iterations; ++ctr) {
+            sink += f (input);
+        }
+        auto const elapsed = std::chrono::steady_clock::now () - start;
+        if (sink == 0U) {
+            std::cerr << "parse failed\n";
+            std::exit (EXIT_FAILURE);
+        }
+        return static_cast<double> (
+                   std::chrono::duration_cast<std::chrono::nanoseconds> (elapsed).count ()) /
+               iterations;
+    }
+
+    void report (char const * name, double before, double after) {
+        std::cout << name << ": " << before << " ns -> " << after << " ns (" << before / after
+                  << "x)\n";
+    }
+
+} // end anonymous namespace
+
+int main (int argc, char ** argv) {
+    unsigned iterations = 1000000;
+    if (argc > 1) {
+        iterations = static_cast<unsigned> (std::max (std::atoi (argv[1]), 1));
+    }
+
+    std::string const status{status_text};
+    std::string const block{header_text};
+    report ("status line", time_per_op (legacy::status_line, status, iterations),
+            time_per_op (fast_status_line, status, iterations));
+    report ("headers", time_per_op (legacy::headers, block, iterations),
+            time_per_op (fast_headers, block, iterations));
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,87 @@
+// Standard library
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+// client
+#include "client/coro.hpp"
+#include "client/request_builder.hpp"
+
+using namespace pstore;
+namespace coro = pstore::http::coro;
+
+namespace {
+
+    int failures = 0;
+
+    void report (std::string const & path, std::error_code const erc) {
+        std::cerr << "Failed: " << path << " (" << erc.message () << ")\n";
+        ++failures;
+    }
+
+    // Fetches one path. Each step suspends, rather than blocks, while its socket is not ready,
+    // so all of the paths are fetched concurrently on the one thread.
+    coro::task<> fetch (coro::reactor & r, std::string host, std::string port,
+                        std::string path) {
+        error_or<http::shared_address_list> const addrs = co_await coro::resolve (r, host, port);
+        if (!addrs) {
+            report (path, addrs.get_error ());
+            co_return;
+        }
+        error_or<socket_descriptor> fd = co_await coro::connect (r, *addrs);
+        if (!fd) {
+            report (path, fd.get_error ());
+            co_return;
+        }
+        coro::stream s{r, std::move (*fd)};
+        std::string request;
+        http::request_builder ()
+            .start ("GET", path)
+            .host (host, port)
+            .header ("Connection", "close")
+            .finish ()
+            .copy_to (request);
+        if (std::error_code const erc =
+                co_await coro::send_request (r, s.socket (), std::move (request))) {
+            report (path, erc);
+            co_return;
+        }
+        http::header_block headers;
+        error_or<http::status_line> const status = co_await coro::read_final_head (s, headers);
+        if (!status) {
+            report (path, status.get_error ());
+            co_return;
+        }
+        // The body is counted but otherwise discarded.
+        error_or<std::size_t> const length = co_await coro::read_body (
+            s, status->status_code (), headers, [] (gsl::span<char const>) {});
+        if (!length) {
+            report (path, length.get_error ());
+            co_return;
+        }
+        std::cout << path << ": " << static_cast<int> (status->status_code ()) << ' '
+                  << status->reason_phrase () << ", " << *length << " byte(s)\n";
+    }
+
+} // end anonymous namespace
+
+int main (int argc, char ** argv) {
+    if (argc < 4) {
+        std::cerr << "USAGE: " << argv[0] << " <hostname> <port> <request path>...\n";
+        return EXIT_FAILURE;
+    }
+    error_or<coro::reactor> eo_reactor = coro::reactor::create ();
+    if (!eo_reactor) {
+        std::cerr << "Failed to start (" << eo_reactor.get_error ().message () << ")\n";
+        return EXIT_FAILURE;
+    }
+    coro::reactor & r = *eo_reactor;
+    for (int arg = 3; arg < argc; ++arg) {
+        r.spawn (fetch (r, argv[1], argv[2], argv[arg]));
+    }
+    if (std::error_code const erc = r.run ()) {
+        std::cerr << "Failed (" << erc.message () << ")\n";
+        return EXIT_FAILURE;
+    }
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,49 @@
+// Standard library
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+// Platform
+#include <fcntl.h>
+#include <unistd.h>
+
+// client
+#include "client/download.hpp"
+
+int main (int argc, char ** argv) {
+    if (argc != 5 && argc != 6) {
+        std::cerr << "USAGE: " << argv[0]
+                  << " <hostname> <port> <request path> <output file> [<connections>]\n";
+        return EXIT_FAILURE;
+    }
+
+    auto const host = std::string{argv[1]};
+    auto const port = std::string{argv[2]};
+    auto const path = std::string{argv[3]};
+    char const * const output = argv[4];
+    pstore::http::download_options options;
+    if (argc == 6) {
+        options.connections = static_cast<unsigned> (std::strtoul (argv[5], nullptr, 10));
+    }
+
+    int const fd = ::open (output, O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+    if (fd == -1) {
+        std::cerr << "Failed to open: " << output << " (" << std::strerror (errno) << ")\n";
+        return EXIT_FAILURE;
+    }
+    pstore::error_or<pstore::http::download_result> const result =
+        pstore::http::http_download (host, port, path, fd, options);
+    if (::close (fd) != 0 && result) {
+        std::cerr << "Failed to write: " << output << " (" << std::strerror (errno) << ")\n";
+        return EXIT_FAILURE;
+    }
+    if (!result) {
+        std::cerr << "Failed to download: " << host << ':' << port << ' ' << path << " ("
+                  << result.get_error ().message () << ")\n";
+        return EXIT_FAILURE;
+    }
+    std::cout << result->size << " bytes in " << result->ranges << " range(s), "
+              << result->resumes << " resumed\n";
+    return EXIT_SUCCESS;
+}
@@ -17,17 +17,53 @@
 
 // client
 #include "client/client.hpp"
+#include "client/request_builder.hpp"
+#include "client/response_cache.hpp"
 
 using namespace pstore;
 
+namespace {
+
+    // Fetches the resource through the response cache held in the database at cache_path.
+    int cached_get (std::string const & cache_path, std::string const & host,
+                    std::string const & port, std::string const & path) {
+        auto eo_cache = http::response_cache::open (cache_path);
+        if (!eo_cache) {
+            std::cerr << "Failed to open cache: " << cache_path << " ("
+                      << eo_cache.get_error ().message () << ")\n";
+            return EXIT_FAILURE;
+        }
+        http::response_cache & cache = **eo_cache;
+        http::header_block headers;
+        auto const response =
+            cache.get (host, port, path, headers, [] (gsl::span<char const> const data) {
+                std::cout.write (data.data (), data.size ());
+            });
+        if (!response) {
+            std::cerr << "Failed: " << host << ':' << port << ' ' << path << " ("
+                      << response.get_error ().message () << ")\n";
+            return EXIT_FAILURE;
+        }
+        auto const counters = cache.snapshot ();
+        std::cerr << "status: " << static_cast<int> (response->status)
+                  << "\ncache: hits=" << counters.hits << " misses=" << counters.misses
+                  << " revalidations=" << counters.revalidations << " stores=" << counters.stores
+                  << '\n';
+        return EXIT_SUCCESS;
+    }
+
+} // end anonymous namespace
+
 int main (int argc, char ** argv) {
+    if (argc == 6 && std::strcmp (argv[1], "--cache") == 0) {
+        return cached_get (argv[2], argv[3], argv[4], argv[5]);
+    }
     if (argc != 4) {
-        std::cerr << "USAGE: " << argv[0] << " <hostname> <port> <request path>\n";
+        std::cerr << "USAGE: " << argv[0]
+                  << " [--cache <database>] <hostname> <port> <request path>\n";
         return EXIT_FAILURE;
     }
 
-    std::unordered_map<std::string, std::string> jar; // cookie jar.
-
     // Establish connection with <hostname>:<port>
     auto const host = std::string{argv[1]};
     auto const port = std::string{argv[2]};
@@ -41,43 +77,50 @@ int main (int argc, char ** argv) {
     }
     socket_descriptor & clientfd = *eo_socket;
 
-    // Send an HTTP GET request.
-    std::error_code const erc = http::http_get (clientfd, host, port, path);
+    // Send an HTTP GET request. The reply's body is decompressed if necessary.
+    std::error_code const erc = http::thread_request_builder ()
+                                    .start ("GET", path)
+                                    .host (host, port)
+                                    .header_ref ("Accept-Encoding", http::accepted_content_codings)
+                                    .finish ()
+                                    .send (clientfd);
     if (erc) {
         std::cerr << "Failed to send: " << erc.message () << ")\n";
         return EXIT_FAILURE;
     }
 
     // Get the server's reply.
-    auto reader = pstore::http::make_buffered_reader<pstore::socket_descriptor &> (
-        pstore::http::net::refiller);
-    pstore::error_or_n<pstore::socket_descriptor &, pstore::http::request_info> eri =
-        read_request (reader, std::ref (clientfd));
-    if (!eri) {
-        std::cerr << "Failed to read: " << eri.get_error ().message () << '\n';
+    auto reader = pstore::http::make_socket_reader (
+        pstore::http::net::refiller, pstore::http::response_buffer_size);
+    auto eo_status = http::read_status_line (reader, clientfd);
+    if (!eo_status) {
+        std::cerr << "Failed to read: " << eo_status.get_error ().message () << '\n';
         return EXIT_FAILURE;
     }
 
-    clientfd = std::move (std::get<0> (*eri));
-    auto const & request = std::get<http::request_info> (*eri);
-    std::cout << "request: " << request.method () << ' ' << request.version () << ' '
-              << "error:" << request.uri () << '\n';
+    auto const & status = std::get<http::status_line> (*eo_status);
+    std::cout << "status: " << status.http_version () << ' '
+              << static_cast<int> (status.status_code ()) << ' ' << status.reason_phrase ()
+              << '\n';
 
     // Scan the HTTP headers and dump the server's response.
 
     PSTORE_ASSERT (clientfd.valid ());
-    std::unordered_map<std::string, std::string> headers;
+    http::header_block headers;
     error_or<socket_descriptor> const err = read_headers (
         reader, std::ref (clientfd),
         [&] (http::header_info io, std::string const & key, std::string const & value) {
             std::cout << "header: " << key << '=' << value << '\n';
-            headers[key] = value;
+            headers.add (key, value);
             return io.handler (key, value);
         },
         http::header_info ()) >>=
-        [&] (socket_descriptor & io2, http::header_info const & header_contents) {
-            return http::read_reply (reader, io2, header_contents, http::content_length (headers));
+        [&] (socket_descriptor & io2, http::header_info const & /*header_contents*/) {
+            return http::read_reply (reader, io2, status.status_code (), headers);
         };
-
+    if (!err) {
+        std::cerr << "Failed to read: " << err.get_error ().message () << '\n';
+        return EXIT_FAILURE;
+    }
     return EXIT_SUCCESS;
 }
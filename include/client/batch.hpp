@@ -0,0 +1,103 @@
+#ifndef CLIENT_BATCH_HPP
+#define CLIENT_BATCH_HPP
+
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include "pstore/adt/error_or.hpp"
+#include "pstore/adt/maybe.hpp"
+
+namespace pstore {
+    namespace http {
+
+        // batch request
+        // ~~~~~~~~~~~~~
+        /// A request read from one line of a batch manifest. Each line is a JSON object:
+        ///
+        ///     {"id": "a", "method": "GET", "url": "http://host:port/path",
+        ///      "headers": {"name": "value"}, "body": "...", "output": "file"}
+        ///
+        /// Only "url" is required. "method" defaults to GET. If "output" is absent, the
+        /// response body is read and discarded. Members with other names are ignored.
+        struct batch_request {
+            /// The manifest line number (starting at 1).
+            std::uint64_t line = 0;
+            /// Set if the line could not be understood or would produce a malformed request
+            /// head; the request is then reported as failed without being sent.
+            std::error_code error;
+
+            std::string id;
+            /// The method, converted to upper case.
+            std::string method = "GET";
+            std::string url;
+            /// The header fields to send. A Host field is dropped: the host is taken from url.
+            std::vector<std::pair<std::string, std::string>> headers;
+            std::string body;
+            std::string output;
+        };
+
+        // manifest reader
+        // ~~~~~~~~~~~~~~~
+        /// Reads a JSONL manifest from a file descriptor a block at a time. Each line is fed to
+        /// an incremental JSON parser as it arrives, so memory use depends on neither the
+        /// length of the file nor the number of lines.
+        class manifest_reader {
+        public:
+            explicit manifest_reader (int fd);
+            manifest_reader (manifest_reader const &) = delete;
+            manifest_reader (manifest_reader &&) = delete;
+            ~manifest_reader () noexcept;
+
+            manifest_reader & operator= (manifest_reader const &) = delete;
+            manifest_reader & operator= (manifest_reader &&) = delete;
+
+            /// Returns the next request or nothing at the end of the file. Blank lines are
+            /// skipped. Fails only if the file can't be read.
+            error_or<maybe<batch_request>> next ();
+
+        private:
+            struct state;
+            std::unique_ptr<state> state_;
+        };
+
+        struct batch_options {
+            /// The maximum number of requests in progress at once.
+            unsigned concurrency = 16;
+            /// The maximum number of connections to any one host:port.
+            unsigned per_host = 4;
+        };
+
+        struct batch_summary {
+            std::uint64_t requests = 0;
+            /// The number of requests which failed to produce a response. A response with an
+            /// error status is not counted here.
+            std::uint64_t failures = 0;
+        };
+
+        // run batch
+        // ~~~~~~~~~
+        /// Executes the requests in the manifest read from \p manifest_fd and writes one JSON
+        /// object per request to \p results as each completes:
+        ///
+        ///     {"line": 1, "id": "a", "status": 200, "bytes": 512, "ms": 1.25}
+        ///
+        /// A failed request has an "error" member in place of "status". "bytes" is the size of
+        /// the message body as received (before any content-coding is removed); "ms" is the
+        /// time from sending the request to having read the whole response.
+        ///
+        /// Requests are run by options.concurrency threads which share a pool of keep-alive
+        /// connections. A request waits if its host already has options.per_host connections in
+        /// use. The manifest is read only as fast as the requests are run so that memory use
+        /// is bounded however long it is.
+        error_or<batch_summary> run_batch (int manifest_fd, std::ostream & results,
+                                           batch_options const & options = {});
+
+    } // end namespace http
+} // end namespace pstore
+
+#endif // CLIENT_BATCH_HPP
@@ -0,0 +1,254 @@
+#ifndef CLIENT_BODY_SINK_HPP
+#define CLIENT_BODY_SINK_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+
+#include "pstore/adt/error_or.hpp"
+#include "pstore/os/descriptor.hpp"
+#include "pstore/support/gsl.hpp"
+
+namespace pstore {
+    namespace http {
+
+        /// The default number of body bytes moved by each read.
+        constexpr std::size_t default_body_chunk_size = 64 * 1024;
+        /// The buffer size for the buffered_reader from which responses are read. This is much
+        /// larger than the buffered_reader's default so that the status line, headers and the
+        /// start of the body normally arrive with a single system call.
+        constexpr std::size_t response_buffer_size = default_body_chunk_size;
+
+        // Body sinks
+        // ~~~~~~~~~~
+        // A body sink receives the body of a response. When the response is read with a
+        // socket_reader, the body readers (read_body() and friends in client.hpp) lend the sink
+        // whatever the reader has buffered, then let a sink which provides transfer() pull the
+        // rest directly from the socket. Other sinks continue to be lent the reader's buffer as
+        // it is refilled. A sink provides:
+        //
+        //   void expect (std::size_t n)
+        //       A hint that at least n more body bytes are coming.
+        //   gsl::span<char> prepare (std::size_t n)
+        //       Returns writable memory for at most n bytes.
+        //   std::error_code commit (gsl::span<char const> data)
+        //       Accepts data. The data lies either within the memory most recently returned by
+        //       prepare() or within the reader's buffer, in which case it must be used or copied
+        //       before commit() returns.
+        //
+        // and optionally:
+        //
+        //   error_or<std::size_t> transfer (socket_descriptor const & fd, std::size_t n)
+        //       Moves at most n bytes from fd to the sink. Returns the number of bytes moved; 0
+        //       means that the peer has closed the connection.
+
+        namespace details {
+
+            /// Returns a buffer of at least \p size bytes owned by the calling thread.
+            gsl::span<char> scratch_buffer (std::size_t size);
+
+            /// Receives at most \p size bytes from \p fd into \p data.
+            error_or<std::size_t> receive (socket_descriptor const & fd, char * data,
+                                           std::size_t size);
+
+            template <typename T, typename = void>
+            struct is_body_sink : std::false_type {};
+            template <typename T>
+            struct is_body_sink<T, std::void_t<decltype (std::declval<T &> ().commit (
+                                       std::declval<gsl::span<char const>> ()))>>
+                    : std::true_type {};
+
+            template <typename T, typename = void>
+            struct has_transfer : std::false_type {};
+            template <typename T>
+            struct has_transfer<T, std::void_t<decltype (std::declval<T &> ().transfer (
+                                       std::declval<socket_descriptor const &> (), 0U))>>
+                    : std::true_type {};
+
+        } // end namespace details
+
+        // callback sink
+        // ~~~~~~~~~~~~~
+        /// Passes the body to a function as a series of gsl::span<char const>. With a
+        /// socket_reader, the spans refer directly to the reader's buffer; with other readers,
+        /// to a per-thread scratch buffer. Either way, they are valid only for the duration of
+        /// the call.
+        template <typename Function>
+        class callback_sink {
+        public:
+            explicit callback_sink (Function f, std::size_t chunk_size = default_body_chunk_size)
+                    : f_ (std::forward<Function> (f))
+                    , chunk_size_{chunk_size} {}
+
+            void expect (std::size_t) noexcept {}
+            gsl::span<char> prepare (std::size_t const n) {
+                return details::scratch_buffer (chunk_size_)
+                    .first (static_cast<std::ptrdiff_t> (std::min (n, chunk_size_)));
+            }
+            std::error_code commit (gsl::span<char const> const data) {
+                f_ (data);
+                return {};
+            }
+
+        private:
+            Function f_;
+            std::size_t const chunk_size_;
+        };
+
+        template <typename Function>
+        callback_sink<Function> make_callback_sink (Function && f) {
+            return callback_sink<Function> (std::forward<Function> (f));
+        }
+
+        // fd sink
+        // ~~~~~~~
+        /// Writes the body to a file descriptor. Data arriving from the socket is moved with
+        /// splice() through a pipe so that it is never copied to user space. (sendfile() can't be
+        /// used because its input must support mmap(), which sockets do not.) If the output is
+        /// not a file, pipe or socket, was opened with O_APPEND or turns out not to support
+        /// splice(), the sink falls back to recv() and write().
+        class fd_sink {
+        public:
+            explicit fd_sink (int fd, std::size_t chunk_size = default_body_chunk_size) noexcept
+                    : fd_{fd}
+                    , chunk_size_{chunk_size} {}
+            fd_sink (fd_sink const &) = delete;
+            fd_sink (fd_sink && other) noexcept;
+            ~fd_sink () noexcept;
+
+            fd_sink & operator= (fd_sink const &) = delete;
+            fd_sink & operator= (fd_sink &&) = delete;
+
+            void expect (std::size_t) noexcept {}
+            gsl::span<char> prepare (std::size_t n);
+            std::error_code commit (gsl::span<char const> data);
+            error_or<std::size_t> transfer (socket_descriptor const & fd, std::size_t n);
+
+        private:
+            error_or<std::size_t> splice_from (socket_descriptor const & fd, std::size_t n);
+            /// Copies \p remaining bytes from the pipe to the output and stops using splice().
+            std::error_code drain_pipe (std::size_t remaining);
+            void close_pipe () noexcept;
+
+            int const fd_;
+            std::size_t const chunk_size_;
+            /// The pipe used for splice(), created on first use: [0] is the read end, [1] the
+            /// write end.
+            int pipe_[2] = {-1, -1};
+            /// Cleared on first use if the output doesn't support splice(), or later if a
+            /// splice() fails with EINVAL or ENOSYS.
+            bool use_splice_ = true;
+        };
+
+        // file range sink
+        // ~~~~~~~~~~~~~~~
+        /// Writes the body with pwrite() to the region of a file which starts at \p offset and
+        /// ends before \p limit. Data beyond the limit is an error rather than being written,
+        /// so a misbehaving server can't overwrite a neighbouring region. The file offset is not
+        /// used, so any number of these sinks may write to different regions of the same file
+        /// concurrently.
+        class file_range_sink {
+        public:
+            file_range_sink (int fd, std::uint64_t offset,
+                             std::uint64_t limit = std::numeric_limits<std::uint64_t>::max (),
+                             std::size_t chunk_size = default_body_chunk_size) noexcept
+                    : fd_{fd}
+                    , offset_{offset}
+                    , limit_{limit}
+                    , chunk_size_{chunk_size} {}
+
+            void expect (std::size_t) noexcept {}
+            gsl::span<char> prepare (std::size_t n);
+            std::error_code commit (gsl::span<char const> data);
+
+            /// The offset at which the next byte will be written.
+            std::uint64_t offset () const noexcept { return offset_; }
+
+        private:
+            int const fd_;
+            std::uint64_t offset_;
+            std::uint64_t const limit_;
+            std::size_t const chunk_size_;
+        };
+
+        // buffer sink
+        // ~~~~~~~~~~~
+        /// Collects the body in a contiguous buffer. When the body's length is known in advance
+        /// (from Content-Length or a chunk header), the buffer is allocated at its full size
+        /// (up to max_expected bytes: the peer's claim is not trusted beyond that) before any
+        /// data arrives, and data from the socket is received directly into it once the
+        /// reader's buffer has been emptied. Otherwise, it grows as needed by at least
+        /// chunk_size bytes at a time. A body larger than max_size is rejected with
+        /// errc::message_size, and a failure to allocate memory is reported as
+        /// errc::not_enough_memory.
+        class buffer_sink {
+        public:
+            /// The default limit on the size of the body.
+            static constexpr std::size_t default_max_size = std::size_t{64} * 1024U * 1024U;
+            /// The most memory that expect() allocates ahead of the data's arrival.
+            static constexpr std::size_t max_expected = std::size_t{1024} * 1024U;
+
+            /// \param capacity  The initial capacity of the buffer. This is allocated if
+            ///   possible; a failure is reported when the data arrives.
+            /// \param chunk_size  The smallest amount by which the buffer grows.
+            /// \param max_size  The largest body that the sink accepts.
+            explicit buffer_sink (std::size_t capacity = 0,
+                                  std::size_t chunk_size = default_body_chunk_size,
+                                  std::size_t max_size = default_max_size) noexcept
+                    : chunk_size_{chunk_size}
+                    , max_size_{max_size} {
+                this->reserve (std::min (capacity, max_size));
+            }
+
+            void expect (std::size_t n) noexcept;
+            gsl::span<char> prepare (std::size_t n);
+            std::error_code commit (gsl::span<char const> data);
+            error_or<std::size_t> transfer (socket_descriptor const & fd, std::size_t n);
+
+            /// Ensures that the buffer can hold \p capacity bytes without reallocating.
+            /// \returns errc::message_size if \p capacity is greater than max_size() or
+            ///   errc::not_enough_memory if the buffer could not be allocated.
+            std::error_code reserve (std::size_t capacity) noexcept;
+            void clear () noexcept { size_ = 0; }
+
+            char const * data () const noexcept { return buffer_.get (); }
+            std::size_t size () const noexcept { return size_; }
+            std::size_t capacity () const noexcept { return capacity_; }
+            std::size_t max_size () const noexcept { return max_size_; }
+
+        private:
+            /// Returns the space (at most \p n bytes) into which the next data is written,
+            /// growing the buffer if there is none.
+            error_or<gsl::span<char>> room (std::size_t n) noexcept;
+            /// Grows the buffer so that at least \p n more bytes will fit.
+            std::error_code grow (std::size_t n) noexcept;
+
+            std::size_t const chunk_size_;
+            std::size_t const max_size_;
+            std::unique_ptr<char[]> buffer_;
+            std::size_t size_ = 0;
+            std::size_t capacity_ = 0;
+        };
+
+        // as body sink
+        // ~~~~~~~~~~~~
+        /// Returns \p t if it is a body sink or, if it's a function, a callback_sink which calls
+        /// it.
+        template <typename T>
+        decltype (auto) as_body_sink (T & t) {
+            if constexpr (details::is_body_sink<T>::value) {
+                return (t);
+            } else {
+                return callback_sink<T &> (t);
+            }
+        }
+
+    } // end namespace http
+} // end namespace pstore
+
+#endif // CLIENT_BODY_SINK_HPP
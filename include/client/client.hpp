@@ -1,18 +1,35 @@
 #ifndef CLIENT_CLIENT_HPP
 #define CLIENT_CLIENT_HPP
 
-#include <unordered_map>
-#include <sstream>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <iosfwd>
+#include <limits>
+#include <type_traits>
+#include <string>
+#include <string_view>
 #include <system_error>
 #include <utility>
 
 #include <netdb.h>
+#include <unistd.h>
 
 #include "pstore/adt/error_or.hpp"
 #include "pstore/os/descriptor.hpp"
 #include "pstore/http/headers.hpp"
 #include "pstore/http/request.hpp"
 
+#include "client/body_sink.hpp"
+#include "client/content_coding.hpp"
+#include "client/header_block.hpp"
+#include "client/request_builder.hpp"
+#include "client/socket_options.hpp"
+#include "client/socket_reader.hpp"
+#include "client/trace.hpp"
+
 #define HTTP_STATUS_CODES                                                                          \
     HTTP_STATUS_CODE (100, continue_code)                                                          \
     HTTP_STATUS_CODE (101, switching_protocols)                                                    \
@@ -67,8 +84,18 @@ namespace pstore {
         std::error_category const & get_gai_error_category () noexcept;
         std::error_code make_gai_error_code (int const e) noexcept;
 
-        // Get host information.
+        // Get host information. Both IPv4 and IPv6 addresses are returned. The call blocks: see
+        // resolver for a caching, non-blocking alternative.
         error_or<addrinfo *> get_host_info (std::string const & host, std::string const & port);
+        // As get_host_info(), reporting the lookup to tracer as phase::resolve.
+        template <typename Tracer>
+        error_or<addrinfo *> get_host_info (std::string const & host, std::string const & port,
+                                            Tracer & tracer) {
+            tracer.begin (phase::resolve);
+            error_or<addrinfo *> result = get_host_info (host, port);
+            tracer.end (phase::resolve);
+            return result;
+        }
 
         // request key
         // ~~~~~~~~~~~
@@ -76,6 +103,8 @@ namespace pstore {
         // nonce consisting of a randomly selected 16-byte value that has
         // been base64-encoded (see Section 4 of [RFC4648]). The nonce
         // MUST be selected randomly for each connection.
+        //
+        // May be called concurrently from any number of threads.
 
         std::string request_key ();
 
@@ -91,9 +120,17 @@ namespace pstore {
         // ~~~~~~~~~~
         std::ostream & operator<< (std::ostream & os, http_status_code sc);
 
+        // decode status code
+        // ~~~~~~~~~~~~~~~~~~
+        /// Decodes the three decimal digits at \p digits arithmetically and checks the result
+        /// against the table of known status codes.
+        maybe<http_status_code> decode_status_code (char const * digits) noexcept;
+
         // str to http status code
         // ~~~~~~~~~~~~~~~~~~~~~~~
-        maybe<http_status_code> str_to_http_status_code (std::string const & x);
+        /// Converts a three-digit status code. Like decode_status_code(), it uses no mutable
+        /// state and so may be called concurrently from any number of threads.
+        maybe<http_status_code> str_to_http_status_code (std::string_view x) noexcept;
 
 
         //*     _        _             _ _           *
@@ -101,12 +138,20 @@ namespace pstore {
         //* (_-<  _/ _` |  _| || (_-< | | | ' \/ -_) *
         //* /__/\__\__,_|\__|\_,_/__/ |_|_|_||_\___| *
         //*                                          *
+        /// The status line of a response. The HTTP version, which is always eight characters
+        /// long, is held by the object; the reason phrase is a view of the text from which the
+        /// line was parsed.
         class status_line {
         public:
-            status_line (std::string && v, http_status_code const sc, std::string && rp) noexcept
-                    : http_version_{std::move (v)}
-                    , status_code_{sc}
-                    , reason_phrase_{std::move (rp)} {}
+            /// \param version  The HTTP-version ("HTTP/" DIGIT "." DIGIT).
+            /// \param sc  The decoded status code.
+            /// \param reason  The reason phrase.
+            status_line (std::string_view version, http_status_code sc,
+                         std::string_view reason) noexcept
+                    : status_code_{sc}
+                    , reason_{reason} {
+                version.copy (version_.data (), version_.size ());
+            }
             status_line (status_line const &) = default;
             status_line (status_line &&) noexcept = default;
 
@@ -115,20 +160,33 @@ namespace pstore {
             status_line & operator= (status_line const &) = delete;
             status_line & operator= (status_line &&) noexcept = delete;
 
-            std::string const & http_version () const { return http_version_; }
+            std::string_view http_version () const noexcept {
+                return {version_.data (), version_.size ()};
+            }
             http_status_code status_code () const noexcept { return status_code_; }
-            std::string const & reason_phrase () const noexcept { return reason_phrase_; }
+            /// The reason phrase. It may contain spaces and may be empty.
+            std::string_view reason_phrase () const noexcept { return reason_; }
 
         private:
-            std::string http_version_;
+            std::array<char, 8> version_{};
             http_status_code status_code_;
-            std::string reason_phrase_;
+            std::string_view reason_;
         };
 
+        // parse status line
+        // ~~~~~~~~~~~~~~~~~
+        /// Parses a response status line (without its trailing CRLF) of the form
+        /// "HTTP/x.y nnn reason phrase" in a single pass. The result's reason phrase is a view
+        /// of \p line.
+        error_or<status_line> parse_status_line (std::string_view line);
+
         // read status line
         // ~~~~~~~~~~~~~~~~
-        /// \tparam Reader  The buffered_reader<> type from which data is to be read.
-        /// \param reader  An instance of Reader: a buffered_reader<> from which data is read,
+        /// Reads a status line without copying it: the result's reason phrase is a view of the
+        /// reader's buffer and is valid only until the reader is next used.
+        ///
+        /// \tparam Reader  A reader with get_line() (see socket_reader<>).
+        /// \param reader  An instance of Reader from which data is read,
         /// \param io  The state passed to the reader's refill function.
         /// \returns  Type error_or_n<Reader::state_type, status_line>. Either an error or the
         /// updated reader state value and an instance of status_line containing the HTTP version,
@@ -138,86 +196,531 @@ namespace pstore {
         read_status_line (Reader & reader, typename Reader::state_type io) {
             using state_type = typename Reader::state_type;
 
-            auto check_for_eof = [] (state_type io2, maybe<std::string> const & buf) {
-                using result_type = error_or_n<state_type, std::string>;
-                if (!buf) {
-                    return result_type{details::out_of_data_error ()};
-                }
-                return result_type{std::in_place, io2, *buf};
-            };
-
-            auto extract_status_line = [] (state_type io3, std::string const & s) {
+            auto extract_status_line = [] (state_type io2,
+                                           maybe<std::string_view> const & line) {
                 using result_type = error_or_n<state_type, status_line>;
-
-                std::istringstream is{s};
-                std::string http_version;
-                std::string status_code;
-                std::string reason_phrase;
-
-                is >> http_version >> status_code >> reason_phrase;
-                if (http_version.length () == 0 || status_code.length () == 0 ||
-                    reason_phrase.length () == 0) {
+                if (!line) {
                     return result_type{details::out_of_data_error ()};
                 }
-                auto const sc = pstore::http::str_to_http_status_code (status_code);
-                if (!sc) {
-                    return result_type{std::errc::not_supported}; // FIXME: a proper error code.
+                error_or<status_line> sl = parse_status_line (*line);
+                if (!sl) {
+                    return result_type{sl.get_error ()};
                 }
-                return result_type{
-                    std::in_place, io3,
-                    status_line{std::move (http_version), *sc, std::move (reason_phrase)}};
+                return result_type{std::in_place, io2, std::move (*sl)};
             };
 
-            return (reader.gets (io) >>= check_for_eof) >>= extract_status_line;
+            return reader.get_line (io) >>= extract_status_line;
         }
 
 
 
-        // Establish connection with the host
+        // The limit that establish_connection() puts on connecting to a host.
+        constexpr std::chrono::milliseconds default_connect_timeout{30000};
+        // The limit that establish_connection() puts on each blocking send and receive.
+        constexpr std::chrono::milliseconds default_io_timeout{60000};
+
+        // Establish connection with the host. The addresses are raced as described by RFC 8305
+        // (see connect_racing()). Takes ownership of info. The socket is configured with the
+        // default socket_options, which disable Nagle's algorithm, except that each send and
+        // receive fails with errc::timed_out after default_io_timeout. Connecting fails with
+        // errc::timed_out after default_connect_timeout.
         error_or<socket_descriptor> establish_connection (addrinfo * info);
+        // As establish_connection(), configuring the socket with opts and giving up connecting
+        // after connect_timeout (zero for no limit). (A separate name keeps
+        // establish_connection usable as the right-hand side of >>=.)
+        error_or<socket_descriptor>
+        establish_connection_with (addrinfo * info, socket_options const & opts,
+                                   std::chrono::milliseconds connect_timeout =
+                                       default_connect_timeout);
 
-        using header_map = std::unordered_map<std::string, std::string>;
+        // Build the text of a GET request.
+        std::string make_get_request (std::string const & path, header_list const & headers);
 
         // Send GET request
         std::error_code http_get (socket_descriptor const & fd, std::string const & path,
-                                  header_map const & headers);
+                                  header_list const & headers);
 
         std::error_code http_get (socket_descriptor const & fd, std::string const & host,
                                   std::string const & port, std::string const & path);
+        // As http_get(), reporting the write to tracer as phase::send and each send system
+        // call with tracer.sent().
+        template <typename Tracer>
+        std::error_code http_get (socket_descriptor const & fd, std::string const & host,
+                                  std::string const & port, std::string const & path,
+                                  Tracer & tracer) {
+            tracer.begin (phase::send);
+            std::error_code const erc = thread_request_builder ()
+                                            .start ("GET", path)
+                                            .host (host, port)
+                                            .finish ()
+                                            .send (fd, tracer);
+            tracer.end (phase::send);
+            return erc;
+        }
 
         // Initiate a WebSocket connection upgrade.
         std::error_code http_ws_get (socket_descriptor const & fd, std::string const & host,
                                      std::string const & port, std::string const & path,
                                      std::string const & ws_key);
 
-        long content_length (std::unordered_map<std::string, std::string> const & headers);
-
-        template <typename BufferedReader>
-        error_or<socket_descriptor> read_reply (BufferedReader & reader, socket_descriptor & io2,
-                                                http::header_info const & /*header_contents*/,
-                                                long content_length) {
-            using return_type = error_or<socket_descriptor>;
-
-            std::array<char, 256> buffer;
-            while (content_length > 0L) {
-                auto len = std::min (content_length, static_cast<long> (buffer.size ()));
-                content_length -= len;
-
-                auto get_reply = reader.get_span (io2, gsl::make_span (buffer.data (), len));
+        // parse content length
+        // ~~~~~~~~~~~~~~~~~~~~
+        /// Decodes the value of a Content-Length header field. A comma-separated list of
+        /// identical values, which is what a repeated field looks like once its values have
+        /// been combined, is accepted (RFC 7230 section 3.3.2).
+        ///
+        /// \returns The length or nothing if the value is malformed or too large.
+        maybe<std::size_t> parse_content_length (std::string_view value) noexcept;
+
+        // content length
+        // ~~~~~~~~~~~~~~
+        /// Returns the body length given by the Content-Length header in \p headers or 0 if
+        /// there is no such header.
+        error_or<std::size_t> content_length (header_block const & headers);
+
+        // keep alive
+        // ~~~~~~~~~~
+        /// Returns true if the connection may be reused for a further request once the body of
+        /// the response has been completely read. HTTP/1.1 connections persist unless the server
+        /// sends "Connection: close"; HTTP/1.0 connections persist only if it sends
+        /// "Connection: keep-alive".
+        ///
+        /// \param http_version  The HTTP version from the response's status line.
+        /// \param headers  The response headers.
+        bool keep_alive (std::string_view http_version, header_block const & headers);
+
+        namespace details {
+
+            /// A variable which holds a reader's state as a loop proceeds. Reference state types
+            /// are held by std::reference_wrapper so that they can be rebound.
+            template <typename State>
+            using loop_state =
+                std::conditional_t<std::is_reference<State>::value,
+                                   std::reference_wrapper<std::remove_reference_t<State>>, State>;
+
+            /// True if Reader lends its buffer in the manner of socket_reader<>.
+            template <typename Reader, typename = void>
+            struct exposes_buffer : std::false_type {};
+            template <typename Reader>
+            struct exposes_buffer<
+                Reader, std::void_t<decltype (std::declval<Reader const &> ().buffered ()),
+                                    decltype (std::declval<Reader &> ().consume (0U))>>
+                    : std::true_type {};
+
+            // read body step
+            // ~~~~~~~~~~~~~~
+            /// Moves at most \p n body bytes to \p sink. If the reader exposes its buffer (see
+            /// socket_reader<>), buffered data is lent to the sink's commit() in place; once the
+            /// buffer is empty, a sink with a transfer() member takes the data directly from the
+            /// socket and other sinks are lent the result of refilling the reader's buffer.
+            /// Other readers copy into the memory returned by the sink's prepare().
+            ///
+            /// \returns Either an error or the updated reader state and the number of bytes
+            ///   moved. 0 means that the peer closed the connection.
+            template <typename Reader, typename Sink>
+            error_or_n<typename Reader::state_type, std::size_t>
+            read_body_step (Reader & reader, typename Reader::state_type io, Sink & sink,
+                            std::size_t const n) {
+                using state_type = typename Reader::state_type;
+                using return_type = error_or_n<state_type, std::size_t>;
+                if constexpr (exposes_buffer<Reader>::value) {
+                    if (reader.buffered ().size () == 0) {
+                        if constexpr (has_transfer<Sink>::value) {
+                            error_or<std::size_t> const moved = sink.transfer (io, n);
+                            if (!moved) {
+                                return return_type{moved.get_error ()};
+                            }
+                            return return_type{std::in_place, io, *moved};
+                        } else {
+                            error_or<std::size_t> const got = reader.fill (io);
+                            if (!got) {
+                                return return_type{got.get_error ()};
+                            }
+                            if (*got == 0U) {
+                                return return_type{std::in_place, io, std::size_t{0}};
+                            }
+                        }
+                    }
+                    gsl::span<char const> const buffered = reader.buffered ();
+                    auto const size =
+                        std::min (n, static_cast<std::size_t> (buffered.size ()));
+                    if (std::error_code const erc =
+                            sink.commit (buffered.first (static_cast<std::ptrdiff_t> (size)))) {
+                        return return_type{erc};
+                    }
+                    reader.consume (size);
+                    return return_type{std::in_place, io, size};
+                }
+                auto get_reply = reader.get_span (io, sink.prepare (n));
                 if (!get_reply) {
                     return return_type{get_reply.get_error ()};
                 }
-                io2 = std::move (std::get<0> (*get_reply));
                 auto const & subspan = std::get<1> (*get_reply);
-                if (subspan.size () == 0) {
+                if (subspan.size () > 0) {
+                    if (std::error_code const erc =
+                            sink.commit (gsl::span<char const>{subspan.data (), subspan.size ()})) {
+                        return return_type{erc};
+                    }
+                }
+                return return_type{std::in_place, std::get<0> (*get_reply),
+                                   static_cast<std::size_t> (subspan.size ())};
+            }
+
+        } // end namespace details
+
+        // read final head
+        // ~~~~~~~~~~~~~~~
+        /// The number of interim (1xx) responses that read_final_head() skips before giving up
+        /// on a server which may never send a final response.
+        constexpr unsigned max_interim_responses = 16;
+
+        /// Reads the status line and headers of a response, skipping any interim (1xx) responses
+        /// which precede it. More than max_interim_responses of them is an error
+        /// (std::errc::bad_message).
+        ///
+        /// \param reader  The socket_reader<> from which data is read.
+        /// \param fd  The socket from which the response is read.
+        /// \param headers  Receives the response headers and the reason phrase to which the
+        ///   result refers.
+        /// \param tracer  Told when each status line has been read and when each block of headers
+        ///   begins and ends. The caller begins phase::status_line.
+        template <typename Reader, typename Tracer>
+        error_or<status_line> read_final_head (Reader & reader, socket_descriptor & fd,
+                                               header_block & headers, Tracer & tracer) {
+            using return_type = error_or<status_line>;
+            for (unsigned interim = 0U; interim <= max_interim_responses; ++interim) {
+                auto eo_status = read_status_line (reader, fd);
+                tracer.end (phase::status_line);
+                if (!eo_status) {
+                    return return_type{eo_status.get_error ()};
+                }
+                tracer.begin (phase::headers);
+                status_line const & status = std::get<status_line> (*eo_status);
+                headers.clear ();
+                // Reading the headers may overwrite the reader's copy of the reason phrase.
+                headers.set_reason_phrase (status.reason_phrase ());
+                auto const eo_headers = read_headers (
+                    reader, std::ref (fd),
+                    [&headers] (header_info io, std::string const & key,
+                                std::string const & value) {
+                        headers.add (key, value);
+                        return io.handler (key, value);
+                    },
+                    header_info ());
+                tracer.end (phase::headers);
+                if (!eo_headers) {
+                    return return_type{eo_headers.get_error ()};
+                }
+                auto const sc = status.status_code ();
+                if (static_cast<int> (sc) >= 200 || sc == http_status_code::switching_protocols) {
+                    return return_type{std::in_place, status.http_version (), sc,
+                                       headers.reason_phrase ()};
+                }
+            }
+            return return_type{std::make_error_code (std::errc::bad_message)};
+        }
+
+        template <typename Reader>
+        error_or<status_line> read_final_head (Reader & reader, socket_descriptor & fd,
+                                               header_block & headers) {
+            null_tracer t;
+            return read_final_head (reader, fd, headers, t);
+        }
+
+        // parse chunk size
+        // ~~~~~~~~~~~~~~~~
+        /// Decodes the hexadecimal size at the start of a chunked transfer-coding chunk header.
+        /// Any chunk extensions are ignored.
+        maybe<std::size_t> parse_chunk_size (std::string_view line) noexcept;
+
+        // is chunked
+        // ~~~~~~~~~~
+        /// Returns true if the value of a Transfer-Encoding header field says that the body is
+        /// sent with the chunked transfer-coding alone. No other transfer-coding is supported.
+        bool is_chunked (std::string_view transfer_encoding) noexcept;
+
+        // read body
+        // ~~~~~~~~~
+        /// Reads a body of exactly \p length bytes from \p reader, passing it to \p consumer.
+        /// The consumer is either a body sink (see body_sink.hpp) or a function which is called
+        /// with each portion of the body as a gsl::span<char const>. If the connection is closed
+        /// before the body is complete, an error is returned.
+        ///
+        /// \returns Either an error or the updated reader state and the number of body bytes.
+        template <typename Reader, typename Consumer>
+        error_or_n<typename Reader::state_type, std::size_t>
+        read_body (Reader & reader, typename Reader::state_type io, std::size_t length,
+                   Consumer && consumer) {
+            using return_type = error_or_n<typename Reader::state_type, std::size_t>;
+            details::loop_state<typename Reader::state_type> state = io;
+
+            auto && sink = as_body_sink (consumer);
+            sink.expect (length);
+            std::size_t remaining = length;
+            while (remaining > 0U) {
+                auto const step = details::read_body_step (reader, state, sink, remaining);
+                if (!step) {
+                    return return_type{step.get_error ()};
+                }
+                state = std::get<0> (*step);
+                std::size_t const moved = std::get<1> (*step);
+                if (moved == 0U) {
+                    // The peer closed the connection before sending the whole body.
+                    return return_type{details::out_of_data_error ()};
+                }
+                remaining -= moved;
+            }
+            return return_type{std::in_place, state, length};
+        }
+
+        // read body to eof
+        // ~~~~~~~~~~~~~~~~
+        /// Reads a body which is delimited by the server closing the connection.
+        template <typename Reader, typename Consumer>
+        error_or_n<typename Reader::state_type, std::size_t>
+        read_body_to_eof (Reader & reader, typename Reader::state_type io, Consumer && consumer) {
+            using return_type = error_or_n<typename Reader::state_type, std::size_t>;
+            details::loop_state<typename Reader::state_type> state = io;
+
+            auto && sink = as_body_sink (consumer);
+            std::size_t total = 0;
+            for (;;) {
+                auto const step = details::read_body_step (
+                    reader, state, sink, std::numeric_limits<std::size_t>::max ());
+                if (!step) {
+                    return return_type{step.get_error ()};
+                }
+                state = std::get<0> (*step);
+                std::size_t const moved = std::get<1> (*step);
+                if (moved == 0U) {
+                    return return_type{std::in_place, state, total};
+                }
+                total += moved;
+            }
+        }
+
+        // read chunked body
+        // ~~~~~~~~~~~~~~~~~
+        /// Reads a body sent with the chunked transfer-coding, passing the decoded data to
+        /// \p consumer (a body sink or function, as for read_body()). Any trailer fields are
+        /// discarded.
+        template <typename Reader, typename Consumer>
+        error_or_n<typename Reader::state_type, std::size_t>
+        read_chunked_body (Reader & reader, typename Reader::state_type io, Consumer && consumer) {
+            using return_type = error_or_n<typename Reader::state_type, std::size_t>;
+            details::loop_state<typename Reader::state_type> state = io;
+            auto && sink = as_body_sink (consumer);
+
+            // Reads a line, treating EOF as an error.
+            auto const get_line = [&reader, &state] () -> error_or<std::string> {
+                auto line = reader.gets (state);
+                if (!line) {
+                    return error_or<std::string>{line.get_error ()};
+                }
+                state = std::get<0> (*line);
+                maybe<std::string> const & str = std::get<1> (*line);
+                if (!str) {
+                    return error_or<std::string>{details::out_of_data_error ()};
+                }
+                return error_or<std::string>{*str};
+            };
+
+            std::size_t total = 0;
+            for (;;) {
+                error_or<std::string> const size_line = get_line ();
+                if (!size_line) {
+                    return return_type{size_line.get_error ()};
+                }
+                maybe<std::size_t> const size = parse_chunk_size (*size_line);
+                if (!size) {
+                    return return_type{std::make_error_code (std::errc::bad_message)};
+                }
+                if (*size == 0U) {
                     break;
                 }
-                std::fwrite (subspan.data (), sizeof (char),
-                             static_cast<std::size_t> (subspan.size ()), stdout);
+                auto const chunk = read_body (reader, state, *size, sink);
+                if (!chunk) {
+                    return return_type{chunk.get_error ()};
+                }
+                state = std::get<0> (*chunk);
+                total += *size;
+
+                // Each chunk's data is followed by CRLF.
+                error_or<std::string> const crlf = get_line ();
+                if (!crlf) {
+                    return return_type{crlf.get_error ()};
+                }
+                if (!crlf->empty ()) {
+                    return return_type{std::make_error_code (std::errc::bad_message)};
+                }
+            }
+            // Skip the trailer section up to the terminating empty line.
+            for (;;) {
+                error_or<std::string> const trailer = get_line ();
+                if (!trailer) {
+                    return return_type{trailer.get_error ()};
+                }
+                if (trailer->empty ()) {
+                    return return_type{std::in_place, state, total};
+                }
+            }
+        }
+
+        namespace details {
+
+            /// Returns true if a response with status code \p sc never has a body.
+            constexpr bool bodiless (http_status_code const sc) noexcept {
+                return static_cast<int> (sc) < 200 || sc == http_status_code::no_content ||
+                       sc == http_status_code::not_modified;
+            }
+
+            // read framed body
+            // ~~~~~~~~~~~~~~~~
+            /// Reads a message body using the framing described by \p headers (RFC 7230
+            /// section 3.3.3): chunked transfer-coding, Content-Length or, failing both, the
+            /// connection close.
+            template <typename Reader, typename Consumer>
+            error_or_n<typename Reader::state_type, std::size_t>
+            read_framed_body (Reader & reader, typename Reader::state_type io,
+                              header_block const & headers, Consumer && consumer) {
+                using return_type = error_or_n<typename Reader::state_type, std::size_t>;
+                if (maybe<std::string_view> const te =
+                        headers.find (known_header::transfer_encoding)) {
+                    if (!is_chunked (*te)) {
+                        return return_type{std::make_error_code (std::errc::not_supported)};
+                    }
+                    return read_chunked_body (reader, io, consumer);
+                }
+                if (maybe<std::string_view> const cl =
+                        headers.find (known_header::content_length)) {
+                    maybe<std::size_t> const length = parse_content_length (*cl);
+                    if (!length) {
+                        return return_type{std::make_error_code (std::errc::bad_message)};
+                    }
+                    return read_body (reader, io, *length, consumer);
+                }
+                return read_body_to_eof (reader, io, consumer);
+            }
+
+            // read decoded framed body
+            // ~~~~~~~~~~~~~~~~~~~~~~~~
+            /// As read_framed_body(), but a body with a gzip or deflate Content-Encoding is
+            /// decompressed before it is passed to \p consumer.
+            template <typename Reader, typename Consumer>
+            error_or_n<typename Reader::state_type, std::size_t>
+            read_decoded_framed_body (Reader & reader, typename Reader::state_type io,
+                                      header_block const & headers, Consumer && consumer) {
+                using return_type = error_or_n<typename Reader::state_type, std::size_t>;
+                auto && sink = as_body_sink (consumer);
+                maybe<std::string_view> const ce = headers.find (known_header::content_encoding);
+                if (!ce) {
+                    return read_framed_body (reader, io, headers, sink);
+                }
+                maybe<content_coding> const coding = parse_content_coding (*ce);
+                if (!coding) {
+                    return return_type{std::make_error_code (std::errc::not_supported)};
+                }
+                if (*coding == content_coding::identity) {
+                    return read_framed_body (reader, io, headers, sink);
+                }
+                inflate_sink<std::remove_reference_t<decltype (sink)>> decoder{sink, *coding};
+                auto body = read_framed_body (reader, io, headers, decoder);
+                if (body) {
+                    if (std::error_code const erc = decoder.finish ()) {
+                        return return_type{erc};
+                    }
+                }
+                return body;
+            }
+
+        } // end namespace details
+
+        // read message body
+        // ~~~~~~~~~~~~~~~~~
+        /// Reads a response body using the framing described by its headers (RFC 7230 section
+        /// 3.3.3): chunked transfer-coding, Content-Length or, failing both, the connection
+        /// close. On success, the body has been consumed in its entirety.
+        ///
+        /// \param reader  The buffered_reader<> from which data is read.
+        /// \param io  The state passed to the reader's refill function.
+        /// \param sc  The response status code. 1xx, 204 and 304 responses have no body.
+        /// \param headers  The response headers.
+        /// \param consumer  A body sink or a function called with each portion of the body as a
+        ///   gsl::span<char const>.
+        /// \returns Either an error or the updated reader state and the number of bytes in the
+        ///   message body.
+        template <typename Reader, typename Consumer>
+        error_or_n<typename Reader::state_type, std::size_t>
+        read_message_body (Reader & reader, typename Reader::state_type io, http_status_code sc,
+                           header_block const & headers, Consumer && consumer) {
+            using return_type = error_or_n<typename Reader::state_type, std::size_t>;
+            if (details::bodiless (sc)) {
+                return return_type{std::in_place, io, std::size_t{0}};
+            }
+            return details::read_framed_body (reader, io, headers, consumer);
+        }
+
+        // read decoded body
+        // ~~~~~~~~~~~~~~~~~
+        /// As read_message_body(), but a body with a gzip or deflate Content-Encoding is
+        /// decompressed as it arrives. Use this to read the response to a request which sent
+        /// "Accept-Encoding: " followed by accepted_content_codings.
+        ///
+        /// \returns Either an error or the updated reader state and the number of bytes in the
+        ///   (encoded) message body.
+        template <typename Reader, typename Consumer>
+        error_or_n<typename Reader::state_type, std::size_t>
+        read_decoded_body (Reader & reader, typename Reader::state_type io, http_status_code sc,
+                           header_block const & headers, Consumer && consumer) {
+            using return_type = error_or_n<typename Reader::state_type, std::size_t>;
+            if (details::bodiless (sc)) {
+                return return_type{std::in_place, io, std::size_t{0}};
+            }
+            return details::read_decoded_framed_body (reader, io, headers, consumer);
+        }
+
+        // read reply
+        // ~~~~~~~~~~
+        /// Reads a response body, framed and encoded as described by \p headers, and copies it
+        /// to stdout. On success, the body has been consumed in its entirety and the connection
+        /// is ready for another request (subject to keep_alive()).
+        ///
+        /// The read is reported to \p tracer as phase::body. Data which the sink takes straight
+        /// from the socket is reported with tracer.received(); for data which passes through
+        /// the reader's buffer, build the reader with traced_refiller().
+        template <typename BufferedReader, typename Tracer>
+        error_or<socket_descriptor>
+        read_reply (BufferedReader & reader, socket_descriptor & io2, http_status_code sc,
+                    header_block const & headers, Tracer & tracer) {
+            using return_type = error_or<socket_descriptor>;
+            // The body bypasses stdio, so anything already written there must go first.
+            std::fflush (stdout);
+            fd_sink out{STDOUT_FILENO};
+            tracer.begin (phase::body);
+            std::error_code erc;
+            if constexpr (std::decay_t<Tracer>::enabled) {
+                traced_sink<fd_sink, std::decay_t<Tracer>> traced{out, tracer};
+                auto const body = read_decoded_body (reader, io2, sc, headers, traced);
+                erc = body ? std::error_code{} : body.get_error ();
+            } else {
+                auto const body = read_decoded_body (reader, io2, sc, headers, out);
+                erc = body ? std::error_code{} : body.get_error ();
+            }
+            tracer.end (phase::body);
+            if (erc) {
+                return return_type{erc};
             }
             return return_type{std::in_place, std::move (io2)};
         }
 
+        template <typename BufferedReader>
+        error_or<socket_descriptor>
+        read_reply (BufferedReader & reader, socket_descriptor & io2, http_status_code sc,
+                    header_block const & headers) {
+            null_tracer t;
+            return read_reply (reader, io2, sc, headers, t);
+        }
+
     } // end namespace http
 } // end namespace pstore
 
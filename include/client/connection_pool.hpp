@@ -0,0 +1,138 @@
+#ifndef CLIENT_CONNECTION_POOL_HPP
+#define CLIENT_CONNECTION_POOL_HPP
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "pstore/adt/error_or.hpp"
+#include "pstore/os/descriptor.hpp"
+
+namespace pstore {
+    namespace http {
+
+        // peer closed
+        // ~~~~~~~~~~~
+        /// Returns true if the peer has closed (or half-closed) the connection or if unsolicited
+        /// data is waiting to be read. In either case, the socket cannot be used for another
+        /// request. The check does not block.
+        bool peer_closed (socket_descriptor const & fd) noexcept;
+
+        // connection pool
+        // ~~~~~~~~~~~~~~~
+        /// A pool of keep-alive connections keyed by host:port. Idle sockets are handed out in
+        /// most-recently-used order; those that have been idle for longer than the configured
+        /// timeout are closed by a background timer. The pool may be shared between threads.
+        class connection_pool {
+        public:
+            using clock = std::chrono::steady_clock;
+
+            struct options {
+                /// The maximum number of idle connections retained for each host.
+                std::size_t max_idle_per_host = 8;
+                /// The maximum number of connections (idle and in-use) for each host.
+                std::size_t max_total_per_host = 32;
+                /// Idle connections older than this are closed.
+                clock::duration idle_timeout = std::chrono::seconds{30};
+                /// The period of the eviction timer. Zero disables the timer: idle connections
+                /// are then evicted only by acquire() and by explicit calls to evict_idle().
+                clock::duration eviction_interval = std::chrono::seconds{5};
+            };
+
+            /// A connection on loan from the pool. Pass it back to connection_pool::release()
+            /// once the response body has been fully read. A lease destroyed without being
+            /// released is assumed to be unusable and its socket is closed. A lease must not
+            /// outlive the pool from which it came.
+            class lease {
+                friend class connection_pool;
+
+            public:
+                lease (lease && other) noexcept;
+                lease (lease const &) = delete;
+                ~lease () noexcept;
+
+                lease & operator= (lease && other) noexcept;
+                lease & operator= (lease const &) = delete;
+
+                socket_descriptor & socket () noexcept { return fd_; }
+                socket_descriptor const & socket () const noexcept { return fd_; }
+                /// True if the connection was previously used for an earlier request. A failure
+                /// on the first write to a reused connection may be retried on a fresh one.
+                bool reused () const noexcept { return reused_; }
+
+            private:
+                lease (connection_pool * pool, std::string key, socket_descriptor && fd,
+                       bool reused) noexcept;
+                void discard () noexcept;
+
+                connection_pool * pool_;
+                std::string key_;
+                socket_descriptor fd_;
+                bool reused_;
+            };
+
+            connection_pool ();
+            explicit connection_pool (options const & opts);
+            connection_pool (connection_pool const &) = delete;
+            connection_pool (connection_pool &&) = delete;
+            ~connection_pool () noexcept;
+
+            connection_pool & operator= (connection_pool const &) = delete;
+            connection_pool & operator= (connection_pool &&) = delete;
+
+            /// Returns an idle connection to \p host:\p port if one is available or establishes
+            /// a new one. Fails with std::errc::resource_unavailable_try_again if the per-host
+            /// connection limit has been reached.
+            error_or<lease> acquire (std::string const & host, std::string const & port);
+
+            /// Returns a connection to the pool. \p reusable should be false if the response
+            /// carried "Connection: close" or the body was not completely read; the socket is
+            /// then closed.
+            void release (lease && l, bool reusable);
+
+            /// Closes idle connections that have exceeded the idle timeout.
+            /// \returns The number of connections that were closed.
+            std::size_t evict_idle (clock::time_point now = clock::now ());
+
+            /// The number of idle connections held for \p host:\p port.
+            std::size_t idle_count (std::string const & host, std::string const & port) const;
+            /// The number of in-use connections leased for \p host:\p port.
+            std::size_t active_count (std::string const & host, std::string const & port) const;
+
+        private:
+            struct idle_connection {
+                socket_descriptor fd;
+                clock::time_point since;
+            };
+            struct host_connections {
+                std::vector<idle_connection> idle;
+                std::size_t active = 0;
+            };
+
+            static std::string make_key (std::string const & host, std::string const & port);
+            /// Called with mutex_ held.
+            std::size_t evict_idle (host_connections & hc, clock::time_point now);
+            /// Evicts expired connections for every host and erases hosts which are left with
+            /// neither idle nor active connections. Called with mutex_ held.
+            std::size_t evict_all_idle (clock::time_point now);
+            void forget (std::string const & key) noexcept;
+            void timer_loop ();
+
+            options const options_;
+            mutable std::mutex mutex_;
+            std::unordered_map<std::string, host_connections> hosts_;
+
+            std::condition_variable cv_;
+            bool done_ = false;
+            std::thread timer_;
+        };
+
+    } // end namespace http
+} // end namespace pstore
+
+#endif // CLIENT_CONNECTION_POOL_HPP
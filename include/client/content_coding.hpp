@@ -0,0 +1,131 @@
+#ifndef CLIENT_CONTENT_CODING_HPP
+#define CLIENT_CONTENT_CODING_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <string_view>
+#include <system_error>
+#include <utility>
+
+#include "pstore/adt/error_or.hpp"
+#include "pstore/adt/maybe.hpp"
+#include "pstore/os/descriptor.hpp"
+#include "pstore/support/gsl.hpp"
+
+#include "client/body_sink.hpp"
+
+namespace pstore {
+    namespace http {
+
+        /// The value of the Accept-Encoding header sent by requests whose responses are read with
+        /// read_decoded_body().
+        constexpr char const accepted_content_codings[] = "gzip, deflate";
+
+        enum class content_coding { identity, gzip, deflate };
+
+        // parse content coding
+        // ~~~~~~~~~~~~~~~~~~~~
+        /// Decodes the value of a Content-Encoding header field.
+        /// \returns The coding or nothing if it is not one that we can decode. A value which
+        ///   lists more than one coding (other than identity) is not supported.
+        maybe<content_coding> parse_content_coding (std::string_view value) noexcept;
+
+        // inflater
+        // ~~~~~~~~
+        /// Incrementally decompresses a gzip or deflate encoded stream. For deflate, both the
+        /// zlib format required by RFC 7230 and the raw format sent by some servers are
+        /// accepted. A gzip stream may consist of several members.
+        ///
+        /// The constructor does not fail: if zlib can't be initialized, the first call to
+        /// inflate() returns the error.
+        class inflater {
+        public:
+            explicit inflater (content_coding coding);
+            inflater (inflater const &) = delete;
+            inflater (inflater &&) noexcept;
+            ~inflater () noexcept;
+
+            inflater & operator= (inflater const &) = delete;
+            inflater & operator= (inflater &&) = delete;
+
+            /// Decompresses as much of \p in as will fit in \p out.
+            /// \returns The number of bytes consumed from \p in and the number written to \p out.
+            ///   Once the end of the stream has been reached, any further input is ignored.
+            error_or<std::pair<std::size_t, std::size_t>> inflate (gsl::span<char const> in,
+                                                                  gsl::span<char> out);
+            /// True if the end of the compressed stream (or, for gzip, of a member) has been
+            /// reached.
+            bool done () const noexcept;
+
+        private:
+            struct stream;
+            std::unique_ptr<stream> stream_;
+        };
+
+        // inflate sink
+        // ~~~~~~~~~~~~
+        /// A body sink which decompresses the data that it is given and passes the result to
+        /// another sink. The compressed data is either lent from the reader's buffer or copied
+        /// into a buffer owned by the inflate_sink, so the two sinks' memory never overlaps.
+        template <typename Sink>
+        class inflate_sink {
+        public:
+            inflate_sink (Sink & inner, content_coding coding,
+                          std::size_t chunk_size = default_body_chunk_size)
+                    : inner_{inner}
+                    , inflater_{coding}
+                    , chunk_size_{chunk_size}
+                    , input_{new char[chunk_size]} {}
+
+            /// The encoded length says nothing about the decoded length, so this hint is not
+            /// passed on.
+            void expect (std::size_t) noexcept {}
+            gsl::span<char> prepare (std::size_t const n) noexcept {
+                return {input_.get (), static_cast<std::ptrdiff_t> (std::min (n, chunk_size_))};
+            }
+            std::error_code commit (gsl::span<char const> data);
+
+            /// Called once the whole body has been given to the sink.
+            /// \returns An error if the compressed stream was truncated.
+            std::error_code finish () const {
+                return inflater_.done () ? std::error_code{}
+                                         : std::make_error_code (std::errc::bad_message);
+            }
+
+        private:
+            Sink & inner_;
+            inflater inflater_;
+            std::size_t const chunk_size_;
+            std::unique_ptr<char[]> input_;
+        };
+
+        template <typename Sink>
+        std::error_code inflate_sink<Sink>::commit (gsl::span<char const> data) {
+            for (;;) {
+                gsl::span<char> const out = inner_.prepare (chunk_size_);
+                auto const r = inflater_.inflate (data, out);
+                if (!r) {
+                    return r.get_error ();
+                }
+                auto const [consumed, produced] = *r;
+                data = data.subspan (static_cast<std::ptrdiff_t> (consumed));
+                if (produced > 0U) {
+                    if (std::error_code const erc =
+                            inner_.commit (out.first (static_cast<std::ptrdiff_t> (produced)))) {
+                        return erc;
+                    }
+                }
+                // Stop when the input has been used up and the output buffer wasn't filled
+                // (which would mean that more output may be pending) or when nothing moved.
+                if ((data.size () == 0 && produced < static_cast<std::size_t> (out.size ())) ||
+                    (consumed == 0U && produced == 0U)) {
+                    return {};
+                }
+            }
+        }
+
+    } // end namespace http
+} // end namespace pstore
+
+#endif // CLIENT_CONTENT_CODING_HPP
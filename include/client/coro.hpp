@@ -0,0 +1,404 @@
+#ifndef CLIENT_CORO_HPP
+#define CLIENT_CORO_HPP
+
+#if __cplusplus < 202002L || !__has_include(<coroutine>)
+#error "client/coro.hpp requires C++20 coroutines: build with CLIENT_COROUTINES=Yes"
+#endif
+
+#include <chrono>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include "pstore/adt/error_or.hpp"
+#include "pstore/adt/maybe.hpp"
+#include "pstore/os/descriptor.hpp"
+#include "pstore/support/gsl.hpp"
+
+#include "client/client.hpp"
+#include "client/happy_eyeballs.hpp"
+#include "client/header_block.hpp"
+#include "client/header_field.hpp"
+#include "client/resolver.hpp"
+#include "client/socket_options.hpp"
+
+// An optional C++20 interface to the client. The C++17 functions compose blocking steps with
+// error_or<> and >>=; the coroutines here perform the same steps but suspend, rather than
+// block, whenever a socket is not ready. Many requests may therefore share one thread:
+//
+//     coro::task<> fetch (coro::reactor & r, std::string host, std::string path) {
+//         auto addrs = co_await coro::resolve (r, host, "80");
+//         if (!addrs) co_return;
+//         auto fd = co_await coro::connect (r, *addrs);
+//         ...
+//         coro::stream s{r, std::move (*fd)};
+//         auto status = co_await coro::read_final_head (s, headers);
+//     }
+//
+//     r.spawn (fetch (r, "example.com", "/"));
+//     r.run ();
+//
+// Every operation is a lazy task<>: nothing happens until it is awaited. Arguments which are
+// taken by reference must outlive the task.
+
+namespace pstore {
+    namespace http {
+        namespace coro {
+
+            // frame pool
+            // ~~~~~~~~~~
+            /// Allocates coroutine frames. Each thread keeps a free list for each size class, so
+            /// once a thread has run its first few requests the frames of later ones reuse the
+            /// same memory rather than coming from the heap. Frames larger than the biggest class
+            /// are allocated normally.
+            class frame_pool {
+            public:
+                static void * allocate (std::size_t size);
+                static void deallocate (void * p, std::size_t size) noexcept;
+
+                /// The number of blocks which the calling thread's pool has taken from the heap.
+                static std::size_t heap_blocks () noexcept;
+
+                static constexpr std::size_t granule = 64;
+                static constexpr std::size_t classes = 32;
+            };
+
+            template <typename T>
+            class task;
+
+            namespace details {
+
+                /// A base for promise types whose frames come from the frame_pool.
+                struct pooled_frame {
+                    static void * operator new (std::size_t size) {
+                        return frame_pool::allocate (size);
+                    }
+                    static void operator delete (void * p, std::size_t size) noexcept {
+                        frame_pool::deallocate (p, size);
+                    }
+                };
+
+                class promise_base : public pooled_frame {
+                public:
+                    std::suspend_always initial_suspend () const noexcept { return {}; }
+
+                    /// On completion, control passes straight to the awaiting coroutine
+                    /// (symmetric transfer) so that long chains of tasks don't grow the stack.
+                    struct final_awaiter {
+                        bool await_ready () const noexcept { return false; }
+                        template <typename Promise>
+                        std::coroutine_handle<>
+                        await_suspend (std::coroutine_handle<Promise> h) noexcept {
+                            std::coroutine_handle<> const c =
+                                static_cast<promise_base &> (h.promise ()).continuation_;
+                            return c ? c : std::noop_coroutine ();
+                        }
+                        void await_resume () const noexcept {}
+                    };
+                    final_awaiter final_suspend () const noexcept { return {}; }
+
+                    void unhandled_exception () noexcept { exception_ = std::current_exception (); }
+                    void set_continuation (std::coroutine_handle<> c) noexcept {
+                        continuation_ = c;
+                    }
+
+                protected:
+                    void rethrow_if_failed () const {
+                        if (exception_) {
+                            std::rethrow_exception (exception_);
+                        }
+                    }
+
+                private:
+                    std::coroutine_handle<> continuation_;
+                    std::exception_ptr exception_;
+                };
+
+                template <typename T>
+                class promise : public promise_base {
+                public:
+                    task<T> get_return_object () noexcept;
+                    template <typename U>
+                    void return_value (U && value) {
+                        value_.emplace (std::forward<U> (value));
+                    }
+                    T result () {
+                        this->rethrow_if_failed ();
+                        return std::move (*value_);
+                    }
+
+                private:
+                    std::optional<T> value_;
+                };
+
+                template <>
+                class promise<void> : public promise_base {
+                public:
+                    task<void> get_return_object () noexcept;
+                    void return_void () const noexcept {}
+                    void result () const { this->rethrow_if_failed (); }
+                };
+
+            } // end namespace details
+
+            // task
+            // ~~~~
+            /// A lazily started coroutine which produces a value of type T. The coroutine runs
+            /// when the task is awaited and the awaiting coroutine resumes once it has finished.
+            template <typename T = void>
+            class [[nodiscard]] task {
+            public:
+                using promise_type = details::promise<T>;
+                using handle_type = std::coroutine_handle<promise_type>;
+
+                explicit task (handle_type h) noexcept
+                        : h_{h} {}
+                task (task && other) noexcept
+                        : h_{std::exchange (other.h_, {})} {}
+                task (task const &) = delete;
+                ~task () noexcept {
+                    if (h_) {
+                        h_.destroy ();
+                    }
+                }
+
+                task & operator= (task && other) noexcept {
+                    if (this != &other) {
+                        if (h_) {
+                            h_.destroy ();
+                        }
+                        h_ = std::exchange (other.h_, {});
+                    }
+                    return *this;
+                }
+                task & operator= (task const &) = delete;
+
+                auto operator co_await () && noexcept {
+                    struct awaiter {
+                        handle_type h;
+                        bool await_ready () const noexcept { return !h || h.done (); }
+                        std::coroutine_handle<> await_suspend (std::coroutine_handle<> c) noexcept {
+                            h.promise ().set_continuation (c);
+                            return h;
+                        }
+                        T await_resume () { return h.promise ().result (); }
+                    };
+                    return awaiter{h_};
+                }
+
+            private:
+                handle_type h_;
+            };
+
+            namespace details {
+
+                template <typename T>
+                task<T> promise<T>::get_return_object () noexcept {
+                    return task<T>{std::coroutine_handle<promise<T>>::from_promise (*this)};
+                }
+                inline task<void> promise<void>::get_return_object () noexcept {
+                    return task<void>{std::coroutine_handle<promise<void>>::from_promise (*this)};
+                }
+
+                /// The coroutine type used by reactor::spawn(). It starts at once and frees its
+                /// own frame when it finishes.
+                struct detached {
+                    struct promise_type : pooled_frame {
+                        detached get_return_object () const noexcept { return {}; }
+                        std::suspend_never initial_suspend () const noexcept { return {}; }
+                        std::suspend_never final_suspend () const noexcept { return {}; }
+                        void return_void () const noexcept {}
+                        void unhandled_exception () const noexcept { std::terminate (); }
+                    };
+                };
+
+            } // end namespace details
+
+            // reactor
+            // ~~~~~~~
+            /// An epoll reactor which resumes coroutines when the sockets on which they are
+            /// waiting become ready. Like event_loop, it is driven by a single thread: tasks are
+            /// resumed from run_once() on the thread that calls it. Each wait arms a one-shot
+            /// registration for the socket, so a socket may have only one waiter at a time.
+            ///
+            /// A reactor must not be moved or destroyed while tasks are pending.
+            class reactor {
+            public:
+                /// Creates a reactor.
+                /// \param r  The resolver used by resolve(). If null, the reactor creates its own.
+                static error_or<reactor> create (std::shared_ptr<resolver> r = nullptr);
+
+                reactor (reactor &&) noexcept;
+                reactor (reactor const &) = delete;
+                ~reactor () noexcept;
+
+                reactor & operator= (reactor &&) noexcept;
+                reactor & operator= (reactor const &) = delete;
+
+                /// An awaitable which suspends until a socket is ready. co_await yields an error
+                /// if the wait could not be started.
+                class readiness {
+                public:
+                    readiness (reactor & r, int fd, std::uint32_t events) noexcept
+                            : r_{r}
+                            , fd_{fd}
+                            , events_{events} {}
+                    bool await_ready () const noexcept { return false; }
+                    bool await_suspend (std::coroutine_handle<> h) noexcept {
+                        error_ = r_.watch (fd_, events_, h);
+                        return !error_;
+                    }
+                    std::error_code await_resume () const noexcept { return error_; }
+
+                private:
+                    reactor & r_;
+                    int fd_;
+                    std::uint32_t events_;
+                    std::error_code error_;
+                };
+
+                /// Suspends until \p fd has data to read or the peer has closed the connection.
+                readiness readable (socket_descriptor const & fd) noexcept;
+                /// Suspends until \p fd can accept more data or a connection attempt finishes.
+                readiness writable (socket_descriptor const & fd) noexcept;
+
+                /// Starts \p t, which then runs until its first suspension. The reactor owns the
+                /// task until it finishes. An exception escaping from the task terminates the
+                /// program.
+                void spawn (task<> t);
+
+                /// Waits for at most \p timeout for socket activity and resumes the tasks which
+                /// are waiting for it. A negative timeout waits indefinitely.
+                /// \returns The number of events handled.
+                error_or<std::size_t> run_once (std::chrono::milliseconds timeout);
+
+                /// Runs the reactor until all of the spawned tasks have finished.
+                std::error_code run ();
+
+                /// The number of spawned tasks which have not yet finished.
+                std::size_t pending () const noexcept { return pending_; }
+
+                resolver & get_resolver () noexcept { return *resolver_; }
+
+                /// Queues \p f to be called on the reactor's thread. Unlike the other members,
+                /// post() may be called from any thread.
+                void post (std::function<void ()> f) const;
+
+            private:
+                struct mailbox;
+
+                reactor (socket_descriptor && epoll_fd, std::shared_ptr<mailbox> && mb,
+                         std::shared_ptr<resolver> && r);
+
+                std::error_code watch (int fd, std::uint32_t events, std::coroutine_handle<> h);
+                void drain_mailbox ();
+                details::detached launch (task<> t);
+
+                /// The epoll instance.
+                socket_descriptor epoll_fd_;
+                std::shared_ptr<mailbox> mailbox_;
+                std::shared_ptr<resolver> resolver_;
+                std::size_t pending_ = 0;
+            };
+
+            // resolve
+            // ~~~~~~~
+            /// Looks up \p host:\p port. A cached result is returned at once; otherwise the task
+            /// suspends while the lookup runs on the resolver's threads.
+            task<resolver::result_type> resolve (reactor & r, std::string host, std::string port);
+
+            // connect
+            // ~~~~~~~
+            /// Connects to one of \p addrs, racing the attempts as connect_racing() does: they
+            /// start in interleave_families() order, each one either when its predecessors have
+            /// all failed or when opts.attempt_delay has passed without any of them connecting,
+            /// and the first to connect wins. The task suspends while the attempts are in
+            /// progress. The socket is configured with opts.socket and left non-blocking.
+            task<error_or<socket_descriptor>> connect (reactor & r, shared_address_list addrs,
+                                                       happy_eyeballs_options opts = {});
+
+            // send request
+            // ~~~~~~~~~~~~
+            /// Writes the whole of \p request (such as the result of make_get_request()) to the
+            /// non-blocking socket \p fd.
+            task<std::error_code> send_request (reactor & r, socket_descriptor const & fd,
+                                                std::string request);
+
+            // stream
+            // ~~~~~~
+            /// Buffers data received from a connected, non-blocking socket for the read
+            /// operations below.
+            class stream {
+            public:
+                /// Called with each portion of a response body as it is received.
+                using body_handler = std::function<void (gsl::span<char const>)>;
+
+                /// The longest line that read_line() accepts.
+                static constexpr std::size_t max_line_length = 64 * 1024;
+
+                stream (reactor & r, socket_descriptor && fd);
+
+                socket_descriptor const & socket () const noexcept { return fd_; }
+
+                /// Reads a line and removes its CR LF (or LF). At the end of the stream the
+                /// result is nothing; a partial final line is an error.
+                task<error_or<maybe<std::string>>> read_line ();
+
+                /// Passes at most \p n bytes to \p f, taking those that are already buffered
+                /// before reading more.
+                /// \returns The number of bytes passed to \p f: 0 at the end of the stream.
+                task<error_or<std::size_t>> read_some (std::size_t n, body_handler const & f);
+
+            private:
+                /// Receives more data into the buffer.
+                /// \returns The number of bytes received: 0 at the end of the stream.
+                task<error_or<std::size_t>> fill ();
+
+                reactor * r_;
+                socket_descriptor fd_;
+                std::vector<char> buffer_;
+                /// The buffered bytes are [first_, last_).
+                std::size_t first_ = 0;
+                std::size_t last_ = 0;
+            };
+
+            // read headers
+            // ~~~~~~~~~~~~
+            /// Reads header fields up to the empty line which ends the header section, replacing
+            /// the contents of \p headers.
+            task<std::error_code> read_headers (stream & s, header_block & headers);
+
+            // read final head
+            // ~~~~~~~~~~~~~~~
+            /// Reads the status line and headers of a response, replacing the contents of
+            /// \p headers and skipping any interim (1xx) responses which precede it. As with the
+            /// blocking read_final_head(), more than max_interim_responses of them is an error.
+            /// The result's reason phrase refers to the copy held by \p headers.
+            task<error_or<status_line>> read_final_head (stream & s, header_block & headers);
+
+            // read body
+            // ~~~~~~~~~
+            /// Reads a response body, passing it to \p consumer. The body is framed as described
+            /// by \p headers: chunked transfer-coding, Content-Length or, failing both, the
+            /// connection close. Responses whose status code forbids a body have none. (The
+            /// response to a HEAD request has no body either, but that is for the caller to
+            /// know.)
+            /// \returns The number of body bytes.
+            task<error_or<std::size_t>> read_body (stream & s, http_status_code code,
+                                                   header_block const & headers,
+                                                   stream::body_handler consumer);
+
+        } // end namespace coro
+    } // end namespace http
+} // end namespace pstore
+
+#endif // CLIENT_CORO_HPP
@@ -0,0 +1,57 @@
+#ifndef CLIENT_DOWNLOAD_HPP
+#define CLIENT_DOWNLOAD_HPP
+
+#include <cstdint>
+#include <string>
+
+#include "pstore/adt/error_or.hpp"
+
+namespace pstore {
+    namespace http {
+
+        struct download_options {
+            /// The maximum number of byte ranges fetched concurrently, each over its own
+            /// connection.
+            unsigned connections = 4;
+            /// No range is made smaller than this: small bodies use fewer connections.
+            std::uint64_t min_range_size = 1024 * 1024;
+            /// The number of times in a row that a range may be interrupted without any of its
+            /// data having been received before the download is abandoned.
+            unsigned max_retries = 3;
+        };
+
+        struct download_result {
+            /// The size of the body and therefore of the output file.
+            std::uint64_t size = 0;
+            /// The number of ranges into which the body was split. 1 if the server ignored the
+            /// Range header and the body was fetched as a single stream.
+            unsigned ranges = 0;
+            /// The number of times an interrupted range was resumed.
+            unsigned resumes = 0;
+        };
+
+        // http download
+        // ~~~~~~~~~~~~~
+        /// Downloads \p path from \p host:\p port to the file open for writing as \p fd.
+        ///
+        /// A request for the first byte ("Range: bytes=0-0") reveals the body's size and
+        /// whether the server supports range requests. If it does, the file is preallocated and
+        /// the body is split into as many as options.connections ranges which are fetched
+        /// concurrently, each written in place with pwrite(). If a connection fails, a new one
+        /// picks up the range from the first byte not yet written. If-Range ensures that the
+        /// pieces all come from the same version of the resource. If the server doesn't honor
+        /// Range, the body of the response to the first request is written as a single stream.
+        ///
+        /// If the resource changes part-way through, so that the server answers a range request
+        /// with the whole of the new version, the download fails at once with ESTALE (in the
+        /// generic category). The caller may start again.
+        ///
+        /// On success, the file's size is exactly that of the body.
+        error_or<download_result> http_download (std::string const & host, std::string const & port,
+                                                 std::string const & path, int fd,
+                                                 download_options const & options = {});
+
+    } // end namespace http
+} // end namespace pstore
+
+#endif // CLIENT_DOWNLOAD_HPP
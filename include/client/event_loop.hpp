@@ -0,0 +1,207 @@
+#ifndef CLIENT_EVENT_LOOP_HPP
+#define CLIENT_EVENT_LOOP_HPP
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <unordered_map>
+#include <vector>
+
+#include "pstore/adt/error_or.hpp"
+#include "pstore/os/descriptor.hpp"
+
+#include "client/client.hpp"
+#include "client/happy_eyeballs.hpp"
+#include "client/request_builder.hpp"
+#include "client/resolver.hpp"
+#include "client/response_parser.hpp"
+#include "client/timer_wheel.hpp"
+
+namespace pstore {
+    namespace http {
+
+        // event loop
+        // ~~~~~~~~~~
+        /// An edge-triggered epoll reactor which drives many concurrent requests from a single
+        /// thread. Each request's socket is non-blocking: connect, send and receive proceed as
+        /// far as they can and then park until epoll reports that the socket is ready again.
+        /// Responses are parsed incrementally by a response_parser. Once a response is complete,
+        /// its connection is kept, unless the server asked for it to be closed, and reused by a
+        /// later request to the same host and port. At most idle_options::max_idle_per_host
+        /// connections are kept for each host and port; each is closed once it has been idle
+        /// for idle_options::idle_timeout. A request may be given deadlines for each of its
+        /// phases and for the whole exchange.
+        ///
+        /// The loop is not thread-safe. Handlers are called from run_once() on the thread that
+        /// calls it and may start further requests.
+        class event_loop {
+        public:
+            /// Called once the response has been completely received or the request has failed.
+            /// On success, the parser holds the response's status line and headers.
+            using completion_handler =
+                std::function<void (std::error_code, response_parser const & response)>;
+            using body_handler = response_parser::body_handler;
+
+            struct idle_options {
+                /// The maximum number of idle connections kept for each host:port.
+                std::size_t max_idle_per_host = 8;
+                /// Idle connections are closed after this long. Zero keeps them until a request
+                /// finds that the server has closed them.
+                std::chrono::milliseconds idle_timeout{30000};
+            };
+
+            /// Limits on a request's duration. A zero duration is no limit. A request which
+            /// exceeds a limit fails with std::errc::timed_out.
+            struct request_options {
+                /// The host name lookup.
+                std::chrono::milliseconds resolve{0};
+                /// Establishing a connection, including trying each of the host's addresses.
+                /// happy_eyeballs_options::timeout, if set, applies as well.
+                std::chrono::milliseconds connect{0};
+                /// From the connection being established (or reused) to the first byte of the
+                /// response.
+                std::chrono::milliseconds first_byte{0};
+                /// From the first byte of the response to the last.
+                std::chrono::milliseconds body{0};
+                /// The whole request.
+                std::chrono::milliseconds total{0};
+            };
+
+            /// Creates an event loop.
+            /// \param r  The resolver used to look up host names. If null, the loop creates its
+            ///   own.
+            /// \param options  Controls how the connection attempts to a host's addresses are
+            ///   raced.
+            static error_or<std::unique_ptr<event_loop>>
+            create (std::shared_ptr<resolver> r = nullptr,
+                    happy_eyeballs_options const & options = {});
+            /// Creates an event loop which keeps idle connections as \p idle says.
+            static error_or<std::unique_ptr<event_loop>>
+            create (std::shared_ptr<resolver> r, happy_eyeballs_options const & options,
+                    idle_options const & idle);
+
+            // The loop's address is captured by resolver and timer callbacks, so it can't move.
+            event_loop (event_loop const &) = delete;
+            event_loop (event_loop &&) = delete;
+            ~event_loop () noexcept;
+
+            event_loop & operator= (event_loop const &) = delete;
+            event_loop & operator= (event_loop &&) = delete;
+
+            /// Starts an asynchronous GET request for \p path from \p host:\p port. An idle
+            /// connection to the same host:port is used if there is one; if that fails before any
+            /// of the response arrives (the server may have closed it), the request is sent again
+            /// on a new connection. Otherwise, if the host's addresses are not cached, they are
+            /// looked up on the resolver's threads. The addresses are raced as connect_racing()
+            /// does: attempts start in interleave_families() order, each one either when its
+            /// predecessors have all failed or when attempt_delay has passed without any of them
+            /// connecting, and the first to connect wins.
+            /// \param host  The host name.
+            /// \param port  The port number or service name.
+            /// \param path  The request path.
+            /// \param done  Called when the request completes or fails.
+            /// \param body  Called with each portion of the response body as it is received.
+            /// \returns An error if the request could not be started, in which case \p done is
+            ///   not called.
+            std::error_code async_get (std::string const & host, std::string const & port,
+                                       std::string const & path, completion_handler done,
+                                       body_handler body = nullptr);
+            /// Starts an asynchronous GET request with the deadlines given by \p opts.
+            std::error_code async_get (std::string const & host, std::string const & port,
+                                       std::string const & path, request_options const & opts,
+                                       completion_handler done, body_handler body = nullptr);
+
+            /// Waits for at most \p timeout for socket activity and handles whatever events
+            /// arrive and every timer which has expired. A negative timeout waits indefinitely.
+            /// The wait ends early when a timer is due.
+            /// \returns The number of events handled.
+            error_or<std::size_t> run_once (std::chrono::milliseconds timeout);
+
+            /// Runs the loop until all in-flight requests have completed.
+            std::error_code run ();
+
+            /// Makes a call to run_once() that is waiting return promptly (or, if there is
+            /// none, the next call). Unlike the other members, wake() may be called from any
+            /// thread.
+            void wake () const noexcept;
+
+            /// The number of requests that have been started but not yet completed.
+            std::size_t in_flight () const noexcept { return connections_.size (); }
+
+        private:
+            struct connection;
+            struct mailbox;
+            struct idle_connection {
+                socket_descriptor fd;
+                timer_wheel::clock::time_point since;
+            };
+
+            event_loop (socket_descriptor && epoll_fd, std::shared_ptr<mailbox> && mb,
+                        std::shared_ptr<resolver> && r, happy_eyeballs_options const & options,
+                        idle_options const & idle);
+
+            /// Queues \p f to be called on the loop's thread. May be called from any thread.
+            static void post (std::weak_ptr<mailbox> const & mb, std::function<void ()> f);
+            void drain_mailbox ();
+
+            /// Removes and returns a usable idle connection for \p key (host:port), if any.
+            socket_descriptor take_idle (std::string const & key);
+            /// Keeps \p fd as an idle connection for \p key unless there are already enough.
+            void make_idle (std::string const & key, socket_descriptor && fd);
+            /// Closes the idle connections for \p key which have exceeded the idle timeout.
+            void expire_idle (std::string const & key);
+            /// Replaces the deadline for the connection's current phase with one \p limit from
+            /// now. A zero limit leaves the phase without a deadline.
+            void set_deadline (connection & c, std::chrono::milliseconds limit);
+            /// Looks up the connection's host, if its addresses aren't cached, and then starts
+            /// connecting.
+            std::error_code resolve (connection & c);
+            /// Starts the request again on a new connection after a reused one failed.
+            /// \returns False if the request can't be retried.
+            bool retry (connection & c);
+            void on_resolved (connection & c, resolver::result_type const & r);
+            std::error_code begin_connect (connection & c, address_list const & addrs);
+            /// Starts a connection attempt to the next address that will accept one.
+            /// \returns An error if no attempt is in progress.
+            std::error_code start_connect (connection & c);
+            /// Looks for an attempt which has connected or failed.
+            /// \returns An error if every attempt has failed.
+            std::error_code check_attempts (connection & c);
+            void on_event (connection & c, std::uint32_t events);
+            std::error_code on_writable (connection & c);
+            std::error_code on_readable (connection & c);
+            /// Finishes the request. If \p reusable, the socket is kept as an idle connection.
+            void complete (connection & c, std::error_code erc, bool reusable = false);
+
+            /// The epoll instance.
+            socket_descriptor epoll_fd_;
+            std::shared_ptr<mailbox> mailbox_;
+            std::shared_ptr<resolver> resolver_;
+            happy_eyeballs_options options_;
+            idle_options const idle_options_;
+            timer_wheel timers_;
+            std::unordered_map<connection *, std::unique_ptr<connection>> connections_;
+            /// The id to be given to the next connection.
+            std::uint64_t next_id_ = 0;
+            /// Connections that completed during the current call to run_once(). They are
+            /// destroyed once all of that call's events have been handled because a later event
+            /// in the same batch may still refer to them.
+            std::vector<std::unique_ptr<connection>> finished_;
+            /// Idle connections by host:port, least recently used first. They aren't in the
+            /// epoll set.
+            std::unordered_map<std::string, std::vector<idle_connection>> idle_;
+            request_builder builder_;
+            /// Receive buffer shared by all connections: the parsers retain only what they need.
+            std::unique_ptr<std::array<char, 64 * 1024>> buffer_;
+        };
+
+    } // end namespace http
+} // end namespace pstore
+
+#endif // CLIENT_EVENT_LOOP_HPP
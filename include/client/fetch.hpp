@@ -0,0 +1,109 @@
+#ifndef CLIENT_FETCH_HPP
+#define CLIENT_FETCH_HPP
+
+#include <functional>
+#include <string>
+#include <system_error>
+#include <type_traits>
+
+#include "pstore/adt/error_or.hpp"
+#include "pstore/http/buffered_reader.hpp"
+#include "pstore/http/headers.hpp"
+#include "pstore/http/net_txrx.hpp"
+
+#include "client/client.hpp"
+#include "client/request_builder.hpp"
+#include "client/trace.hpp"
+
+namespace pstore {
+    namespace http {
+
+        // fetch
+        // ~~~~~
+        /// Performs a complete GET request for \p path on a new connection to \p host:\p port:
+        /// resolves the host, connects, sends the request, then reads the head of the final
+        /// response (skipping any interim ones) into \p headers and passes the body to
+        /// \p consumer (a body sink or function, as for
+        /// read_body()). The request offers gzip and deflate content codings and the body is
+        /// decompressed before it reaches the consumer.
+        ///
+        /// Each phase, the bytes sent and received and the number of system calls are reported
+        /// to \p tracer, whose finish() member is called exactly once. With the default
+        /// null_tracer, the instrumentation compiles away entirely.
+        ///
+        /// \returns  The response status line.
+        template <typename Consumer, typename Tracer = null_tracer>
+        error_or<status_line> fetch (std::string const & host, std::string const & port,
+                                     std::string const & path, header_block & headers,
+                                     Consumer && consumer, Tracer && tracer = Tracer{}) {
+            using return_type = error_or<status_line>;
+            auto const fail = [&tracer] (std::error_code const erc) {
+                tracer.finish (erc);
+                return return_type{erc};
+            };
+
+            tracer.begin (phase::resolve);
+            error_or<addrinfo *> eo_info = get_host_info (host, port);
+            tracer.end (phase::resolve);
+            if (!eo_info) {
+                return fail (eo_info.get_error ());
+            }
+
+            tracer.begin (phase::connect);
+            error_or<socket_descriptor> eo_socket = establish_connection (*eo_info);
+            tracer.end (phase::connect);
+            if (!eo_socket) {
+                return fail (eo_socket.get_error ());
+            }
+            socket_descriptor & fd = *eo_socket;
+
+            tracer.begin (phase::send);
+            std::error_code const erc = thread_request_builder ()
+                                            .start ("GET", path)
+                                            .host (host, port)
+                                            .header_ref ("Accept-Encoding",
+                                                         accepted_content_codings)
+                                            .finish ()
+                                            .send (fd, tracer);
+            tracer.end (phase::send);
+            if (erc) {
+                return fail (erc);
+            }
+
+            auto reader = make_socket_reader (
+                traced_refiller (tracer, net::refiller), response_buffer_size);
+
+            tracer.begin (phase::status_line);
+            auto eo_status = read_final_head (reader, fd, headers, tracer);
+            if (!eo_status) {
+                return fail (eo_status.get_error ());
+            }
+
+            auto const read_body = [&] (auto & sink) {
+                auto const eo_body =
+                    read_decoded_body (reader, fd, eo_status->status_code (), headers, sink);
+                return eo_body ? std::error_code{} : eo_body.get_error ();
+            };
+            tracer.begin (phase::body);
+            std::error_code body_erc;
+            if constexpr (std::decay_t<Tracer>::enabled) {
+                // Data that the sink takes directly from the socket bypasses the refiller.
+                decltype (auto) sink = as_body_sink (consumer);
+                traced_sink<std::remove_reference_t<decltype (sink)>, std::decay_t<Tracer>>
+                    traced{sink, tracer};
+                body_erc = read_body (traced);
+            } else {
+                body_erc = read_body (consumer);
+            }
+            tracer.end (phase::body);
+            if (body_erc) {
+                return fail (body_erc);
+            }
+            tracer.finish (std::error_code{});
+            return eo_status;
+        }
+
+    } // end namespace http
+} // end namespace pstore
+
+#endif // CLIENT_FETCH_HPP
@@ -0,0 +1,47 @@
+#ifndef CLIENT_HAPPY_EYEBALLS_HPP
+#define CLIENT_HAPPY_EYEBALLS_HPP
+
+#include <chrono>
+
+#include "pstore/adt/error_or.hpp"
+#include "pstore/os/descriptor.hpp"
+
+#include "client/resolver.hpp"
+#include "client/socket_options.hpp"
+
+namespace pstore {
+    namespace http {
+
+        struct happy_eyeballs_options {
+            /// The delay before the next connection attempt is started while earlier ones are
+            /// still in progress (RFC 8305 section 5 recommends 250ms).
+            std::chrono::milliseconds attempt_delay{250};
+            /// The overall limit on the time spent connecting. Zero means no limit beyond that
+            /// imposed by the kernel on each attempt.
+            std::chrono::milliseconds timeout{0};
+            /// Applied to each socket before it connects.
+            socket_options socket;
+        };
+
+        // interleave families
+        // ~~~~~~~~~~~~~~~~~~~
+        /// Reorders \p addrs so that address families alternate, starting with the family of
+        /// the first (most preferred) address (RFC 8305 section 4).
+        address_list interleave_families (address_list const & addrs);
+
+        // connect racing
+        // ~~~~~~~~~~~~~~
+        /// Connects to one of \p addrs using the "Happy Eyeballs" algorithm (RFC 8305). Attempts
+        /// are made in interleave_families() order. A new attempt starts whenever the previous
+        /// one fails or options.attempt_delay passes without any attempt succeeding, so an
+        /// address which silently drops SYNs delays the connection by at most attempt_delay.
+        /// The first connection to be established wins; the others are abandoned.
+        ///
+        /// \returns A connected socket in blocking mode.
+        error_or<socket_descriptor> connect_racing (address_list const & addrs,
+                                                    happy_eyeballs_options const & options = {});
+
+    } // end namespace http
+} // end namespace pstore
+
+#endif // CLIENT_HAPPY_EYEBALLS_HPP
@@ -0,0 +1,195 @@
+#ifndef CLIENT_HEADER_BLOCK_HPP
+#define CLIENT_HEADER_BLOCK_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "pstore/adt/maybe.hpp"
+#include "pstore/adt/small_vector.hpp"
+
+#include "client/header_field.hpp"
+
+#define CLIENT_KNOWN_HEADERS                                                                       \
+    CLIENT_KNOWN_HEADER ("age", age)                                                               \
+    CLIENT_KNOWN_HEADER ("cache-control", cache_control)                                           \
+    CLIENT_KNOWN_HEADER ("connection", connection)                                                 \
+    CLIENT_KNOWN_HEADER ("content-encoding", content_encoding)                                     \
+    CLIENT_KNOWN_HEADER ("content-length", content_length)                                         \
+    CLIENT_KNOWN_HEADER ("content-range", content_range)                                           \
+    CLIENT_KNOWN_HEADER ("etag", etag)                                                             \
+    CLIENT_KNOWN_HEADER ("last-modified", last_modified)                                           \
+    CLIENT_KNOWN_HEADER ("sec-websocket-accept", sec_websocket_accept)                             \
+    CLIENT_KNOWN_HEADER ("transfer-encoding", transfer_encoding)                                   \
+    CLIENT_KNOWN_HEADER ("upgrade", upgrade)                                                       \
+    CLIENT_KNOWN_HEADER ("vary", vary)
+
+namespace pstore {
+    namespace http {
+
+        // known header
+        // ~~~~~~~~~~~~
+        /// The header fields that the client itself consults. Each has a fixed slot in a
+        /// header_block so that it can be found without searching.
+#define CLIENT_KNOWN_HEADER(name, id) id,
+        enum class known_header { CLIENT_KNOWN_HEADERS };
+#undef CLIENT_KNOWN_HEADER
+
+#define CLIENT_KNOWN_HEADER(name, id) +1
+        constexpr std::size_t known_header_count = 0 CLIENT_KNOWN_HEADERS;
+#undef CLIENT_KNOWN_HEADER
+
+        // lookup known header
+        // ~~~~~~~~~~~~~~~~~~~
+        /// Maps a header field name, in any case, to its known_header slot.
+        maybe<known_header> lookup_known_header (std::string_view name) noexcept;
+
+        /// Returns the lower-case name of a known header field.
+        std::string_view known_header_name (known_header h) noexcept;
+
+        //*  _                _           _    _         _    *
+        //* | |_  ___ __ _ __| |___ _ _  | |__| |___  __| |__ *
+        //* | ' \/ -_) _` / _` / -_) '_| | '_ \ / _ \/ _| / / *
+        //* |_||_\___\__,_\__,_\___|_|   |_.__/_\___/\__|_\_\ *
+        //*                                                   *
+        /// The header fields of one response. Names and values are copied into a single
+        /// character arena and the fields are recorded as offsets into it, so adding a field
+        /// allocates nothing once the block has grown to the size of a typical response.
+        /// clear() keeps that storage for the next response on the connection.
+        ///
+        /// Names are converted to lower-case as they are added. The known headers are interned
+        /// to fixed slots and found in constant time; any other name is found with a
+        /// case-insensitive linear search of the (short) field list.
+        ///
+        /// A repeated field is combined with the earlier one into a single comma-separated list
+        /// (RFC 7230 section 3.2.2).
+        class header_block {
+            struct entry {
+                std::uint32_t name_offset;
+                std::uint32_t name_length;
+                std::uint32_t value_offset;
+                std::uint32_t value_length;
+            };
+
+        public:
+            class const_iterator {
+            public:
+                using iterator_category = std::forward_iterator_tag;
+                using value_type = header_field;
+                using difference_type = std::ptrdiff_t;
+                using pointer = header_field const *;
+                using reference = header_field;
+
+                const_iterator () noexcept = default;
+                const_iterator (header_block const * block,
+                                std::vector<entry>::const_iterator pos) noexcept
+                        : block_{block}
+                        , pos_{pos} {}
+
+                bool operator== (const_iterator const & other) const noexcept {
+                    return pos_ == other.pos_;
+                }
+                bool operator!= (const_iterator const & other) const noexcept {
+                    return pos_ != other.pos_;
+                }
+
+                header_field operator* () const noexcept { return block_->field (*pos_); }
+
+                const_iterator & operator++ () noexcept {
+                    ++pos_;
+                    return *this;
+                }
+                const_iterator operator++ (int) noexcept {
+                    auto const prev = *this;
+                    ++*this;
+                    return prev;
+                }
+
+            private:
+                header_block const * block_ = nullptr;
+                std::vector<entry>::const_iterator pos_;
+            };
+
+            header_block () { slots_.fill (0); }
+
+            /// Removes all of the fields but keeps the storage.
+            void clear () noexcept;
+
+            /// Adds a field. If a field with the same name is present, \p value is appended to
+            /// its value after a comma.
+            void add (std::string_view name, std::string_view value);
+            /// Adds a field or, if a field with the same name is present, replaces its value.
+            void set (std::string_view name, std::string_view value);
+
+            /// Returns the value of a known header field, if present.
+            maybe<std::string_view> find (known_header h) const noexcept {
+                std::uint32_t const slot = slots_[static_cast<std::size_t> (h)];
+                if (slot == 0U) {
+                    return {};
+                }
+                return maybe<std::string_view>{this->value (fields_[slot - 1U])};
+            }
+            /// Returns the value of the field named \p name (compared case-insensitively), if
+            /// present.
+            maybe<std::string_view> find (std::string_view name) const noexcept;
+
+            bool contains (known_header h) const noexcept {
+                return slots_[static_cast<std::size_t> (h)] != 0U;
+            }
+            bool contains (std::string_view name) const noexcept {
+                return static_cast<bool> (this->find (name));
+            }
+
+            std::size_t size () const noexcept { return fields_.size (); }
+            bool empty () const noexcept { return fields_.empty (); }
+
+            const_iterator begin () const noexcept { return {this, fields_.begin ()}; }
+            const_iterator end () const noexcept { return {this, fields_.end ()}; }
+
+            /// The reason phrase of the response's status line. read_final_head() copies it here
+            /// from the reader's buffer so that it outlives the next read; the status_line that
+            /// it returns refers to this copy.
+            std::string_view reason_phrase () const noexcept { return reason_; }
+            void set_reason_phrase (std::string_view const reason) { reason_.assign (reason); }
+
+        private:
+            std::string_view name (entry const & e) const noexcept {
+                return {text_.data () + e.name_offset, e.name_length};
+            }
+            std::string_view value (entry const & e) const noexcept {
+                return {text_.data () + e.value_offset, e.value_length};
+            }
+            header_field field (entry const & e) const noexcept {
+                return {this->name (e), this->value (e)};
+            }
+
+            /// Returns the index of the field named \p name or fields_.size () if there is none.
+            std::size_t index_of (std::string_view name) const noexcept;
+            /// Copies \p s to the end of the arena, returning its offset.
+            std::uint32_t append_text (std::string_view s);
+            void add_entry (std::string_view name, std::string_view value);
+
+            /// The text of the names and values.
+            std::string text_;
+            std::string reason_;
+            std::vector<entry> fields_;
+            /// For each known header, one more than the index of its entry in fields_ or 0 if
+            /// it is absent.
+            std::array<std::uint32_t, known_header_count> slots_;
+        };
+
+        // header list
+        // ~~~~~~~~~~~
+        /// Extra header fields for a request, sent in the order in which they appear. The names
+        /// and values are views: the strings to which they refer must outlive the request's
+        /// construction. A typical handful of fields is held without allocating.
+        using header_list = small_vector<header_field, 8>;
+
+    } // end namespace http
+} // end namespace pstore
+
+#endif // CLIENT_HEADER_BLOCK_HPP
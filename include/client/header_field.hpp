@@ -0,0 +1,108 @@
+#ifndef CLIENT_HEADER_FIELD_HPP
+#define CLIENT_HEADER_FIELD_HPP
+
+#include <algorithm>
+#include <cctype>
+#include <cstddef>
+#include <string_view>
+#include <system_error>
+
+#include "pstore/adt/error_or.hpp"
+#include "pstore/adt/maybe.hpp"
+
+#include "client/scan.hpp"
+
+namespace pstore {
+    namespace http {
+
+        /// A header field whose name and value refer to text in a read buffer.
+        struct header_field {
+            std::string_view name;
+            std::string_view value;
+        };
+
+        namespace details {
+
+            constexpr bool is_ows (char const c) noexcept { return c == ' ' || c == '\t'; }
+
+            /// Compares \p a and \p b ignoring case, as field names and most tokens in field
+            /// values are compared.
+            inline bool equal_ci (std::string_view const a, std::string_view const b) noexcept {
+                return a.length () == b.length () &&
+                       std::equal (std::begin (a), std::end (a), std::begin (b),
+                                   [] (char const c1, char const c2) {
+                                       return std::tolower (static_cast<unsigned char> (c1)) ==
+                                              std::tolower (static_cast<unsigned char> (c2));
+                                   });
+            }
+
+            constexpr std::string_view trim_ows (std::string_view s) noexcept {
+                while (!s.empty () && is_ows (s.front ())) {
+                    s.remove_prefix (1);
+                }
+                while (!s.empty () && is_ows (s.back ())) {
+                    s.remove_suffix (1);
+                }
+                return s;
+            }
+
+        } // end namespace details
+
+        // parse header field
+        // ~~~~~~~~~~~~~~~~~~
+        /// Splits a header line (without its CRLF) into its name and value. Optional whitespace
+        /// around the value is removed. The name is returned as it appears on the wire.
+        maybe<header_field> parse_header_field (std::string_view line) noexcept;
+
+        // parse header block
+        // ~~~~~~~~~~~~~~~~~~
+        /// Parses header lines from [first, last) up to and including the empty line which ends
+        /// the header section. \p f is called with a header_field for each line; its views refer
+        /// directly into [first, last). The ':' and LF delimiters are found with find_either()
+        /// and find_byte() so the field names and values are each scanned once.
+        ///
+        /// \returns  The number of bytes consumed including the final empty line, or 0 if the
+        ///   buffer does not hold the complete header section. In that case \p f may have been
+        ///   called for some of the fields.
+        template <typename Function>
+        error_or<std::size_t> parse_header_block (char const * const first,
+                                                  char const * const last, Function f) {
+            using return_type = error_or<std::size_t>;
+            for (char const * pos = first; pos != last;) {
+                // Find the end of the field name or, for the empty line, the LF.
+                char const * const delim = find_either (pos, last, ':', '\n');
+                if (delim == last) {
+                    break;
+                }
+                if (*delim == '\n') {
+                    auto const line = std::string_view{pos, static_cast<std::size_t> (delim - pos)};
+                    if (line.empty () || line == "\r") {
+                        return return_type{static_cast<std::size_t> (delim + 1 - first)};
+                    }
+                    return return_type{std::make_error_code (std::errc::bad_message)};
+                }
+                char const * const nl = find_byte (delim + 1, last, '\n');
+                if (nl == last) {
+                    break;
+                }
+                char const * line_end = nl;
+                if (line_end != delim + 1 && *(line_end - 1) == '\r') {
+                    --line_end;
+                }
+                auto const name = std::string_view{pos, static_cast<std::size_t> (delim - pos)};
+                if (name.empty () || details::is_ows (name.front ()) ||
+                    details::is_ows (name.back ())) {
+                    return return_type{std::make_error_code (std::errc::bad_message)};
+                }
+                auto const value = std::string_view{
+                    delim + 1, static_cast<std::size_t> (line_end - (delim + 1))};
+                f (header_field{name, details::trim_ows (value)});
+                pos = nl + 1;
+            }
+            return return_type{std::size_t{0}};
+        }
+
+    } // end namespace http
+} // end namespace pstore
+
+#endif // CLIENT_HEADER_FIELD_HPP
@@ -0,0 +1,108 @@
+#ifndef CLIENT_MPMC_QUEUE_HPP
+#define CLIENT_MPMC_QUEUE_HPP
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace pstore {
+    namespace http {
+
+        // mpmc queue
+        // ~~~~~~~~~~
+        /// A bounded lock-free multi-producer, multi-consumer queue (after Dmitry Vyukov's
+        /// design). Each cell carries a sequence number which tells producers and consumers
+        /// whether it is free or full for the current lap around the ring, so a push or pop costs
+        /// a single compare-and-swap on the shared index.
+        template <typename T>
+        class mpmc_queue {
+        public:
+            /// \param capacity  The number of values that the queue can hold. Must be a power of
+            ///   two.
+            explicit mpmc_queue (std::size_t const capacity)
+                    : cells_ (capacity)
+                    , mask_{capacity - 1U} {
+                assert (capacity != 0U && (capacity & (capacity - 1U)) == 0U);
+                for (std::size_t ctr = 0; ctr < capacity; ++ctr) {
+                    cells_[ctr].sequence.store (ctr, std::memory_order_relaxed);
+                }
+            }
+
+            /// Moves \p value into the queue. If the queue is full, returns false and leaves
+            /// \p value untouched.
+            bool push (T & value) {
+                cell * c = nullptr;
+                std::size_t pos = enqueue_.load (std::memory_order_relaxed);
+                for (;;) {
+                    c = &cells_[pos & mask_];
+                    std::size_t const seq = c->sequence.load (std::memory_order_acquire);
+                    auto const diff =
+                        static_cast<std::intptr_t> (seq) - static_cast<std::intptr_t> (pos);
+                    if (diff == 0) {
+                        if (enqueue_.compare_exchange_weak (pos, pos + 1U,
+                                                       std::memory_order_relaxed)) {
+                            break;
+                        }
+                    } else if (diff < 0) {
+                        return false;
+                    } else {
+                        pos = enqueue_.load (std::memory_order_relaxed);
+                    }
+                }
+                c->value = std::move (value);
+                c->sequence.store (pos + 1U, std::memory_order_release);
+                return true;
+            }
+
+            /// Moves the oldest value in the queue into \p value. If the queue is empty, returns
+            /// false.
+            bool pop (T & value) {
+                cell * c = nullptr;
+                std::size_t pos = dequeue_.load (std::memory_order_relaxed);
+                for (;;) {
+                    c = &cells_[pos & mask_];
+                    std::size_t const seq = c->sequence.load (std::memory_order_acquire);
+                    auto const diff =
+                        static_cast<std::intptr_t> (seq) - static_cast<std::intptr_t> (pos + 1U);
+                    if (diff == 0) {
+                        if (dequeue_.compare_exchange_weak (pos, pos + 1U,
+                                                       std::memory_order_relaxed)) {
+                            break;
+                        }
+                    } else if (diff < 0) {
+                        return false;
+                    } else {
+                        pos = dequeue_.load (std::memory_order_relaxed);
+                    }
+                }
+                value = std::move (c->value);
+                c->value = T{};
+                c->sequence.store (pos + mask_ + 1U, std::memory_order_release);
+                return true;
+            }
+
+            /// An estimate of the number of values in the queue.
+            std::size_t size () const noexcept {
+                std::size_t const e = enqueue_.load (std::memory_order_relaxed);
+                std::size_t const d = dequeue_.load (std::memory_order_relaxed);
+                return e > d ? e - d : 0U;
+            }
+
+        private:
+            struct cell {
+                std::atomic<std::size_t> sequence;
+                T value;
+            };
+            std::vector<cell> cells_;
+            std::size_t const mask_;
+            // Producers and consumers update different cache lines.
+            alignas (64) std::atomic<std::size_t> enqueue_{0};
+            alignas (64) std::atomic<std::size_t> dequeue_{0};
+        };
+
+    } // end namespace http
+} // end namespace pstore
+
+#endif // CLIENT_MPMC_QUEUE_HPP
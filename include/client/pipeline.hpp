@@ -0,0 +1,59 @@
+#ifndef CLIENT_PIPELINE_HPP
+#define CLIENT_PIPELINE_HPP
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "client/client.hpp"
+
+namespace pstore {
+    namespace http {
+
+        struct pipeline_options {
+            /// The maximum number of requests that may be awaiting a response on the connection
+            /// at any one time.
+            std::size_t depth = 8;
+            /// The number of times in a row that a connection may be lost without any response
+            /// having been received before the remaining requests are abandoned.
+            unsigned max_replays = 3;
+        };
+
+        /// Receives each response from a pipeline.
+        /// \param index  The index of the corresponding request path.
+        /// \param status  The response's status line.
+        /// \param headers  The response headers.
+        /// \param body  The complete response body.
+        using pipeline_handler =
+            std::function<void (std::size_t index, status_line const & status,
+                                header_block const & headers, std::string const & body)>;
+
+        // http get pipelined
+        // ~~~~~~~~~~~~~~~~~~
+        /// Fetches each of \p paths from \p host:\p port using HTTP/1.1 pipelining: up to
+        /// options.depth GET requests are written back-to-back on one connection and the
+        /// responses, which must arrive in the same order, are matched to them first-in,
+        /// first-out.
+        ///
+        /// If the server closes the connection (or asks for it to be closed) before every
+        /// response has arrived, the unanswered requests are replayed on a new connection. GET
+        /// is idempotent so this is safe. Requests are replayed only if the connection was lost
+        /// before any of the next response arrived. If a request can't be sent because the
+        /// connection has been lost, the responses to those already sent are read before the
+        /// rest are replayed.
+        ///
+        /// \returns An error if a connection could not be established or failed repeatedly, if
+        ///   a response could not be understood or if the connection was lost part-way through
+        ///   a response. In that case, \p handler will have been called for only a subset of
+        ///   the paths.
+        std::error_code http_get_pipelined (std::string const & host, std::string const & port,
+                                            std::vector<std::string> const & paths,
+                                            pipeline_options const & options,
+                                            pipeline_handler const & handler);
+
+    } // end namespace http
+} // end namespace pstore
+
+#endif // CLIENT_PIPELINE_HPP
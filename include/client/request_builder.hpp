@@ -0,0 +1,114 @@
+#ifndef CLIENT_REQUEST_BUILDER_HPP
+#define CLIENT_REQUEST_BUILDER_HPP
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+#include <sys/uio.h>
+
+#include "pstore/adt/error_or.hpp"
+#include "pstore/os/descriptor.hpp"
+
+#include "client/trace.hpp"
+
+namespace pstore {
+    namespace http {
+
+        // request builder
+        // ~~~~~~~~~~~~~~~
+        /// Serializes the request line and header fields of an HTTP/1.1 request. Text is either
+        /// copied into a reusable buffer or, for header values added with header_ref(),
+        /// referenced in place by the iovec array passed to sendmsg(). Once the buffer and
+        /// vectors have grown to accommodate the largest request, building and sending a
+        /// request does not allocate.
+        ///
+        /// Header fields are emitted in the order in which they were added so the same
+        /// sequence of calls always produces byte-identical requests.
+        class request_builder {
+        public:
+            static constexpr std::size_t default_capacity = 1024;
+
+            explicit request_builder (std::size_t capacity = default_capacity);
+
+            /// Begins a new request, discarding any previous one. Buffers keep their capacity.
+            request_builder & start (std::string_view method, std::string_view target);
+            /// Adds a header field by copying the name and value into the buffer.
+            request_builder & header (std::string_view name, std::string_view value);
+            /// Adds a header field whose value is referenced rather than copied. The value must
+            /// remain valid and unchanged until the request has been sent.
+            request_builder & header_ref (std::string_view name, std::string_view value);
+            /// Adds a Host header field of the form host:port.
+            request_builder & host (std::string_view host, std::string_view port);
+            /// Terminates the header section.
+            request_builder & finish ();
+
+            /// The total number of bytes in the request.
+            std::size_t size () const noexcept;
+            /// Replaces the contents of \p out with the serialized request.
+            void copy_to (std::string & out) const;
+
+            /// Writes the request to \p fd, a blocking socket, retrying after partial writes. If
+            /// the socket's send timeout expires, fails with std::errc::timed_out.
+            std::error_code send (socket_descriptor const & fd) {
+                null_tracer t;
+                return this->send (fd, t);
+            }
+            /// Writes the request to \p fd, reporting each system call to \p tracer.
+            template <typename Tracer>
+            std::error_code send (socket_descriptor const & fd, Tracer & tracer) {
+                for (this->prepare_iov (); next_iov_ < iov_.size ();) {
+                    error_or<std::size_t> const sent = this->send_once (fd);
+                    if (!sent) {
+                        return sent.get_error ();
+                    }
+                    tracer.sent (*sent);
+                }
+                return {};
+            }
+
+        private:
+            /// A run of the request text. If ptr is null, the text lives in buffer_ starting at
+            /// offset; buffer_ may be reallocated as the request grows, so pointers to it are
+            /// only formed when the request is sent.
+            struct segment {
+                char const * ptr;
+                std::size_t offset;
+                std::size_t length;
+            };
+
+            void append (std::string_view s);
+            void append_ref (std::string_view s);
+
+            /// Builds iov_ from segments_.
+            void prepare_iov ();
+            /// Makes a single sendmsg() call for the unsent part of iov_.
+            /// \returns The number of bytes written.
+            error_or<std::size_t> send_once (socket_descriptor const & fd);
+
+            std::string buffer_;
+            std::vector<segment> segments_;
+            std::vector<iovec> iov_;
+            /// The index of the first iov_ entry which has not been completely sent.
+            std::size_t next_iov_ = 0;
+        };
+
+        // thread request builder
+        // ~~~~~~~~~~~~~~~~~~~~~~
+        /// Returns a builder owned by the calling thread. Reusing it means that, in the steady
+        /// state, serializing a request doesn't allocate.
+        request_builder & thread_request_builder ();
+
+        // is idempotent
+        // ~~~~~~~~~~~~~
+        /// Returns true if \p method is idempotent (RFC 7231 section 4.2.2), so that sending a
+        /// request more than once has the same effect as sending it once. Only such requests
+        /// may be retried or hedged.
+        bool is_idempotent (std::string_view method) noexcept;
+
+    } // end namespace http
+} // end namespace pstore
+
+#endif // CLIENT_REQUEST_BUILDER_HPP
@@ -0,0 +1,142 @@
+#ifndef CLIENT_RESOLVER_HPP
+#define CLIENT_RESOLVER_HPP
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <netdb.h>
+#include <sys/socket.h>
+
+#include "pstore/adt/error_or.hpp"
+#include "pstore/adt/maybe.hpp"
+
+namespace pstore {
+    namespace http {
+
+        /// A resolved socket address.
+        struct address {
+            sockaddr_storage storage;
+            socklen_t length;
+
+            int family () const noexcept { return storage.ss_family; }
+            sockaddr const * get () const noexcept {
+                return reinterpret_cast<sockaddr const *> (&storage);
+            }
+        };
+
+        using address_list = std::vector<address>;
+        using shared_address_list = std::shared_ptr<address_list const>;
+
+        // to address list
+        // ~~~~~~~~~~~~~~~
+        /// Copies the addresses from a getaddrinfo() result.
+        address_list to_address_list (addrinfo const * info);
+
+        // resolver
+        // ~~~~~~~~
+        /// A caching name resolver. Successful lookups are cached for options::positive_ttl and
+        /// names which do not exist for options::negative_ttl. (getaddrinfo() does not report
+        /// DNS record TTLs, so these are fixed.) Both IPv4 and IPv6 addresses are returned, in
+        /// the order preferred by getaddrinfo(), for the families which the host has configured.
+        ///
+        /// resolve_async() never blocks: lookups which miss the cache are performed by a small
+        /// pool of worker threads and concurrent requests for the same name share one lookup.
+        /// The resolver is thread-safe.
+        class resolver {
+        public:
+            using clock = std::chrono::steady_clock;
+            using result_type = error_or<shared_address_list>;
+            using callback = std::function<void (result_type const &)>;
+
+            struct options {
+                clock::duration positive_ttl = std::chrono::seconds{60};
+                clock::duration negative_ttl = std::chrono::seconds{5};
+                /// The maximum number of names held in the cache.
+                std::size_t max_entries = 1024;
+                /// The number of threads used for asynchronous lookups.
+                unsigned worker_threads = 2;
+            };
+
+            resolver ();
+            explicit resolver (options const & opts);
+            resolver (resolver const &) = delete;
+            resolver (resolver &&) = delete;
+            /// Waits for any lookups that are in progress to finish.
+            ~resolver () noexcept;
+
+            resolver & operator= (resolver const &) = delete;
+            resolver & operator= (resolver &&) = delete;
+
+            /// Returns the addresses of \p host:\p port from the cache or, if they are not
+            /// cached, by calling getaddrinfo() on the calling thread.
+            result_type resolve (std::string const & host, std::string const & port);
+
+            /// Looks up \p host:\p port and passes the result to \p cb. If the result is
+            /// cached, \p cb is called before resolve_async() returns; otherwise it is called
+            /// later on one of the resolver's worker threads.
+            void resolve_async (std::string const & host, std::string const & port, callback cb);
+
+            /// Returns the cached result for \p host:\p port, if there is one which has not
+            /// expired.
+            maybe<result_type> cached (std::string const & host, std::string const & port);
+
+            /// Adds \p addrs to the cache as the addresses of \p host:\p port, in the manner of
+            /// curl's --resolve option. A pinned entry does not expire, although clear() discards
+            /// it.
+            void pin (std::string const & host, std::string const & port, address_list addrs);
+
+            /// Discards every cached result.
+            void clear ();
+
+        private:
+            struct entry {
+                maybe<result_type> result;
+                clock::time_point expires;
+                /// Callbacks waiting for a lookup which is in progress.
+                std::vector<callback> waiters;
+                bool pending = false;
+                /// Set by pin(). The result of a lookup which was already in progress doesn't
+                /// replace a pinned result.
+                bool pinned = false;
+            };
+            struct work_item {
+                std::string key;
+                std::string host;
+                std::string port;
+            };
+
+            static std::string make_key (std::string const & host, std::string const & port);
+            static result_type lookup (std::string const & host, std::string const & port);
+
+            /// Called with mutex_ held.
+            maybe<result_type> find_fresh (std::string const & key, clock::time_point now);
+            /// Records the result of a lookup, unless the name has been pinned, and returns the
+            /// callbacks that were waiting for it.
+            std::vector<callback> store (std::string const & key, result_type const & result);
+            void trim (clock::time_point now);
+            void worker ();
+
+            options const options_;
+            std::mutex mutex_;
+            std::unordered_map<std::string, entry> cache_;
+
+            std::condition_variable cv_;
+            std::deque<work_item> queue_;
+            bool done_ = false;
+            std::vector<std::thread> workers_;
+        };
+
+    } // end namespace http
+} // end namespace pstore
+
+#endif // CLIENT_RESOLVER_HPP
@@ -0,0 +1,159 @@
+#ifndef CLIENT_RESPONSE_CACHE_HPP
+#define CLIENT_RESPONSE_CACHE_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+#include "pstore/adt/error_or.hpp"
+#include "pstore/adt/maybe.hpp"
+#include "pstore/support/gsl.hpp"
+
+#include "client/client.hpp"
+
+namespace pstore {
+    namespace http {
+
+        // cache policy
+        // ~~~~~~~~~~~~
+        /// The caching rules carried by a response's Cache-Control, Age and Vary headers.
+        struct cache_policy {
+            /// False if the response must not be stored (no-store or Vary).
+            bool storable = true;
+            /// How long the response may be used without revalidation. Zero if it must be
+            /// revalidated every time (no-cache or no max-age).
+            std::chrono::seconds lifetime{0};
+        };
+
+        /// Decodes the Cache-Control and Age headers of a response (RFC 7234 section 5).
+        /// Expires is not consulted: a response without max-age is stored only if it has a
+        /// validator and is then revalidated on each use. This is a private cache, so the
+        /// private directive doesn't stop a response from being stored. Entries are keyed by
+        /// URL alone, so a response which carries Vary is not stored: it might be used for a
+        /// request whose headers select a different representation.
+        cache_policy parse_cache_policy (header_block const & headers);
+
+        // cache limits
+        // ~~~~~~~~~~~~
+        /// Bounds on the memory and disk space used by a response_cache.
+        struct cache_limits {
+            /// A response whose decoded body is larger than this is passed to the caller but is
+            /// not stored. No more than this much of a body is held in memory.
+            std::size_t max_body_size = std::size_t{4} * 1024U * 1024U;
+            /// Once the database file has reached this size, responses are no longer stored and
+            /// revalidated entries are not refreshed. Zero means that there is no limit.
+            std::uint64_t max_file_size = std::uint64_t{1} * 1024U * 1024U * 1024U;
+        };
+
+        enum class cache_outcome {
+            /// A fresh entry was used without contacting the server.
+            hit,
+            /// A stale entry was confirmed by a 304 response.
+            revalidated,
+            /// The response came from the server.
+            miss,
+        };
+
+        // response cache
+        // ~~~~~~~~~~~~~~
+        /// A persistent cache of GET responses held in a memory-mapped pstore database. Each
+        /// entry records the response's status, its headers (including the ETag and
+        /// Last-Modified validators) and its decoded body.
+        ///
+        /// A fresh entry is served directly from the mapped file without any network I/O. A
+        /// stale entry is revalidated with If-None-Match and/or If-Modified-Since; if the
+        /// server answers 304, the stored body is served from the mapping and only the entry's
+        /// expiry time and headers are rewritten.
+        ///
+        /// pstore's transaction lock serializes writers and each lookup first syncs to the
+        /// latest revision, so a cache file may be shared by several processes. Within a
+        /// process, the cache may be shared between threads.
+        ///
+        /// A pstore database is append-only: each stored response and each refreshed entry adds
+        /// a record, and the records that they supersede are never reclaimed. The file's growth
+        /// is bounded by cache_limits::max_file_size, after which the cache serves what it holds
+        /// but stores nothing more; deleting the file is the only way to reclaim the space.
+        class response_cache {
+        public:
+            /// Called with the body of a response, possibly in several pieces. A span refers to
+            /// the mapped database or to a transient buffer and is valid only for the duration
+            /// of the call.
+            using body_handler = std::function<void (gsl::span<char const>)>;
+
+            struct counters {
+                std::uint64_t hits = 0;
+                std::uint64_t misses = 0;
+                std::uint64_t revalidations = 0;
+                /// The number of responses written to the database.
+                std::uint64_t stores = 0;
+            };
+
+            struct response {
+                http_status_code status;
+                cache_outcome outcome;
+            };
+
+            /// Opens the cache database at \p path, creating it if it does not exist.
+            static error_or<std::unique_ptr<response_cache>>
+            open (std::string const & path, cache_limits const & limits = cache_limits{});
+
+            response_cache (response_cache const &) = delete;
+            response_cache (response_cache &&) = delete;
+            ~response_cache () noexcept;
+
+            response_cache & operator= (response_cache const &) = delete;
+            response_cache & operator= (response_cache &&) = delete;
+
+            /// Performs a GET request for \p path on \p host:\p port, answering it from the
+            /// cache if possible. On return, \p headers holds the response headers and the body
+            /// has been passed to \p body. The body is always decoded: the request offers gzip
+            /// and deflate and any Content-Encoding has been removed. A response from the
+            /// server is passed to \p body as it arrives.
+            ///
+            /// The headers of a response from the server are those that it sent. Those of a
+            /// stored response omit the fields which describe the message rather than the
+            /// resource (Connection, Content-Encoding, Transfer-Encoding and so on) and their
+            /// Content-Length is that of the decoded body.
+            error_or<response> get (std::string const & host, std::string const & port,
+                                    std::string const & path, header_block & headers,
+                                    body_handler const & body);
+
+            counters snapshot () const noexcept;
+
+        private:
+            struct database;
+            struct entry;
+
+            response_cache (std::unique_ptr<database> && db, cache_limits const & limits);
+
+            /// True if the database file has reached limits_.max_file_size.
+            bool full () const noexcept;
+
+            maybe<entry> lookup (std::string const & key);
+            std::error_code store (std::string const & key, http_status_code status,
+                                   header_block const & headers, cache_policy const & policy,
+                                   gsl::span<char const> body);
+            std::error_code refresh (std::string const & key, entry const & e,
+                                     header_block const & headers, cache_policy const & policy);
+
+            /// pstore::database is not thread-safe.
+            std::mutex mut_;
+            std::unique_ptr<database> db_;
+            cache_limits const limits_;
+
+            std::atomic<std::uint64_t> hits_{0};
+            std::atomic<std::uint64_t> misses_{0};
+            std::atomic<std::uint64_t> revalidations_{0};
+            std::atomic<std::uint64_t> stores_{0};
+        };
+
+    } // end namespace http
+} // end namespace pstore
+
+#endif // CLIENT_RESPONSE_CACHE_HPP
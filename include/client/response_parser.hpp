@@ -0,0 +1,114 @@
+#ifndef CLIENT_RESPONSE_PARSER_HPP
+#define CLIENT_RESPONSE_PARSER_HPP
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <string_view>
+
+#include "pstore/adt/error_or.hpp"
+#include "pstore/support/gsl.hpp"
+
+#include "client/client.hpp"
+#include "client/header_block.hpp"
+#include "client/header_field.hpp"
+
+namespace pstore {
+    namespace http {
+
+        // response parser
+        // ~~~~~~~~~~~~~~~
+        /// A resumable HTTP/1.x response parser. Unlike read_status_line(), read_headers() and
+        /// read_reply(), which pull data through a buffered_reader and block until it arrives,
+        /// the parser is pushed whatever bytes happen to be available and records its progress
+        /// so that a short read simply leaves it waiting for more.
+        ///
+        /// Body bytes are passed to the body handler as they are parsed; they are not retained.
+        /// A chunked body is decoded: the handler sees only the chunk data.
+        class response_parser {
+        public:
+            using body_handler = std::function<void (gsl::span<char const>)>;
+
+            /// The maximum number of bytes permitted in the status line and headers.
+            static constexpr std::size_t max_head_size = 64 * 1024;
+
+            response_parser () = default;
+            explicit response_parser (body_handler body)
+                    : body_{std::move (body)} {}
+
+            /// Parses as much of [first, last) as possible.
+            /// \returns The number of bytes consumed. This is less than last - first only once
+            ///   the response is complete: any remaining bytes belong to whatever follows it.
+            error_or<std::size_t> parse (char const * first, char const * last);
+
+            /// Tells the parser that the peer has closed the connection. A response whose body
+            /// is delimited by the connection close is completed by this call; for any other
+            /// incomplete response it is an error.
+            std::error_code eof ();
+
+            /// True once the status line and all of the headers have been parsed.
+            bool head_complete () const noexcept { return state_ > state::headers; }
+            /// True once the entire response has been parsed.
+            bool complete () const noexcept { return state_ == state::done; }
+
+            std::string const & http_version () const noexcept { return http_version_; }
+            http_status_code status_code () const noexcept { return status_code_; }
+            std::string const & reason_phrase () const noexcept { return reason_phrase_; }
+            /// The response headers.
+            header_block const & headers () const noexcept { return headers_; }
+            /// The trailer fields which followed a chunked body.
+            header_block const & trailers () const noexcept { return trailers_; }
+
+            /// Prepares the parser for the next response on the same connection.
+            void reset ();
+
+        private:
+            enum class state {
+                status_line,
+                headers,
+                body,
+                body_to_eof,
+                chunk_size,  ///< Expecting a chunk-size line.
+                chunk_data,  ///< Within the data of a chunk.
+                chunk_end,   ///< Expecting the CRLF which follows a chunk's data.
+                trailers,    ///< Within the trailer section.
+                done
+            };
+
+            /// True if the parser is in a state in which input is processed line by line.
+            bool line_state () const noexcept {
+                return state_ != state::body && state_ != state::body_to_eof &&
+                       state_ != state::chunk_data;
+            }
+
+            error_or<std::size_t> parse_line (char const * first, char const * last);
+            std::error_code end_of_line (std::string_view line);
+            std::error_code end_of_chunk_line (std::string_view line);
+            void add_header (header_field const & field) {
+                headers_.add (field.name, field.value);
+            }
+            std::error_code end_of_headers ();
+            std::size_t parse_body (char const * first, char const * last);
+
+            state state_ = state::status_line;
+            /// A partial line carried over from an earlier call to parse().
+            std::string line_;
+            /// The number of bytes in the head or, once the head is complete, in the current
+            /// chunk-size line or trailer section.
+            std::size_t head_size_ = 0;
+            /// The number of body (or current chunk) bytes still to come.
+            std::size_t remaining_ = 0;
+
+            std::string http_version_;
+            http_status_code status_code_ = http_status_code::ok;
+            std::string reason_phrase_;
+            header_block headers_;
+            header_block trailers_;
+
+            body_handler body_;
+        };
+
+    } // end namespace http
+} // end namespace pstore
+
+#endif // CLIENT_RESPONSE_PARSER_HPP
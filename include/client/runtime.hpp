@@ -0,0 +1,126 @@
+#ifndef CLIENT_RUNTIME_HPP
+#define CLIENT_RUNTIME_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "pstore/adt/error_or.hpp"
+
+#include "client/resolver.hpp"
+#include "client/response_parser.hpp"
+
+namespace pstore {
+    namespace http {
+
+        // runtime
+        // ~~~~~~~
+        /// A thread-per-core client. Each worker thread is pinned to a CPU and runs its own
+        /// uring_loop (or, where io_uring is unavailable, an event_loop). A loop's connections
+        /// belong to its worker alone, so no socket is ever shared between threads: each worker
+        /// keeps its own pool of keep-alive connections.
+        ///
+        /// Requests are passed to the workers through bounded lock-free queues, one per worker.
+        /// A request submitted by a worker's own thread (from a completion handler, say) goes to
+        /// that worker's queue; others are spread round-robin. A worker with spare capacity and
+        /// nothing queued of its own steals from the worker whose queue is longest, once that
+        /// queue has backed up beyond options::steal_threshold.
+        ///
+        /// submit() and wait() may be called from any thread. Handlers are called on the worker
+        /// thread which made the request.
+        class runtime {
+        public:
+            using completion_handler =
+                std::function<void (std::error_code, response_parser const & response)>;
+            using body_handler = response_parser::body_handler;
+
+            struct options {
+                /// The number of worker threads. 0 means one for each CPU on which the process
+                /// may run.
+                unsigned threads = 0;
+                /// Pin each worker to its own CPU.
+                bool pin = true;
+                /// The capacity of each worker's queue. Must be a power of two.
+                std::size_t queue_capacity = 1024;
+                /// The maximum number of requests that a worker has in flight at once.
+                std::size_t max_in_flight = 64;
+                /// A worker steals only from a queue holding more than this many requests.
+                std::size_t steal_threshold = 8;
+            };
+
+            /// Starts the workers.
+            /// \param r  The resolver shared by the workers. If null, the runtime creates one.
+            static error_or<std::unique_ptr<runtime>>
+            create (options const & opts, std::shared_ptr<resolver> r = nullptr);
+
+            runtime (runtime const &) = delete;
+            runtime (runtime &&) = delete;
+            /// Waits for the requests that have been submitted to complete, then stops the
+            /// workers.
+            ~runtime () noexcept;
+
+            runtime & operator= (runtime const &) = delete;
+            runtime & operator= (runtime &&) = delete;
+
+            /// Queues a GET request for \p path from \p host:\p port.
+            /// \returns An error if every worker's queue is full, in which case \p done is not
+            ///   called. Any later failure is reported to \p done.
+            std::error_code submit (std::string host, std::string port, std::string path,
+                                    completion_handler done, body_handler body = nullptr);
+
+            /// Blocks until every request submitted so far has completed. Must not be called
+            /// from a handler.
+            void wait ();
+
+            /// The number of worker threads.
+            std::size_t threads () const noexcept { return workers_.size (); }
+            /// The index of the worker on whose thread the caller is running or threads() if
+            /// the caller is not one of this runtime's workers.
+            std::size_t current_worker () const noexcept;
+            /// The number of requests that workers have taken from another's queue.
+            std::uint64_t stolen () const noexcept;
+
+        private:
+            struct job;
+            class core_loop;
+            struct worker;
+
+            runtime (options const & opts, std::shared_ptr<resolver> && r);
+
+            void run_worker (worker & w, int cpu);
+            /// Takes a request from the longest queue other than that of \p w if it has backed
+            /// up.
+            bool steal (worker & w, job & j);
+            void start (worker & w, job && j);
+            /// Called as each request completes.
+            void finished ();
+            /// Wakes \p w if it is waiting for work.
+            static void notify (worker & w);
+
+            options const opts_;
+            std::shared_ptr<resolver> resolver_;
+            std::vector<std::unique_ptr<worker>> workers_;
+            /// Chooses the worker for a request submitted from outside the runtime.
+            std::atomic<std::size_t> next_{0};
+            /// The number of requests submitted but not yet completed.
+            std::atomic<std::size_t> outstanding_{0};
+            std::atomic<bool> stop_{false};
+            std::mutex mutex_;
+            /// Signalled when outstanding_ falls to zero.
+            std::condition_variable idle_;
+
+            /// The worker whose thread this is, if any.
+            static thread_local worker * current_;
+        };
+
+    } // end namespace http
+} // end namespace pstore
+
+#endif // CLIENT_RUNTIME_HPP
@@ -0,0 +1,22 @@
+#ifndef CLIENT_SCAN_HPP
+#define CLIENT_SCAN_HPP
+
+namespace pstore {
+    namespace http {
+
+        // find byte
+        // ~~~~~~~~~
+        /// Returns a pointer to the first occurrence of \p c in [first, last) or last if there is
+        /// none. This is memchr(), which the C library already vectorizes.
+        char const * find_byte (char const * first, char const * last, char c) noexcept;
+
+        // find either
+        // ~~~~~~~~~~~
+        /// Returns a pointer to the first occurrence of either \p a or \p b in [first, last) or
+        /// last if there is neither. Uses AVX2 or SSE2 where the host supports them.
+        char const * find_either (char const * first, char const * last, char a, char b) noexcept;
+
+    } // end namespace http
+} // end namespace pstore
+
+#endif // CLIENT_SCAN_HPP
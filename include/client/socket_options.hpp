@@ -0,0 +1,116 @@
+#ifndef CLIENT_SOCKET_OPTIONS_HPP
+#define CLIENT_SOCKET_OPTIONS_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <system_error>
+#include <vector>
+
+#include "pstore/os/descriptor.hpp"
+#include "pstore/support/gsl.hpp"
+
+namespace pstore {
+    namespace http {
+
+        // socket options
+        // ~~~~~~~~~~~~~~
+        /// Tuning for a client's TCP sockets, applied by configure_socket() before the
+        /// connection is made.
+        struct socket_options {
+            /// Disables Nagle's algorithm (TCP_NODELAY) so that a small request is sent at once
+            /// rather than held back until earlier data has been acknowledged.
+            bool no_delay = true;
+            /// Acknowledges received data at once rather than delaying ACKs (TCP_QUICKACK).
+            /// Linux may return to delayed acknowledgements later in the connection's life.
+            bool quick_ack = false;
+            /// Uses TCP Fast Open (TCP_FASTOPEN_CONNECT). Once the server has issued a cookie,
+            /// connect() returns at once and the first data written (normally the request)
+            /// travels in the SYN, saving a round trip. Without a cookie, the connection is made
+            /// as usual.
+            bool fast_open = false;
+            /// The sizes of the socket's receive and send buffers (SO_RCVBUF and SO_SNDBUF) in
+            /// bytes. 0 leaves the kernel's automatic sizing in place.
+            int receive_buffer = 0;
+            int send_buffer = 0;
+            /// Allows zero_copy_sender to send large writes with MSG_ZEROCOPY (SO_ZEROCOPY).
+            bool zero_copy = false;
+            /// Limits on each blocking receive and send on the socket (SO_RCVTIMEO and
+            /// SO_SNDTIMEO). One which waits longer fails with std::errc::timed_out. Zero waits
+            /// indefinitely. A non-blocking socket is unaffected.
+            std::chrono::milliseconds receive_timeout{0};
+            std::chrono::milliseconds send_timeout{0};
+        };
+
+        // configure socket
+        // ~~~~~~~~~~~~~~~~
+        /// Applies \p opts to \p fd, which must not yet be connected. Fast Open, quick
+        /// acknowledgement and zero-copy are quietly left off if the kernel doesn't support
+        /// them.
+        std::error_code configure_socket (socket_descriptor const & fd,
+                                          socket_options const & opts);
+
+        // send all
+        // ~~~~~~~~
+        /// Writes the whole of \p data to \p fd, retrying after partial writes. The data is
+        /// copied, so it may be reused as soon as the function returns.
+        std::error_code send_all (socket_descriptor const & fd, gsl::span<char const> data);
+
+        // zero copy sender
+        // ~~~~~~~~~~~~~~~~
+        /// Writes are sent with MSG_ZEROCOPY only if they are at least this large: below about
+        /// 10KB, handling the completion costs more than copying the data.
+        constexpr std::size_t zero_copy_threshold = 16 * 1024;
+
+        /// Sends large writes on one socket with MSG_ZEROCOPY without waiting for the kernel to
+        /// finish with them. The kernel reports that it has finished with a send, on the
+        /// socket's error queue, only once the peer has acknowledged the data, so each write's
+        /// owner is held until then. The reports are read, without blocking, before each send
+        /// and by reap().
+        ///
+        /// Writes smaller than zero_copy_threshold, and every write if zero-copy isn't enabled
+        /// for the socket, are copied as send_all() does. If the socket reaches its limit of
+        /// pinned pages, the rest of the write is copied too.
+        class zero_copy_sender {
+        public:
+            /// \param fd  The socket, which must outlive the sender.
+            explicit zero_copy_sender (socket_descriptor const & fd);
+
+            /// Writes the whole of \p data to the socket. \p data must stay unchanged until
+            /// the kernel has finished with it. \p owner, which is released at that point,
+            /// can ensure this; it may be null if \p data outlives the sender anyway.
+            std::error_code send (gsl::span<char const> data, std::shared_ptr<void const> owner);
+            /// Reads the reports that have arrived and releases the owners of the writes that
+            /// the kernel has finished with.
+            std::error_code reap ();
+
+            /// The number of writes that the kernel hasn't yet finished with.
+            std::size_t pending () const noexcept { return pending_.size (); }
+
+        private:
+            struct pending_send {
+                /// The sequence number of the write's first zero-copy send.
+                std::uint32_t first;
+                /// The number of zero-copy sends that the write took.
+                std::uint32_t sends;
+                /// The number of those sends that the kernel hasn't yet reported.
+                std::uint32_t outstanding;
+                std::shared_ptr<void const> owner;
+            };
+
+            /// Counts down the sends numbered [lo, hi] and releases the writes which have no
+            /// more.
+            void completed (std::uint32_t lo, std::uint32_t hi);
+
+            socket_descriptor const & fd_;
+            bool const enabled_;
+            /// The sequence number that the kernel will give the socket's next zero-copy send.
+            std::uint32_t next_ = 0;
+            std::vector<pending_send> pending_;
+        };
+
+    } // end namespace http
+} // end namespace pstore
+
+#endif // CLIENT_SOCKET_OPTIONS_HPP
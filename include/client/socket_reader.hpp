@@ -0,0 +1,244 @@
+#ifndef CLIENT_SOCKET_READER_HPP
+#define CLIENT_SOCKET_READER_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+
+#include "pstore/adt/error_or.hpp"
+#include "pstore/adt/maybe.hpp"
+#include "pstore/os/descriptor.hpp"
+#include "pstore/support/gsl.hpp"
+
+#include "client/body_sink.hpp"
+#include "client/scan.hpp"
+
+namespace pstore {
+    namespace http {
+
+        // socket reader
+        // ~~~~~~~~~~~~~
+        /// A buffered reader for responses arriving on a socket. It offers the parts of
+        /// pstore's buffered_reader<> interface used by the response readers (gets() and
+        /// get_span()) and so works with read_status_line(), read_headers() and the body
+        /// readers. Unlike buffered_reader<>, it exposes its buffer: the body readers lend
+        /// buffered data to a sink in place with buffered() and consume(), and once the buffer
+        /// is empty they let a sink which can do better (an fd_sink's splice(), say) take the
+        /// rest of the body straight from the socket.
+        ///
+        /// \tparam Refiller  A function with the signature of pstore::http::net::refiller()
+        ///   which reads from the socket into a span of bytes.
+        /// \tparam State  The state passed to the refiller. A source other than a socket is
+        ///   useful only in tests and benchmarks.
+        template <typename Refiller, typename State = socket_descriptor &>
+        class socket_reader {
+        public:
+            using state_type = State;
+
+            /// The longest line that gets() accepts.
+            static constexpr std::size_t max_line_length = 64 * 1024;
+
+            explicit socket_reader (Refiller refill, std::size_t size = response_buffer_size)
+                    : refill_ (std::move (refill))
+                    , size_{std::max (size, std::size_t{1})}
+                    , buffer_{new std::uint8_t[size_]} {}
+
+            /// Reads a line, removing its CR LF (or LF). At the end of the stream the result is
+            /// nothing; a final line without a terminator is returned as it stands.
+            error_or_n<state_type, maybe<std::string>> gets (state_type fd);
+
+            /// As gets(), but the line is returned as a view of the buffer rather than copied.
+            /// The view is valid until the reader is next used. The line must fit in the
+            /// buffer: a longer one fails with std::errc::message_size.
+            error_or_n<state_type, maybe<std::string_view>> get_line (state_type fd);
+
+            /// Copies at most sp.size() bytes into \p sp, reading from the socket only if
+            /// nothing is buffered.
+            /// \returns The part of \p sp which was filled: empty at the end of the stream.
+            template <typename SpanType>
+            error_or_n<state_type, SpanType> get_span (state_type fd, SpanType sp);
+
+            /// The number of bytes which have been received but not yet consumed.
+            std::size_t available () const noexcept { return end_ - pos_; }
+            /// The bytes which have been received but not yet consumed.
+            gsl::span<char const> buffered () const noexcept {
+                return {reinterpret_cast<char const *> (buffer_.get ()) + pos_,
+                        static_cast<std::ptrdiff_t> (end_ - pos_)};
+            }
+            /// Discards the first \p n bytes of buffered().
+            void consume (std::size_t const n) noexcept {
+                pos_ += std::min (n, this->available ());
+            }
+            /// Reads from the socket into the buffer, which must be empty. If the socket's
+            /// receive timeout expires, fails with std::errc::timed_out.
+            /// \returns The number of bytes read: 0 at the end of the stream.
+            error_or<std::size_t> fill (state_type fd);
+
+        private:
+            /// Reads from the socket into the buffer after end_.
+            error_or<std::size_t> append (state_type fd);
+
+            Refiller refill_;
+            std::size_t const size_;
+            std::unique_ptr<std::uint8_t[]> buffer_;
+            /// The buffered bytes are [pos_, end_).
+            std::size_t pos_ = 0;
+            std::size_t end_ = 0;
+        };
+
+        template <typename Refiller, typename State = socket_descriptor &>
+        socket_reader<Refiller, State>
+        make_socket_reader (Refiller refill, std::size_t size = response_buffer_size) {
+            return socket_reader<Refiller, State> (std::move (refill), size);
+        }
+
+        // fill
+        // ~~~~
+        template <typename Refiller, typename State>
+        error_or<std::size_t> socket_reader<Refiller, State>::fill (state_type fd) {
+            pos_ = end_ = 0;
+            return this->append (fd);
+        }
+
+        // append
+        // ~~~~~~
+        template <typename Refiller, typename State>
+        error_or<std::size_t> socket_reader<Refiller, State>::append (state_type fd) {
+            using return_type = error_or<std::size_t>;
+            gsl::span<std::uint8_t> const rest{buffer_.get () + end_,
+                                               static_cast<std::ptrdiff_t> (size_ - end_)};
+            auto const r = refill_ (fd, rest);
+            if (!r) {
+                std::error_code const erc = r.get_error ();
+                // A blocking socket reports that its receive timeout (SO_RCVTIMEO) has expired
+                // as EAGAIN.
+                if (erc == std::errc::resource_unavailable_try_again ||
+                    erc == std::errc::operation_would_block) {
+                    return return_type{std::make_error_code (std::errc::timed_out)};
+                }
+                return return_type{erc};
+            }
+            auto const got = static_cast<std::size_t> (std::get<1> (*r) - rest.begin ());
+            end_ += got;
+            return return_type{got};
+        }
+
+        // gets
+        // ~~~~
+        template <typename Refiller, typename State>
+        auto socket_reader<Refiller, State>::gets (state_type fd)
+            -> error_or_n<state_type, maybe<std::string>> {
+            using return_type = error_or_n<state_type, maybe<std::string>>;
+            std::string line;
+            bool any = false;
+            for (;;) {
+                if (pos_ == end_) {
+                    error_or<std::size_t> const got = this->fill (fd);
+                    if (!got) {
+                        return return_type{got.get_error ()};
+                    }
+                    if (*got == 0U) {
+                        if (!any) {
+                            return return_type{std::in_place, fd, maybe<std::string>{}};
+                        }
+                        break;
+                    }
+                }
+                any = true;
+                auto const * const first = reinterpret_cast<char const *> (buffer_.get ());
+                char const * const lf = find_byte (first + pos_, first + end_, '\n');
+                line.append (first + pos_, lf);
+                if (line.length () > max_line_length) {
+                    return return_type{std::make_error_code (std::errc::message_size)};
+                }
+                if (lf != first + end_) {
+                    pos_ = static_cast<std::size_t> (lf - first) + 1U;
+                    break;
+                }
+                pos_ = end_;
+            }
+            if (!line.empty () && line.back () == '\r') {
+                line.pop_back ();
+            }
+            return return_type{std::in_place, fd, maybe<std::string>{std::move (line)}};
+        }
+
+        // get line
+        // ~~~~~~~~
+        template <typename Refiller, typename State>
+        auto socket_reader<Refiller, State>::get_line (state_type fd)
+            -> error_or_n<state_type, maybe<std::string_view>> {
+            using return_type = error_or_n<state_type, maybe<std::string_view>>;
+            auto const * const first = reinterpret_cast<char const *> (buffer_.get ());
+            // The part of the buffer already searched for the LF.
+            std::size_t scanned = pos_;
+            for (;;) {
+                char const * const lf = find_byte (first + scanned, first + end_, '\n');
+                if (lf != first + end_) {
+                    std::string_view line{first + pos_,
+                                          static_cast<std::size_t> (lf - (first + pos_))};
+                    pos_ = static_cast<std::size_t> (lf - first) + 1U;
+                    if (!line.empty () && line.back () == '\r') {
+                        line.remove_suffix (1);
+                    }
+                    return return_type{std::in_place, fd, maybe<std::string_view>{line}};
+                }
+                if (pos_ == 0U && end_ == size_) {
+                    return return_type{std::make_error_code (std::errc::message_size)};
+                }
+                // Move the start of the line to the front of the buffer and read more after it.
+                std::memmove (buffer_.get (), buffer_.get () + pos_, end_ - pos_);
+                end_ -= pos_;
+                pos_ = 0;
+                scanned = end_;
+                error_or<std::size_t> const got = this->append (fd);
+                if (!got) {
+                    return return_type{got.get_error ()};
+                }
+                if (*got == 0U) {
+                    if (end_ == 0U) {
+                        return return_type{std::in_place, fd, maybe<std::string_view>{}};
+                    }
+                    // A final line without a terminator.
+                    std::string_view line{first, end_};
+                    pos_ = end_;
+                    if (line.back () == '\r') {
+                        line.remove_suffix (1);
+                    }
+                    return return_type{std::in_place, fd, maybe<std::string_view>{line}};
+                }
+            }
+        }
+
+        // get span
+        // ~~~~~~~~
+        template <typename Refiller, typename State>
+        template <typename SpanType>
+        auto socket_reader<Refiller, State>::get_span (state_type fd, SpanType sp)
+            -> error_or_n<state_type, SpanType> {
+            using return_type = error_or_n<state_type, SpanType>;
+            if (pos_ == end_) {
+                error_or<std::size_t> const got = this->fill (fd);
+                if (!got) {
+                    return return_type{got.get_error ()};
+                }
+            }
+            auto const n = std::min (static_cast<std::size_t> (sp.size_bytes ()),
+                                     this->available ()) /
+                           sizeof (typename SpanType::element_type);
+            std::memcpy (sp.data (), buffer_.get () + pos_,
+                         n * sizeof (typename SpanType::element_type));
+            pos_ += n * sizeof (typename SpanType::element_type);
+            return return_type{std::in_place, fd, sp.first (static_cast<std::ptrdiff_t> (n))};
+        }
+
+    } // end namespace http
+} // end namespace pstore
+
+#endif // CLIENT_SOCKET_READER_HPP
@@ -0,0 +1,102 @@
+#ifndef CLIENT_TIMER_WHEEL_HPP
+#define CLIENT_TIMER_WHEEL_HPP
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "pstore/adt/maybe.hpp"
+
+namespace pstore {
+    namespace http {
+
+        // timer wheel
+        // ~~~~~~~~~~~
+        /// A hierarchical timing wheel (Varghese and Lauck). Timers are kept in four levels of
+        /// 64 slots: level 0 has a slot for each of the next 64 ticks, level 1 for each of the
+        /// next 64 groups of 64 ticks and so on. As time passes, the timers in a higher level's
+        /// slot are moved down to the level below. Scheduling and cancelling a timer take
+        /// constant time whatever the number of timers, which suits deadlines which are set on
+        /// every request and almost always cancelled before they expire.
+        ///
+        /// Timers never fire early: a deadline is rounded up to the next tick. The wheel is not
+        /// thread-safe.
+        class timer_wheel {
+        public:
+            using clock = std::chrono::steady_clock;
+            using callback = std::function<void ()>;
+            /// Identifies a scheduled timer. 0 is never a valid handle.
+            using handle = std::uint64_t;
+
+            explicit timer_wheel (clock::time_point now = clock::now (),
+                                  clock::duration tick = std::chrono::milliseconds{1});
+
+            /// Arranges for \p cb to be called by the first call to advance() at or after
+            /// \p when. A timer whose time has already been passed to advance() fires on the
+            /// next tick.
+            handle schedule (clock::time_point when, callback cb);
+            /// Cancels a timer. It is harmless to cancel a timer which has already fired or been
+            /// cancelled, or handle 0.
+            /// \returns True if the timer was pending.
+            bool cancel (handle h) noexcept;
+
+            /// Calls the callbacks of all of the timers which are due at \p now. A callback may
+            /// schedule and cancel timers.
+            /// \returns The number of timers which fired.
+            std::size_t advance (clock::time_point now);
+
+            /// A time at or before which advance() should next be called. It may be earlier
+            /// than the next timer's deadline but is never later. Nothing if no timer is
+            /// pending.
+            maybe<clock::time_point> next_expiry () const noexcept;
+
+            /// The number of pending timers.
+            std::size_t size () const noexcept { return size_; }
+            bool empty () const noexcept { return size_ == 0U; }
+
+        private:
+            static constexpr unsigned levels = 4;
+            static constexpr unsigned slot_bits = 6;
+            static constexpr unsigned slots = 1U << slot_bits;
+            static constexpr std::uint64_t slot_mask = slots - 1U;
+            static constexpr std::uint32_t npos = ~std::uint32_t{0};
+
+            struct node {
+                std::uint64_t expiry = 0;
+                callback cb;
+                std::uint32_t prev = npos;
+                std::uint32_t next = npos;
+                /// Incremented each time the node is reused so that stale handles are ignored.
+                std::uint32_t generation = 0;
+                /// The level and slot whose list holds the node or npos if the node is free.
+                std::uint32_t level = npos;
+                std::uint32_t slot = 0;
+            };
+
+            std::uint64_t to_tick (clock::time_point t, bool round_up) const noexcept;
+            void place (std::uint32_t index);
+            void unlink (std::uint32_t index) noexcept;
+            void release (std::uint32_t index) noexcept;
+            /// Moves the timers in the higher levels' current slots down a level.
+            void cascade ();
+            std::size_t expire (std::uint32_t slot);
+
+            clock::time_point start_;
+            clock::duration tick_;
+            /// The last tick processed by advance().
+            std::uint64_t current_ = 0;
+            std::vector<node> nodes_;
+            std::vector<std::uint32_t> free_;
+            std::array<std::array<std::uint32_t, slots>, levels> heads_;
+            /// For each level, a bit for each slot which is not empty.
+            std::array<std::uint64_t, levels> occupied_{};
+            std::size_t size_ = 0;
+        };
+
+    } // end namespace http
+} // end namespace pstore
+
+#endif // CLIENT_TIMER_WHEEL_HPP
@@ -0,0 +1,207 @@
+#ifndef CLIENT_TRACE_HPP
+#define CLIENT_TRACE_HPP
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <system_error>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "pstore/adt/error_or.hpp"
+#include "pstore/os/descriptor.hpp"
+#include "pstore/support/gsl.hpp"
+
+#include "client/body_sink.hpp"
+
+namespace pstore {
+    namespace http {
+
+        /// The phases of a request, in the order in which they happen.
+        enum class phase : unsigned {
+            resolve,     ///< get_host_info()
+            connect,     ///< establish_connection()
+            send,        ///< Writing the request.
+            status_line, ///< Waiting for and reading the status line.
+            headers,     ///< Reading the header fields.
+            body,        ///< Reading the message body.
+        };
+        constexpr std::size_t phase_count = static_cast<std::size_t> (phase::body) + 1U;
+
+        char const * phase_name (phase p) noexcept;
+
+        // request trace
+        // ~~~~~~~~~~~~~
+        /// Everything recorded about a single request.
+        struct request_trace {
+            using clock = std::chrono::steady_clock;
+
+            /// When each phase began and ended. A phase which never started has a default
+            /// constructed (epoch) begin time.
+            std::array<clock::time_point, phase_count> begin{};
+            std::array<clock::time_point, phase_count> end{};
+
+            std::uint64_t bytes_sent = 0;
+            std::uint64_t bytes_received = 0;
+            /// The number of send system calls.
+            std::uint64_t sends = 0;
+            /// The number of refiller calls, each of which is one receive system call.
+            std::uint64_t refills = 0;
+
+            /// Set if the request failed.
+            std::error_code error;
+
+            bool started (phase const p) const noexcept {
+                return begin[static_cast<std::size_t> (p)] != clock::time_point{};
+            }
+            clock::duration duration (phase const p) const noexcept {
+                auto const index = static_cast<std::size_t> (p);
+                return started (p) ? end[index] - begin[index] : clock::duration{0};
+            }
+        };
+
+        // counters registry
+        // ~~~~~~~~~~~~~~~~~
+        /// Totals aggregated across any number of requests and threads. Updates are relaxed
+        /// atomic additions; snapshot() is not atomic across counters.
+        class counters_registry {
+        public:
+            struct counters {
+                std::uint64_t requests = 0;
+                std::uint64_t errors = 0;
+                std::uint64_t bytes_sent = 0;
+                std::uint64_t bytes_received = 0;
+                std::uint64_t sends = 0;
+                std::uint64_t refills = 0;
+                /// The total time spent in each phase.
+                std::array<std::chrono::nanoseconds, phase_count> time{};
+            };
+
+            void add (request_trace const & trace) noexcept;
+            counters snapshot () const noexcept;
+            void reset () noexcept;
+
+        private:
+            std::atomic<std::uint64_t> requests_{0};
+            std::atomic<std::uint64_t> errors_{0};
+            std::atomic<std::uint64_t> bytes_sent_{0};
+            std::atomic<std::uint64_t> bytes_received_{0};
+            std::atomic<std::uint64_t> sends_{0};
+            std::atomic<std::uint64_t> refills_{0};
+            std::array<std::atomic<std::int64_t>, phase_count> time_{};
+        };
+
+        // null tracer
+        // ~~~~~~~~~~~
+        /// The tracer policy used when no tracing is wanted. Every member is an empty inline
+        /// function so instrumented code compiles to exactly what it would be without the
+        /// instrumentation.
+        ///
+        /// A tracer policy provides begin(phase), end(phase), sent(bytes), received(bytes) and
+        /// finish(error). sent() and received() are called once per system call.
+        struct null_tracer {
+            /// Lets callers skip work done only for the tracer's benefit with if constexpr.
+            static constexpr bool enabled = false;
+
+            void begin (phase) noexcept {}
+            void end (phase) noexcept {}
+            void sent (std::size_t) noexcept {}
+            void received (std::size_t) noexcept {}
+            void finish (std::error_code) noexcept {}
+        };
+
+        // tracer
+        // ~~~~~~
+        /// Records a request_trace for each request. When the request finishes, the trace is
+        /// added to the registry (if there is one) and passed to the sink (if there is one),
+        /// then cleared ready for the next request. A tracer must not be shared between
+        /// threads; a registry may be.
+        class tracer {
+        public:
+            static constexpr bool enabled = true;
+            using sink = std::function<void (request_trace const &)>;
+
+            explicit tracer (sink s, counters_registry * registry = nullptr)
+                    : sink_{std::move (s)}
+                    , registry_{registry} {}
+            explicit tracer (counters_registry * registry)
+                    : registry_{registry} {}
+
+            void begin (phase const p) noexcept {
+                trace_.begin[static_cast<std::size_t> (p)] = request_trace::clock::now ();
+            }
+            void end (phase const p) noexcept {
+                trace_.end[static_cast<std::size_t> (p)] = request_trace::clock::now ();
+            }
+            void sent (std::size_t const bytes) noexcept {
+                trace_.bytes_sent += bytes;
+                ++trace_.sends;
+            }
+            void received (std::size_t const bytes) noexcept {
+                trace_.bytes_received += bytes;
+                ++trace_.refills;
+            }
+            void finish (std::error_code erc);
+
+            request_trace const & current () const noexcept { return trace_; }
+
+        private:
+            sink sink_;
+            counters_registry * registry_;
+            request_trace trace_;
+        };
+
+        // traced refiller
+        // ~~~~~~~~~~~~~~~
+        /// Wraps a buffered_reader refill function so that each call is reported to \p t.
+        template <typename Tracer, typename Refiller>
+        auto traced_refiller (Tracer & t, Refiller refill) {
+            return [&t, refill] (auto && io, gsl::span<std::uint8_t> const & s) {
+                auto result = refill (std::forward<decltype (io)> (io), s);
+                if (result) {
+                    t.received (static_cast<std::size_t> (std::get<1> (*result) - s.begin ()));
+                }
+                return result;
+            };
+        }
+
+        // traced sink
+        // ~~~~~~~~~~~
+        /// Wraps a body sink so that the data which its transfer() member (if it has one) takes
+        /// directly from the socket is reported to \p t as a receive system call. Data that
+        /// passes through the reader's buffer is reported by traced_refiller().
+        template <typename Sink, typename Tracer>
+        class traced_sink {
+        public:
+            traced_sink (Sink & sink, Tracer & t) noexcept
+                    : sink_{sink}
+                    , t_{t} {}
+
+            void expect (std::size_t const n) { sink_.expect (n); }
+            gsl::span<char> prepare (std::size_t const n) { return sink_.prepare (n); }
+            std::error_code commit (gsl::span<char const> const data) {
+                return sink_.commit (data);
+            }
+            template <typename S = Sink,
+                      typename = std::enable_if_t<details::has_transfer<S>::value>>
+            error_or<std::size_t> transfer (socket_descriptor const & fd, std::size_t const n) {
+                error_or<std::size_t> result = sink_.transfer (fd, n);
+                if (result) {
+                    t_.received (*result);
+                }
+                return result;
+            }
+
+        private:
+            Sink & sink_;
+            Tracer & t_;
+        };
+
+    } // end namespace http
+} // end namespace pstore
+
+#endif // CLIENT_TRACE_HPP
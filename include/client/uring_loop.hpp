@@ -0,0 +1,263 @@
+#ifndef CLIENT_URING_LOOP_HPP
+#define CLIENT_URING_LOOP_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <system_error>
+#include <unordered_map>
+#include <vector>
+
+#include "pstore/adt/error_or.hpp"
+
+#include "client/request_builder.hpp"
+#include "client/resolver.hpp"
+#include "client/response_parser.hpp"
+#include "client/socket_options.hpp"
+#include "client/timer_wheel.hpp"
+#include "client/trace.hpp"
+
+namespace pstore {
+    namespace http {
+
+        // uring loop
+        // ~~~~~~~~~~
+        /// A completion-based counterpart to event_loop which performs its network I/O through a
+        /// Linux io_uring. Connects, sends and receives for every connection are queued in the
+        /// ring's submission queue and handed to the kernel together by a single io_uring_enter()
+        /// call in each run_once(), so the number of system calls no longer grows with the
+        /// number of operations.
+        ///
+        /// Each socket occupies a slot in the ring's fixed-file table. Data is received into a
+        /// ring of buffers registered with the kernel (a provided-buffer ring) and, where the
+        /// kernel supports it, by a single multishot receive per connection which stays armed
+        /// for as long as the connection is open. Connections are kept alive and reused for
+        /// later requests to the same host:port. Idle connections are closed once they have
+        /// been idle for options::idle_timeout and, least recently used first, whenever their
+        /// slots are needed for new connections.
+        ///
+        /// A request may be given deadlines for each of its phases and for the whole exchange.
+        /// It may also be hedged: if no response has started to arrive after a delay derived
+        /// from the recent response times of the same host:port, the request is sent again on
+        /// a second connection. Whichever connection receives a response first is used and the
+        /// other is closed.
+        ///
+        /// io_uring may be missing from the kernel or disabled by policy. supported() tells
+        /// whether the loop can be created; if not, use event_loop or the blocking functions
+        /// in client.hpp instead.
+        ///
+        /// The loop is not thread-safe. Handlers are called from run_once() on the thread that
+        /// calls it and may start further requests.
+        class uring_loop {
+        public:
+            /// Called once the response has been completely received or the request has failed.
+            /// On success, the parser holds the response's status line and headers.
+            using completion_handler =
+                std::function<void (std::error_code, response_parser const & response)>;
+            using body_handler = response_parser::body_handler;
+
+            struct options {
+                /// The number of submission queue entries.
+                unsigned entries = 256;
+                /// The maximum number of connections open at once.
+                unsigned max_connections = 256;
+                /// The maximum number of idle connections kept for each host:port.
+                std::size_t max_idle_per_host = 8;
+                /// Idle connections are closed after this long. Zero keeps them until the peer
+                /// closes them or their slots are needed.
+                std::chrono::milliseconds idle_timeout{30000};
+                /// The number of receive buffers. Must be a power of two no greater than 32768.
+                unsigned buffers = 256;
+                /// The size of each receive buffer.
+                std::size_t buffer_size = 16 * 1024;
+                /// Applied to each socket before it connects. With fast_open, a request's first
+                /// send carries it in the SYN.
+                socket_options socket;
+            };
+
+            /// Limits on a request's duration and its hedging policy. A zero duration is no
+            /// limit. A request which exceeds a limit fails with std::errc::timed_out.
+            struct request_options {
+                /// The host name lookup.
+                std::chrono::milliseconds resolve{0};
+                /// Establishing a connection, including trying each of the host's addresses.
+                std::chrono::milliseconds connect{0};
+                /// From the connection being established (or reused) to the first byte of the
+                /// response.
+                std::chrono::milliseconds first_byte{0};
+                /// From the first byte of the response to the last.
+                std::chrono::milliseconds body{0};
+                /// The whole request.
+                std::chrono::milliseconds total{0};
+
+                /// Send a second copy of the request if there is no response after a delay.
+                /// Applies only to idempotent methods.
+                bool hedge = false;
+                /// The percentile of the host's recent times to first byte after which the
+                /// second copy is sent.
+                double hedge_percentile = 0.95;
+                /// The delay used until enough times to first byte have been recorded.
+                std::chrono::milliseconds hedge_delay{50};
+
+                /// If not null, receives the times of the connect (for a new connection),
+                /// send, status_line and body phases of the attempt which answers the request.
+                /// status_line ends when the first byte of the response arrives. The trace must
+                /// outlive the request.
+                request_trace * trace = nullptr;
+            };
+
+            /// Returns true if the kernel provides the io_uring features that the loop needs.
+            static bool supported () noexcept;
+
+            /// Creates a loop.
+            /// \param r  The resolver used to look up host names. If null, the loop creates its
+            ///   own.
+            static error_or<std::unique_ptr<uring_loop>>
+            create (std::shared_ptr<resolver> r = nullptr);
+            static error_or<std::unique_ptr<uring_loop>>
+            create (options const & opts, std::shared_ptr<resolver> r = nullptr);
+
+            // Resolver and timer callbacks capture the loop's address, so it can't move.
+            uring_loop (uring_loop const &) = delete;
+            uring_loop (uring_loop &&) = delete;
+            ~uring_loop () noexcept;
+
+            uring_loop & operator= (uring_loop const &) = delete;
+            uring_loop & operator= (uring_loop &&) = delete;
+
+            /// Starts an asynchronous GET request for \p path from \p host:\p port. An idle
+            /// connection to the same host:port is reused if there is one; otherwise a new
+            /// connection is made, trying the host's addresses in turn.
+            /// \param host  The host name.
+            /// \param port  The port number or service name.
+            /// \param path  The request path.
+            /// \param done  Called when the request completes or fails.
+            /// \param body  Called with each portion of the response body as it is received.
+            /// \returns An error if the request could not be started, in which case \p done is
+            ///   not called.
+            std::error_code async_get (std::string const & host, std::string const & port,
+                                       std::string const & path, completion_handler done,
+                                       body_handler body = nullptr);
+            /// Starts an asynchronous GET request with the deadlines and hedging policy given by
+            /// \p opts.
+            std::error_code async_get (std::string const & host, std::string const & port,
+                                       std::string const & path, request_options const & opts,
+                                       completion_handler done, body_handler body = nullptr);
+
+            /// Submits any queued operations, then waits for at most \p timeout for at least
+            /// one to complete and handles every completion that is available and every timer
+            /// which has expired. A negative timeout waits indefinitely. The wait ends early
+            /// when a request's timer is due.
+            /// \returns The number of completions handled.
+            error_or<std::size_t> run_once (std::chrono::milliseconds timeout);
+
+            /// Runs the loop until all in-flight requests have completed.
+            std::error_code run ();
+
+            /// Makes a call to run_once() that is waiting return promptly (or, if there is
+            /// none, the next call). Unlike the other members, wake() may be called from any
+            /// thread.
+            void wake () const noexcept;
+
+            /// The number of requests that have been started but not yet completed.
+            std::size_t in_flight () const noexcept { return in_flight_; }
+
+        private:
+            struct ring;
+            struct connection;
+            struct exchange;
+            struct mailbox;
+            class latency_history;
+            enum class op : std::uint8_t;
+
+            uring_loop (std::unique_ptr<ring> && rg, std::shared_ptr<mailbox> && mb,
+                        std::shared_ptr<resolver> && r, options const & opts);
+
+            /// Queues \p f to be called on the loop's thread. May be called from any thread.
+            static void post (std::weak_ptr<mailbox> const & mb, std::function<void ()> f);
+            void drain_mailbox ();
+
+            /// Takes an idle connection for \p ex's host:port or makes a new one and adds it to
+            /// the exchange's attempts.
+            error_or<connection *> attach (std::shared_ptr<exchange> const & ex);
+            /// Sends the request on a reused connection or, for a new one, resolves the host
+            /// name (unless the addresses are already known) and starts connecting.
+            std::error_code begin (connection & c);
+            void on_resolved (connection & c, resolver::result_type const & r);
+            std::error_code start_connect (connection & c);
+            void on_completion (std::uint64_t user_data, std::int32_t res, std::uint32_t flags);
+            void on_connect (connection & c, std::int32_t res);
+            void on_send (connection & c, std::int32_t res);
+            void on_recv (connection & c, std::int32_t res, std::uint32_t flags);
+            std::error_code on_data (connection & c, char const * first, std::size_t size);
+            /// Records the time to first byte and abandons the exchange's other attempt.
+            void on_first_byte (connection & c);
+            /// Ends an attempt. The exchange completes unless the attempt failed and another is
+            /// still in progress.
+            void complete (connection & c, std::error_code erc, bool reusable);
+            /// Ends an exchange, abandoning any attempts which are still in progress.
+            void finish (exchange & ex, std::error_code erc, response_parser const & response);
+            /// Starts the request again on a new connection after a reused one failed.
+            bool retry (connection & c);
+            /// Removes a connection from its exchange and closes it.
+            void drop (connection & c);
+
+            /// Replaces a connection's timer with one which fails the attempt after \p limit.
+            void arm (connection & c, std::chrono::milliseconds limit);
+            void on_timeout (connection & c);
+            void on_hedge (exchange & ex);
+            /// The delay after which a request to \p key is hedged.
+            timer_wheel::clock::duration hedge_delay (std::string const & key,
+                                                      request_options const & opts) const;
+
+            std::error_code submit_connect (connection & c);
+            std::error_code submit_send (connection & c);
+            std::error_code submit_recv (connection & c);
+            std::error_code submit_wake ();
+            /// Asks the kernel to abandon a connection's pending connect.
+            std::error_code submit_cancel (connection & c);
+
+            /// Makes a connection to \p key in a free fixed-file slot. If every slot is in use,
+            /// the least recently used idle connection gives up its slot.
+            error_or<connection *> new_connection (std::string const & key);
+            /// Places a connection which has completed a response in the idle list for its
+            /// host:port, or retires it if the list is full.
+            void make_idle (connection & c);
+            /// Closes the least recently used idle connection and frees its slot.
+            /// \returns False if there is no idle connection or its slot couldn't be freed.
+            bool evict_idle ();
+            /// Shuts down a connection's socket. It is freed once none of its operations remain
+            /// in the ring.
+            void retire (connection & c);
+            void release_if_unused (connection & c);
+
+            std::unique_ptr<ring> ring_;
+            std::shared_ptr<mailbox> mailbox_;
+            std::shared_ptr<resolver> resolver_;
+            socket_options socket_options_;
+            /// Connections indexed by their fixed-file slot.
+            std::vector<std::unique_ptr<connection>> slots_;
+            std::vector<unsigned> free_slots_;
+            /// Connections which gave up their slots to new connections but still have
+            /// operations in the ring.
+            std::vector<std::unique_ptr<connection>> detached_;
+            std::size_t const max_idle_per_host_;
+            std::chrono::milliseconds const idle_timeout_;
+            /// Idle connections by host:port, most recently used last.
+            std::unordered_map<std::string, std::vector<connection *>> idle_;
+            /// Recent times to first byte by host:port.
+            std::unordered_map<std::string, std::unique_ptr<latency_history>> latency_;
+            timer_wheel timers_;
+            std::size_t in_flight_ = 0;
+            /// Cleared if the kernel rejects a multishot receive.
+            bool multishot_ = true;
+            request_builder builder_;
+        };
+
+    } // end namespace http
+} // end namespace pstore
+
+#endif // CLIENT_URING_LOOP_HPP
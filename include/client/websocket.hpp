@@ -0,0 +1,123 @@
+#ifndef CLIENT_WEBSOCKET_HPP
+#define CLIENT_WEBSOCKET_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+#include "pstore/adt/error_or.hpp"
+#include "pstore/os/descriptor.hpp"
+#include "pstore/support/gsl.hpp"
+
+#include "client/ws_frame.hpp"
+
+namespace pstore {
+    namespace http {
+
+        // websocket
+        // ~~~~~~~~~
+        /// A client WebSocket connection (RFC 6455).
+        ///
+        /// Outgoing frames are masked with a fresh key as they are copied into a send buffer.
+        /// Servers never mask their frames (a masked frame is a protocol error), so receive()
+        /// reads incoming payloads directly into the caller's buffer: only bytes which arrived
+        /// with an earlier frame's data are copied. Pings are answered automatically and pongs
+        /// are discarded.
+        ///
+        /// The class is not thread-safe.
+        class websocket {
+        public:
+            /// A complete message returned by receive().
+            struct message {
+                /// text, binary or close.
+                ws::opcode type;
+                /// The number of payload bytes written to the caller's buffer. For a close
+                /// message, this is the length of the reason.
+                std::size_t size;
+                /// For a close message, the status code sent by the server.
+                ws::close_code code;
+            };
+
+            /// Sends the upgrade request for \p path on \p fd, then reads and verifies the
+            /// server's response, including its Sec-WebSocket-Accept header.
+            static error_or<websocket> connect (socket_descriptor && fd, std::string const & host,
+                                                std::string const & port,
+                                                std::string const & path);
+
+            websocket (websocket const &) = delete;
+            websocket (websocket &&) noexcept = default;
+            ~websocket () noexcept = default;
+
+            websocket & operator= (websocket const &) = delete;
+            websocket & operator= (websocket &&) noexcept = default;
+
+            /// Sends a single frame. A message may be fragmented by sending a text or binary
+            /// frame with \p fin false, followed by continuation frames, the last with \p fin
+            /// true.
+            std::error_code send_frame (ws::opcode op, gsl::span<char const> payload,
+                                        bool fin = true);
+            std::error_code send_text (std::string_view text) {
+                char const * const first = text.data ();
+                return this->send_frame (ws::opcode::text,
+                                         gsl::make_span (first, first + text.size ()));
+            }
+            std::error_code send_binary (gsl::span<char const> payload) {
+                return this->send_frame (ws::opcode::binary, payload);
+            }
+            std::error_code ping (gsl::span<char const> payload = {}) {
+                return this->send_frame (ws::opcode::ping, payload);
+            }
+            /// Starts the closing handshake. Continue to call receive() until it returns a close
+            /// message.
+            std::error_code close (ws::close_code code = ws::close_code::normal,
+                                   std::string_view reason = {});
+
+            /// Reads the next complete message into \p buffer, reassembling fragments and
+            /// handling any control frames which arrive before or between them. A message
+            /// larger than \p buffer is an error (std::errc::message_size) after which the
+            /// connection must be closed.
+            error_or<message> receive (gsl::span<char> buffer);
+
+            socket_descriptor const & socket () const noexcept { return fd_; }
+
+        private:
+            static constexpr std::size_t buffer_size = 16 * 1024;
+
+            explicit websocket (socket_descriptor && fd);
+
+            std::error_code read_handshake (std::string const & key);
+            /// Ensures that at least \p n bytes are available in buffer_.
+            std::error_code fill (std::size_t n);
+            error_or<ws::frame_header> read_frame_header ();
+            /// Reads \p length payload bytes to \p out, first from buffer_ then from the socket.
+            std::error_code read_payload (std::uint8_t * out, std::size_t length);
+            std::error_code write_all (std::uint8_t const * first, std::uint8_t const * last);
+
+            socket_descriptor fd_;
+            std::unique_ptr<std::array<std::uint8_t, buffer_size>> buffer_;
+            /// The unconsumed bytes of buffer_ are [pos_, end_).
+            std::size_t pos_ = 0;
+            std::size_t end_ = 0;
+
+            /// Returns the key with which to mask the next outgoing frame.
+            error_or<std::uint32_t> next_mask ();
+
+            std::vector<std::uint8_t> send_buffer_;
+            /// Masking keys must be unpredictable (RFC 6455 section 5.3), so they come from the
+            /// kernel's random number generator. They are fetched in batches to save calls.
+            std::array<std::uint32_t, 64> masks_{};
+            std::size_t mask_pos_ = std::tuple_size<decltype (masks_)>::value;
+
+            bool close_sent_ = false;
+            bool close_received_ = false;
+        };
+
+    } // end namespace http
+} // end namespace pstore
+
+#endif // CLIENT_WEBSOCKET_HPP
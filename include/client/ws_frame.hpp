@@ -0,0 +1,101 @@
+#ifndef CLIENT_WS_FRAME_HPP
+#define CLIENT_WS_FRAME_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include "pstore/adt/error_or.hpp"
+
+namespace pstore {
+    namespace http {
+        namespace ws {
+
+            /// Frame opcodes (RFC 6455 section 5.2).
+            enum class opcode : std::uint8_t {
+                continuation = 0x0,
+                text = 0x1,
+                binary = 0x2,
+                close = 0x8,
+                ping = 0x9,
+                pong = 0xA,
+            };
+
+            constexpr bool is_control (opcode const op) noexcept {
+                return (static_cast<std::uint8_t> (op) & 0x8U) != 0U;
+            }
+
+            /// Status codes carried by close frames (RFC 6455 section 7.4.1).
+            enum class close_code : std::uint16_t {
+                normal = 1000,
+                going_away = 1001,
+                protocol_error = 1002,
+                unsupported_data = 1003,
+                no_status = 1005,
+                invalid_payload = 1007,
+                message_too_big = 1009,
+            };
+
+            using masking_key = std::array<std::uint8_t, 4>;
+
+            /// The decoded fixed part of a frame.
+            struct frame_header {
+                bool fin = true;
+                opcode op = opcode::text;
+                bool masked = false;
+                masking_key mask{};
+                std::uint64_t payload_length = 0;
+            };
+
+            /// The largest possible frame header: 2 bytes, an 8 byte extended length and a 4
+            /// byte masking key.
+            constexpr std::size_t max_header_size = 14;
+            /// The largest payload permitted in a control frame.
+            constexpr std::size_t max_control_payload = 125;
+
+            // decode frame header
+            // ~~~~~~~~~~~~~~~~~~~
+            /// Decodes a frame header from [first, last).
+            ///
+            /// \returns  The size of the header, or 0 if [first, last) does not yet hold all of
+            ///   it. A header using reserved bits or opcodes, a fragmented or oversized control
+            ///   frame, or a length which isn't minimally encoded is an error.
+            error_or<std::size_t> decode_frame_header (std::uint8_t const * first,
+                                                       std::uint8_t const * last,
+                                                       frame_header & header) noexcept;
+
+            // encode frame header
+            // ~~~~~~~~~~~~~~~~~~~
+            /// Writes \p header to \p out, which must have room for max_header_size bytes.
+            /// \returns  The number of bytes written.
+            std::size_t encode_frame_header (frame_header const & header,
+                                             std::uint8_t * out) noexcept;
+
+            // mask copy
+            // ~~~~~~~~~
+            /// Copies [first, last) to \p out, XORing each byte with \p key. \p offset is the
+            /// position of first within the payload and selects the starting key byte. \p out may
+            /// be the same as \p first to mask in place. The work is done 32 or 16 bytes at a time
+            /// where AVX2 or SSE2 are available.
+            void mask_copy (std::uint8_t const * first, std::uint8_t const * last,
+                            std::uint8_t * out, masking_key const & key,
+                            std::size_t offset = 0) noexcept;
+
+            inline void apply_mask (std::uint8_t * first, std::uint8_t * last,
+                                    masking_key const & key, std::size_t offset = 0) noexcept {
+                mask_copy (first, last, first, key, offset);
+            }
+
+            // accept key
+            // ~~~~~~~~~~
+            /// Returns the Sec-WebSocket-Accept value which a server must send in response to a
+            /// request carrying Sec-WebSocket-Key \p key: base64 (SHA-1 (key + GUID)).
+            std::string accept_key (std::string_view key);
+
+        } // end namespace ws
+    }     // end namespace http
+} // end namespace pstore
+
+#endif // CLIENT_WS_FRAME_HPP
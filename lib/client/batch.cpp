@@ -0,0 +1,682 @@
+#include "client/batch.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <iomanip>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "peejay/json.hpp"
+
+#include "pstore/http/buffered_reader.hpp"
+#include "pstore/http/net_txrx.hpp"
+
+#include "client/body_sink.hpp"
+#include "client/client.hpp"
+#include "client/connection_pool.hpp"
+#include "client/header_field.hpp"
+#include "client/request_builder.hpp"
+
+namespace {
+
+    using namespace pstore;
+    using clock_type = std::chrono::steady_clock;
+
+    std::error_code last_error () noexcept { return {errno, std::generic_category ()}; }
+
+    // manifest callbacks
+    // ~~~~~~~~~~~~~~~~~~
+    // The peejay backend which fills in a batch_request from the JSON object on one manifest
+    // line.
+    class manifest_callbacks {
+    public:
+        using result_type = bool;
+
+        explicit manifest_callbacks (http::batch_request * const request) noexcept
+                : request_{request} {}
+
+        std::error_code string_value (peejay::u8string_view const & s) {
+            return this->string (to_string (s));
+        }
+        std::error_code integer_value (std::int64_t) const { return this->scalar (); }
+        std::error_code float_value (double) const { return this->scalar (); }
+        std::error_code boolean_value (bool) const { return this->scalar (); }
+        std::error_code null_value () const { return this->scalar (); }
+
+        std::error_code begin_array () { return this->open (false); }
+        std::error_code end_array () { return this->close (); }
+        std::error_code begin_object () { return this->open (true); }
+        std::error_code key (peejay::u8string_view const & s) {
+            std::string name = to_string (s);
+            if (depth_ == 1U) {
+                member_ = lookup (name);
+            } else if (depth_ == 2U && member_ == member::headers) {
+                header_name_ = std::move (name);
+            }
+            return {};
+        }
+        std::error_code end_object () { return this->close (); }
+
+        bool result () const noexcept { return true; }
+
+    private:
+        enum class member { id, method, url, headers, body, output, other };
+
+        static std::string to_string (peejay::u8string_view const & s) {
+            return {reinterpret_cast<char const *> (s.data ()), s.size ()};
+        }
+        static member lookup (std::string const & name) noexcept {
+            if (name == "id") {
+                return member::id;
+            }
+            if (name == "method") {
+                return member::method;
+            }
+            if (name == "url") {
+                return member::url;
+            }
+            if (name == "headers") {
+                return member::headers;
+            }
+            if (name == "body") {
+                return member::body;
+            }
+            if (name == "output") {
+                return member::output;
+            }
+            return member::other;
+        }
+
+        static std::error_code bad () noexcept {
+            return std::make_error_code (std::errc::invalid_argument);
+        }
+
+        std::error_code string (std::string && s) {
+            if (depth_ == 1U) {
+                switch (member_) {
+                case member::id: request_->id = std::move (s); return {};
+                case member::method: request_->method = std::move (s); return {};
+                case member::url: request_->url = std::move (s); return {};
+                case member::body: request_->body = std::move (s); return {};
+                case member::output: request_->output = std::move (s); return {};
+                case member::headers: return bad ();
+                case member::other: return {};
+                }
+            }
+            if (depth_ == 2U && member_ == member::headers) {
+                request_->headers.emplace_back (std::move (header_name_), std::move (s));
+                return {};
+            }
+            return this->scalar ();
+        }
+        // Values other than strings are allowed only within members that we ignore.
+        std::error_code scalar () const noexcept {
+            return depth_ >= 1U && member_ == member::other ? std::error_code{} : bad ();
+        }
+        std::error_code open (bool const is_object) {
+            bool const ok = depth_ == 0U
+                                ? is_object
+                                : member_ == member::other ||
+                                      (depth_ == 1U && is_object && member_ == member::headers);
+            if (!ok) {
+                return bad ();
+            }
+            ++depth_;
+            return {};
+        }
+        std::error_code close () noexcept {
+            --depth_;
+            return {};
+        }
+
+        http::batch_request * request_;
+        // The number of objects and arrays currently open.
+        unsigned depth_ = 0;
+        member member_ = member::other;
+        std::string header_name_;
+    };
+
+    using manifest_parser =
+        decltype (peejay::make_parser (std::declval<manifest_callbacks> ()));
+
+    bool is_blank (char const * first, char const * last) noexcept {
+        return std::all_of (first, last,
+                            [] (char c) { return c == ' ' || c == '\t' || c == '\r'; });
+    }
+
+    // Is c allowed in a token such as a method or field name (RFC 7230 section 3.2.6)?
+    bool is_tchar (char const c) noexcept {
+        return std::isalnum (static_cast<unsigned char> (c)) != 0 ||
+               (c != '\0' && std::strchr ("!#$%&'*+-.^_`|~", c) != nullptr);
+    }
+
+    bool is_token (std::string const & s) noexcept {
+        return !s.empty () && std::all_of (std::begin (s), std::end (s), is_tchar);
+    }
+
+    // Checks the parts of a request which are copied into its head so that a manifest line
+    // can't end the head early or add lines to it. The method is converted to upper case and
+    // any Host field is removed: the Host sent is always the one in the URL.
+    std::error_code prepare_head (http::batch_request & request) {
+        auto const bad = std::make_error_code (std::errc::invalid_argument);
+        if (!is_token (request.method)) {
+            return bad;
+        }
+        for (char & c : request.method) {
+            c = static_cast<char> (std::toupper (static_cast<unsigned char> (c)));
+        }
+        // The request target may contain neither whitespace nor control characters.
+        if (std::any_of (std::begin (request.url), std::end (request.url), [] (char const c) {
+                auto const u = static_cast<unsigned char> (c);
+                return u <= 0x20U || u == 0x7FU;
+            })) {
+            return bad;
+        }
+        for (auto const & header : request.headers) {
+            if (!is_token (header.first) ||
+                header.second.find_first_of (std::string_view{"\r\n\0", 3}) !=
+                    std::string::npos) {
+                return bad;
+            }
+        }
+        request.headers.erase (std::remove_if (std::begin (request.headers),
+                                               std::end (request.headers),
+                                               [] (auto const & header) {
+                                                   return http::details::equal_ci (header.first,
+                                                                                   "host");
+                                               }),
+                               std::end (request.headers));
+        return {};
+    }
+
+    // The parts of an http:// URL.
+    struct target {
+        std::string host;
+        std::string port = "80";
+        std::string path = "/";
+    };
+
+    // Splits http://host[:port][/path].
+    maybe<target> split_url (std::string const & url) {
+        static constexpr char scheme[] = "http://";
+        if (url.compare (0, sizeof (scheme) - 1, scheme) != 0) {
+            return {};
+        }
+        std::string rest = url.substr (sizeof (scheme) - 1);
+        target result;
+        auto const slash = rest.find ('/');
+        std::string const authority = rest.substr (0, slash);
+        if (slash != std::string::npos) {
+            result.path = rest.substr (slash);
+        }
+
+        std::string::size_type colon = std::string::npos;
+        if (!authority.empty () && authority.front () == '[') {
+            // An IPv6 literal.
+            auto const close = authority.find (']');
+            if (close == std::string::npos) {
+                return {};
+            }
+            result.host = authority.substr (1, close - 1);
+            colon = authority.find (':', close);
+        } else {
+            colon = authority.find (':');
+            result.host = authority.substr (0, colon);
+        }
+        if (colon != std::string::npos) {
+            result.port = authority.substr (colon + 1);
+        }
+        if (result.host.empty () || result.port.empty ()) {
+            return {};
+        }
+        return maybe<target>{std::move (result)};
+    }
+
+    void write_json_string (std::ostream & os, std::string const & s) {
+        os << '"';
+        for (char const c : s) {
+            switch (c) {
+            case '"': os << "\\\""; break;
+            case '\\': os << "\\\\"; break;
+            case '\n': os << "\\n"; break;
+            case '\r': os << "\\r"; break;
+            case '\t': os << "\\t"; break;
+            default:
+                if (static_cast<unsigned char> (c) < 0x20) {
+                    os << "\\u" << std::hex << std::setw (4) << std::setfill ('0')
+                       << static_cast<unsigned> (c) << std::dec << std::setfill (' ');
+                } else {
+                    os << c;
+                }
+                break;
+            }
+        }
+        os << '"';
+    }
+
+    // work queue
+    // ~~~~~~~~~~
+    // A bounded queue of requests: push() waits while the queue is full so that the manifest
+    // is read no faster than the requests are run.
+    class work_queue {
+    public:
+        explicit work_queue (std::size_t capacity)
+                : capacity_{capacity} {}
+
+        void push (http::batch_request && r) {
+            std::unique_lock<std::mutex> lock{mut_};
+            not_full_.wait (lock, [this] () { return queue_.size () < capacity_; });
+            queue_.push_back (std::move (r));
+            not_empty_.notify_one ();
+        }
+        // Returns nothing once the queue has been closed and drained.
+        maybe<http::batch_request> pop () {
+            std::unique_lock<std::mutex> lock{mut_};
+            not_empty_.wait (lock, [this] () { return closed_ || !queue_.empty (); });
+            if (queue_.empty ()) {
+                return {};
+            }
+            maybe<http::batch_request> result{std::move (queue_.front ())};
+            queue_.pop_front ();
+            not_full_.notify_one ();
+            return result;
+        }
+        void close () {
+            std::lock_guard<std::mutex> const lock{mut_};
+            closed_ = true;
+            not_empty_.notify_all ();
+        }
+
+    private:
+        std::size_t const capacity_;
+        std::mutex mut_;
+        std::condition_variable not_empty_;
+        std::condition_variable not_full_;
+        std::deque<http::batch_request> queue_;
+        bool closed_ = false;
+    };
+
+    // host limiter
+    // ~~~~~~~~~~~~
+    // Counts the requests in progress for each host:port, making callers wait while a host is
+    // at its limit. Hosts with no requests in progress are forgotten so that the map doesn't
+    // grow with the number of distinct hosts in the manifest.
+    class host_limiter {
+    public:
+        explicit host_limiter (unsigned limit)
+                : limit_{std::max (limit, 1U)} {}
+
+        void acquire (std::string const & key) {
+            std::unique_lock<std::mutex> lock{mut_};
+            cv_.wait (lock, [&] () {
+                auto const pos = active_.find (key);
+                return pos == std::end (active_) || pos->second < limit_;
+            });
+            ++active_[key];
+        }
+        void release (std::string const & key) {
+            std::lock_guard<std::mutex> const lock{mut_};
+            auto const pos = active_.find (key);
+            if (--pos->second == 0U) {
+                active_.erase (pos);
+            }
+            cv_.notify_all ();
+        }
+
+    private:
+        unsigned const limit_;
+        std::mutex mut_;
+        std::condition_variable cv_;
+        std::unordered_map<std::string, unsigned> active_;
+    };
+
+    struct outcome {
+        std::error_code error;
+        maybe<http::http_status_code> status;
+        std::uint64_t bytes = 0;
+        clock_type::duration time{};
+    };
+
+    struct batch_context {
+        batch_context (std::ostream & r, http::batch_options const & o)
+                : results{r}
+                , limiter{o.per_host}
+                , pool{pool_options (o)} {}
+
+        static http::connection_pool::options pool_options (http::batch_options const & o) {
+            http::connection_pool::options result;
+            result.max_idle_per_host = std::max (o.per_host, 1U);
+            result.max_total_per_host = std::max (o.per_host, 1U);
+            return result;
+        }
+
+        std::ostream & results;
+        std::mutex results_mut;
+        host_limiter limiter;
+        http::connection_pool pool;
+        http::batch_summary summary;
+    };
+
+    // Sends everything in data, retrying after partial writes.
+    std::error_code send_all (socket_descriptor const & fd, std::string const & data) {
+        for (std::size_t sent = 0; sent < data.size ();) {
+            ssize_t const r = ::send (fd.native_handle (), data.data () + sent,
+                                      data.size () - sent, MSG_NOSIGNAL);
+            if (r < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return last_error ();
+            }
+            sent += static_cast<std::size_t> (r);
+        }
+        return {};
+    }
+
+    // Reads the response body into the request's output file or, if it has none, discards
+    // it.
+    template <typename Reader>
+    error_or<std::uint64_t> read_output (Reader & reader, socket_descriptor & fd,
+                                         http::batch_request const & request,
+                                         http::http_status_code const sc,
+                                         http::header_block const & headers) {
+        using return_type = error_or<std::uint64_t>;
+        if (request.method == "HEAD") {
+            return return_type{std::uint64_t{0}};
+        }
+        if (request.output.empty ()) {
+            auto discard = http::make_callback_sink ([] (gsl::span<char const>) {});
+            auto const body = http::read_message_body (reader, fd, sc, headers, discard);
+            if (!body) {
+                return return_type{body.get_error ()};
+            }
+            return return_type{std::uint64_t{std::get<1> (*body)}};
+        }
+        int const out =
+            ::open (request.output.c_str (), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (out == -1) {
+            return return_type{last_error ()};
+        }
+        std::error_code erc;
+        std::uint64_t bytes = 0;
+        {
+            http::fd_sink sink{out};
+            auto const body = http::read_message_body (reader, fd, sc, headers, sink);
+            if (body) {
+                bytes = std::get<1> (*body);
+            } else {
+                erc = body.get_error ();
+            }
+        }
+        if (::close (out) != 0 && !erc) {
+            erc = last_error ();
+        }
+        return erc ? return_type{erc} : return_type{bytes};
+    }
+
+    // Makes one attempt at a request. retry is set if the attempt failed on a reused
+    // connection before any part of a response arrived.
+    outcome attempt (batch_context & ctx, http::batch_request const & request,
+                     target const & t, bool & retry) {
+        outcome result;
+        retry = false;
+        error_or<http::connection_pool::lease> eo_lease = ctx.pool.acquire (t.host, t.port);
+        if (!eo_lease) {
+            result.error = eo_lease.get_error ();
+            return result;
+        }
+        http::connection_pool::lease & lease = *eo_lease;
+        socket_descriptor & fd = lease.socket ();
+        auto const start = clock_type::now ();
+
+        http::request_builder & builder = http::thread_request_builder ();
+        builder.start (request.method, t.path).host (t.host, t.port);
+        for (auto const & header : request.headers) {
+            builder.header_ref (header.first, header.second);
+        }
+        std::error_code erc;
+        if (request.body.empty ()) {
+            erc = builder.finish ().send (fd);
+        } else {
+            // The head and body go in a single write: sent separately, the body would wait
+            // for the server's delayed acknowledgement of the head.
+            builder.header ("Content-Length", std::to_string (request.body.size ()));
+            std::string message;
+            builder.finish ().copy_to (message);
+            message += request.body;
+            erc = send_all (fd, message);
+        }
+        if (erc) {
+            retry = lease.reused ();
+            result.error = erc;
+            return result;
+        }
+
+        auto reader = http::make_socket_reader (http::net::refiller, http::response_buffer_size);
+        http::header_block headers;
+        error_or<http::status_line> const eo_status = http::read_final_head (reader, fd, headers);
+        if (!eo_status) {
+            retry = lease.reused ();
+            result.error = eo_status.get_error ();
+            return result;
+        }
+        http::http_status_code const sc = eo_status->status_code ();
+        result.status = sc;
+        error_or<std::uint64_t> const bytes = read_output (reader, fd, request, sc, headers);
+        result.time = clock_type::now () - start;
+        if (!bytes) {
+            result.error = bytes.get_error ();
+            return result;
+        }
+        result.bytes = *bytes;
+        // A body which was framed by the connection closing leaves nothing to reuse.
+        ctx.pool.release (std::move (lease),
+                          http::keep_alive (eo_status->http_version (), headers) &&
+                              (request.method == "HEAD" ||
+                               headers.contains (http::known_header::content_length) ||
+                               headers.contains (http::known_header::transfer_encoding) ||
+                               http::details::bodiless (sc)));
+        return result;
+    }
+
+    outcome execute (batch_context & ctx, http::batch_request const & request) {
+        outcome result;
+        if (request.error) {
+            result.error = request.error;
+            return result;
+        }
+        maybe<target> const t = split_url (request.url);
+        if (!t) {
+            result.error = std::make_error_code (std::errc::invalid_argument);
+            return result;
+        }
+        std::string const key = t->host + ':' + t->port;
+        ctx.limiter.acquire (key);
+        bool retry = false;
+        result = attempt (ctx, request, *t, retry);
+        if (retry && http::is_idempotent (request.method)) {
+            // The server may have closed an idle connection just as we reused it.
+            result = attempt (ctx, request, *t, retry);
+        }
+        ctx.limiter.release (key);
+        return result;
+    }
+
+    void report (batch_context & ctx, http::batch_request const & request,
+                 outcome const & result) {
+        std::ostringstream os;
+        os << "{\"line\": " << request.line;
+        if (!request.id.empty ()) {
+            os << ", \"id\": ";
+            write_json_string (os, request.id);
+        }
+        if (result.status) {
+            os << ", \"status\": " << static_cast<unsigned> (*result.status);
+        }
+        if (result.error) {
+            os << ", \"error\": ";
+            write_json_string (os, result.error.message ());
+        }
+        os << ", \"bytes\": " << result.bytes << ", \"ms\": " << std::fixed
+           << std::setprecision (3)
+           << std::chrono::duration<double, std::milli> (result.time).count () << "}\n";
+
+        std::lock_guard<std::mutex> const lock{ctx.results_mut};
+        ctx.results << os.str ();
+        ++ctx.summary.requests;
+        if (result.error) {
+            ++ctx.summary.failures;
+        }
+    }
+
+} // end anonymous namespace
+
+namespace pstore {
+    namespace http {
+
+        // manifest reader
+        // ~~~~~~~~~~~~~~~
+        struct manifest_reader::state {
+            static constexpr std::size_t buffer_size = 64 * 1024;
+
+            explicit state (int const f)
+                    : fd{f}
+                    , buffer{new char[buffer_size]} {}
+
+            int const fd;
+            std::unique_ptr<char[]> buffer;
+            std::size_t pos = 0;
+            std::size_t end = 0;
+            bool eof = false;
+            std::uint64_t line = 0;
+        };
+
+        manifest_reader::manifest_reader (int const fd)
+                : state_{new state (fd)} {}
+
+        manifest_reader::~manifest_reader () noexcept = default;
+
+        error_or<maybe<batch_request>> manifest_reader::next () {
+            using return_type = error_or<maybe<batch_request>>;
+            state & s = *state_;
+            for (;;) {
+                batch_request request;
+                request.line = ++s.line;
+                manifest_parser parser = peejay::make_parser (manifest_callbacks{&request});
+                bool blank = true;
+                bool newline = false;
+                while (!newline) {
+                    if (s.pos == s.end) {
+                        if (s.eof) {
+                            break;
+                        }
+                        ssize_t const r = ::read (s.fd, s.buffer.get (), state::buffer_size);
+                        if (r < 0) {
+                            if (errno == EINTR) {
+                                continue;
+                            }
+                            return return_type{last_error ()};
+                        }
+                        s.pos = 0;
+                        s.end = static_cast<std::size_t> (r);
+                        s.eof = r == 0;
+                        continue;
+                    }
+                    char const * const first = s.buffer.get () + s.pos;
+                    auto const * const nl =
+                        static_cast<char const *> (std::memchr (first, '\n', s.end - s.pos));
+                    char const * const last = nl != nullptr ? nl : s.buffer.get () + s.end;
+                    blank = blank && is_blank (first, last);
+                    // Once the line is known to be bad, the rest of it is skipped.
+                    if (!request.error) {
+                        parser.input (first, last);
+                        if (parser.has_error ()) {
+                            request.error = parser.last_error ();
+                        }
+                    }
+                    newline = nl != nullptr;
+                    s.pos = static_cast<std::size_t> (last - s.buffer.get ()) + (newline ? 1U : 0U);
+                }
+                if (blank) {
+                    if (!newline) {
+                        return return_type{maybe<batch_request>{}};
+                    }
+                    continue;
+                }
+                if (!request.error) {
+                    parser.eof ();
+                    if (parser.has_error ()) {
+                        request.error = parser.last_error ();
+                    } else if (request.url.empty ()) {
+                        request.error = std::make_error_code (std::errc::invalid_argument);
+                    } else {
+                        request.error = prepare_head (request);
+                    }
+                }
+                return return_type{maybe<batch_request>{std::move (request)}};
+            }
+        }
+
+        // run batch
+        // ~~~~~~~~~
+        error_or<batch_summary> run_batch (int const manifest_fd, std::ostream & results,
+                                           batch_options const & options) {
+            using return_type = error_or<batch_summary>;
+            unsigned const workers = std::max (options.concurrency, 1U);
+            batch_context ctx{results, options};
+            work_queue queue{2U * workers};
+
+            std::vector<std::thread> threads;
+            threads.reserve (workers);
+            // Closing the queue lets the workers finish once they have emptied it.
+            auto const join_all = [&queue, &threads] {
+                queue.close ();
+                for (std::thread & t : threads) {
+                    t.join ();
+                }
+            };
+            std::error_code erc;
+            try {
+                for (auto ctr = 0U; ctr < workers; ++ctr) {
+                    threads.emplace_back ([&ctx, &queue] () {
+                        while (maybe<batch_request> request = queue.pop ()) {
+                            report (ctx, *request, execute (ctx, *request));
+                        }
+                    });
+                }
+
+                manifest_reader reader{manifest_fd};
+                for (;;) {
+                    error_or<maybe<batch_request>> next = reader.next ();
+                    if (!next) {
+                        erc = next.get_error ();
+                        break;
+                    }
+                    if (!*next) {
+                        break;
+                    }
+                    queue.push (std::move (**next));
+                }
+            } catch (...) {
+                // Don't leave running threads in the vector as the exception unwinds.
+                join_all ();
+                throw;
+            }
+            join_all ();
+            results.flush ();
+            return erc ? return_type{erc} : return_type{ctx.summary};
+        }
+
+    } // end namespace http
+} // end namespace pstore
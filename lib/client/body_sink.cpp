@@ -0,0 +1,328 @@
+#include "client/body_sink.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <new>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+    std::error_code last_error () noexcept { return {errno, std::generic_category ()}; }
+
+    /// The error for a failed receive from a blocking socket. Such a socket reports that its
+    /// receive timeout (SO_RCVTIMEO) has expired as EAGAIN.
+    std::error_code receive_error () noexcept {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return std::make_error_code (std::errc::timed_out);
+        }
+        return last_error ();
+    }
+
+    /// Is \p erc the error with which splice() rejects a file that it can't write: one opened
+    /// with O_APPEND or on a file system without splice() support?
+    bool is_splice_unsupported (std::error_code const & erc) noexcept {
+        return erc == std::errc::invalid_argument || erc == std::errc::function_not_supported;
+    }
+
+    pstore::gsl::span<char> make_span (char * const data, std::size_t const size) noexcept {
+        return {data, static_cast<std::ptrdiff_t> (size)};
+    }
+
+} // end anonymous namespace
+
+namespace pstore {
+    namespace http {
+
+        namespace details {
+
+            // scratch buffer
+            // ~~~~~~~~~~~~~~
+            gsl::span<char> scratch_buffer (std::size_t const size) {
+                thread_local std::vector<char> buffer;
+                if (buffer.size () < size) {
+                    buffer.resize (size);
+                }
+                return make_span (buffer.data (), size);
+            }
+
+            // receive
+            // ~~~~~~~
+            error_or<std::size_t> receive (socket_descriptor const & fd, char * const data,
+                                           std::size_t const size) {
+                using return_type = error_or<std::size_t>;
+                ssize_t r;
+                while ((r = ::recv (fd.native_handle (), data, size, 0)) < 0) {
+                    if (errno != EINTR) {
+                        return return_type{receive_error ()};
+                    }
+                }
+                return return_type{static_cast<std::size_t> (r)};
+            }
+
+        } // end namespace details
+
+        // fd sink
+        // ~~~~~~~
+        fd_sink::fd_sink (fd_sink && other) noexcept
+                : fd_{other.fd_}
+                , chunk_size_{other.chunk_size_}
+                , use_splice_{other.use_splice_} {
+            std::swap (pipe_, other.pipe_);
+        }
+
+        fd_sink::~fd_sink () noexcept { this->close_pipe (); }
+
+        void fd_sink::close_pipe () noexcept {
+            for (int & p : pipe_) {
+                if (p != -1) {
+                    ::close (p);
+                    p = -1;
+                }
+            }
+        }
+
+        gsl::span<char> fd_sink::prepare (std::size_t const n) {
+            return details::scratch_buffer (chunk_size_)
+                .first (static_cast<std::ptrdiff_t> (std::min (n, chunk_size_)));
+        }
+
+        std::error_code fd_sink::commit (gsl::span<char const> const data) {
+            char const * p = data.data ();
+            auto remaining = static_cast<std::size_t> (data.size ());
+            while (remaining > 0U) {
+                ssize_t const r = ::write (fd_, p, remaining);
+                if (r < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    return last_error ();
+                }
+                p += r;
+                remaining -= static_cast<std::size_t> (r);
+            }
+            return {};
+        }
+
+        error_or<std::size_t> fd_sink::transfer (socket_descriptor const & fd,
+                                                 std::size_t const n) {
+            if (use_splice_ && pipe_[0] == -1) {
+                // Only files, pipes and sockets can be relied upon to accept splice(). Anything
+                // else (a terminal, say) gets copies, as does a file opened with O_APPEND, for
+                // which splice() fails with EINVAL.
+                struct stat st;
+                int const flags = ::fcntl (fd_, F_GETFL);
+                use_splice_ = ::fstat (fd_, &st) == 0 && flags != -1 &&
+                              (flags & O_APPEND) == 0 &&
+                              (S_ISREG (st.st_mode) || S_ISFIFO (st.st_mode) ||
+                               S_ISSOCK (st.st_mode)) &&
+                              ::pipe2 (pipe_, O_CLOEXEC) == 0;
+            }
+            if (use_splice_) {
+                error_or<std::size_t> const spliced = this->splice_from (fd, n);
+                if (spliced || !is_splice_unsupported (spliced.get_error ())) {
+                    return spliced;
+                }
+                // The file system doesn't support splice() after all: use copies from now on.
+                use_splice_ = false;
+                this->close_pipe ();
+            }
+            gsl::span<char> const buffer = this->prepare (n);
+            error_or<std::size_t> const got =
+                details::receive (fd, buffer.data (), static_cast<std::size_t> (buffer.size ()));
+            if (got && *got > 0U) {
+                if (std::error_code const erc = this->commit (buffer.first (
+                        static_cast<std::ptrdiff_t> (*got)))) {
+                    return error_or<std::size_t>{erc};
+                }
+            }
+            return got;
+        }
+
+        error_or<std::size_t> fd_sink::splice_from (socket_descriptor const & fd,
+                                                    std::size_t const n) {
+            using return_type = error_or<std::size_t>;
+            ssize_t in;
+            while ((in = ::splice (fd.native_handle (), nullptr, pipe_[1], nullptr,
+                                   std::min (n, chunk_size_), SPLICE_F_MOVE)) < 0) {
+                if (errno != EINTR) {
+                    return return_type{receive_error ()};
+                }
+            }
+            auto remaining = static_cast<std::size_t> (in);
+            while (remaining > 0U) {
+                ssize_t const out =
+                    ::splice (pipe_[0], nullptr, fd_, nullptr, remaining, SPLICE_F_MOVE);
+                if (out < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    std::error_code const erc = last_error ();
+                    if (is_splice_unsupported (erc)) {
+                        // The output won't accept splice(): copy what's left in the pipe so that
+                        // the caller can fall back to copying without losing any of the body.
+                        if (std::error_code const drain_erc = this->drain_pipe (remaining)) {
+                            return return_type{drain_erc};
+                        }
+                        return return_type{static_cast<std::size_t> (in)};
+                    }
+                    // The data left in the pipe is lost along with the rest of the body.
+                    return return_type{erc};
+                }
+                remaining -= static_cast<std::size_t> (out);
+            }
+            return return_type{static_cast<std::size_t> (in)};
+        }
+
+        std::error_code fd_sink::drain_pipe (std::size_t remaining) {
+            use_splice_ = false;
+            while (remaining > 0U) {
+                gsl::span<char> const buffer = this->prepare (remaining);
+                ssize_t const r =
+                    ::read (pipe_[0], buffer.data (), static_cast<std::size_t> (buffer.size ()));
+                if (r < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    return last_error ();
+                }
+                if (r == 0) {
+                    break;
+                }
+                if (std::error_code const erc =
+                        this->commit (buffer.first (static_cast<std::ptrdiff_t> (r)))) {
+                    return erc;
+                }
+                remaining -= static_cast<std::size_t> (r);
+            }
+            this->close_pipe ();
+            return {};
+        }
+
+        // file range sink
+        // ~~~~~~~~~~~~~~~
+        gsl::span<char> file_range_sink::prepare (std::size_t const n) {
+            return details::scratch_buffer (chunk_size_)
+                .first (static_cast<std::ptrdiff_t> (std::min (n, chunk_size_)));
+        }
+
+        std::error_code file_range_sink::commit (gsl::span<char const> const data) {
+            auto remaining = static_cast<std::size_t> (data.size ());
+            if (remaining > limit_ - offset_) {
+                return std::make_error_code (std::errc::file_too_large);
+            }
+            char const * p = data.data ();
+            while (remaining > 0U) {
+                ssize_t const r = ::pwrite (fd_, p, remaining, static_cast<off_t> (offset_));
+                if (r < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    return last_error ();
+                }
+                p += r;
+                offset_ += static_cast<std::uint64_t> (r);
+                remaining -= static_cast<std::size_t> (r);
+            }
+            return {};
+        }
+
+        // buffer sink
+        // ~~~~~~~~~~~
+        void buffer_sink::expect (std::size_t const n) noexcept {
+            // A failure here is reported when the data arrives.
+            this->reserve (size_ + std::min ({n, max_expected, max_size_ - size_}));
+        }
+
+        std::error_code buffer_sink::reserve (std::size_t const capacity) noexcept {
+            if (capacity <= capacity_) {
+                return {};
+            }
+            if (capacity > max_size_) {
+                return std::make_error_code (std::errc::message_size);
+            }
+            // Note that the new storage is not value-initialized: there's no point in zeroing
+            // memory that is about to be overwritten by the body.
+            std::unique_ptr<char[]> replacement{new (std::nothrow) char[capacity]};
+            if (!replacement) {
+                return std::make_error_code (std::errc::not_enough_memory);
+            }
+            if (size_ > 0U) {
+                std::memcpy (replacement.get (), buffer_.get (), size_);
+            }
+            buffer_ = std::move (replacement);
+            capacity_ = capacity;
+            return {};
+        }
+
+        std::error_code buffer_sink::grow (std::size_t const n) noexcept {
+            if (n > max_size_ - size_) {
+                return std::make_error_code (std::errc::message_size);
+            }
+            // Grow by half as much again (within the limit) so that an unknown length doesn't
+            // mean a reallocation for every read.
+            std::size_t const geometric =
+                capacity_ + std::min (capacity_ / 2U, max_size_ - capacity_);
+            return this->reserve (std::max (size_ + n, geometric));
+        }
+
+        error_or<gsl::span<char>> buffer_sink::room (std::size_t n) noexcept {
+            using return_type = error_or<gsl::span<char>>;
+            // Offer whatever space remains (provided that it isn't absurdly small).
+            n = std::min (n, std::max (capacity_ - size_, chunk_size_));
+            if (capacity_ - size_ < n) {
+                if (std::error_code const erc = this->grow (n)) {
+                    return return_type{erc};
+                }
+            }
+            return return_type{make_span (buffer_.get () + size_, n)};
+        }
+
+        gsl::span<char> buffer_sink::prepare (std::size_t const n) {
+            error_or<gsl::span<char>> const space = this->room (n);
+            if (!space) {
+                // Offer scratch memory instead: commit() will find that the data is not in place
+                // and report the error when it fails to copy it.
+                return details::scratch_buffer (chunk_size_)
+                    .first (static_cast<std::ptrdiff_t> (std::min (n, chunk_size_)));
+            }
+            return *space;
+        }
+
+        std::error_code buffer_sink::commit (gsl::span<char const> const data) {
+            auto const size = static_cast<std::size_t> (data.size ());
+            // The data was either written in place by whoever called prepare() or is lent from
+            // the reader's buffer.
+            if (size > 0U && data.data () != buffer_.get () + size_) {
+                if (capacity_ - size_ < size) {
+                    if (std::error_code const erc = this->grow (size)) {
+                        return erc;
+                    }
+                }
+                std::memcpy (buffer_.get () + size_, data.data (), size);
+            }
+            size_ += size;
+            return {};
+        }
+
+        error_or<std::size_t> buffer_sink::transfer (socket_descriptor const & fd,
+                                                     std::size_t const n) {
+            error_or<gsl::span<char>> const space = this->room (n);
+            if (!space) {
+                return error_or<std::size_t>{space.get_error ()};
+            }
+            error_or<std::size_t> const got =
+                details::receive (fd, space->data (), static_cast<std::size_t> (space->size ()));
+            if (got) {
+                size_ += *got;
+            }
+            return got;
+        }
+
+    } // end namespace http
+} // end namespace pstore
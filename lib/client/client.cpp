@@ -1,9 +1,20 @@
 #include "client/client.hpp"
+#include "client/happy_eyeballs.hpp"
+#include "client/header_field.hpp"
+#include "client/request_builder.hpp"
+#include "client/resolver.hpp"
 
+#include <algorithm>
+#include <array>
 #include <cassert>
+#include <cctype>
 #include <cstring>
+#include <limits>
+#include <ostream>
 #include <random>
 
+#include <sys/socket.h>
+
 #include "pstore/support/base64.hpp"
 #include "pstore/support/error.hpp"
 
@@ -35,29 +46,102 @@ namespace pstore {
         }
 #undef HTTP_STATUS_CODE
 
+        namespace {
+
+            constexpr std::size_t max_status_code = 600;
+
+            // A table with an entry for every integer below max_status_code which is true if that
+            // value is a status code listed in HTTP_STATUS_CODES.
+            constexpr std::array<bool, max_status_code> make_status_code_table () noexcept {
+                std::array<bool, max_status_code> table{};
+#define HTTP_STATUS_CODE(x, y) table[x] = true;
+                HTTP_STATUS_CODES
+#undef HTTP_STATUS_CODE
+                return table;
+            }
+
+            constexpr auto status_code_table = make_status_code_table ();
+
+            constexpr bool is_digit (char const c) noexcept { return c >= '0' && c <= '9'; }
+
+        } // end anonymous namespace
+
+        // decode status code
+        // ~~~~~~~~~~~~~~~~~~
+        maybe<http_status_code> decode_status_code (char const * const digits) noexcept {
+            if (!is_digit (digits[0]) || !is_digit (digits[1]) || !is_digit (digits[2])) {
+                return {};
+            }
+            auto const code = static_cast<std::size_t> (digits[0] - '0') * 100U +
+                              static_cast<std::size_t> (digits[1] - '0') * 10U +
+                              static_cast<std::size_t> (digits[2] - '0');
+            if (code >= max_status_code || !status_code_table[code]) {
+                // no such status code
+                return {};
+            }
+            return maybe<http_status_code>{static_cast<http_status_code> (code)};
+        }
+
         // str to http status code
         // ~~~~~~~~~~~~~~~~~~~~~~~
-#define HTTP_STATUS_CODE(x, y) {#x, http_status_code::y},
-        maybe<http_status_code> str_to_http_status_code (std::string const & x) {
-            static std::unordered_map<std::string, http_status_code> const map{{HTTP_STATUS_CODES}};
-            auto const pos = map.find (x);
-            if (pos == map.end ()) {
-                // no such status code
+        maybe<http_status_code> str_to_http_status_code (std::string_view x) noexcept {
+            if (x.length () != 3U) {
                 return {};
             }
-            return maybe<http_status_code>{pos->second};
+            return decode_status_code (x.data ());
         }
-#undef HTTP_STATUS_CODE
 
 
+        // parse status line
+        // ~~~~~~~~~~~~~~~~~
+        error_or<status_line> parse_status_line (std::string_view const line) {
+            using result_type = error_or<status_line>;
+            // status-line = HTTP-version SP status-code SP reason-phrase
+            // HTTP-version = "HTTP/" DIGIT "." DIGIT
+            constexpr auto version_length = std::size_t{8};
+            constexpr auto code_offset = version_length + 1U;
+            constexpr auto reason_offset = code_offset + 4U;
+
+            if (line.length () < reason_offset - 1U) {
+                return result_type{details::out_of_data_error ()};
+            }
+            char const * const l = line.data ();
+            if (std::memcmp (l, "HTTP/", 5) != 0 || !is_digit (l[5]) || l[6] != '.' ||
+                !is_digit (l[7]) || l[version_length] != ' ' ||
+                (line.length () >= reason_offset && l[reason_offset - 1U] != ' ')) {
+                return result_type{std::make_error_code (std::errc::bad_message)};
+            }
+            auto const sc = decode_status_code (l + code_offset);
+            if (!sc) {
+                return result_type{std::make_error_code (std::errc::bad_message)};
+            }
+            return result_type{std::in_place, line.substr (0, version_length), *sc,
+                               line.substr (std::min (reason_offset, line.length ()))};
+        }
+
+        // parse header field
+        // ~~~~~~~~~~~~~~~~~~
+        maybe<header_field> parse_header_field (std::string_view line) noexcept {
+            auto const colon = line.find (':');
+            if (colon == std::string_view::npos || colon == 0U ||
+                details::is_ows (line[colon - 1U]) || details::is_ows (line.front ())) {
+                return {};
+            }
+            return maybe<header_field>{
+                header_field{line.substr (0, colon), details::trim_ows (line.substr (colon + 1U))}};
+        }
+
         // Get host information.
         error_or<addrinfo *> get_host_info (std::string const & host, std::string const & port) {
             using return_type = error_or<addrinfo *>;
 
             addrinfo hints;
             std::memset (&hints, 0, sizeof (hints));
-            hints.ai_family = AF_INET;
+            // Ask for both IPv4 and IPv6 addresses but only for the families that this host has
+            // configured.
+            hints.ai_family = AF_UNSPEC;
             hints.ai_socktype = SOCK_STREAM;
+            hints.ai_flags = AI_ADDRCONFIG;
             addrinfo * res = nullptr;
             if (int const r = ::getaddrinfo (host.c_str (), port.c_str (), &hints, &res)) {
                 return return_type{make_gai_error_code (r)};
@@ -66,11 +150,10 @@ namespace pstore {
         }
 
         std::string request_key () {
-            static std::random_device rd;
-            static std::default_random_engine dre{rd ()};
-            static std::uniform_int_distribution<int> uid{
-                std::numeric_limits<std::uint8_t>::min (),
-                std::numeric_limits<std::uint8_t>::max ()};
+            // Each thread has its own engine so that concurrent calls don't race on its state.
+            thread_local std::default_random_engine dre{std::random_device{}()};
+            std::uniform_int_distribution<int> uid{std::numeric_limits<std::uint8_t>::min (),
+                                                   std::numeric_limits<std::uint8_t>::max ()};
 
             std::array<std::uint8_t, 16> nonce;
             std::generate (std::begin (nonce), std::end (nonce), [&] () { return uid (dre); });
@@ -80,69 +163,185 @@ namespace pstore {
         }
 
         error_or<socket_descriptor> establish_connection (addrinfo * info) {
-            using return_type = error_or<socket_descriptor>;
-            assert (info != nullptr);
-            int error = 0;
+            socket_options opts;
+            opts.receive_timeout = opts.send_timeout = default_io_timeout;
+            return establish_connection_with (info, opts);
+        }
 
+        error_or<socket_descriptor>
+        establish_connection_with (addrinfo * info, socket_options const & opts,
+                                   std::chrono::milliseconds const connect_timeout) {
+            assert (info != nullptr);
             std::unique_ptr<addrinfo, decltype (&freeaddrinfo)> info_ptr{info, &freeaddrinfo};
-            for (; info != nullptr; info = info->ai_next) {
-                socket_descriptor clientfd{
-                    ::socket (info->ai_family, info->ai_socktype, info->ai_protocol)};
-                if (clientfd.valid () &&
-                    ::connect (clientfd.native_handle (), info->ai_addr, info->ai_addrlen) == 0) {
-                    return return_type{std::move (clientfd)};
+            happy_eyeballs_options he;
+            he.timeout = connect_timeout;
+            he.socket = opts;
+            return connect_racing (to_address_list (info), he);
+        }
+
+        namespace {
+
+            void add_headers (request_builder & builder, header_list const & headers) {
+                for (header_field const & field : headers) {
+                    builder.header_ref (field.name, field.value);
                 }
-                error = errno;
             }
-            return return_type{make_error_code (errno_erc{error})};
+
+        } // end anonymous namespace
+
+        std::string make_get_request (std::string const & path, header_list const & headers) {
+            request_builder & builder = thread_request_builder ();
+            builder.start ("GET", path);
+            add_headers (builder, headers);
+            builder.finish ();
+            std::string result;
+            builder.copy_to (result);
+            return result;
         }
 
         std::error_code http_get (socket_descriptor const & fd, std::string const & path,
-                                  header_map const & headers) {
-            std::string const ws_key = request_key ();
-            static constexpr auto crlf = "\r\n";
-            std::ostringstream os;
-            os << "GET " << path << " HTTP/1.1" << crlf;
-            for (auto const & kvp : headers) {
-                os << kvp.first << ':' << kvp.second << crlf;
-            }
-            os << crlf;
-
-            auto const & str = os.str ();
-            if (::send (fd.native_handle (), str.data (), str.length (), 0) < 0) {
-                return {errno, std::generic_category ()};
-            }
-            return {};
+                                  header_list const & headers) {
+            request_builder & builder = thread_request_builder ();
+            builder.start ("GET", path);
+            add_headers (builder, headers);
+            return builder.finish ().send (fd);
         }
 
         std::error_code http_get (socket_descriptor const & fd, std::string const & host,
                                   std::string const & port, std::string const & path) {
-            header_map headers;
-            headers["Host"] = std::string{host} + ":" + std::string{port};
-            return http_get (fd, path, headers);
+            null_tracer t;
+            return http_get (fd, host, port, path, t);
         }
 
         // Initiate a WebSocket connection upgrade.
         std::error_code http_ws_get (socket_descriptor const & fd, std::string const & host,
                                      std::string const & port, std::string const & path,
                                      std::string const & ws_key) {
-            header_map headers;
-            headers["Host"] = host + ":" + port;
-            headers["Upgrade"] = "websocket";
-            headers["Connection"] = "Upgrade";
-            headers["Sec-WebSocket-Key"] = ws_key;
-            headers["Sec-WebSocket-Version"] = "13";
-            return http_get (fd, path, headers);
-        }
-
-        long content_length (std::unordered_map<std::string, std::string> const & headers) {
-            auto cl = 0L;
-            auto const pos = headers.find ("content-length");
-            if (pos != std::end (headers)) {
-                // TODO: a more robust string to long.
-                cl = std::max (std::stol (pos->second), 0L);
-            }
-            return cl;
+            return thread_request_builder ()
+                .start ("GET", path)
+                .host (host, port)
+                .header ("Upgrade", "websocket")
+                .header ("Connection", "Upgrade")
+                .header_ref ("Sec-WebSocket-Key", ws_key)
+                .header ("Sec-WebSocket-Version", "13")
+                .finish ()
+                .send (fd);
+        }
+
+        maybe<std::size_t> parse_content_length (std::string_view value) noexcept {
+            maybe<std::size_t> result;
+            for (;;) {
+                value = details::trim_ows (value);
+                auto const comma = value.find (',');
+                std::string_view const element = details::trim_ows (value.substr (0, comma));
+                if (element.empty ()) {
+                    return {};
+                }
+                std::size_t length = 0;
+                for (char const c : element) {
+                    if (!is_digit (c)) {
+                        return {};
+                    }
+                    auto const digit = static_cast<std::size_t> (c - '0');
+                    if (length > (std::numeric_limits<std::size_t>::max () - digit) / 10U) {
+                        return {}; // overflow
+                    }
+                    length = length * 10U + digit;
+                }
+                if (result && *result != length) {
+                    return {};
+                }
+                result = length;
+                if (comma == std::string_view::npos) {
+                    return result;
+                }
+                value.remove_prefix (comma + 1U);
+            }
+        }
+
+        error_or<std::size_t> content_length (header_block const & headers) {
+            using return_type = error_or<std::size_t>;
+            maybe<std::string_view> const value = headers.find (known_header::content_length);
+            if (!value) {
+                return return_type{std::size_t{0}};
+            }
+            maybe<std::size_t> const length = parse_content_length (*value);
+            if (!length) {
+                return return_type{std::make_error_code (std::errc::bad_message)};
+            }
+            return return_type{*length};
+        }
+
+        maybe<std::size_t> parse_chunk_size (std::string_view line) noexcept {
+            std::size_t size = 0;
+            auto digits = 0U;
+            for (char const c : line) {
+                unsigned value;
+                if (c >= '0' && c <= '9') {
+                    value = static_cast<unsigned> (c - '0');
+                } else if (c >= 'a' && c <= 'f') {
+                    value = static_cast<unsigned> (c - 'a' + 10);
+                } else if (c >= 'A' && c <= 'F') {
+                    value = static_cast<unsigned> (c - 'A' + 10);
+                } else if (c == ';' || c == ' ' || c == '\t') {
+                    // The start of a chunk extension (or whitespace preceding it).
+                    break;
+                } else {
+                    return {};
+                }
+                if (size > (std::numeric_limits<std::size_t>::max () >> 4U)) {
+                    return {}; // overflow
+                }
+                size = (size << 4U) | value;
+                ++digits;
+            }
+            if (digits == 0U) {
+                return {};
+            }
+            return maybe<std::size_t>{size};
+        }
+
+        bool is_chunked (std::string_view const transfer_encoding) noexcept {
+            std::string_view const te = details::trim_ows (transfer_encoding);
+            constexpr std::string_view chunked = "chunked";
+            return te.length () == chunked.length () &&
+                   std::equal (std::begin (te), std::end (te), std::begin (chunked),
+                               [] (char const c1, char const c2) {
+                                   return std::tolower (static_cast<unsigned char> (c1)) == c2;
+                               });
+        }
+
+        bool keep_alive (std::string_view http_version, header_block const & headers) {
+            // The Connection header is a comma-separated list of tokens.
+            auto const has_token = [&] (std::string_view const value, char const * token) {
+                std::string_view::size_type pos = 0;
+                while (pos <= value.length ()) {
+                    auto end = value.find (',', pos);
+                    if (end == std::string_view::npos) {
+                        end = value.length ();
+                    }
+                    auto first = value.find_first_not_of (" \t", pos);
+                    auto last = value.find_last_not_of (" \t", end - 1U);
+                    if (first != std::string_view::npos && first < end &&
+                        last != std::string_view::npos && last >= first &&
+                        details::equal_ci (value.substr (first, last - first + 1U), token)) {
+                        return true;
+                    }
+                    pos = end + 1U;
+                }
+                return false;
+            };
+
+            if (maybe<std::string_view> const connection =
+                    headers.find (known_header::connection)) {
+                if (has_token (*connection, "close")) {
+                    return false;
+                }
+                if (has_token (*connection, "keep-alive")) {
+                    return true;
+                }
+            }
+            return http_version != "HTTP/1.0";
         }
 
     } // end namespace http
@@ -0,0 +1,223 @@
+#include "client/connection_pool.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+
+#include <sys/socket.h>
+
+#include "client/client.hpp"
+
+namespace pstore {
+    namespace http {
+
+        // peer closed
+        // ~~~~~~~~~~~
+        bool peer_closed (socket_descriptor const & fd) noexcept {
+            if (!fd.valid ()) {
+                return true;
+            }
+            char c;
+            for (;;) {
+                ssize_t const r =
+                    ::recv (fd.native_handle (), &c, sizeof (c), MSG_PEEK | MSG_DONTWAIT);
+                if (r < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    // No data waiting on an otherwise healthy socket.
+                    return errno != EAGAIN && errno != EWOULDBLOCK;
+                }
+                // r == 0: an orderly shutdown by the peer. r > 0: bytes that we didn't ask for
+                // (perhaps an error response sent before the server closed the connection).
+                return true;
+            }
+        }
+
+        // lease
+        // ~~~~~
+        connection_pool::lease::lease (connection_pool * pool, std::string key,
+                                       socket_descriptor && fd, bool reused) noexcept
+                : pool_{pool}
+                , key_{std::move (key)}
+                , fd_{std::move (fd)}
+                , reused_{reused} {}
+
+        connection_pool::lease::lease (lease && other) noexcept
+                : pool_{other.pool_}
+                , key_{std::move (other.key_)}
+                , fd_{std::move (other.fd_)}
+                , reused_{other.reused_} {
+            other.pool_ = nullptr;
+        }
+
+        connection_pool::lease::~lease () noexcept { this->discard (); }
+
+        auto connection_pool::lease::operator= (lease && other) noexcept -> lease & {
+            if (&other != this) {
+                this->discard ();
+                pool_ = other.pool_;
+                key_ = std::move (other.key_);
+                fd_ = std::move (other.fd_);
+                reused_ = other.reused_;
+                other.pool_ = nullptr;
+            }
+            return *this;
+        }
+
+        void connection_pool::lease::discard () noexcept {
+            if (pool_ != nullptr) {
+                fd_.reset ();
+                pool_->forget (key_);
+                pool_ = nullptr;
+            }
+        }
+
+        // connection pool
+        // ~~~~~~~~~~~~~~~
+        connection_pool::connection_pool ()
+                : connection_pool (options{}) {}
+
+        connection_pool::connection_pool (options const & opts)
+                : options_{opts} {
+            if (options_.eviction_interval > clock::duration::zero ()) {
+                timer_ = std::thread{[this] () { this->timer_loop (); }};
+            }
+        }
+
+        connection_pool::~connection_pool () noexcept {
+            if (timer_.joinable ()) {
+                {
+                    std::lock_guard<std::mutex> const lock{mutex_};
+                    done_ = true;
+                }
+                cv_.notify_one ();
+                timer_.join ();
+            }
+        }
+
+        std::string connection_pool::make_key (std::string const & host,
+                                               std::string const & port) {
+            std::string key;
+            key.reserve (host.length () + 1U + port.length ());
+            key += host;
+            key += ':';
+            key += port;
+            return key;
+        }
+
+        auto connection_pool::acquire (std::string const & host, std::string const & port)
+            -> error_or<lease> {
+            using return_type = error_or<lease>;
+            std::string key = make_key (host, port);
+            {
+                std::unique_lock<std::mutex> lock{mutex_};
+                host_connections & hc = hosts_[key];
+                this->evict_idle (hc, clock::now ());
+                while (!hc.idle.empty ()) {
+                    socket_descriptor fd = std::move (hc.idle.back ().fd);
+                    hc.idle.pop_back ();
+                    if (!peer_closed (fd)) {
+                        ++hc.active;
+                        return return_type{lease{this, std::move (key), std::move (fd), true}};
+                    }
+                }
+                if (hc.active >= options_.max_total_per_host) {
+                    return return_type{
+                        std::make_error_code (std::errc::resource_unavailable_try_again)};
+                }
+                // Reserve the slot before dropping the lock to connect.
+                ++hc.active;
+            }
+
+            error_or<socket_descriptor> eo = get_host_info (host, port) >>= establish_connection;
+            if (!eo) {
+                this->forget (key);
+                return return_type{eo.get_error ()};
+            }
+            return return_type{lease{this, std::move (key), std::move (*eo), false}};
+        }
+
+        void connection_pool::release (lease && l, bool reusable) {
+            if (l.pool_ != this) {
+                return;
+            }
+            l.pool_ = nullptr;
+            socket_descriptor fd = std::move (l.fd_);
+
+            std::lock_guard<std::mutex> const lock{mutex_};
+            auto const pos = hosts_.find (l.key_);
+            assert (pos != hosts_.end () && pos->second.active > 0U);
+            host_connections & hc = pos->second;
+            --hc.active;
+            if (reusable && hc.idle.size () < options_.max_idle_per_host && !peer_closed (fd)) {
+                hc.idle.push_back (idle_connection{std::move (fd), clock::now ()});
+            } else if (hc.active == 0U && hc.idle.empty ()) {
+                hosts_.erase (pos);
+            }
+        }
+
+        std::size_t connection_pool::evict_idle (clock::time_point now) {
+            std::lock_guard<std::mutex> const lock{mutex_};
+            return this->evict_all_idle (now);
+        }
+
+        std::size_t connection_pool::evict_all_idle (clock::time_point now) {
+            std::size_t evicted = 0;
+            for (auto it = hosts_.begin (); it != hosts_.end ();) {
+                evicted += this->evict_idle (it->second, now);
+                if (it->second.idle.empty () && it->second.active == 0U) {
+                    it = hosts_.erase (it);
+                } else {
+                    ++it;
+                }
+            }
+            return evicted;
+        }
+
+        std::size_t connection_pool::evict_idle (host_connections & hc, clock::time_point now) {
+            // The idle list is ordered from least- to most-recently used so the expired
+            // entries are all at the front.
+            auto const first_live = std::find_if (
+                std::begin (hc.idle), std::end (hc.idle), [&] (idle_connection const & ic) {
+                    return now - ic.since < options_.idle_timeout;
+                });
+            auto const evicted =
+                static_cast<std::size_t> (std::distance (std::begin (hc.idle), first_live));
+            hc.idle.erase (std::begin (hc.idle), first_live);
+            return evicted;
+        }
+
+        std::size_t connection_pool::idle_count (std::string const & host,
+                                                 std::string const & port) const {
+            std::lock_guard<std::mutex> const lock{mutex_};
+            auto const pos = hosts_.find (make_key (host, port));
+            return pos == hosts_.end () ? std::size_t{0} : pos->second.idle.size ();
+        }
+
+        std::size_t connection_pool::active_count (std::string const & host,
+                                                   std::string const & port) const {
+            std::lock_guard<std::mutex> const lock{mutex_};
+            auto const pos = hosts_.find (make_key (host, port));
+            return pos == hosts_.end () ? std::size_t{0} : pos->second.active;
+        }
+
+        void connection_pool::forget (std::string const & key) noexcept {
+            std::lock_guard<std::mutex> const lock{mutex_};
+            auto const pos = hosts_.find (key);
+            if (pos != hosts_.end () && pos->second.active > 0U) {
+                if (--pos->second.active == 0U && pos->second.idle.empty ()) {
+                    hosts_.erase (pos);
+                }
+            }
+        }
+
+        void connection_pool::timer_loop () {
+            std::unique_lock<std::mutex> lock{mutex_};
+            while (!cv_.wait_for (lock, options_.eviction_interval, [this] { return done_; })) {
+                this->evict_all_idle (clock::now ());
+            }
+        }
+
+    } // end namespace http
+} // end namespace pstore
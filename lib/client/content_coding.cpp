@@ -0,0 +1,185 @@
+#include "client/content_coding.hpp"
+
+#include <array>
+#include <cctype>
+#include <limits>
+
+#include <zlib.h>
+
+#include "client/header_field.hpp"
+
+namespace {
+
+    using pstore::http::details::equal_ci;
+
+    // zlib's windowBits values. Adding 32 to the maximum enables automatic detection of the gzip
+    // and zlib formats; a negative value selects raw deflate.
+    constexpr int max_window_bits = 15;
+    constexpr int auto_detect_window_bits = max_window_bits + 32;
+    constexpr int raw_window_bits = -max_window_bits;
+
+    std::error_code zlib_error (int const status) noexcept {
+        switch (status) {
+        case Z_MEM_ERROR: return std::make_error_code (std::errc::not_enough_memory);
+        case Z_NEED_DICT:
+        case Z_DATA_ERROR: return std::make_error_code (std::errc::bad_message);
+        default: return std::make_error_code (std::errc::io_error);
+        }
+    }
+
+} // end anonymous namespace
+
+namespace pstore {
+    namespace http {
+
+        // parse content coding
+        // ~~~~~~~~~~~~~~~~~~~~
+        maybe<content_coding> parse_content_coding (std::string_view value) noexcept {
+            auto result = content_coding::identity;
+            while (!value.empty ()) {
+                auto const comma = value.find (',');
+                std::string_view const name = details::trim_ows (value.substr (0, comma));
+                value = comma == std::string_view::npos ? std::string_view{}
+                                                        : value.substr (comma + 1U);
+                if (name.empty () || equal_ci (name, "identity")) {
+                    continue;
+                }
+                if (result != content_coding::identity) {
+                    // Only a single layer of compression is supported.
+                    return {};
+                }
+                if (equal_ci (name, "gzip") || equal_ci (name, "x-gzip")) {
+                    result = content_coding::gzip;
+                } else if (equal_ci (name, "deflate")) {
+                    result = content_coding::deflate;
+                } else {
+                    return {};
+                }
+            }
+            return maybe<content_coding>{result};
+        }
+
+        // inflater
+        // ~~~~~~~~
+        struct inflater::stream {
+            explicit stream (content_coding c)
+                    : coding{c} {}
+
+            z_stream z{};
+            content_coding const coding;
+            /// For deflate, the first two bytes of the stream are held here until we know
+            /// whether they are a zlib header.
+            std::array<Bytef, 2> header{};
+            std::size_t header_size = 0;
+            std::size_t header_pos = 0;
+            bool done = false;
+            /// The result of inflateInit2(). If it failed, inflate() reports the error.
+            int init_status = Z_OK;
+        };
+
+        inflater::inflater (content_coding const coding)
+                : stream_{new stream (coding)} {
+            stream_->init_status = inflateInit2 (&stream_->z, auto_detect_window_bits);
+            if (coding != content_coding::deflate) {
+                stream_->header_size = stream_->header.size ();
+                stream_->header_pos = stream_->header.size ();
+            }
+        }
+
+        inflater::inflater (inflater &&) noexcept = default;
+
+        inflater::~inflater () noexcept {
+            if (stream_ && stream_->init_status == Z_OK) {
+                inflateEnd (&stream_->z);
+            }
+        }
+
+        bool inflater::done () const noexcept { return stream_->done; }
+
+        error_or<std::pair<std::size_t, std::size_t>>
+        inflater::inflate (gsl::span<char const> const in, gsl::span<char> const out) {
+            using return_type = error_or<std::pair<std::size_t, std::size_t>>;
+            stream & s = *stream_;
+            if (s.init_status != Z_OK) {
+                return return_type{zlib_error (s.init_status)};
+            }
+            z_stream & z = s.z;
+            // zlib counts in uInt, which may be narrower than std::size_t.
+            constexpr auto max_count = std::size_t{std::numeric_limits<uInt>::max ()};
+            auto const in_size = std::min (static_cast<std::size_t> (in.size ()), max_count);
+            auto const out_size = std::min (static_cast<std::size_t> (out.size ()), max_count);
+            std::size_t consumed = 0;
+
+            if (s.header_size < s.header.size ()) {
+                while (s.header_size < s.header.size () && consumed < in_size) {
+                    s.header[s.header_size++] = static_cast<Bytef> (in[consumed++]);
+                }
+                if (s.header_size < s.header.size ()) {
+                    return return_type{std::make_pair (consumed, std::size_t{0})};
+                }
+                // Some servers send raw deflate data rather than the zlib format that "deflate"
+                // is supposed to mean. A zlib header names the deflate method in the low bits
+                // of its first byte and is a multiple of 31 when read as a big-endian number.
+                unsigned const cmf = s.header[0];
+                unsigned const flg = s.header[1];
+                if ((cmf & 0x0FU) != 8U || ((cmf << 8U) | flg) % 31U != 0U) {
+                    if (inflateReset2 (&z, raw_window_bits) != Z_OK) {
+                        return return_type{std::make_error_code (std::errc::io_error)};
+                    }
+                }
+            }
+
+            z.next_out = reinterpret_cast<Bytef *> (out.data ());
+            z.avail_out = static_cast<uInt> (out_size);
+            while (z.avail_out > 0U) {
+                // Input comes from the held header bytes, if any remain, then from in.
+                bool const from_header = s.header_pos < s.header_size;
+                if (from_header) {
+                    z.next_in = s.header.data () + s.header_pos;
+                    z.avail_in = static_cast<uInt> (s.header_size - s.header_pos);
+                } else {
+                    z.next_in = reinterpret_cast<Bytef *> (const_cast<char *> (in.data ())) +
+                                consumed;
+                    z.avail_in = static_cast<uInt> (in_size - consumed);
+                }
+                // With no input left, zlib may still hold output that didn't fit in the last
+                // call: keep calling inflate() until it reports that it can make no progress.
+                if (s.done) {
+                    if (z.avail_in == 0U) {
+                        break;
+                    }
+                    if (s.coding != content_coding::gzip) {
+                        // Anything after the end of the stream is ignored.
+                        consumed = in_size;
+                        break;
+                    }
+                    // A gzip file may contain several members, one after another.
+                    if (inflateReset (&z) != Z_OK) {
+                        return return_type{std::make_error_code (std::errc::io_error)};
+                    }
+                    s.done = false;
+                }
+
+                uInt const avail_in = z.avail_in;
+                uInt const avail_out = z.avail_out;
+                int const status = ::inflate (&z, Z_NO_FLUSH);
+                std::size_t const used = avail_in - z.avail_in;
+                if (from_header) {
+                    s.header_pos += used;
+                } else {
+                    consumed += used;
+                }
+                if (status == Z_STREAM_END) {
+                    s.done = true;
+                } else if (status == Z_BUF_ERROR ||
+                           (status == Z_OK && used == 0U && z.avail_out == avail_out)) {
+                    break;
+                } else if (status != Z_OK) {
+                    return return_type{zlib_error (status)};
+                }
+            }
+            return return_type{std::make_pair (consumed, out_size - z.avail_out)};
+        }
+
+    } // end namespace http
+} // end namespace pstore
@@ -0,0 +1,740 @@
+#include "client/coro.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <limits>
+#include <new>
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include "client/happy_eyeballs.hpp"
+
+namespace {
+
+    using namespace pstore;
+
+    std::error_code last_error () noexcept { return {errno, std::generic_category ()}; }
+
+    bool would_block () noexcept { return errno == EAGAIN || errno == EWOULDBLOCK; }
+
+    // A thread's free lists. The blocks are released when the thread exits.
+    class free_lists {
+    public:
+        free_lists () noexcept { heads_.fill (nullptr); }
+        free_lists (free_lists const &) = delete;
+        ~free_lists () noexcept {
+            for (block * b : heads_) {
+                while (b != nullptr) {
+                    block * const next = b->next;
+                    ::operator delete (b);
+                    b = next;
+                }
+            }
+        }
+        free_lists & operator= (free_lists const &) = delete;
+
+        void * pop (std::size_t const c) {
+            if (block * const b = heads_[c]) {
+                heads_[c] = b->next;
+                return b;
+            }
+            ++heap_blocks_;
+            return ::operator new ((c + 1U) * http::coro::frame_pool::granule);
+        }
+        void push (std::size_t const c, void * const p) noexcept {
+            auto * const b = static_cast<block *> (p);
+            b->next = heads_[c];
+            heads_[c] = b;
+        }
+        std::size_t heap_blocks () const noexcept { return heap_blocks_; }
+
+    private:
+        struct block {
+            block * next;
+        };
+        std::array<block *, http::coro::frame_pool::classes> heads_;
+        std::size_t heap_blocks_ = 0;
+    };
+
+    free_lists & thread_free_lists () {
+        thread_local free_lists lists;
+        return lists;
+    }
+
+    // The size class for a block of size bytes.
+    constexpr std::size_t size_class (std::size_t const size) noexcept {
+        return (std::max (size, std::size_t{1}) - 1U) / http::coro::frame_pool::granule;
+    }
+
+} // end anonymous namespace
+
+namespace pstore {
+    namespace http {
+        namespace coro {
+
+            // allocate
+            // ~~~~~~~~
+            void * frame_pool::allocate (std::size_t const size) {
+                std::size_t const c = size_class (size);
+                if (c >= classes) {
+                    return ::operator new (size);
+                }
+                return thread_free_lists ().pop (c);
+            }
+
+            // deallocate
+            // ~~~~~~~~~~
+            void frame_pool::deallocate (void * const p, std::size_t const size) noexcept {
+                std::size_t const c = size_class (size);
+                if (c >= classes) {
+                    ::operator delete (p);
+                    return;
+                }
+                // A frame freed by a different thread from the one that allocated it joins
+                // the freeing thread's pool.
+                thread_free_lists ().push (c, p);
+            }
+
+            // heap blocks
+            // ~~~~~~~~~~~
+            std::size_t frame_pool::heap_blocks () noexcept {
+                return thread_free_lists ().heap_blocks ();
+            }
+
+            // mailbox
+            // ~~~~~~~
+            /// Functions posted to the reactor from other threads. The eventfd wakes
+            /// epoll_wait().
+            struct reactor::mailbox {
+                explicit mailbox (int efd) noexcept
+                        : event_fd{efd} {}
+
+                socket_descriptor event_fd;
+                std::mutex mutex;
+                std::vector<std::function<void ()>> queue;
+            };
+
+            // create
+            // ~~~~~~
+            error_or<reactor> reactor::create (std::shared_ptr<resolver> r) {
+                using return_type = error_or<reactor>;
+                // socket_descriptor is used simply as an owner of the epoll and event file
+                // descriptors.
+                socket_descriptor fd{::epoll_create1 (EPOLL_CLOEXEC)};
+                if (!fd.valid ()) {
+                    return return_type{last_error ()};
+                }
+                auto mb = std::make_shared<mailbox> (::eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC));
+                if (!mb->event_fd.valid ()) {
+                    return return_type{last_error ()};
+                }
+                // The mailbox is marked by a null data pointer; all others are coroutine
+                // handles.
+                epoll_event ev{};
+                ev.events = EPOLLIN | EPOLLET;
+                ev.data.ptr = nullptr;
+                if (::epoll_ctl (fd.native_handle (), EPOLL_CTL_ADD,
+                                 mb->event_fd.native_handle (), &ev) != 0) {
+                    return return_type{last_error ()};
+                }
+                if (!r) {
+                    r = std::make_shared<resolver> ();
+                }
+                return return_type{reactor{std::move (fd), std::move (mb), std::move (r)}};
+            }
+
+            reactor::reactor (socket_descriptor && epoll_fd, std::shared_ptr<mailbox> && mb,
+                              std::shared_ptr<resolver> && r)
+                    : epoll_fd_{std::move (epoll_fd)}
+                    , mailbox_{std::move (mb)}
+                    , resolver_{std::move (r)} {}
+
+            reactor::reactor (reactor && other) noexcept
+                    : epoll_fd_{std::move (other.epoll_fd_)}
+                    , mailbox_{std::move (other.mailbox_)}
+                    , resolver_{std::move (other.resolver_)}
+                    , pending_{std::exchange (other.pending_, 0)} {}
+            reactor::~reactor () noexcept = default;
+            reactor & reactor::operator= (reactor && other) noexcept {
+                epoll_fd_ = std::move (other.epoll_fd_);
+                mailbox_ = std::move (other.mailbox_);
+                resolver_ = std::move (other.resolver_);
+                pending_ = std::exchange (other.pending_, 0);
+                return *this;
+            }
+
+            // readable
+            // ~~~~~~~~
+            auto reactor::readable (socket_descriptor const & fd) noexcept -> readiness {
+                return {*this, fd.native_handle (), EPOLLIN | EPOLLRDHUP};
+            }
+
+            // writable
+            // ~~~~~~~~
+            auto reactor::writable (socket_descriptor const & fd) noexcept -> readiness {
+                return {*this, fd.native_handle (), EPOLLOUT};
+            }
+
+            // watch
+            // ~~~~~
+            std::error_code reactor::watch (int const fd, std::uint32_t const events,
+                                            std::coroutine_handle<> const h) {
+                epoll_event ev{};
+                ev.events = events | EPOLLONESHOT;
+                ev.data.ptr = h.address ();
+                // A socket stays registered (but disarmed) after its first wait has fired, so
+                // modifying the registration is the common case.
+                if (::epoll_ctl (epoll_fd_.native_handle (), EPOLL_CTL_MOD, fd, &ev) == 0) {
+                    return {};
+                }
+                if (errno == ENOENT &&
+                    ::epoll_ctl (epoll_fd_.native_handle (), EPOLL_CTL_ADD, fd, &ev) == 0) {
+                    return {};
+                }
+                return last_error ();
+            }
+
+            // spawn
+            // ~~~~~
+            void reactor::spawn (task<> t) {
+                ++pending_;
+                this->launch (std::move (t));
+            }
+
+            // launch
+            // ~~~~~~
+            details::detached reactor::launch (task<> t) {
+                co_await std::move (t);
+                --pending_;
+            }
+
+            // post
+            // ~~~~
+            void reactor::post (std::function<void ()> f) const {
+                {
+                    std::lock_guard<std::mutex> const lock{mailbox_->mutex};
+                    mailbox_->queue.push_back (std::move (f));
+                }
+                std::uint64_t const one = 1;
+                // A failure can only mean that the counter is saturated, which is enough to
+                // wake the reactor anyway.
+                (void) ::write (mailbox_->event_fd.native_handle (), &one, sizeof (one));
+            }
+
+            // drain mailbox
+            // ~~~~~~~~~~~~~
+            void reactor::drain_mailbox () {
+                std::uint64_t count;
+                while (::read (mailbox_->event_fd.native_handle (), &count, sizeof (count)) > 0) {
+                }
+                std::vector<std::function<void ()>> work;
+                {
+                    std::lock_guard<std::mutex> const lock{mailbox_->mutex};
+                    work.swap (mailbox_->queue);
+                }
+                for (auto const & f : work) {
+                    f ();
+                }
+            }
+
+            // run once
+            // ~~~~~~~~
+            error_or<std::size_t> reactor::run_once (std::chrono::milliseconds const timeout) {
+                using return_type = error_or<std::size_t>;
+                std::array<epoll_event, 256> events;
+                int const n =
+                    ::epoll_wait (epoll_fd_.native_handle (), events.data (),
+                                  static_cast<int> (events.size ()),
+                                  timeout.count () < 0 ? -1 : static_cast<int> (timeout.count ()));
+                if (n < 0) {
+                    if (errno == EINTR) {
+                        return return_type{std::size_t{0}};
+                    }
+                    return return_type{last_error ()};
+                }
+                // The registrations are one-shot, so a handle which has been resumed can't
+                // appear again in this batch even if its coroutine has since finished.
+                for (auto ctr = 0; ctr < n; ++ctr) {
+                    void * const ptr = events[static_cast<std::size_t> (ctr)].data.ptr;
+                    if (ptr == nullptr) {
+                        this->drain_mailbox ();
+                    } else {
+                        std::coroutine_handle<>::from_address (ptr).resume ();
+                    }
+                }
+                return return_type{static_cast<std::size_t> (n)};
+            }
+
+            // run
+            // ~~~
+            std::error_code reactor::run () {
+                while (pending_ > 0U) {
+                    error_or<std::size_t> const r = this->run_once (std::chrono::milliseconds{-1});
+                    if (!r) {
+                        return r.get_error ();
+                    }
+                }
+                return {};
+            }
+
+            // resolve
+            // ~~~~~~~
+            task<resolver::result_type> resolve (reactor & r, std::string host,
+                                                 std::string port) {
+                if (maybe<resolver::result_type> const hit =
+                        r.get_resolver ().cached (host, port)) {
+                    co_return *hit;
+                }
+                struct lookup {
+                    reactor & r;
+                    std::string const & host;
+                    std::string const & port;
+                    maybe<resolver::result_type> result;
+
+                    bool await_ready () const noexcept { return false; }
+                    void await_suspend (std::coroutine_handle<> h) {
+                        // The callback may run on a worker thread: the result is handed back
+                        // to the reactor's thread before the coroutine is resumed.
+                        r.get_resolver ().resolve_async (
+                            host, port, [this, h] (resolver::result_type const & res) {
+                                r.post ([this, h, res] {
+                                    result = res;
+                                    h.resume ();
+                                });
+                            });
+                    }
+                    resolver::result_type await_resume () { return std::move (*result); }
+                };
+                co_return co_await lookup{r, host, port, {}};
+            }
+
+            // connect
+            // ~~~~~~~
+            task<error_or<socket_descriptor>> connect (reactor & r, shared_address_list addrs,
+                                                       happy_eyeballs_options opts) {
+                using return_type = error_or<socket_descriptor>;
+                using clock = std::chrono::steady_clock;
+
+                // The attempts, and a timer for the next attempt or the deadline, are gathered
+                // in an epoll instance of their own. It is readable whenever any of them is
+                // ready, so the coroutine waits for it as it would for a single socket.
+                socket_descriptor waiter{::epoll_create1 (EPOLL_CLOEXEC)};
+                socket_descriptor timer{
+                    ::timerfd_create (CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)};
+                if (!waiter.valid () || !timer.valid ()) {
+                    co_return return_type{last_error ()};
+                }
+                auto const add = [&waiter] (socket_descriptor const & fd,
+                                            std::uint32_t const events) {
+                    epoll_event ev{};
+                    ev.events = events;
+                    ev.data.fd = fd.native_handle ();
+                    return ::epoll_ctl (waiter.native_handle (), EPOLL_CTL_ADD,
+                                        fd.native_handle (), &ev) == 0;
+                };
+                if (!add (timer, EPOLLIN)) {
+                    co_return return_type{last_error ()};
+                }
+
+                address_list const order = interleave_families (*addrs);
+                auto next = order.begin ();
+                std::error_code error = std::make_error_code (std::errc::address_not_available);
+                std::vector<socket_descriptor> attempts;
+                auto const deadline = opts.timeout.count () > 0 ? clock::now () + opts.timeout
+                                                                : clock::time_point::max ();
+                auto next_start = clock::now ();
+
+                for (;;) {
+                    auto const now = clock::now ();
+                    // Start the next attempt if it's due or if there's nothing else in progress.
+                    while (next != order.end () && (now >= next_start || attempts.empty ())) {
+                        address const & addr = *next++;
+                        socket_descriptor fd{::socket (addr.family (),
+                                                       SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                                                       0)};
+                        if (!fd.valid ()) {
+                            error = last_error ();
+                            continue;
+                        }
+                        if (std::error_code const erc = configure_socket (fd, opts.socket)) {
+                            error = erc;
+                            continue;
+                        }
+                        if (::connect (fd.native_handle (), addr.get (), addr.length) == 0) {
+                            co_return return_type{std::move (fd)};
+                        }
+                        if (errno != EINPROGRESS) {
+                            error = last_error ();
+                            continue;
+                        }
+                        if (!add (fd, EPOLLOUT)) {
+                            co_return return_type{last_error ()};
+                        }
+                        attempts.push_back (std::move (fd));
+                        next_start = now + opts.attempt_delay;
+                        break;
+                    }
+                    if (attempts.empty ()) {
+                        co_return return_type{error};
+                    }
+                    if (now >= deadline) {
+                        co_return return_type{std::make_error_code (std::errc::timed_out)};
+                    }
+
+                    // Wait for an attempt to finish, for the next to become due, or for the
+                    // deadline. A zero it_value would disarm the timer, so it is at least 1ns.
+                    auto wake = deadline;
+                    if (next != order.end ()) {
+                        wake = std::min (wake, next_start);
+                    }
+                    itimerspec spec{};
+                    if (wake != clock::time_point::max ()) {
+                        auto const ns = std::max (
+                            std::chrono::duration_cast<std::chrono::nanoseconds> (wake - now)
+                                .count (),
+                            std::chrono::nanoseconds::rep{1});
+                        spec.it_value.tv_sec = static_cast<time_t> (ns / 1000000000);
+                        spec.it_value.tv_nsec = static_cast<long> (ns % 1000000000);
+                    }
+                    if (::timerfd_settime (timer.native_handle (), 0, &spec, nullptr) != 0) {
+                        co_return return_type{last_error ()};
+                    }
+                    if (std::error_code const erc = co_await r.readable (waiter)) {
+                        co_return return_type{erc};
+                    }
+
+                    // Check the attempts that have finished. Closing those that failed also
+                    // removes them from the epoll set.
+                    std::array<epoll_event, 16> events;
+                    int const n = ::epoll_wait (waiter.native_handle (), events.data (),
+                                                static_cast<int> (events.size ()), 0);
+                    for (auto ctr = 0; ctr < n; ++ctr) {
+                        int const ready = events[static_cast<std::size_t> (ctr)].data.fd;
+                        auto const pos = std::find_if (
+                            std::begin (attempts), std::end (attempts),
+                            [ready] (socket_descriptor const & fd) {
+                                return fd.native_handle () == ready;
+                            });
+                        if (pos == std::end (attempts)) {
+                            // The timer: wake is recomputed at the top of the loop.
+                            std::uint64_t expirations;
+                            (void) ::read (timer.native_handle (), &expirations,
+                                           sizeof (expirations));
+                            continue;
+                        }
+                        int so_error = 0;
+                        socklen_t len = sizeof (so_error);
+                        if (::getsockopt (ready, SOL_SOCKET, SO_ERROR, &so_error, &len) != 0) {
+                            so_error = errno;
+                        }
+                        if (so_error == 0) {
+                            // The losers are closed as attempts goes out of scope.
+                            co_return return_type{std::move (*pos)};
+                        }
+                        error = std::error_code{so_error, std::generic_category ()};
+                        attempts.erase (pos);
+                        // A failure means that the next attempt can start right away.
+                        next_start = clock::now ();
+                    }
+                }
+            }
+
+            // send request
+            // ~~~~~~~~~~~~
+            task<std::error_code> send_request (reactor & r, socket_descriptor const & fd,
+                                                std::string request) {
+                char const * first = request.data ();
+                char const * const last = first + request.size ();
+                while (first != last) {
+                    ssize_t const sent =
+                        ::send (fd.native_handle (), first,
+                                static_cast<std::size_t> (last - first), MSG_NOSIGNAL);
+                    if (sent >= 0) {
+                        first += sent;
+                    } else if (would_block ()) {
+                        if (std::error_code const erc = co_await r.writable (fd)) {
+                            co_return erc;
+                        }
+                    } else if (errno != EINTR) {
+                        co_return last_error ();
+                    }
+                }
+                co_return std::error_code{};
+            }
+
+            stream::stream (reactor & r, socket_descriptor && fd)
+                    : r_{&r}
+                    , fd_{std::move (fd)}
+                    , buffer_ (4096) {}
+
+            // fill
+            // ~~~~
+            task<error_or<std::size_t>> stream::fill () {
+                using return_type = error_or<std::size_t>;
+                // Make room at the end of the buffer, first by discarding the bytes which have
+                // been consumed and then by growing it.
+                if (first_ > 0U) {
+                    std::memmove (buffer_.data (), buffer_.data () + first_, last_ - first_);
+                    last_ -= first_;
+                    first_ = 0;
+                }
+                if (last_ == buffer_.size ()) {
+                    buffer_.resize (buffer_.size () * 2U);
+                }
+                for (;;) {
+                    ssize_t const r = ::recv (fd_.native_handle (), buffer_.data () + last_,
+                                              buffer_.size () - last_, 0);
+                    if (r >= 0) {
+                        last_ += static_cast<std::size_t> (r);
+                        co_return return_type{static_cast<std::size_t> (r)};
+                    }
+                    if (would_block ()) {
+                        if (std::error_code const erc = co_await r_->readable (fd_)) {
+                            co_return return_type{erc};
+                        }
+                    } else if (errno != EINTR) {
+                        co_return return_type{last_error ()};
+                    }
+                }
+            }
+
+            // read line
+            // ~~~~~~~~~
+            task<error_or<maybe<std::string>>> stream::read_line () {
+                using return_type = error_or<maybe<std::string>>;
+                std::size_t scanned = first_;
+                for (;;) {
+                    auto const begin = buffer_.begin ();
+                    auto const lf = std::find (begin + static_cast<std::ptrdiff_t> (scanned),
+                                               begin + static_cast<std::ptrdiff_t> (last_), '\n');
+                    if (lf != begin + static_cast<std::ptrdiff_t> (last_)) {
+                        auto end = lf;
+                        if (end != begin + static_cast<std::ptrdiff_t> (first_) &&
+                            *(end - 1) == '\r') {
+                            --end;
+                        }
+                        std::string line{begin + static_cast<std::ptrdiff_t> (first_), end};
+                        first_ = static_cast<std::size_t> (lf - begin) + 1U;
+                        co_return return_type{maybe<std::string>{std::move (line)}};
+                    }
+                    if (last_ - first_ >= max_line_length) {
+                        co_return return_type{std::make_error_code (std::errc::message_size)};
+                    }
+                    // fill() moves the unconsumed bytes to the start of the buffer.
+                    scanned = last_ - first_;
+                    error_or<std::size_t> const got = co_await this->fill ();
+                    if (!got) {
+                        co_return return_type{got.get_error ()};
+                    }
+                    if (*got == 0U) {
+                        if (first_ != last_) {
+                            co_return return_type{http::details::out_of_data_error ()};
+                        }
+                        co_return return_type{maybe<std::string>{}};
+                    }
+                }
+            }
+
+            // read some
+            // ~~~~~~~~~
+            task<error_or<std::size_t>> stream::read_some (std::size_t const n,
+                                                           body_handler const & f) {
+                using return_type = error_or<std::size_t>;
+                if (first_ == last_) {
+                    first_ = last_ = 0;
+                    error_or<std::size_t> const got = co_await this->fill ();
+                    if (!got || *got == 0U) {
+                        co_return got;
+                    }
+                }
+                std::size_t const size = std::min (n, last_ - first_);
+                f (gsl::make_span (buffer_.data () + first_, size));
+                first_ += size;
+                co_return return_type{size};
+            }
+
+            namespace {
+
+                // Reads a body of exactly length bytes.
+                task<error_or<std::size_t>> read_fixed (stream & s, std::size_t const length,
+                                                        stream::body_handler const & consumer) {
+                    using return_type = error_or<std::size_t>;
+                    std::size_t remaining = length;
+                    while (remaining > 0U) {
+                        error_or<std::size_t> const moved =
+                            co_await s.read_some (remaining, consumer);
+                        if (!moved) {
+                            co_return moved;
+                        }
+                        if (*moved == 0U) {
+                            // The peer closed the connection before sending the whole body.
+                            co_return return_type{http::details::out_of_data_error ()};
+                        }
+                        remaining -= *moved;
+                    }
+                    co_return return_type{length};
+                }
+
+                // Reads a body which is delimited by the server closing the connection.
+                task<error_or<std::size_t>> read_to_eof (stream & s,
+                                                         stream::body_handler const & consumer) {
+                    using return_type = error_or<std::size_t>;
+                    std::size_t total = 0;
+                    for (;;) {
+                        error_or<std::size_t> const moved = co_await s.read_some (
+                            std::numeric_limits<std::size_t>::max (), consumer);
+                        if (!moved) {
+                            co_return moved;
+                        }
+                        if (*moved == 0U) {
+                            co_return return_type{total};
+                        }
+                        total += *moved;
+                    }
+                }
+
+                // Reads a line, treating the end of the stream as an error.
+                task<error_or<std::string>> get_line (stream & s) {
+                    using return_type = error_or<std::string>;
+                    error_or<maybe<std::string>> line = co_await s.read_line ();
+                    if (!line) {
+                        co_return return_type{line.get_error ()};
+                    }
+                    if (!*line) {
+                        co_return return_type{http::details::out_of_data_error ()};
+                    }
+                    co_return return_type{std::move (**line)};
+                }
+
+                // Reads a body sent with the chunked transfer-coding. Any trailer fields are
+                // discarded.
+                task<error_or<std::size_t>> read_chunked (stream & s,
+                                                          stream::body_handler const & consumer) {
+                    using return_type = error_or<std::size_t>;
+                    std::size_t total = 0;
+                    for (;;) {
+                        error_or<std::string> const size_line = co_await get_line (s);
+                        if (!size_line) {
+                            co_return return_type{size_line.get_error ()};
+                        }
+                        maybe<std::size_t> const size = parse_chunk_size (*size_line);
+                        if (!size) {
+                            co_return return_type{std::make_error_code (std::errc::bad_message)};
+                        }
+                        if (*size == 0U) {
+                            break;
+                        }
+                        error_or<std::size_t> const chunk =
+                            co_await read_fixed (s, *size, consumer);
+                        if (!chunk) {
+                            co_return chunk;
+                        }
+                        total += *size;
+
+                        // Each chunk's data is followed by CRLF.
+                        error_or<std::string> const crlf = co_await get_line (s);
+                        if (!crlf) {
+                            co_return return_type{crlf.get_error ()};
+                        }
+                        if (!crlf->empty ()) {
+                            co_return return_type{std::make_error_code (std::errc::bad_message)};
+                        }
+                    }
+                    // Skip the trailer section up to the terminating empty line.
+                    for (;;) {
+                        error_or<std::string> const trailer = co_await get_line (s);
+                        if (!trailer) {
+                            co_return return_type{trailer.get_error ()};
+                        }
+                        if (trailer->empty ()) {
+                            co_return return_type{total};
+                        }
+                    }
+                }
+
+            } // end anonymous namespace
+
+            // read headers
+            // ~~~~~~~~~~~~
+            task<std::error_code> read_headers (stream & s, header_block & headers) {
+                headers.clear ();
+                for (;;) {
+                    error_or<std::string> const line = co_await get_line (s);
+                    if (!line) {
+                        co_return line.get_error ();
+                    }
+                    if (line->empty ()) {
+                        co_return std::error_code{};
+                    }
+                    maybe<header_field> const field = parse_header_field (*line);
+                    if (!field) {
+                        co_return std::make_error_code (std::errc::bad_message);
+                    }
+                    headers.add (field->name, field->value);
+                }
+            }
+
+            // read final head
+            // ~~~~~~~~~~~~~~~
+            task<error_or<status_line>> read_final_head (stream & s, header_block & headers) {
+                using return_type = error_or<status_line>;
+                for (unsigned interim = 0U; interim <= max_interim_responses; ++interim) {
+                    error_or<std::string> const line = co_await get_line (s);
+                    if (!line) {
+                        co_return return_type{line.get_error ()};
+                    }
+                    error_or<status_line> const status = parse_status_line (*line);
+                    if (!status) {
+                        co_return status;
+                    }
+                    if (std::error_code const erc = co_await read_headers (s, headers)) {
+                        co_return return_type{erc};
+                    }
+                    auto const sc = status->status_code ();
+                    if (static_cast<int> (sc) >= 200 ||
+                        sc == http_status_code::switching_protocols) {
+                        // The status line refers to line, which is about to be destroyed.
+                        headers.set_reason_phrase (status->reason_phrase ());
+                        co_return return_type{std::in_place, status->http_version (), sc,
+                                              headers.reason_phrase ()};
+                    }
+                }
+                co_return return_type{std::make_error_code (std::errc::bad_message)};
+            }
+
+            // read body
+            // ~~~~~~~~~
+            task<error_or<std::size_t>> read_body (stream & s, http_status_code const code,
+                                                   header_block const & headers,
+                                                   stream::body_handler consumer) {
+                using return_type = error_or<std::size_t>;
+                if (http::details::bodiless (code)) {
+                    co_return return_type{std::size_t{0}};
+                }
+                if (maybe<std::string_view> const te =
+                        headers.find (known_header::transfer_encoding)) {
+                    if (!is_chunked (*te)) {
+                        co_return return_type{std::make_error_code (std::errc::not_supported)};
+                    }
+                    co_return co_await read_chunked (s, consumer);
+                }
+                if (maybe<std::string_view> const cl =
+                        headers.find (known_header::content_length)) {
+                    maybe<std::size_t> const length = parse_content_length (*cl);
+                    if (!length) {
+                        co_return return_type{std::make_error_code (std::errc::bad_message)};
+                    }
+                    co_return co_await read_fixed (s, *length, consumer);
+                }
+                co_return co_await read_to_eof (s, consumer);
+            }
+
+        } // end namespace coro
+    } // end namespace http
+} // end namespace pstore
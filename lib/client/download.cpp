@@ -0,0 +1,421 @@
+#include "client/download.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <charconv>
+#include <limits>
+#include <memory>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "pstore/adt/maybe.hpp"
+#include "pstore/http/buffered_reader.hpp"
+#include "pstore/http/net_txrx.hpp"
+
+#include "client/body_sink.hpp"
+#include "client/client.hpp"
+#include "client/happy_eyeballs.hpp"
+#include "client/request_builder.hpp"
+#include "client/resolver.hpp"
+
+namespace {
+
+    using namespace pstore;
+
+    std::error_code last_error () noexcept { return {errno, std::generic_category ()}; }
+
+    constexpr auto unknown_length = std::numeric_limits<std::uint64_t>::max ();
+
+    // The error reported when the server answers a range request with the whole of a
+    // different version of the resource. (std::errc has no equivalent of ESTALE.)
+    std::error_code resource_changed () noexcept { return {ESTALE, std::generic_category ()}; }
+
+    // A decoded Content-Range header value.
+    struct content_range {
+        // False for the "bytes */length" form sent with a 416 response.
+        bool satisfied = false;
+        std::uint64_t first = 0;
+        std::uint64_t last = 0;
+        // The complete length of the body or unknown_length if the server sent "*".
+        std::uint64_t length = unknown_length;
+    };
+
+    bool parse_number (std::string_view const s, std::uint64_t & out) noexcept {
+        char const * const last = s.data () + s.length ();
+        auto const r = std::from_chars (s.data (), last, out);
+        return !s.empty () && r.ec == std::errc{} && r.ptr == last;
+    }
+
+    // Parses a Content-Range value of the form "bytes first-last/length" (where length may be
+    // "*") or "bytes */length" (RFC 7233 section 4.2).
+    maybe<content_range> parse_content_range (std::string_view v) {
+        constexpr std::string_view unit = "bytes ";
+        if (v.substr (0, unit.length ()) != unit) {
+            return {};
+        }
+        v.remove_prefix (unit.length ());
+        auto const slash = v.find ('/');
+        if (slash == std::string_view::npos) {
+            return {};
+        }
+        content_range result;
+        std::string_view const range = v.substr (0, slash);
+        std::string_view const length = v.substr (slash + 1U);
+        if (length != "*" && !parse_number (length, result.length)) {
+            return {};
+        }
+        if (range == "*") {
+            return maybe<content_range>{result};
+        }
+        auto const dash = range.find ('-');
+        if (dash == std::string_view::npos ||
+            !parse_number (range.substr (0, dash), result.first) ||
+            !parse_number (range.substr (dash + 1U), result.last) || result.last < result.first ||
+            (result.length != unknown_length && result.last >= result.length)) {
+            return {};
+        }
+        result.satisfied = true;
+        return maybe<content_range>{result};
+    }
+
+    maybe<content_range> find_content_range (http::header_block const & headers) {
+        maybe<std::string_view> const value = headers.find (http::known_header::content_range);
+        if (!value) {
+            return {};
+        }
+        return parse_content_range (*value);
+    }
+
+    // Sets the size of the file and, where the file system supports it, allocates its blocks
+    // so that the writes to it can't fail for lack of space and the file isn't fragmented.
+    std::error_code preallocate (int const fd, std::uint64_t const size) {
+        if (::ftruncate (fd, static_cast<off_t> (size)) != 0) {
+            return last_error ();
+        }
+        if (size > 0U) {
+            int const e = ::posix_fallocate (fd, 0, static_cast<off_t> (size));
+            if (e != 0 && e != EOPNOTSUPP && e != EINVAL) {
+                return {e, std::generic_category ()};
+            }
+        }
+        return {};
+    }
+
+    struct download_context {
+        download_context (std::string const & h, std::string const & p, std::string const & t,
+                          int const f, http::download_options const & o)
+                : host{h}
+                , port{p}
+                , path{t}
+                , fd{f}
+                , options{o} {}
+
+        std::string const & host;
+        std::string const & port;
+        std::string const & path;
+        int const fd;
+        http::download_options const & options;
+        http::address_list addresses;
+        // The If-Range validator (a strong entity-tag or a Last-Modified date) or empty if the
+        // server provided neither.
+        std::string validator;
+        std::uint64_t size = 0;
+        std::atomic<unsigned> resumes{0};
+        // Set when a range fails, telling the others to give up.
+        std::atomic<bool> abandon{false};
+    };
+
+    // The part of the body [next, end) which remains to be fetched for one range.
+    struct byte_range {
+        std::uint64_t next;
+        std::uint64_t end;
+    };
+
+    // Connects to the server and sends a GET request. If range is not empty, it is the value
+    // of a Range header which is accompanied by If-Range if there is a validator.
+    error_or<socket_descriptor> send_request (download_context const & ctx,
+                                              std::string const & range) {
+        using return_type = error_or<socket_descriptor>;
+        return_type eo_socket = http::connect_racing (ctx.addresses);
+        if (!eo_socket) {
+            return eo_socket;
+        }
+        http::request_builder & builder = http::thread_request_builder ();
+        builder.start ("GET", ctx.path).host (ctx.host, ctx.port);
+        if (!range.empty ()) {
+            builder.header_ref ("Range", range);
+            if (!ctx.validator.empty ()) {
+                builder.header_ref ("If-Range", ctx.validator);
+            }
+        }
+        if (std::error_code const erc = builder.finish ().send (*eo_socket)) {
+            return return_type{erc};
+        }
+        return eo_socket;
+    }
+
+    // Writes the whole of a response body to the start of the output file.
+    template <typename Reader>
+    error_or<http::download_result> single_stream (Reader & reader, socket_descriptor & fd,
+                                                   http::status_line const & status,
+                                                   http::header_block const & headers,
+                                                   int const out) {
+        using return_type = error_or<http::download_result>;
+        error_or<std::size_t> const length = http::content_length (headers);
+        if (!length) {
+            return return_type{length.get_error ()};
+        }
+        if (*length > 0U) {
+            if (std::error_code const erc = preallocate (out, *length)) {
+                return return_type{erc};
+            }
+        }
+        http::file_range_sink sink{out, 0};
+        auto const body =
+            http::read_message_body (reader, fd, status.status_code (), headers, sink);
+        if (!body) {
+            return return_type{body.get_error ()};
+        }
+        // Discard anything beyond the end of the body.
+        if (::ftruncate (out, static_cast<off_t> (sink.offset ())) != 0) {
+            return return_type{last_error ()};
+        }
+        http::download_result result;
+        result.size = sink.offset ();
+        result.ranges = 1;
+        return return_type{result};
+    }
+
+    // Makes a single attempt to fetch the remainder of r. r.next is advanced past any data
+    // which is written to the file, even if the attempt ultimately fails.
+    std::error_code fetch_range_once (download_context & ctx, byte_range & r) {
+        std::string const spec =
+            "bytes=" + std::to_string (r.next) + '-' + std::to_string (r.end - 1U);
+        error_or<socket_descriptor> eo_socket = send_request (ctx, spec);
+        if (!eo_socket) {
+            return eo_socket.get_error ();
+        }
+        socket_descriptor & fd = *eo_socket;
+        auto reader =
+            http::make_socket_reader (http::net::refiller, http::response_buffer_size);
+        http::header_block headers;
+        error_or<http::status_line> const eo_status = http::read_final_head (reader, fd, headers);
+        if (!eo_status) {
+            return eo_status.get_error ();
+        }
+        switch (eo_status->status_code ()) {
+        case http::http_status_code::partial_content: break;
+        // The resource has changed (If-Range didn't match).
+        case http::http_status_code::ok: return resource_changed ();
+        default: return std::make_error_code (std::errc::protocol_error);
+        }
+        maybe<content_range> const cr = find_content_range (headers);
+        if (!cr || !cr->satisfied || cr->first != r.next || cr->last >= r.end ||
+            cr->length != ctx.size) {
+            return std::make_error_code (std::errc::bad_message);
+        }
+
+        http::file_range_sink sink{ctx.fd, r.next, cr->last + 1U};
+        auto const body =
+            http::read_message_body (reader, fd, eo_status->status_code (), headers, sink);
+        r.next = sink.offset ();
+        if (!body) {
+            return body.get_error ();
+        }
+        if (r.next != cr->last + 1U) {
+            return http::details::out_of_data_error ();
+        }
+        return {};
+    }
+
+    // Fetches a range, resuming after interruptions.
+    std::error_code fetch_range (download_context & ctx, byte_range & r) {
+        unsigned failures = 0;
+        while (r.next < r.end) {
+            if (ctx.abandon.load (std::memory_order_relaxed)) {
+                return std::make_error_code (std::errc::operation_canceled);
+            }
+            std::uint64_t const before = r.next;
+            std::error_code const erc = fetch_range_once (ctx, r);
+            if (!erc) {
+                continue;
+            }
+            // The data already in the file belongs to an earlier version of the resource, so
+            // there's no point in asking again.
+            if (erc == resource_changed ()) {
+                ctx.abandon.store (true, std::memory_order_relaxed);
+                return erc;
+            }
+            if (r.next > before) {
+                failures = 0;
+            } else if (++failures > ctx.options.max_retries) {
+                ctx.abandon.store (true, std::memory_order_relaxed);
+                return erc;
+            }
+            ctx.resumes.fetch_add (1U, std::memory_order_relaxed);
+        }
+        return {};
+    }
+
+    // Splits [first, size) into ranges and fetches them concurrently.
+    error_or<http::download_result> fetch_ranges (download_context & ctx,
+                                                  std::uint64_t const first) {
+        using return_type = error_or<http::download_result>;
+        std::uint64_t const remaining = ctx.size - first;
+        std::uint64_t const count =
+            remaining == 0U
+                ? 0U
+                : std::clamp (remaining / std::max (ctx.options.min_range_size, std::uint64_t{1}),
+                              std::uint64_t{1},
+                              std::uint64_t{std::max (ctx.options.connections, 1U)});
+
+        std::vector<byte_range> ranges;
+        ranges.reserve (count);
+        for (auto ctr = std::uint64_t{0}; ctr < count; ++ctr) {
+            ranges.push_back (byte_range{first + remaining * ctr / count,
+                                         first + remaining * (ctr + 1U) / count});
+        }
+
+        // The first range is fetched by this thread, the rest by one thread each.
+        std::vector<std::error_code> errors (ranges.size ());
+        std::vector<std::thread> threads;
+        threads.reserve (ranges.size ());
+        auto const join_all = [&threads] {
+            for (std::thread & t : threads) {
+                t.join ();
+            }
+        };
+        try {
+            for (auto ctr = std::size_t{1}; ctr < ranges.size (); ++ctr) {
+                threads.emplace_back ([&ctx, &ranges, &errors, ctr] {
+                    errors[ctr] = fetch_range (ctx, ranges[ctr]);
+                });
+            }
+            if (!ranges.empty ()) {
+                errors[0] = fetch_range (ctx, ranges[0]);
+            }
+        } catch (...) {
+            // A thread couldn't be started (or this one's fetch threw): stop the threads which
+            // are running before the exception leaves them joinable.
+            ctx.abandon.store (true, std::memory_order_relaxed);
+            join_all ();
+            throw;
+        }
+        join_all ();
+
+        // Report the error which caused the download to be abandoned rather than the
+        // cancellation of the others.
+        for (std::error_code const & erc : errors) {
+            if (erc && erc != std::errc::operation_canceled) {
+                return return_type{erc};
+            }
+        }
+        http::download_result result;
+        result.size = ctx.size;
+        result.ranges = static_cast<unsigned> (count);
+        result.resumes = ctx.resumes.load ();
+        return return_type{result};
+    }
+
+} // end anonymous namespace
+
+namespace pstore {
+    namespace http {
+
+        // http download
+        // ~~~~~~~~~~~~~
+        error_or<download_result> http_download (std::string const & host, std::string const & port,
+                                                 std::string const & path, int const fd,
+                                                 download_options const & options) {
+            using return_type = error_or<download_result>;
+
+            error_or<addrinfo *> const eo_info = get_host_info (host, port);
+            if (!eo_info) {
+                return return_type{eo_info.get_error ()};
+            }
+            download_context ctx{host, port, path, fd, options};
+            {
+                std::unique_ptr<addrinfo, decltype (&freeaddrinfo)> info{*eo_info, &freeaddrinfo};
+                ctx.addresses = to_address_list (info.get ());
+            }
+
+            // Ask for the first byte to learn the body's size and whether ranges are supported.
+            error_or<socket_descriptor> eo_socket = send_request (ctx, "bytes=0-0");
+            if (!eo_socket) {
+                return return_type{eo_socket.get_error ()};
+            }
+            auto reader = make_socket_reader (net::refiller, response_buffer_size);
+            header_block headers;
+            error_or<status_line> eo_status = read_final_head (reader, *eo_socket, headers);
+            if (!eo_status) {
+                return return_type{eo_status.get_error ()};
+            }
+
+            switch (eo_status->status_code ()) {
+            case http_status_code::ok:
+                // The server ignored the Range header and is sending the whole body.
+                return single_stream (reader, *eo_socket, *eo_status, headers, fd);
+            case http_status_code::requested_range_not_satisfiable:
+                // Not even the first byte exists: the body is empty.
+                if (std::error_code const erc = preallocate (fd, 0)) {
+                    return return_type{erc};
+                }
+                return return_type{download_result{}};
+            case http_status_code::partial_content: break;
+            default: return return_type{std::make_error_code (std::errc::protocol_error)};
+            }
+
+            maybe<content_range> const cr = find_content_range (headers);
+            if (!cr || !cr->satisfied || cr->first != 0U) {
+                return return_type{std::make_error_code (std::errc::bad_message)};
+            }
+            if (cr->length == unknown_length) {
+                // The server won't say how big the body is so it can't be split. Ask again for
+                // all of it.
+                error_or<socket_descriptor> eo_whole_socket = send_request (ctx, std::string{});
+                if (!eo_whole_socket) {
+                    return return_type{eo_whole_socket.get_error ()};
+                }
+                auto whole_reader = make_socket_reader (net::refiller, response_buffer_size);
+                error_or<status_line> const eo_whole =
+                    read_final_head (whole_reader, *eo_whole_socket, headers);
+                if (!eo_whole) {
+                    return return_type{eo_whole.get_error ()};
+                }
+                if (eo_whole->status_code () != http_status_code::ok) {
+                    return return_type{std::make_error_code (std::errc::protocol_error)};
+                }
+                return single_stream (whole_reader, *eo_whole_socket, *eo_whole, headers, fd);
+            }
+
+            // If-Range needs a strong validator: a weak entity-tag won't do.
+            ctx.size = cr->length;
+            maybe<std::string_view> const etag = headers.find (known_header::etag);
+            maybe<std::string_view> const last_modified =
+                headers.find (known_header::last_modified);
+            if (etag && etag->compare (0, 2, "W/") != 0) {
+                ctx.validator = *etag;
+            } else if (last_modified) {
+                ctx.validator = *last_modified;
+            }
+
+            if (std::error_code const erc = preallocate (fd, ctx.size)) {
+                return return_type{erc};
+            }
+            // Keep the byte that we asked for; the ranges start after it.
+            file_range_sink first{fd, 0, cr->last + 1U};
+            auto const body =
+                read_message_body (reader, *eo_socket, eo_status->status_code (), headers, first);
+            if (!body) {
+                return return_type{body.get_error ()};
+            }
+            return fetch_ranges (ctx, first.offset ());
+        }
+
+    } // end namespace http
+} // end namespace pstore
@@ -0,0 +1,673 @@
+#include "client/event_loop.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstdint>
+
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "pstore/support/error.hpp"
+
+#include "client/happy_eyeballs.hpp"
+#include "client/socket_options.hpp"
+
+namespace pstore {
+    namespace http {
+
+        // connection
+        // ~~~~~~~~~~
+        struct event_loop::connection {
+            enum class phase { resolving, connecting, sending, receiving };
+
+            connection (std::uint64_t const i, std::string const & h, std::string const & p,
+                        request_options const & opts, std::string && req,
+                        completion_handler && d, body_handler && body)
+                    : id{i}
+                    , host{h}
+                    , port{p}
+                    , key{h + ':' + p}
+                    , limits{opts}
+                    , request{std::move (req)}
+                    , parser{std::move (body)}
+                    , done{std::move (d)} {}
+
+            /// Distinguishes this connection from any other that the loop creates, even one
+            /// that is later allocated at the same address.
+            std::uint64_t const id;
+            std::string const host;
+            std::string const port;
+            /// The host:port key under which the socket is kept once it is idle.
+            std::string const key;
+            request_options const limits;
+
+            /// The addresses to try, in the order in which they are to be tried.
+            address_list addresses;
+            /// The index of the next address to try.
+            std::size_t next_address = 0;
+            /// The connection attempts in progress.
+            std::vector<socket_descriptor> attempts;
+            /// The reason that the most recent attempt failed.
+            std::error_code attempt_error = std::make_error_code (std::errc::address_not_available);
+            /// Starts the next attempt when attempt_delay has passed.
+            timer_wheel::handle attempt_timer = 0;
+            /// Abandons the connection when the connect timeout has passed.
+            timer_wheel::handle connect_timer = 0;
+            /// The deadline for the current phase.
+            timer_wheel::handle deadline = 0;
+            /// The deadline for the whole request.
+            timer_wheel::handle total_deadline = 0;
+            socket_descriptor fd;
+            phase state = phase::resolving;
+            /// True if fd was taken from the idle connections for this request.
+            bool reused = false;
+            /// True once any of the response has arrived.
+            bool received = false;
+
+            std::string request;
+            /// The number of bytes of request that have been sent.
+            std::size_t sent = 0;
+
+            response_parser parser;
+            completion_handler done;
+            bool finished = false;
+        };
+
+        // mailbox
+        // ~~~~~~~
+        /// Functions posted to the loop from other threads. The eventfd wakes epoll_wait().
+        struct event_loop::mailbox {
+            explicit mailbox (int efd) noexcept
+                    : event_fd{efd} {}
+
+            socket_descriptor event_fd;
+            std::mutex mutex;
+            std::vector<std::function<void ()>> queue;
+        };
+
+        namespace {
+
+            std::error_code last_error () noexcept { return {errno, std::generic_category ()}; }
+
+        } // end anonymous namespace
+
+        // create
+        // ~~~~~~
+        error_or<std::unique_ptr<event_loop>>
+        event_loop::create (std::shared_ptr<resolver> r, happy_eyeballs_options const & options) {
+            return create (std::move (r), options, idle_options{});
+        }
+
+        error_or<std::unique_ptr<event_loop>>
+        event_loop::create (std::shared_ptr<resolver> r, happy_eyeballs_options const & options,
+                            idle_options const & idle) {
+            using return_type = error_or<std::unique_ptr<event_loop>>;
+            // socket_descriptor is used simply as an owner of the epoll and event file
+            // descriptors.
+            socket_descriptor fd{::epoll_create1 (EPOLL_CLOEXEC)};
+            if (!fd.valid ()) {
+                return return_type{last_error ()};
+            }
+            auto mb = std::make_shared<mailbox> (::eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC));
+            if (!mb->event_fd.valid ()) {
+                return return_type{last_error ()};
+            }
+            // The mailbox is marked by a null data pointer.
+            epoll_event ev{};
+            ev.events = EPOLLIN | EPOLLET;
+            ev.data.ptr = nullptr;
+            if (::epoll_ctl (fd.native_handle (), EPOLL_CTL_ADD, mb->event_fd.native_handle (),
+                             &ev) != 0) {
+                return return_type{last_error ()};
+            }
+            if (!r) {
+                r = std::make_shared<resolver> ();
+            }
+            return return_type{std::unique_ptr<event_loop>{
+                new event_loop (std::move (fd), std::move (mb), std::move (r), options, idle)}};
+        }
+
+        event_loop::event_loop (socket_descriptor && epoll_fd, std::shared_ptr<mailbox> && mb,
+                                std::shared_ptr<resolver> && r,
+                                happy_eyeballs_options const & options,
+                                idle_options const & idle)
+                : epoll_fd_{std::move (epoll_fd)}
+                , mailbox_{std::move (mb)}
+                , resolver_{std::move (r)}
+                , options_{options}
+                , idle_options_{idle}
+                , buffer_{new std::array<char, 64 * 1024>} {}
+
+        event_loop::~event_loop () noexcept = default;
+
+        // post
+        // ~~~~
+        void event_loop::post (std::weak_ptr<mailbox> const & mb, std::function<void ()> f) {
+            // The loop may have been destroyed while a lookup was in progress.
+            if (std::shared_ptr<mailbox> const m = mb.lock ()) {
+                {
+                    std::lock_guard<std::mutex> const lock{m->mutex};
+                    m->queue.push_back (std::move (f));
+                }
+                std::uint64_t const one = 1;
+                // A failure can only mean that the counter is saturated, which is enough to wake
+                // the loop anyway.
+                (void) ::write (m->event_fd.native_handle (), &one, sizeof (one));
+            }
+        }
+
+        // wake
+        // ~~~~
+        void event_loop::wake () const noexcept {
+            std::uint64_t const one = 1;
+            (void) ::write (mailbox_->event_fd.native_handle (), &one, sizeof (one));
+        }
+
+        // drain mailbox
+        // ~~~~~~~~~~~~~
+        void event_loop::drain_mailbox () {
+            std::uint64_t count;
+            while (::read (mailbox_->event_fd.native_handle (), &count, sizeof (count)) > 0) {
+            }
+            std::vector<std::function<void ()>> work;
+            {
+                std::lock_guard<std::mutex> const lock{mailbox_->mutex};
+                work.swap (mailbox_->queue);
+            }
+            for (auto const & f : work) {
+                f ();
+            }
+        }
+
+        // async get
+        // ~~~~~~~~~
+        std::error_code event_loop::async_get (std::string const & host, std::string const & port,
+                                               std::string const & path, completion_handler done,
+                                               body_handler body) {
+            return this->async_get (host, port, path, request_options{}, std::move (done),
+                                    std::move (body));
+        }
+
+        std::error_code event_loop::async_get (std::string const & host, std::string const & port,
+                                               std::string const & path,
+                                               request_options const & opts,
+                                               completion_handler done, body_handler body) {
+            std::string request;
+            builder_.start ("GET", path).host (host, port).finish ().copy_to (request);
+            auto c = std::make_unique<connection> (next_id_++, host, port, opts,
+                                                   std::move (request), std::move (done),
+                                                   std::move (body));
+            connection * const cp = c.get ();
+            connections_.emplace (cp, std::move (c));
+            if (opts.total.count () > 0) {
+                cp->total_deadline =
+                    timers_.schedule (timer_wheel::clock::now () + opts.total, [this, cp] {
+                        cp->total_deadline = 0;
+                        this->complete (*cp, std::make_error_code (std::errc::timed_out));
+                    });
+            }
+
+            // Send on an idle connection to the same host:port if there is one. Registering it
+            // reports that the socket is writable, so the request is sent by on_event().
+            for (socket_descriptor fd = this->take_idle (cp->key); fd.valid ();
+                 fd = this->take_idle (cp->key)) {
+                epoll_event ev{};
+                ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+                ev.data.ptr = cp;
+                if (::epoll_ctl (epoll_fd_.native_handle (), EPOLL_CTL_ADD, fd.native_handle (),
+                                 &ev) == 0) {
+                    cp->fd = std::move (fd);
+                    cp->reused = true;
+                    cp->state = connection::phase::sending;
+                    this->set_deadline (*cp, opts.first_byte);
+                    return {};
+                }
+            }
+
+            if (std::error_code const erc = this->resolve (*cp)) {
+                timers_.cancel (cp->connect_timer);
+                timers_.cancel (cp->deadline);
+                timers_.cancel (cp->total_deadline);
+                connections_.erase (cp);
+                return erc;
+            }
+            return {};
+        }
+
+        // take idle
+        // ~~~~~~~~~
+        socket_descriptor event_loop::take_idle (std::string const & key) {
+            // Expired connections whose timers have yet to run are closed first.
+            this->expire_idle (key);
+            auto const pos = idle_.find (key);
+            if (pos == idle_.end ()) {
+                return socket_descriptor{};
+            }
+            std::vector<idle_connection> & list = pos->second;
+            socket_descriptor fd;
+            while (!fd.valid () && !list.empty ()) {
+                fd = std::move (list.back ().fd);
+                list.pop_back ();
+                // Nothing should arrive on an idle connection: if it is readable, the server
+                // has closed it (or misbehaved) and it can't be used.
+                pollfd pfd{fd.native_handle (), POLLIN | POLLRDHUP, 0};
+                if (::poll (&pfd, 1, 0) != 0) {
+                    fd.reset ();
+                }
+            }
+            if (list.empty ()) {
+                idle_.erase (pos);
+            }
+            return fd;
+        }
+
+        // make idle
+        // ~~~~~~~~~
+        void event_loop::make_idle (std::string const & key, socket_descriptor && fd) {
+            std::vector<idle_connection> & list = idle_[key];
+            if (list.size () >= idle_options_.max_idle_per_host) {
+                if (list.empty ()) {
+                    idle_.erase (key);
+                }
+                return;
+            }
+            auto const now = timer_wheel::clock::now ();
+            list.push_back (idle_connection{std::move (fd), now});
+            if (idle_options_.idle_timeout.count () > 0) {
+                // The timer isn't cancelled if the connection is reused: it then finds nothing
+                // to expire.
+                timers_.schedule (now + idle_options_.idle_timeout,
+                                  [this, key] { this->expire_idle (key); });
+            }
+        }
+
+        // expire idle
+        // ~~~~~~~~~~~
+        void event_loop::expire_idle (std::string const & key) {
+            auto const timeout = idle_options_.idle_timeout;
+            auto const pos = idle_.find (key);
+            if (timeout.count () <= 0 || pos == idle_.end ()) {
+                return;
+            }
+            // The list is ordered from least to most recently used, so the expired connections
+            // are all at the front.
+            std::vector<idle_connection> & list = pos->second;
+            auto const now = timer_wheel::clock::now ();
+            list.erase (std::begin (list),
+                        std::find_if (std::begin (list), std::end (list),
+                                      [now, timeout] (idle_connection const & ic) {
+                                          return now - ic.since < timeout;
+                                      }));
+            if (list.empty ()) {
+                idle_.erase (pos);
+            }
+        }
+
+        // set deadline
+        // ~~~~~~~~~~~~
+        void event_loop::set_deadline (connection & c, std::chrono::milliseconds const limit) {
+            timers_.cancel (c.deadline);
+            c.deadline = 0;
+            if (limit.count () > 0) {
+                c.deadline = timers_.schedule (timer_wheel::clock::now () + limit, [this, &c] {
+                    c.deadline = 0;
+                    this->complete (c, std::make_error_code (std::errc::timed_out));
+                });
+            }
+        }
+
+        // resolve
+        // ~~~~~~~
+        std::error_code event_loop::resolve (connection & c) {
+            maybe<resolver::result_type> const cached = resolver_->cached (c.host, c.port);
+            if (cached) {
+                // A cache hit: start connecting straight away.
+                if (!*cached) {
+                    return cached->get_error ();
+                }
+                return this->begin_connect (c, ***cached);
+            }
+
+            // Resolve on the resolver's threads and continue on this one.
+            c.state = connection::phase::resolving;
+            this->set_deadline (c, c.limits.resolve);
+            // The connection may have completed and been destroyed by the time that the lookup
+            // does, so the callback names it by address and id and the loop checks that it is
+            // still there.
+            std::weak_ptr<mailbox> mb = mailbox_;
+            connection * const cp = &c;
+            std::uint64_t const id = c.id;
+            resolver_->resolve_async (
+                c.host, c.port, [this, mb, cp, id] (resolver::result_type const & r) {
+                    post (mb, [this, cp, id, r] {
+                        auto const pos = connections_.find (cp);
+                        if (pos != connections_.end () && pos->second->id == id) {
+                            this->on_resolved (*cp, r);
+                        }
+                    });
+                });
+            return {};
+        }
+
+        // retry
+        // ~~~~~
+        bool event_loop::retry (connection & c) {
+            // The server may have closed an idle connection just as we reused it. GET is
+            // idempotent so the request can safely be sent again on a new connection.
+            if (!c.reused || c.received) {
+                return false;
+            }
+            // Closing the socket also removes it from the epoll set.
+            c.fd.reset ();
+            c.reused = false;
+            c.sent = 0;
+            if (std::error_code const erc = this->resolve (c)) {
+                this->complete (c, erc);
+            }
+            return true;
+        }
+
+        // on resolved
+        // ~~~~~~~~~~~
+        void event_loop::on_resolved (connection & c, resolver::result_type const & r) {
+            if (c.finished) {
+                return;
+            }
+            std::error_code erc = r.get_error ();
+            if (!erc) {
+                erc = this->begin_connect (c, **r);
+            }
+            if (erc) {
+                this->complete (c, erc);
+            }
+        }
+
+        // begin connect
+        // ~~~~~~~~~~~~~
+        std::error_code event_loop::begin_connect (connection & c, address_list const & addrs) {
+            c.addresses = interleave_families (addrs);
+            c.state = connection::phase::connecting;
+            this->set_deadline (c, c.limits.connect);
+            if (options_.timeout.count () > 0) {
+                c.connect_timer =
+                    timers_.schedule (timer_wheel::clock::now () + options_.timeout, [this, &c] {
+                        c.connect_timer = 0;
+                        this->complete (c, std::make_error_code (std::errc::timed_out));
+                    });
+            }
+            return this->start_connect (c);
+        }
+
+        // start connect
+        // ~~~~~~~~~~~~~
+        std::error_code event_loop::start_connect (connection & c) {
+            timers_.cancel (c.attempt_timer);
+            c.attempt_timer = 0;
+            while (c.next_address < c.addresses.size ()) {
+                address const & addr = c.addresses[c.next_address++];
+                socket_descriptor fd{
+                    ::socket (addr.family (), SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)};
+                if (!fd.valid ()) {
+                    c.attempt_error = last_error ();
+                    continue;
+                }
+                if ((c.attempt_error = configure_socket (fd, options_.socket))) {
+                    continue;
+                }
+                bool const connected =
+                    ::connect (fd.native_handle (), addr.get (), addr.length) == 0;
+                if (!connected && errno != EINPROGRESS) {
+                    c.attempt_error = last_error ();
+                    continue;
+                }
+
+                // Register for everything once: with edge-triggered notification there is no
+                // need to modify the interest set as the connection moves between phases. Every
+                // attempt reports to the connection, which then checks them all.
+                epoll_event ev{};
+                ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+                ev.data.ptr = &c;
+                if (::epoll_ctl (epoll_fd_.native_handle (), EPOLL_CTL_ADD, fd.native_handle (),
+                                 &ev) != 0) {
+                    return last_error ();
+                }
+                c.attempts.push_back (std::move (fd));
+                if (connected) {
+                    return this->check_attempts (c);
+                }
+                if (c.next_address < c.addresses.size ()) {
+                    // Race the next address if no attempt has connected within attempt_delay.
+                    auto const race = [this, &c] {
+                        c.attempt_timer = 0;
+                        if (std::error_code const erc = this->start_connect (c)) {
+                            this->complete (c, erc);
+                        }
+                    };
+                    c.attempt_timer = timers_.schedule (
+                        timer_wheel::clock::now () + options_.attempt_delay, race);
+                }
+                return {};
+            }
+            return c.attempts.empty () ? c.attempt_error : std::error_code{};
+        }
+
+        // check attempts
+        // ~~~~~~~~~~~~~~
+        std::error_code event_loop::check_attempts (connection & c) {
+            auto it = c.attempts.begin ();
+            while (it != c.attempts.end ()) {
+                pollfd pfd{it->native_handle (), POLLOUT, 0};
+                if (::poll (&pfd, 1, 0) <= 0) {
+                    ++it;
+                    continue;
+                }
+                int error = 0;
+                socklen_t len = sizeof (error);
+                if (::getsockopt (it->native_handle (), SOL_SOCKET, SO_ERROR, &error, &len) != 0) {
+                    error = errno;
+                }
+                if (error == 0) {
+                    // The winner. Closing the other attempts also removes them from the epoll
+                    // set.
+                    c.fd = std::move (*it);
+                    c.attempts.clear ();
+                    timers_.cancel (c.attempt_timer);
+                    timers_.cancel (c.connect_timer);
+                    c.attempt_timer = c.connect_timer = 0;
+                    c.state = connection::phase::sending;
+                    this->set_deadline (c, c.limits.first_byte);
+                    return {};
+                }
+                c.attempt_error = std::error_code{error, std::generic_category ()};
+                it = c.attempts.erase (it);
+            }
+            // If every attempt has failed, there's no need to wait before trying the next
+            // address.
+            return c.attempts.empty () ? this->start_connect (c) : std::error_code{};
+        }
+
+        // run once
+        // ~~~~~~~~
+        error_or<std::size_t> event_loop::run_once (std::chrono::milliseconds timeout) {
+            using return_type = error_or<std::size_t>;
+            using clock = timer_wheel::clock;
+            // Wait no longer than the time until the next timer is due.
+            if (maybe<clock::time_point> const next = timers_.next_expiry ()) {
+                auto const until = std::chrono::ceil<std::chrono::milliseconds> (
+                    std::max (*next - clock::now (), clock::duration{0}));
+                if (timeout.count () < 0 || until < timeout) {
+                    timeout = until;
+                }
+            }
+            std::array<epoll_event, 256> events;
+            int const n =
+                ::epoll_wait (epoll_fd_.native_handle (), events.data (),
+                              static_cast<int> (events.size ()),
+                              timeout.count () < 0 ? -1 : static_cast<int> (timeout.count ()));
+            if (n < 0 && errno != EINTR) {
+                return return_type{last_error ()};
+            }
+            std::size_t handled = 0;
+            for (auto ctr = 0; ctr < n; ++ctr) {
+                auto & ev = events[static_cast<std::size_t> (ctr)];
+                if (ev.data.ptr == nullptr) {
+                    this->drain_mailbox ();
+                } else {
+                    this->on_event (*static_cast<connection *> (ev.data.ptr), ev.events);
+                }
+                ++handled;
+            }
+            handled += timers_.advance (clock::now ());
+            finished_.clear ();
+            return return_type{handled};
+        }
+
+        // run
+        // ~~~
+        std::error_code event_loop::run () {
+            while (this->in_flight () > 0U) {
+                error_or<std::size_t> const r = this->run_once (std::chrono::milliseconds{-1});
+                if (!r) {
+                    return r.get_error ();
+                }
+            }
+            return {};
+        }
+
+        // on event
+        // ~~~~~~~~
+        void event_loop::on_event (connection & c, std::uint32_t events) {
+            if (c.finished) {
+                return;
+            }
+            std::error_code erc;
+            if (c.state == connection::phase::resolving) {
+                return;
+            }
+            if (c.state != connection::phase::receiving &&
+                (events & (EPOLLOUT | EPOLLERR | EPOLLHUP)) != 0U) {
+                erc = this->on_writable (c);
+            }
+            // Once the request has been sent, try reading straight away: the edge that
+            // announced the response may have been reported alongside this one.
+            if (!erc && c.state == connection::phase::receiving) {
+                erc = this->on_readable (c);
+            }
+            if (erc) {
+                this->complete (c, erc);
+            }
+        }
+
+        // on writable
+        // ~~~~~~~~~~~
+        std::error_code event_loop::on_writable (connection & c) {
+            if (c.state == connection::phase::connecting) {
+                if (std::error_code const erc = this->check_attempts (c)) {
+                    return erc;
+                }
+                if (c.state == connection::phase::connecting) {
+                    return {};
+                }
+            }
+
+            while (c.sent < c.request.length ()) {
+                ssize_t const r =
+                    ::send (c.fd.native_handle (), c.request.data () + c.sent,
+                            c.request.length () - c.sent, MSG_NOSIGNAL);
+                if (r < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                        // The socket buffer is full: wait for the next EPOLLOUT edge.
+                        return {};
+                    }
+                    std::error_code const erc = last_error ();
+                    return this->retry (c) ? std::error_code{} : erc;
+                }
+                c.sent += static_cast<std::size_t> (r);
+            }
+            c.state = connection::phase::receiving;
+            return {};
+        }
+
+        // on readable
+        // ~~~~~~~~~~~
+        std::error_code event_loop::on_readable (connection & c) {
+            // Edge-triggered: keep reading until the kernel has nothing more to give us.
+            for (;;) {
+                ssize_t const r =
+                    ::recv (c.fd.native_handle (), buffer_->data (), buffer_->size (), 0);
+                if (r < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                        // A short read: park the connection until more data arrives.
+                        return {};
+                    }
+                    std::error_code const erc = last_error ();
+                    return this->retry (c) ? std::error_code{} : erc;
+                }
+                if (r == 0) {
+                    if (!this->retry (c)) {
+                        this->complete (c, c.parser.eof ());
+                    }
+                    return {};
+                }
+                if (!c.received) {
+                    c.received = true;
+                    this->set_deadline (c, c.limits.body);
+                }
+                auto const size = static_cast<std::size_t> (r);
+                error_or<std::size_t> const consumed =
+                    c.parser.parse (buffer_->data (), buffer_->data () + size);
+                if (!consumed) {
+                    return consumed.get_error ();
+                }
+                if (c.parser.complete ()) {
+                    // The connection can be reused only if nothing follows the response.
+                    bool const reusable =
+                        *consumed == size &&
+                        keep_alive (c.parser.http_version (), c.parser.headers ());
+                    this->complete (c, std::error_code{}, reusable);
+                    return {};
+                }
+            }
+        }
+
+        // complete
+        // ~~~~~~~~
+        void event_loop::complete (connection & c, std::error_code erc, bool const reusable) {
+            assert (!c.finished);
+            c.finished = true;
+            // An idle socket is taken out of the epoll set: it is registered again, for the
+            // connection that reuses it, by async_get().
+            if (reusable && ::epoll_ctl (epoll_fd_.native_handle (), EPOLL_CTL_DEL,
+                                         c.fd.native_handle (), nullptr) == 0) {
+                this->make_idle (c.key, std::move (c.fd));
+            }
+            c.fd.reset ();
+            c.attempts.clear ();
+            timers_.cancel (c.attempt_timer);
+            timers_.cancel (c.connect_timer);
+            timers_.cancel (c.deadline);
+            timers_.cancel (c.total_deadline);
+            c.attempt_timer = c.connect_timer = c.deadline = c.total_deadline = 0;
+
+            auto const pos = connections_.find (&c);
+            assert (pos != connections_.end ());
+            finished_.push_back (std::move (pos->second));
+            connections_.erase (pos);
+
+            if (c.done) {
+                c.done (erc, c.parser);
+            }
+        }
+
+    } // end namespace http
+} // end namespace pstore
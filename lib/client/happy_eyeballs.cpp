@@ -0,0 +1,180 @@
+#include "client/happy_eyeballs.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+
+namespace {
+
+    using namespace pstore;
+
+    std::error_code last_error () noexcept { return {errno, std::generic_category ()}; }
+
+    // Starts a non-blocking connect to addr. On return, fd is either connected, connecting or
+    // invalid. With TCP Fast Open and a cookie from an earlier connection, connect() succeeds
+    // at once: the handshake happens when the request is sent.
+    std::error_code start_attempt (http::address const & addr,
+                                   http::socket_options const & opts, socket_descriptor & fd,
+                                   bool & connected) {
+        fd.reset (::socket (addr.family (), SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0));
+        if (!fd.valid ()) {
+            return last_error ();
+        }
+        if (std::error_code const erc = http::configure_socket (fd, opts)) {
+            fd.reset ();
+            return erc;
+        }
+        connected = ::connect (fd.native_handle (), addr.get (), addr.length) == 0;
+        if (!connected && errno != EINPROGRESS) {
+            auto const erc = last_error ();
+            fd.reset ();
+            return erc;
+        }
+        return {};
+    }
+
+    std::error_code make_blocking (socket_descriptor const & fd) {
+        int const flags = ::fcntl (fd.native_handle (), F_GETFL);
+        if (flags < 0 || ::fcntl (fd.native_handle (), F_SETFL, flags & ~O_NONBLOCK) < 0) {
+            return last_error ();
+        }
+        return {};
+    }
+
+} // end anonymous namespace
+
+namespace pstore {
+    namespace http {
+
+        // interleave families
+        // ~~~~~~~~~~~~~~~~~~~
+        address_list interleave_families (address_list const & addrs) {
+            if (addrs.empty ()) {
+                return {};
+            }
+            int const first_family = addrs.front ().family ();
+            address_list preferred;
+            address_list other;
+            for (address const & a : addrs) {
+                (a.family () == first_family ? preferred : other).push_back (a);
+            }
+            address_list result;
+            result.reserve (addrs.size ());
+            auto p = preferred.begin ();
+            auto o = other.begin ();
+            while (p != preferred.end () || o != other.end ()) {
+                if (p != preferred.end ()) {
+                    result.push_back (*p++);
+                }
+                if (o != other.end ()) {
+                    result.push_back (*o++);
+                }
+            }
+            return result;
+        }
+
+        // connect racing
+        // ~~~~~~~~~~~~~~
+        error_or<socket_descriptor> connect_racing (address_list const & addrs,
+                                                    happy_eyeballs_options const & options) {
+            using return_type = error_or<socket_descriptor>;
+            using clock = std::chrono::steady_clock;
+
+            address_list const order = interleave_families (addrs);
+            auto next = order.begin ();
+            std::error_code error = std::make_error_code (std::errc::address_not_available);
+
+            std::vector<socket_descriptor> attempts;
+            std::vector<pollfd> fds;
+            auto const deadline = options.timeout.count () > 0
+                                      ? clock::now () + options.timeout
+                                      : clock::time_point::max ();
+            auto next_start = clock::now ();
+
+            for (;;) {
+                auto now = clock::now ();
+                // Start the next attempt if it's due or if there's nothing else in progress.
+                while (next != order.end () && (now >= next_start || attempts.empty ())) {
+                    socket_descriptor fd;
+                    bool connected = false;
+                    if (std::error_code const erc =
+                            start_attempt (*next++, options.socket, fd, connected)) {
+                        error = erc;
+                        continue;
+                    }
+                    if (connected) {
+                        if (std::error_code const erc = make_blocking (fd)) {
+                            return return_type{erc};
+                        }
+                        return return_type{std::move (fd)};
+                    }
+                    attempts.push_back (std::move (fd));
+                    next_start = now + options.attempt_delay;
+                    break;
+                }
+                if (attempts.empty ()) {
+                    return return_type{error};
+                }
+                if (now >= deadline) {
+                    return return_type{std::make_error_code (std::errc::timed_out)};
+                }
+
+                // Wait for an attempt to finish, for the next to become due, or for the
+                // deadline.
+                auto wake = deadline;
+                if (next != order.end ()) {
+                    wake = std::min (wake, next_start);
+                }
+                int timeout = -1;
+                if (wake != clock::time_point::max ()) {
+                    auto const ms = std::chrono::duration_cast<std::chrono::milliseconds> (
+                                        wake - now + std::chrono::milliseconds{1})
+                                        .count ();
+                    timeout = static_cast<int> (std::max (ms, decltype (ms){0}));
+                }
+                fds.clear ();
+                for (socket_descriptor const & fd : attempts) {
+                    fds.push_back (pollfd{fd.native_handle (), POLLOUT, 0});
+                }
+                int const r = ::poll (fds.data (), fds.size (), timeout);
+                if (r < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    return return_type{last_error ()};
+                }
+
+                // Check the attempts that have finished, removing those that failed.
+                auto index = fds.size ();
+                while (index > 0U) {
+                    --index;
+                    if (fds[index].revents == 0) {
+                        continue;
+                    }
+                    socket_descriptor & fd = attempts[index];
+                    int so_error = 0;
+                    socklen_t len = sizeof (so_error);
+                    if (::getsockopt (fd.native_handle (), SOL_SOCKET, SO_ERROR, &so_error,
+                                      &len) != 0) {
+                        so_error = errno;
+                    }
+                    if (so_error == 0) {
+                        if (std::error_code const erc = make_blocking (fd)) {
+                            return return_type{erc};
+                        }
+                        // The losers are closed as attempts goes out of scope.
+                        return return_type{std::move (fd)};
+                    }
+                    error = std::error_code{so_error, std::generic_category ()};
+                    attempts.erase (attempts.begin () + static_cast<std::ptrdiff_t> (index));
+                    // A failure means that the next attempt can start right away.
+                    next_start = clock::now ();
+                }
+            }
+        }
+
+    } // end namespace http
+} // end namespace pstore
@@ -0,0 +1,172 @@
+#include "client/header_block.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cctype>
+#include <limits>
+
+namespace {
+
+    using namespace pstore;
+
+    constexpr char lower (char const c) noexcept {
+        return c >= 'A' && c <= 'Z' ? static_cast<char> (c - 'A' + 'a') : c;
+    }
+
+    // Compares a name in any case with one that is known to be in lower-case.
+    bool equal_lower (std::string_view const name, std::string_view const lower_name) noexcept {
+        return name.length () == lower_name.length () &&
+               std::equal (std::begin (name), std::end (name), std::begin (lower_name),
+                           [] (char const c1, char const c2) { return lower (c1) == c2; });
+    }
+
+#define CLIENT_KNOWN_HEADER(name, id) std::string_view{name},
+    constexpr std::array<std::string_view, http::known_header_count> known_names{
+        {CLIENT_KNOWN_HEADERS}};
+#undef CLIENT_KNOWN_HEADER
+
+    // The length of the longest known header name.
+    constexpr std::size_t max_known_length () noexcept {
+        std::size_t result = 0;
+        for (std::string_view const n : known_names) {
+            result = std::max (result, n.length ());
+        }
+        return result;
+    }
+
+    // For each name length, a bit mask of the known headers with that length. Most names are
+    // rejected by this table without a single character comparison.
+    constexpr std::array<std::uint32_t, max_known_length () + 1U> make_by_length () noexcept {
+        std::array<std::uint32_t, max_known_length () + 1U> result{};
+        for (std::size_t h = 0; h < known_names.size (); ++h) {
+            result[known_names[h].length ()] |= std::uint32_t{1} << h;
+        }
+        return result;
+    }
+    constexpr auto by_length = make_by_length ();
+    static_assert (http::known_header_count <= 32U, "by_length needs more bits");
+
+} // end anonymous namespace
+
+namespace pstore {
+    namespace http {
+
+        // lookup known header
+        // ~~~~~~~~~~~~~~~~~~~
+        maybe<known_header> lookup_known_header (std::string_view const name) noexcept {
+            if (name.length () >= by_length.size ()) {
+                return {};
+            }
+            for (std::uint32_t candidates = by_length[name.length ()]; candidates != 0U;
+                 candidates &= candidates - 1U) {
+                auto index = 0U;
+                while ((candidates & (std::uint32_t{1} << index)) == 0U) {
+                    ++index;
+                }
+                if (equal_lower (name, known_names[index])) {
+                    return maybe<known_header>{static_cast<known_header> (index)};
+                }
+            }
+            return {};
+        }
+
+        std::string_view known_header_name (known_header const h) noexcept {
+            return known_names[static_cast<std::size_t> (h)];
+        }
+
+        // clear
+        // ~~~~~
+        void header_block::clear () noexcept {
+            text_.clear ();
+            reason_.clear ();
+            fields_.clear ();
+            slots_.fill (0);
+        }
+
+        // find
+        // ~~~~
+        maybe<std::string_view> header_block::find (std::string_view const name) const noexcept {
+            if (maybe<known_header> const h = lookup_known_header (name)) {
+                return this->find (*h);
+            }
+            std::size_t const index = this->index_of (name);
+            if (index == fields_.size ()) {
+                return {};
+            }
+            return maybe<std::string_view>{this->value (fields_[index])};
+        }
+
+        // add
+        // ~~~
+        void header_block::add (std::string_view const name, std::string_view const value) {
+            std::size_t const index = this->index_of (name);
+            if (index == fields_.size ()) {
+                this->add_entry (name, value);
+                return;
+            }
+            // The combined value is written to the end of the arena. The old value's bytes are
+            // abandoned until the block is cleared.
+            entry & e = fields_[index];
+            text_.reserve (text_.size () + e.value_length + 2U + value.length ());
+            std::string_view const previous = this->value (e);
+            auto const offset = static_cast<std::uint32_t> (text_.size ());
+            text_.append (previous.data (), previous.length ());
+            text_.append (", ");
+            text_.append (value.data (), value.length ());
+            e.value_offset = offset;
+            e.value_length = static_cast<std::uint32_t> (text_.size () - offset);
+        }
+
+        // set
+        // ~~~
+        void header_block::set (std::string_view const name, std::string_view const value) {
+            std::size_t const index = this->index_of (name);
+            if (index == fields_.size ()) {
+                this->add_entry (name, value);
+                return;
+            }
+            entry & e = fields_[index];
+            e.value_offset = this->append_text (value);
+            e.value_length = static_cast<std::uint32_t> (value.length ());
+        }
+
+        // index of
+        // ~~~~~~~~
+        std::size_t header_block::index_of (std::string_view const name) const noexcept {
+            if (maybe<known_header> const h = lookup_known_header (name)) {
+                std::uint32_t const slot = slots_[static_cast<std::size_t> (*h)];
+                return slot == 0U ? fields_.size () : slot - 1U;
+            }
+            auto const pos = std::find_if (
+                std::begin (fields_), std::end (fields_),
+                [this, name] (entry const & e) { return equal_lower (name, this->name (e)); });
+            return static_cast<std::size_t> (pos - std::begin (fields_));
+        }
+
+        // append text
+        // ~~~~~~~~~~~
+        std::uint32_t header_block::append_text (std::string_view const s) {
+            assert (text_.size () + s.length () <= std::numeric_limits<std::uint32_t>::max ());
+            auto const offset = static_cast<std::uint32_t> (text_.size ());
+            text_.append (s.data (), s.length ());
+            return offset;
+        }
+
+        // add entry
+        // ~~~~~~~~~
+        void header_block::add_entry (std::string_view const name, std::string_view const value) {
+            entry e;
+            e.name_offset = static_cast<std::uint32_t> (text_.size ());
+            e.name_length = static_cast<std::uint32_t> (name.length ());
+            std::transform (std::begin (name), std::end (name), std::back_inserter (text_), lower);
+            e.value_offset = this->append_text (value);
+            e.value_length = static_cast<std::uint32_t> (value.length ());
+            if (maybe<known_header> const h = lookup_known_header (name)) {
+                slots_[static_cast<std::size_t> (*h)] =
+                    static_cast<std::uint32_t> (fields_.size () + 1U);
+            }
+            fields_.push_back (e);
+        }
+
+    } // end namespace http
+} // end namespace pstore
@@ -0,0 +1,148 @@
+#include "client/pipeline.hpp"
+
+#include <algorithm>
+#include <deque>
+
+#include "pstore/http/buffered_reader.hpp"
+#include "pstore/http/net_txrx.hpp"
+
+namespace {
+
+    using namespace pstore;
+
+    // Returns true if the body of a response with the given headers is delimited by the server
+    // closing the connection.
+    bool close_delimited (http::http_status_code const sc, http::header_block const & headers) {
+        auto const code = static_cast<int> (sc);
+        if (code < 200 || sc == http::http_status_code::no_content ||
+            sc == http::http_status_code::not_modified) {
+            return false;
+        }
+        return !headers.contains (http::known_header::transfer_encoding) &&
+               !headers.contains (http::known_header::content_length);
+    }
+
+    // Returns true if \p erc means that the connection was lost rather than that the server
+    // sent something which couldn't be understood.
+    bool connection_lost (std::error_code const erc) noexcept {
+        return erc == std::errc::broken_pipe || erc == std::errc::connection_reset ||
+               erc == std::errc::connection_aborted;
+    }
+
+} // end anonymous namespace
+
+namespace pstore {
+    namespace http {
+
+        // http get pipelined
+        // ~~~~~~~~~~~~~~~~~~
+        std::error_code http_get_pipelined (std::string const & host, std::string const & port,
+                                            std::vector<std::string> const & paths,
+                                            pipeline_options const & options,
+                                            pipeline_handler const & handler) {
+            // The indices of the requests which have not yet been sent, in order.
+            std::deque<std::size_t> unsent (paths.size ());
+            std::size_t index = 0;
+            std::generate (std::begin (unsent), std::end (unsent), [&index] { return index++; });
+
+            std::size_t const depth = std::max (options.depth, std::size_t{1});
+            unsigned failures = 0;
+            std::string body;
+            header_block headers;
+
+            while (!unsent.empty ()) {
+                error_or<socket_descriptor> eo_socket =
+                    get_host_info (host, port) >>= establish_connection;
+                if (!eo_socket) {
+                    return eo_socket.get_error ();
+                }
+                socket_descriptor & fd = *eo_socket;
+                auto reader = make_socket_reader (net::refiller, response_buffer_size);
+
+                // The indices of requests which have been sent but not yet answered.
+                std::deque<std::size_t> outstanding;
+                std::size_t answered = 0;
+                bool closing = false;
+                // Cleared if a request can't be sent. The responses to the requests that were
+                // sent may still be waiting to be read.
+                bool sending = true;
+                std::error_code erc;
+
+                while (!closing) {
+                    // Top up the pipeline.
+                    while (sending && outstanding.size () < depth && !unsent.empty ()) {
+                        erc = http_get (fd, host, port, paths[unsent.front ()]);
+                        if (erc) {
+                            if (!connection_lost (erc)) {
+                                return erc;
+                            }
+                            sending = false;
+                            break;
+                        }
+                        outstanding.push_back (unsent.front ());
+                        unsent.pop_front ();
+                    }
+                    if (outstanding.empty ()) {
+                        break;
+                    }
+
+                    // Wait for the first byte of the response to the oldest outstanding
+                    // request. If the connection is lost first, the server did not start to
+                    // answer and the outstanding requests can be replayed. Once the response
+                    // has begun, any failure is returned.
+                    if (reader.available () == 0U) {
+                        error_or<std::size_t> const got = reader.fill (fd);
+                        if (!got) {
+                            erc = got.get_error ();
+                            if (!connection_lost (erc)) {
+                                return erc;
+                            }
+                            break;
+                        }
+                        if (*got == 0U) {
+                            erc = std::make_error_code (std::errc::connection_aborted);
+                            break;
+                        }
+                    }
+
+                    error_or<status_line> eo_status = read_final_head (reader, fd, headers);
+                    if (!eo_status) {
+                        return eo_status.get_error ();
+                    }
+                    status_line const & status = *eo_status;
+
+                    body.clear ();
+                    auto const eo_body = read_message_body (
+                        reader, fd, status.status_code (), headers,
+                        [&body] (gsl::span<char const> const & span) {
+                            body.append (span.data (), static_cast<std::size_t> (span.size ()));
+                        });
+                    if (!eo_body) {
+                        return eo_body.get_error ();
+                    }
+
+                    handler (outstanding.front (), status, headers, body);
+                    outstanding.pop_front ();
+                    ++answered;
+
+                    // If the server is closing the connection, it won't answer any of the
+                    // requests that are still outstanding.
+                    closing = !keep_alive (status.http_version (), headers) ||
+                              close_delimited (status.status_code (), headers);
+                }
+
+                // Replay anything that went unanswered on a new connection, keeping the
+                // original order.
+                unsent.insert (std::begin (unsent), std::begin (outstanding),
+                               std::end (outstanding));
+                if (answered > 0U) {
+                    failures = 0;
+                } else if (!unsent.empty () && ++failures > options.max_replays) {
+                    return erc ? erc : std::make_error_code (std::errc::connection_aborted);
+                }
+            }
+            return {};
+        }
+
+    } // end namespace http
+} // end namespace pstore
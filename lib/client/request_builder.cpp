@@ -0,0 +1,185 @@
+#include "client/request_builder.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+
+#include <sys/socket.h>
+
+namespace {
+
+    constexpr auto crlf = std::string_view{"\r\n"};
+
+} // end anonymous namespace
+
+namespace pstore {
+    namespace http {
+
+        // thread request builder
+        // ~~~~~~~~~~~~~~~~~~~~~~
+        request_builder & thread_request_builder () {
+            thread_local request_builder builder;
+            return builder;
+        }
+
+        // is idempotent
+        // ~~~~~~~~~~~~~
+        bool is_idempotent (std::string_view const method) noexcept {
+            // Method names are case-sensitive.
+            return method == "GET" || method == "HEAD" || method == "PUT" ||
+                   method == "DELETE" || method == "OPTIONS" || method == "TRACE";
+        }
+
+        request_builder::request_builder (std::size_t capacity) {
+            buffer_.reserve (capacity);
+            segments_.reserve (16);
+            iov_.reserve (16);
+        }
+
+        // start
+        // ~~~~~
+        request_builder & request_builder::start (std::string_view method,
+                                                  std::string_view target) {
+            buffer_.clear ();
+            segments_.clear ();
+            this->append (method);
+            this->append (" ");
+            this->append (target);
+            this->append (" HTTP/1.1");
+            this->append (crlf);
+            return *this;
+        }
+
+        // header
+        // ~~~~~~
+        request_builder & request_builder::header (std::string_view name,
+                                                   std::string_view value) {
+            this->append (name);
+            this->append (": ");
+            this->append (value);
+            this->append (crlf);
+            return *this;
+        }
+
+        // header ref
+        // ~~~~~~~~~~
+        request_builder & request_builder::header_ref (std::string_view name,
+                                                       std::string_view value) {
+            this->append (name);
+            this->append (": ");
+            this->append_ref (value);
+            this->append (crlf);
+            return *this;
+        }
+
+        // host
+        // ~~~~
+        request_builder & request_builder::host (std::string_view host, std::string_view port) {
+            this->append ("Host: ");
+            this->append (host);
+            this->append (":");
+            this->append (port);
+            this->append (crlf);
+            return *this;
+        }
+
+        // finish
+        // ~~~~~~
+        request_builder & request_builder::finish () {
+            this->append (crlf);
+            return *this;
+        }
+
+        // size
+        // ~~~~
+        std::size_t request_builder::size () const noexcept {
+            std::size_t total = 0;
+            for (segment const & s : segments_) {
+                total += s.length;
+            }
+            return total;
+        }
+
+        // copy to
+        // ~~~~~~~
+        void request_builder::copy_to (std::string & out) const {
+            out.clear ();
+            out.reserve (this->size ());
+            for (segment const & s : segments_) {
+                out.append (s.ptr != nullptr ? s.ptr : buffer_.data () + s.offset, s.length);
+            }
+        }
+
+        // prepare iov
+        // ~~~~~~~~~~~
+        void request_builder::prepare_iov () {
+            iov_.clear ();
+            for (segment const & s : segments_) {
+                char const * const base = s.ptr != nullptr ? s.ptr : buffer_.data () + s.offset;
+                iov_.push_back (iovec{const_cast<char *> (base), s.length});
+            }
+            next_iov_ = 0;
+        }
+
+        // send once
+        // ~~~~~~~~~
+        error_or<std::size_t> request_builder::send_once (socket_descriptor const & fd) {
+            using return_type = error_or<std::size_t>;
+            auto first = iov_.begin () + static_cast<std::ptrdiff_t> (next_iov_);
+            auto const last = iov_.end ();
+            msghdr msg{};
+            msg.msg_iov = &*first;
+            msg.msg_iovlen = static_cast<decltype (msg.msg_iovlen)> (
+                std::min (last - first, std::ptrdiff_t{IOV_MAX}));
+            // sendmsg() rather than writev() so that MSG_NOSIGNAL can turn SIGPIPE into an EPIPE
+            // error.
+            ssize_t r;
+            while ((r = ::sendmsg (fd.native_handle (), &msg, MSG_NOSIGNAL)) < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    // The socket's send timeout (SO_SNDTIMEO) has expired.
+                    return return_type{std::make_error_code (std::errc::timed_out)};
+                }
+                if (errno != EINTR) {
+                    return return_type{std::error_code{errno, std::generic_category ()}};
+                }
+            }
+            // Skip the vectors that were completely written and adjust the first of those that
+            // remain to start after the bytes that were.
+            auto sent = static_cast<std::size_t> (r);
+            while (first != last && sent >= first->iov_len) {
+                sent -= first->iov_len;
+                ++first;
+            }
+            if (first != last) {
+                first->iov_base = static_cast<char *> (first->iov_base) + sent;
+                first->iov_len -= sent;
+            }
+            next_iov_ = static_cast<std::size_t> (first - iov_.begin ());
+            return return_type{static_cast<std::size_t> (r)};
+        }
+
+        // append
+        // ~~~~~~
+        void request_builder::append (std::string_view s) {
+            if (s.empty ()) {
+                return;
+            }
+            // Extend the previous segment if it also lives in the buffer.
+            if (!segments_.empty () && segments_.back ().ptr == nullptr) {
+                segments_.back ().length += s.length ();
+            } else {
+                segments_.push_back (segment{nullptr, buffer_.length (), s.length ()});
+            }
+            buffer_.append (s.data (), s.length ());
+        }
+
+        // append ref
+        // ~~~~~~~~~~
+        void request_builder::append_ref (std::string_view s) {
+            if (!s.empty ()) {
+                segments_.push_back (segment{s.data (), 0, s.length ()});
+            }
+        }
+
+    } // end namespace http
+} // end namespace pstore
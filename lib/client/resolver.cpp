@@ -0,0 +1,256 @@
+#include "client/resolver.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#include "client/client.hpp"
+
+namespace pstore {
+    namespace http {
+
+        // to address list
+        // ~~~~~~~~~~~~~~~
+        address_list to_address_list (addrinfo const * info) {
+            address_list result;
+            for (; info != nullptr; info = info->ai_next) {
+                if (info->ai_addr == nullptr || info->ai_addrlen > sizeof (sockaddr_storage)) {
+                    continue;
+                }
+                address a;
+                std::memset (&a.storage, 0, sizeof (a.storage));
+                std::memcpy (&a.storage, info->ai_addr, info->ai_addrlen);
+                a.length = info->ai_addrlen;
+                result.push_back (a);
+            }
+            return result;
+        }
+
+        // resolver
+        // ~~~~~~~~
+        resolver::resolver ()
+                : resolver (options{}) {}
+
+        resolver::resolver (options const & opts)
+                : options_{opts} {}
+
+        resolver::~resolver () noexcept {
+            {
+                std::lock_guard<std::mutex> const lock{mutex_};
+                done_ = true;
+            }
+            cv_.notify_all ();
+            for (std::thread & t : workers_) {
+                t.join ();
+            }
+        }
+
+        std::string resolver::make_key (std::string const & host, std::string const & port) {
+            std::string key;
+            key.reserve (host.length () + 1U + port.length ());
+            key += host;
+            key += ':';
+            key += port;
+            return key;
+        }
+
+        // lookup
+        // ~~~~~~
+        auto resolver::lookup (std::string const & host, std::string const & port)
+            -> result_type {
+            error_or<addrinfo *> const info = get_host_info (host, port);
+            if (!info) {
+                return result_type{info.get_error ()};
+            }
+            std::unique_ptr<addrinfo, decltype (&freeaddrinfo)> info_ptr{*info, &freeaddrinfo};
+            return result_type{std::make_shared<address_list const> (to_address_list (*info))};
+        }
+
+        // find fresh
+        // ~~~~~~~~~~
+        auto resolver::find_fresh (std::string const & key, clock::time_point now)
+            -> maybe<result_type> {
+            auto const pos = cache_.find (key);
+            if (pos == cache_.end () || !pos->second.result || pos->second.expires <= now) {
+                return {};
+            }
+            return pos->second.result;
+        }
+
+        // store
+        // ~~~~~
+        auto resolver::store (std::string const & key, result_type const & result)
+            -> std::vector<callback> {
+            auto const now = clock::now ();
+            std::lock_guard<std::mutex> const lock{mutex_};
+            entry & e = cache_[key];
+            e.pending = false;
+            if (e.pinned) {
+                // pin() has already answered any waiters.
+                std::vector<callback> waiters;
+                waiters.swap (e.waiters);
+                return waiters;
+            }
+
+            // Remember successes and names which definitely don't exist. Don't cache transient
+            // failures such as EAI_AGAIN: the next request should try again.
+            auto const erc = result.get_error ();
+            bool const negative = erc == make_gai_error_code (EAI_NONAME)
+#ifdef EAI_NODATA
+                                  || erc == make_gai_error_code (EAI_NODATA)
+#endif
+                ;
+            if (result || negative) {
+                e.result = result;
+                e.expires = now + (result ? options_.positive_ttl : options_.negative_ttl);
+            } else {
+                e.result.reset ();
+            }
+            std::vector<callback> waiters;
+            waiters.swap (e.waiters);
+            this->trim (now);
+            return waiters;
+        }
+
+        // trim
+        // ~~~~
+        void resolver::trim (clock::time_point now) {
+            if (cache_.size () <= options_.max_entries) {
+                return;
+            }
+            // Remove expired and unusable entries first.
+            for (auto it = cache_.begin (); it != cache_.end ();) {
+                entry const & e = it->second;
+                if (!e.pending && (!e.result || e.expires <= now)) {
+                    it = cache_.erase (it);
+                } else {
+                    ++it;
+                }
+            }
+            // Then the entries which would expire soonest.
+            while (cache_.size () > options_.max_entries) {
+                auto victim = cache_.end ();
+                for (auto it = cache_.begin (); it != cache_.end (); ++it) {
+                    if (!it->second.pending &&
+                        (victim == cache_.end () || it->second.expires < victim->second.expires)) {
+                        victim = it;
+                    }
+                }
+                if (victim == cache_.end ()) {
+                    break;
+                }
+                cache_.erase (victim);
+            }
+        }
+
+        // resolve
+        // ~~~~~~~
+        auto resolver::resolve (std::string const & host, std::string const & port)
+            -> result_type {
+            std::string key = make_key (host, port);
+            {
+                std::lock_guard<std::mutex> const lock{mutex_};
+                maybe<result_type> const r = this->find_fresh (key, clock::now ());
+                if (r) {
+                    return *r;
+                }
+            }
+            result_type const result = lookup (host, port);
+            for (callback const & cb : this->store (key, result)) {
+                cb (result);
+            }
+            return result;
+        }
+
+        // resolve async
+        // ~~~~~~~~~~~~~
+        void resolver::resolve_async (std::string const & host, std::string const & port,
+                                      callback cb) {
+            std::string key = make_key (host, port);
+            {
+                std::unique_lock<std::mutex> lock{mutex_};
+                maybe<result_type> const r = this->find_fresh (key, clock::now ());
+                if (!r) {
+                    entry & e = cache_[key];
+                    e.waiters.push_back (std::move (cb));
+                    if (!e.pending) {
+                        e.pending = true;
+                        queue_.push_back (work_item{std::move (key), host, port});
+                        if (workers_.size () < std::max (options_.worker_threads, 1U)) {
+                            workers_.emplace_back ([this] { this->worker (); });
+                        }
+                        lock.unlock ();
+                        cv_.notify_one ();
+                    }
+                    return;
+                }
+                lock.unlock ();
+                cb (*r);
+            }
+        }
+
+        // cached
+        // ~~~~~~
+        auto resolver::cached (std::string const & host, std::string const & port)
+            -> maybe<result_type> {
+            std::lock_guard<std::mutex> const lock{mutex_};
+            return this->find_fresh (make_key (host, port), clock::now ());
+        }
+
+        // pin
+        // ~~~
+        void resolver::pin (std::string const & host, std::string const & port,
+                            address_list addrs) {
+            auto const result =
+                result_type{std::make_shared<address_list const> (std::move (addrs))};
+            std::vector<callback> waiters;
+            {
+                std::lock_guard<std::mutex> const lock{mutex_};
+                entry & e = cache_[make_key (host, port)];
+                e.result = result;
+                e.expires = clock::time_point::max ();
+                e.pinned = true;
+                waiters.swap (e.waiters);
+            }
+            for (callback const & cb : waiters) {
+                cb (result);
+            }
+        }
+
+        // clear
+        // ~~~~~
+        void resolver::clear () {
+            std::lock_guard<std::mutex> const lock{mutex_};
+            for (auto it = cache_.begin (); it != cache_.end ();) {
+                if (it->second.pending) {
+                    it->second.result.reset ();
+                    it->second.pinned = false;
+                    ++it;
+                } else {
+                    it = cache_.erase (it);
+                }
+            }
+        }
+
+        // worker
+        // ~~~~~~
+        void resolver::worker () {
+            for (;;) {
+                work_item item;
+                {
+                    std::unique_lock<std::mutex> lock{mutex_};
+                    cv_.wait (lock, [this] { return done_ || !queue_.empty (); });
+                    if (queue_.empty ()) {
+                        return; // done_ is set and there's no more work.
+                    }
+                    item = std::move (queue_.front ());
+                    queue_.pop_front ();
+                }
+                result_type const result = lookup (item.host, item.port);
+                for (callback const & cb : this->store (item.key, result)) {
+                    cb (result);
+                }
+            }
+        }
+
+    } // end namespace http
+} // end namespace pstore
@@ -0,0 +1,529 @@
+#include "client/response_cache.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <charconv>
+#include <cstring>
+#include <exception>
+#include <new>
+#include <system_error>
+#include <vector>
+
+#include <sys/stat.h>
+
+#include "pstore/core/address.hpp"
+#include "pstore/core/database.hpp"
+#include "pstore/core/hamt_map.hpp"
+#include "pstore/core/index_types.hpp"
+#include "pstore/core/transaction.hpp"
+#include "pstore/http/buffered_reader.hpp"
+#include "pstore/http/net_txrx.hpp"
+
+#include "client/body_sink.hpp"
+#include "client/content_coding.hpp"
+#include "client/header_field.hpp"
+#include "client/request_builder.hpp"
+
+namespace {
+
+    using namespace pstore;
+
+    using pstore::http::details::equal_ci;
+
+    std::int64_t now () noexcept {
+        return std::chrono::duration_cast<std::chrono::seconds> (
+                   std::chrono::system_clock::now ().time_since_epoch ())
+            .count ();
+    }
+
+    maybe<std::int64_t> parse_seconds (std::string_view const s) noexcept {
+        std::int64_t result = 0;
+        char const * const last = s.data () + s.length ();
+        auto const r = std::from_chars (s.data (), last, result);
+        if (s.empty () || r.ec != std::errc{} || r.ptr != last || result < 0) {
+            return {};
+        }
+        return maybe<std::int64_t>{result};
+    }
+
+    // Headers which describe the connection or the encoding of the message rather than the
+    // resource itself. They are not stored and are not updated by a 304 response.
+    bool is_message_header (std::string_view const name) {
+        static std::array<char const *, 9> const names{{
+            "connection",
+            "content-encoding",
+            "content-length",
+            "keep-alive",
+            "proxy-authenticate",
+            "te",
+            "trailer",
+            "transfer-encoding",
+            "upgrade",
+        }};
+        return std::find_if (std::begin (names), std::end (names), [&name] (char const * n) {
+                   return name == n;
+               }) != std::end (names);
+    }
+
+    // Returns the headers to be stored for a response whose decoded body has length size.
+    http::header_block stored_headers (http::header_block const & headers,
+                                       std::size_t const size) {
+        http::header_block result;
+        for (http::header_field const field : headers) {
+            if (!is_message_header (field.name)) {
+                result.add (field.name, field.value);
+            }
+        }
+        result.set (http::known_header_name (http::known_header::content_length),
+                    std::to_string (size));
+        return result;
+    }
+
+    // The layout of the data stored for each cache entry. It is followed by the response
+    // headers, each name and value terminated by a NUL. The body is stored separately so
+    // that a refreshed entry can share the body of its predecessor.
+    struct record {
+        static constexpr std::array<char, 8> expected_signature{{'h', 't', 't', 'p', 'r', 'e',
+                                                                 's', '1'}};
+        std::array<char, 8> signature;
+        std::uint64_t body_address;
+        std::uint64_t body_size;
+        std::int64_t expires;
+        std::uint32_t status;
+        std::uint32_t headers_size;
+    };
+
+    std::vector<char> encode_record (record const & r, http::header_block const & headers) {
+        std::vector<char> result (sizeof (record));
+        for (http::header_field const field : headers) {
+            result.insert (std::end (result), std::begin (field.name), std::end (field.name));
+            result.push_back ('\0');
+            result.insert (std::end (result), std::begin (field.value), std::end (field.value));
+            result.push_back ('\0');
+        }
+        record header = r;
+        header.signature = record::expected_signature;
+        header.headers_size = static_cast<std::uint32_t> (result.size () - sizeof (record));
+        std::memcpy (result.data (), &header, sizeof (header));
+        return result;
+    }
+
+    // Runs f(), turning any exception thrown by pstore into an error code.
+    template <typename Function>
+    std::error_code guarded (Function f) noexcept {
+        try {
+            return f ();
+        } catch (std::system_error const & ex) {
+            return ex.code ();
+        } catch (std::bad_alloc const &) {
+            return std::make_error_code (std::errc::not_enough_memory);
+        } catch (...) {
+            return std::make_error_code (std::errc::io_error);
+        }
+    }
+
+    // Copies data into newly allocated storage in the database.
+    extent<char> write_data (transaction_base & transaction, gsl::span<char const> const data) {
+        if (data.size () == 0) {
+            return {};
+        }
+        auto const size = static_cast<std::size_t> (data.size ());
+        std::pair<std::shared_ptr<char>, typed_address<char>> const storage =
+            transaction.alloc_rw<char> (size);
+        std::memcpy (storage.first.get (), data.data (), size);
+        return make_extent (storage.second, size);
+    }
+
+    // store sink
+    // ~~~~~~~~~~
+    // A body sink which passes the body to the caller's handler as it arrives and keeps a copy
+    // to be stored in the cache. If the body grows beyond the buffer's limit, the copy is
+    // abandoned and the response is delivered without being stored.
+    class store_sink {
+    public:
+        store_sink (http::response_cache::body_handler const & body, bool const keep,
+                    std::size_t const max_size)
+                : body_{body} {
+            if (keep) {
+                copy_ = std::make_unique<http::buffer_sink> (0, http::default_body_chunk_size,
+                                                             max_size);
+            }
+        }
+
+        void expect (std::size_t const n) noexcept {
+            if (copy_) {
+                copy_->expect (n);
+            }
+        }
+        gsl::span<char> prepare (std::size_t const n) {
+            return http::details::scratch_buffer (http::default_body_chunk_size)
+                .first (static_cast<std::ptrdiff_t> (std::min (n, http::default_body_chunk_size)));
+        }
+        std::error_code commit (gsl::span<char const> const data) {
+            if (copy_ && copy_->commit (data)) {
+                copy_.reset ();
+            }
+            size_ += static_cast<std::size_t> (data.size ());
+            if (data.size () > 0) {
+                body_ (data);
+            }
+            return {};
+        }
+
+        /// The number of bytes in the body.
+        std::size_t size () const noexcept { return size_; }
+        /// The body to be stored or nothing if it is not to be stored.
+        maybe<gsl::span<char const>> kept () const noexcept {
+            if (!copy_) {
+                return {};
+            }
+            return maybe<gsl::span<char const>>{gsl::span<char const>{
+                copy_->data (), static_cast<std::ptrdiff_t> (copy_->size ())}};
+        }
+
+    private:
+        http::response_cache::body_handler const & body_;
+        std::unique_ptr<http::buffer_sink> copy_;
+        std::size_t size_ = 0;
+    };
+
+} // end anonymous namespace
+
+namespace pstore {
+    namespace http {
+
+        // parse cache policy
+        // ~~~~~~~~~~~~~~~~~~
+        cache_policy parse_cache_policy (header_block const & headers) {
+            cache_policy result;
+            if (headers.contains (known_header::vary)) {
+                result.storable = false;
+            }
+            maybe<std::int64_t> max_age;
+            bool no_cache = false;
+            if (maybe<std::string_view> const cc = headers.find (known_header::cache_control)) {
+                std::string_view value = *cc;
+                while (!value.empty ()) {
+                    auto const comma = value.find (',');
+                    std::string_view const directive = details::trim_ows (value.substr (0, comma));
+                    value = comma == std::string_view::npos ? std::string_view{}
+                                                            : value.substr (comma + 1U);
+                    auto const equals = directive.find ('=');
+                    std::string_view const name = details::trim_ows (directive.substr (0, equals));
+                    std::string_view argument;
+                    if (equals != std::string_view::npos) {
+                        argument = details::trim_ows (directive.substr (equals + 1U));
+                    }
+                    if (argument.length () >= 2U && argument.front () == '"' &&
+                        argument.back () == '"') {
+                        argument = argument.substr (1U, argument.length () - 2U);
+                    }
+                    if (equal_ci (name, "no-store")) {
+                        result.storable = false;
+                    } else if (equal_ci (name, "no-cache")) {
+                        no_cache = true;
+                    } else if (equal_ci (name, "max-age")) {
+                        // An invalid max-age makes the response stale (RFC 7234 section 4.2.1).
+                        max_age = parse_seconds (argument).value_or (0);
+                    }
+                }
+            }
+            if (no_cache || !max_age) {
+                return result;
+            }
+            // Time that the response has already spent in other caches counts against its
+            // lifetime.
+            std::int64_t age = 0;
+            if (maybe<std::string_view> const age_header = headers.find (known_header::age)) {
+                age = parse_seconds (details::trim_ows (*age_header)).value_or (0);
+            }
+            result.lifetime = std::chrono::seconds{std::max (*max_age - age, std::int64_t{0})};
+            return result;
+        }
+
+        // response cache
+        // ~~~~~~~~~~~~~~
+        struct response_cache::database {
+            explicit database (std::string const & p)
+                    : path{p}
+                    , db{p, pstore::database::access_mode::writable} {}
+            std::string const path;
+            pstore::database db;
+        };
+
+        struct response_cache::entry {
+            http_status_code status;
+            std::int64_t expires;
+            header_block headers;
+            extent<char> body;
+        };
+
+        error_or<std::unique_ptr<response_cache>>
+        response_cache::open (std::string const & path, cache_limits const & limits) {
+            using return_type = error_or<std::unique_ptr<response_cache>>;
+            std::unique_ptr<database> db;
+            if (std::error_code const erc = guarded ([&] () {
+                    db = std::make_unique<database> (path);
+                    return std::error_code{};
+                })) {
+                return return_type{erc};
+            }
+            return return_type{
+                std::unique_ptr<response_cache>{new response_cache (std::move (db), limits)}};
+        }
+
+        response_cache::response_cache (std::unique_ptr<database> && db,
+                                        cache_limits const & limits)
+                : db_{std::move (db)}
+                , limits_{limits} {}
+
+        response_cache::~response_cache () noexcept = default;
+
+        auto response_cache::snapshot () const noexcept -> counters {
+            counters result;
+            result.hits = hits_.load (std::memory_order_relaxed);
+            result.misses = misses_.load (std::memory_order_relaxed);
+            result.revalidations = revalidations_.load (std::memory_order_relaxed);
+            result.stores = stores_.load (std::memory_order_relaxed);
+            return result;
+        }
+
+        // full
+        // ~~~~
+        bool response_cache::full () const noexcept {
+            if (limits_.max_file_size == 0U) {
+                return false;
+            }
+            struct stat st;
+            return ::stat (db_->path.c_str (), &st) == 0 &&
+                   static_cast<std::uint64_t> (st.st_size) >= limits_.max_file_size;
+        }
+
+        // lookup
+        // ~~~~~~
+        auto response_cache::lookup (std::string const & key) -> maybe<entry> {
+            maybe<entry> result;
+            std::error_code const erc = guarded ([&] () {
+                pstore::database & db = db_->db;
+                // Pick up entries written by other processes since we last looked.
+                db.sync ();
+                auto const names = pstore::index::get_index<trailer::indices::write> (db, false);
+                if (names == nullptr) {
+                    return std::error_code{};
+                }
+                auto const pos = names->find (db, key);
+                if (pos == names->end (db)) {
+                    return std::error_code{};
+                }
+                extent<char> const ex = pos->second;
+                if (ex.size < sizeof (record)) {
+                    return std::make_error_code (std::errc::bad_message);
+                }
+                std::shared_ptr<char const> const data = db.getro (ex);
+                record r;
+                std::memcpy (&r, data.get (), sizeof (r));
+                if (r.signature != record::expected_signature ||
+                    r.headers_size != ex.size - sizeof (record)) {
+                    return std::make_error_code (std::errc::bad_message);
+                }
+                entry e;
+                e.status = static_cast<http_status_code> (r.status);
+                e.expires = r.expires;
+                e.body = make_extent (typed_address<char>::make (address{r.body_address}),
+                                      r.body_size);
+                // The headers are a series of NUL-terminated name/value pairs.
+                std::string_view rest{data.get () + sizeof (record), r.headers_size};
+                while (!rest.empty ()) {
+                    auto const name_end = rest.find ('\0');
+                    auto const value_end = rest.find ('\0', name_end + 1U);
+                    if (value_end == std::string_view::npos) {
+                        return std::make_error_code (std::errc::bad_message);
+                    }
+                    e.headers.add (rest.substr (0, name_end),
+                                   rest.substr (name_end + 1U, value_end - name_end - 1U));
+                    rest.remove_prefix (value_end + 1U);
+                }
+                result = std::move (e);
+                return std::error_code{};
+            });
+            // A damaged entry is treated as a miss: the response will replace it.
+            return erc ? maybe<entry>{} : result;
+        }
+
+        // store
+        // ~~~~~
+        std::error_code response_cache::store (std::string const & key,
+                                               http_status_code const status,
+                                               header_block const & headers,
+                                               cache_policy const & policy,
+                                               gsl::span<char const> const body) {
+            return guarded ([&] () {
+                pstore::database & db = db_->db;
+                // Holds the database's transaction lock, excluding writers in other processes,
+                // until the transaction is committed or destroyed.
+                auto transaction = pstore::begin (db);
+                record r{};
+                extent<char> const b = write_data (transaction, body);
+                r.body_address = b.addr.absolute ();
+                r.body_size = b.size;
+                r.expires = now () + policy.lifetime.count ();
+                r.status = static_cast<std::uint32_t> (status);
+                std::vector<char> const meta = encode_record (r, headers);
+                auto const names = pstore::index::get_index<trailer::indices::write> (db);
+                names->insert_or_assign (transaction, key, write_data (transaction, meta));
+                transaction.commit ();
+                return std::error_code{};
+            });
+        }
+
+        // refresh
+        // ~~~~~~~
+        std::error_code response_cache::refresh (std::string const & key, entry const & e,
+                                                 header_block const & headers,
+                                                 cache_policy const & policy) {
+            return guarded ([&] () {
+                pstore::database & db = db_->db;
+                auto transaction = pstore::begin (db);
+                record r{};
+                r.body_address = e.body.addr.absolute ();
+                r.body_size = e.body.size;
+                r.expires = now () + policy.lifetime.count ();
+                r.status = static_cast<std::uint32_t> (e.status);
+                std::vector<char> const meta = encode_record (r, headers);
+                auto const names = pstore::index::get_index<trailer::indices::write> (db);
+                names->insert_or_assign (transaction, key, write_data (transaction, meta));
+                transaction.commit ();
+                return std::error_code{};
+            });
+        }
+
+        // get
+        // ~~~
+        auto response_cache::get (std::string const & host, std::string const & port,
+                                  std::string const & path, header_block & headers,
+                                  body_handler const & body) -> error_or<response> {
+            using return_type = error_or<response>;
+            std::string const key = host + ':' + port + path;
+
+            // Passes a body which lies in the database to the handler. The mapping is not
+            // altered by transactions so the handler may run without holding the lock.
+            auto const serve = [this, &body] (entry const & e) {
+                if (e.body.size == 0U) {
+                    return std::error_code{};
+                }
+                std::shared_ptr<char const> data;
+                std::error_code const erc = guarded ([&] () {
+                    std::lock_guard<std::mutex> const lock{mut_};
+                    data = db_->db.getro (e.body);
+                    return std::error_code{};
+                });
+                if (!erc) {
+                    body (gsl::span<char const>{data.get (),
+                                                static_cast<std::ptrdiff_t> (e.body.size)});
+                }
+                return erc;
+            };
+
+            maybe<entry> cached;
+            {
+                std::lock_guard<std::mutex> const lock{mut_};
+                cached = this->lookup (key);
+            }
+            if (cached && cached->expires > now ()) {
+                if (std::error_code const erc = serve (*cached)) {
+                    return return_type{erc};
+                }
+                hits_.fetch_add (1U, std::memory_order_relaxed);
+                headers = cached->headers;
+                return return_type{response{cached->status, cache_outcome::hit}};
+            }
+
+            error_or<socket_descriptor> eo_socket =
+                get_host_info (host, port) >>= establish_connection;
+            if (!eo_socket) {
+                return return_type{eo_socket.get_error ()};
+            }
+            socket_descriptor & fd = *eo_socket;
+
+            request_builder & builder = thread_request_builder ();
+            builder.start ("GET", path)
+                .host (host, port)
+                .header_ref ("Accept-Encoding", accepted_content_codings);
+            if (cached) {
+                if (maybe<std::string_view> const etag =
+                        cached->headers.find (known_header::etag)) {
+                    builder.header_ref ("If-None-Match", *etag);
+                }
+                if (maybe<std::string_view> const last_modified =
+                        cached->headers.find (known_header::last_modified)) {
+                    builder.header_ref ("If-Modified-Since", *last_modified);
+                }
+            }
+            if (std::error_code const erc = builder.finish ().send (fd)) {
+                return return_type{erc};
+            }
+
+            auto reader = make_socket_reader (net::refiller, response_buffer_size);
+            error_or<status_line> const eo_status = read_final_head (reader, fd, headers);
+            if (!eo_status) {
+                return return_type{eo_status.get_error ()};
+            }
+            http_status_code const sc = eo_status->status_code ();
+
+            if (sc == http_status_code::not_modified && cached) {
+                // The 304's headers update those that were stored (RFC 7234 section 4.3.4) and
+                // the freshness of the stored response is then computed from the result. The
+                // stored Age was the response's age when it was first received: unless the 304
+                // says otherwise, the response has just been validated by the origin.
+                header_block updated = cached->headers;
+                if (!headers.contains (known_header::age)) {
+                    updated.set ("Age", "0");
+                }
+                for (header_field const field : headers) {
+                    if (!is_message_header (field.name)) {
+                        updated.set (field.name, field.value);
+                    }
+                }
+                cache_policy const updated_policy = parse_cache_policy (updated);
+                if (updated_policy.storable && !this->full ()) {
+                    std::lock_guard<std::mutex> const lock{mut_};
+                    // Failing to record the new expiry time only means that the next request
+                    // will be revalidated again.
+                    this->refresh (key, *cached, updated, updated_policy);
+                }
+                if (std::error_code const erc = serve (*cached)) {
+                    return return_type{erc};
+                }
+                revalidations_.fetch_add (1U, std::memory_order_relaxed);
+                headers = std::move (updated);
+                return return_type{response{cached->status, cache_outcome::revalidated}};
+            }
+
+            cache_policy const policy = parse_cache_policy (headers);
+            bool const keep =
+                sc == http_status_code::ok && policy.storable &&
+                (policy.lifetime.count () > 0 || headers.contains (known_header::etag) ||
+                 headers.contains (known_header::last_modified)) &&
+                !this->full ();
+            store_sink sink{body, keep, limits_.max_body_size};
+            auto const eo_body = read_decoded_body (reader, fd, sc, headers, sink);
+            if (!eo_body) {
+                return return_type{eo_body.get_error ()};
+            }
+            misses_.fetch_add (1U, std::memory_order_relaxed);
+            if (maybe<gsl::span<char const>> const content = sink.kept ()) {
+                // The caller sees the headers as they were received. The stored copy omits
+                // those which describe this message rather than the resource.
+                header_block const stored = stored_headers (headers, sink.size ());
+                std::lock_guard<std::mutex> const lock{mut_};
+                // The response has been delivered even if it can't be stored.
+                if (!this->store (key, sc, stored, policy, *content)) {
+                    stores_.fetch_add (1U, std::memory_order_relaxed);
+                }
+            }
+            return return_type{response{sc, cache_outcome::miss}};
+        }
+
+    } // end namespace http
+} // end namespace pstore
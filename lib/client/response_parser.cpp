@@ -0,0 +1,253 @@
+#include "client/response_parser.hpp"
+
+#include "client/scan.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace pstore {
+    namespace http {
+
+        // parse
+        // ~~~~~
+        error_or<std::size_t> response_parser::parse (char const * first, char const * last) {
+            using return_type = error_or<std::size_t>;
+            std::size_t consumed = 0;
+            while (first != last && state_ != state::done) {
+                std::size_t n = 0;
+                if (this->line_state ()) {
+                    auto const r = this->parse_line (first, last);
+                    if (!r) {
+                        return r;
+                    }
+                    n = *r;
+                } else {
+                    n = this->parse_body (first, last);
+                }
+                first += n;
+                consumed += n;
+            }
+            return return_type{consumed};
+        }
+
+        // eof
+        // ~~~
+        std::error_code response_parser::eof () {
+            if (state_ == state::body_to_eof) {
+                state_ = state::done;
+            }
+            return state_ == state::done ? std::error_code{} : details::out_of_data_error ();
+        }
+
+        // reset
+        // ~~~~~
+        void response_parser::reset () {
+            state_ = state::status_line;
+            line_.clear ();
+            head_size_ = 0;
+            remaining_ = 0;
+            http_version_.clear ();
+            status_code_ = http_status_code::ok;
+            reason_phrase_.clear ();
+            headers_.clear ();
+            trailers_.clear ();
+        }
+
+        // parse line
+        // ~~~~~~~~~~
+        error_or<std::size_t> response_parser::parse_line (char const * first,
+                                                          char const * last) {
+            using return_type = error_or<std::size_t>;
+            if (state_ == state::headers && line_.empty () && headers_.empty ()) {
+                // The fast path: if the whole header section is in the buffer, parse all of it
+                // in place without copying any line.
+                error_or<std::size_t> const block = parse_header_block (
+                    first, last, [this] (header_field const & f) { this->add_header (f); });
+                if (!block) {
+                    return block;
+                }
+                if (*block > 0U) {
+                    head_size_ += *block;
+                    if (head_size_ > max_head_size) {
+                        return return_type{std::make_error_code (std::errc::message_size)};
+                    }
+                    if (std::error_code const erc = this->end_of_headers ()) {
+                        return return_type{erc};
+                    }
+                    return block;
+                }
+                // The header section is incomplete. The fields that were delivered will be seen
+                // again as they are parsed line by line, so discard them.
+                headers_.clear ();
+            }
+
+            char const * const nl = find_byte (first, last, '\n');
+            auto const length = static_cast<std::size_t> (nl - first);
+            head_size_ += length;
+            if (head_size_ > max_head_size) {
+                return return_type{std::make_error_code (std::errc::message_size)};
+            }
+            if (nl == last) {
+                // A partial line: keep it and wait for the rest to arrive.
+                line_.append (first, length);
+                return return_type{length};
+            }
+
+            std::string_view line;
+            if (line_.empty ()) {
+                // The whole line is in the buffer: there's no need to copy it.
+                line = std::string_view{first, length};
+            } else {
+                line_.append (first, length);
+                line = line_;
+            }
+            if (!line.empty () && line.back () == '\r') {
+                line.remove_suffix (1);
+            }
+            std::error_code const erc = this->end_of_line (line);
+            line_.clear ();
+            if (erc) {
+                return return_type{erc};
+            }
+            return return_type{length + 1U};
+        }
+
+        // end of line
+        // ~~~~~~~~~~~
+        std::error_code response_parser::end_of_line (std::string_view line) {
+            if (state_ != state::status_line && state_ != state::headers) {
+                return this->end_of_chunk_line (line);
+            }
+            if (state_ == state::status_line) {
+                if (line.empty ()) {
+                    // Tolerate blank lines ahead of the status line (RFC 7230 section 3.5).
+                    return {};
+                }
+                error_or<status_line> const sl = parse_status_line (line);
+                if (!sl) {
+                    return sl.get_error ();
+                }
+                http_version_ = sl->http_version ();
+                status_code_ = sl->status_code ();
+                reason_phrase_ = sl->reason_phrase ();
+                state_ = state::headers;
+                return {};
+            }
+
+            if (line.empty ()) {
+                return this->end_of_headers ();
+            }
+            // Obsolete line folding is rejected along with plain garbage.
+            maybe<header_field> const field = parse_header_field (line);
+            if (!field) {
+                return std::make_error_code (std::errc::bad_message);
+            }
+            this->add_header (*field);
+            return {};
+        }
+
+        // end of chunk line
+        // ~~~~~~~~~~~~~~~~~
+        std::error_code response_parser::end_of_chunk_line (std::string_view line) {
+            switch (state_) {
+            case state::chunk_size: {
+                maybe<std::size_t> const size = parse_chunk_size (line);
+                if (!size) {
+                    return std::make_error_code (std::errc::bad_message);
+                }
+                // The size limit applies to each chunk-size line individually.
+                head_size_ = 0;
+                remaining_ = *size;
+                state_ = remaining_ == 0U ? state::trailers : state::chunk_data;
+                return {};
+            }
+            case state::chunk_end:
+                if (!line.empty ()) {
+                    return std::make_error_code (std::errc::bad_message);
+                }
+                head_size_ = 0;
+                state_ = state::chunk_size;
+                return {};
+            case state::trailers: {
+                if (line.empty ()) {
+                    state_ = state::done;
+                    return {};
+                }
+                maybe<header_field> const field = parse_header_field (line);
+                if (!field) {
+                    return std::make_error_code (std::errc::bad_message);
+                }
+                trailers_.add (field->name, field->value);
+                return {};
+            }
+            case state::status_line:
+            case state::headers:
+            case state::body:
+            case state::body_to_eof:
+            case state::chunk_data:
+            case state::done: break;
+            }
+            return std::make_error_code (std::errc::state_not_recoverable);
+        }
+
+        // end of headers
+        // ~~~~~~~~~~~~~~
+        std::error_code response_parser::end_of_headers () {
+            auto const code = static_cast<int> (status_code_);
+            if (code >= 100 && code < 200 &&
+                status_code_ != http_status_code::switching_protocols) {
+                // An interim response: the final response follows.
+                this->reset ();
+                return {};
+            }
+            if (code < 200 || status_code_ == http_status_code::no_content ||
+                status_code_ == http_status_code::not_modified) {
+                // These responses never carry a body. After 101 (switching protocols), the
+                // remaining bytes belong to the new protocol.
+                state_ = state::done;
+                return {};
+            }
+            if (maybe<std::string_view> const te =
+                    headers_.find (known_header::transfer_encoding)) {
+                if (!is_chunked (*te)) {
+                    return std::make_error_code (std::errc::not_supported);
+                }
+                // Transfer-Encoding overrides any Content-Length (RFC 7230 section 3.3.3).
+                head_size_ = 0;
+                state_ = state::chunk_size;
+                return {};
+            }
+            maybe<std::string_view> const cl = headers_.find (known_header::content_length);
+            if (!cl) {
+                state_ = state::body_to_eof;
+                return {};
+            }
+
+            maybe<std::size_t> const length = parse_content_length (*cl);
+            if (!length) {
+                return std::make_error_code (std::errc::bad_message);
+            }
+            remaining_ = *length;
+            state_ = remaining_ == 0U ? state::done : state::body;
+            return {};
+        }
+
+        // parse body
+        // ~~~~~~~~~~
+        std::size_t response_parser::parse_body (char const * first, char const * last) {
+            auto available = static_cast<std::size_t> (last - first);
+            if (state_ == state::body || state_ == state::chunk_data) {
+                available = std::min (available, remaining_);
+                remaining_ -= available;
+                if (remaining_ == 0U) {
+                    state_ = state_ == state::body ? state::done : state::chunk_end;
+                }
+            }
+            if (body_ && available > 0U) {
+                body_ (gsl::make_span (first, static_cast<std::ptrdiff_t> (available)));
+            }
+            return available;
+        }
+
+    } // end namespace http
+} // end namespace pstore
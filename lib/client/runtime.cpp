@@ -0,0 +1,355 @@
+#include "client/runtime.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <utility>
+
+#include <pthread.h>
+#include <sched.h>
+
+#include "client/event_loop.hpp"
+#include "client/mpmc_queue.hpp"
+#include "client/uring_loop.hpp"
+
+namespace {
+
+    constexpr bool is_power_of_two (std::size_t const n) noexcept {
+        return n != 0U && (n & (n - 1U)) == 0U;
+    }
+
+    // The CPUs on which the process may run.
+    std::vector<int> allowed_cpus () {
+        std::vector<int> result;
+        cpu_set_t set;
+        CPU_ZERO (&set);
+        if (::sched_getaffinity (0, sizeof (set), &set) == 0) {
+            for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+                if (CPU_ISSET (cpu, &set)) {
+                    result.push_back (cpu);
+                }
+            }
+        }
+        return result;
+    }
+
+} // end anonymous namespace
+
+namespace pstore {
+    namespace http {
+
+        thread_local runtime::worker * runtime::current_ = nullptr;
+
+        // job
+        // ~~~
+        struct runtime::job {
+            std::string host;
+            std::string port;
+            std::string path;
+            completion_handler done;
+            body_handler body;
+        };
+
+        // core loop
+        // ~~~~~~~~~
+        /// The parts of uring_loop and event_loop that a worker uses.
+        class runtime::core_loop {
+        public:
+            /// Creates a uring_loop if the kernel supports it or an event_loop if it doesn't.
+            static error_or<std::unique_ptr<core_loop>>
+            create (std::shared_ptr<resolver> const & r);
+
+            virtual ~core_loop () noexcept = default;
+            virtual std::error_code async_get (std::string const & host, std::string const & port,
+                                               std::string const & path, completion_handler done,
+                                               body_handler body) = 0;
+            virtual error_or<std::size_t> run_once (std::chrono::milliseconds timeout) = 0;
+            virtual std::size_t in_flight () const noexcept = 0;
+            virtual void wake () const noexcept = 0;
+
+        private:
+            template <typename Loop>
+            class adapter;
+        };
+
+        template <typename Loop>
+        class runtime::core_loop::adapter final : public core_loop {
+        public:
+            explicit adapter (std::unique_ptr<Loop> && loop) noexcept
+                    : loop_{std::move (loop)} {}
+
+            std::error_code async_get (std::string const & host, std::string const & port,
+                                       std::string const & path, completion_handler done,
+                                       body_handler body) override {
+                return loop_->async_get (host, port, path, std::move (done), std::move (body));
+            }
+            error_or<std::size_t> run_once (std::chrono::milliseconds const timeout) override {
+                return loop_->run_once (timeout);
+            }
+            std::size_t in_flight () const noexcept override { return loop_->in_flight (); }
+            void wake () const noexcept override { loop_->wake (); }
+
+        private:
+            std::unique_ptr<Loop> loop_;
+        };
+
+        error_or<std::unique_ptr<runtime::core_loop>>
+        runtime::core_loop::create (std::shared_ptr<resolver> const & r) {
+            using return_type = error_or<std::unique_ptr<core_loop>>;
+            if (uring_loop::supported ()) {
+                error_or<std::unique_ptr<uring_loop>> eo = uring_loop::create (r);
+                if (!eo) {
+                    return return_type{eo.get_error ()};
+                }
+                return return_type{std::make_unique<adapter<uring_loop>> (std::move (*eo))};
+            }
+            error_or<std::unique_ptr<event_loop>> eo = event_loop::create (r);
+            if (!eo) {
+                return return_type{eo.get_error ()};
+            }
+            return return_type{std::make_unique<adapter<event_loop>> (std::move (*eo))};
+        }
+
+        // worker
+        // ~~~~~~
+        struct runtime::worker {
+            worker (runtime * const o, std::size_t const i, std::size_t const capacity,
+                    std::unique_ptr<core_loop> && l)
+                    : owner{o}
+                    , index{i}
+                    , queue{capacity}
+                    , loop{std::move (l)} {}
+
+            runtime * const owner;
+            std::size_t const index;
+            mpmc_queue<job> queue;
+            std::unique_ptr<core_loop> const loop;
+            std::thread thread;
+            /// Set while the worker may be blocked waiting for its loop.
+            alignas (64) std::atomic<bool> sleeping{false};
+            std::atomic<std::uint64_t> stolen{0};
+        };
+
+        // create
+        // ~~~~~~
+        error_or<std::unique_ptr<runtime>> runtime::create (options const & opts,
+                                                            std::shared_ptr<resolver> r) {
+            using return_type = error_or<std::unique_ptr<runtime>>;
+            if (!is_power_of_two (opts.queue_capacity) || opts.max_in_flight == 0U) {
+                return return_type{std::make_error_code (std::errc::invalid_argument)};
+            }
+            std::vector<int> const cpus = allowed_cpus ();
+            std::size_t threads = opts.threads;
+            if (threads == 0U) {
+                threads = std::max (cpus.size (), std::size_t{1});
+            }
+            if (!r) {
+                r = std::make_shared<resolver> ();
+            }
+            std::unique_ptr<runtime> result{new runtime (opts, std::move (r))};
+
+            // Create every loop before starting any thread so that a failure leaves nothing to
+            // stop.
+            result->workers_.reserve (threads);
+            for (std::size_t ctr = 0; ctr < threads; ++ctr) {
+                error_or<std::unique_ptr<core_loop>> eo_loop =
+                    core_loop::create (result->resolver_);
+                if (!eo_loop) {
+                    return return_type{eo_loop.get_error ()};
+                }
+                result->workers_.push_back (std::make_unique<worker> (
+                    result.get (), ctr, opts.queue_capacity, std::move (*eo_loop)));
+            }
+            for (std::unique_ptr<worker> const & w : result->workers_) {
+                int const cpu = opts.pin && !cpus.empty () ? cpus[w->index % cpus.size ()] : -1;
+                w->thread = std::thread{&runtime::run_worker, result.get (), std::ref (*w), cpu};
+            }
+            return return_type{std::move (result)};
+        }
+
+        runtime::runtime (options const & opts, std::shared_ptr<resolver> && r)
+                : opts_{opts}
+                , resolver_{std::move (r)} {}
+
+        runtime::~runtime () noexcept {
+            this->wait ();
+            stop_.store (true);
+            for (std::unique_ptr<worker> const & w : workers_) {
+                w->loop->wake ();
+            }
+            for (std::unique_ptr<worker> const & w : workers_) {
+                if (w->thread.joinable ()) {
+                    w->thread.join ();
+                }
+            }
+        }
+
+        // submit
+        // ~~~~~~
+        std::error_code runtime::submit (std::string host, std::string port, std::string path,
+                                         completion_handler done, body_handler body) {
+            if (stop_.load (std::memory_order_relaxed)) {
+                return std::make_error_code (std::errc::operation_canceled);
+            }
+            job j{std::move (host), std::move (port), std::move (path), std::move (done),
+                  std::move (body)};
+            std::size_t const n = workers_.size ();
+            // Keep a worker's follow-on requests on its own core.
+            std::size_t const first = current_ != nullptr && current_->owner == this
+                                          ? current_->index
+                                          : next_.fetch_add (1U, std::memory_order_relaxed) % n;
+            outstanding_.fetch_add (1U);
+            for (std::size_t ctr = 0; ctr < n; ++ctr) {
+                worker & w = *workers_[(first + ctr) % n];
+                if (w.queue.push (j)) {
+                    notify (w);
+                    if (w.queue.size () > opts_.steal_threshold) {
+                        // The queue has backed up: make sure that an idle worker looks at it.
+                        for (std::unique_ptr<worker> const & other : workers_) {
+                            if (other.get () != &w && other->sleeping.load ()) {
+                                notify (*other);
+                                break;
+                            }
+                        }
+                    }
+                    return {};
+                }
+            }
+            this->finished ();
+            return std::make_error_code (std::errc::resource_unavailable_try_again);
+        }
+
+        // wait
+        // ~~~~
+        void runtime::wait () {
+            std::unique_lock<std::mutex> lock{mutex_};
+            idle_.wait (lock, [this] { return outstanding_.load () == 0U; });
+        }
+
+        // current worker
+        // ~~~~~~~~~~~~~~
+        std::size_t runtime::current_worker () const noexcept {
+            return current_ != nullptr && current_->owner == this ? current_->index
+                                                                  : workers_.size ();
+        }
+
+        // stolen
+        // ~~~~~~
+        std::uint64_t runtime::stolen () const noexcept {
+            std::uint64_t result = 0;
+            for (std::unique_ptr<worker> const & w : workers_) {
+                result += w->stolen.load (std::memory_order_relaxed);
+            }
+            return result;
+        }
+
+        // notify
+        // ~~~~~~
+        void runtime::notify (worker & w) {
+            // Pairs with the fence in run_worker(): either the worker sees the new request
+            // before it waits or we see that it is waiting and wake it. The push which precedes
+            // this call updates the queue with relaxed operations, so without the fence this
+            // load could be satisfied before the push became visible (and the worker's check of
+            // the queue before its store), leaving the worker asleep with work queued.
+            std::atomic_thread_fence (std::memory_order_seq_cst);
+            if (w.sleeping.load ()) {
+                w.loop->wake ();
+            }
+        }
+
+        // run worker
+        // ~~~~~~~~~~
+        void runtime::run_worker (worker & w, int const cpu) {
+            current_ = &w;
+            if (cpu >= 0) {
+                cpu_set_t set;
+                CPU_ZERO (&set);
+                CPU_SET (cpu, &set);
+                // Failure isn't fatal: the worker simply runs wherever it is scheduled.
+                (void) ::pthread_setaffinity_np (::pthread_self (), sizeof (set), &set);
+            }
+
+            job j;
+            for (;;) {
+                // Start as much work as the loop has room for: this worker's own first, then
+                // any taken from a backed-up neighbour.
+                while (w.loop->in_flight () < opts_.max_in_flight &&
+                       (w.queue.pop (j) || this->steal (w, j))) {
+                    this->start (w, std::move (j));
+                }
+                if (stop_.load () && w.loop->in_flight () == 0U && w.queue.size () == 0U) {
+                    break;
+                }
+
+                w.sleeping.store (true);
+                // Re-check after announcing that we may sleep: a request queued before the
+                // store was not followed by a wake. The fence (which pairs with the one in
+                // notify()) keeps the queue's relaxed loads from moving ahead of the store.
+                std::atomic_thread_fence (std::memory_order_seq_cst);
+                bool const ready =
+                    w.queue.size () > 0U && w.loop->in_flight () < opts_.max_in_flight;
+                auto const timeout = std::chrono::milliseconds{ready ? 0 : -1};
+                if (!w.loop->run_once (timeout)) {
+                    // Nothing can be done about the loop failing: avoid spinning.
+                    std::this_thread::yield ();
+                }
+                w.sleeping.store (false);
+            }
+            current_ = nullptr;
+        }
+
+        // steal
+        // ~~~~~
+        bool runtime::steal (worker & w, job & j) {
+            worker * victim = nullptr;
+            std::size_t longest = opts_.steal_threshold;
+            for (std::unique_ptr<worker> const & other : workers_) {
+                std::size_t const size = other->queue.size ();
+                if (other.get () != &w && size > longest) {
+                    victim = other.get ();
+                    longest = size;
+                }
+            }
+            if (victim != nullptr && victim->queue.pop (j)) {
+                w.stolen.fetch_add (1U, std::memory_order_relaxed);
+                return true;
+            }
+            return false;
+        }
+
+        // start
+        // ~~~~~
+        void runtime::start (worker & w, job && j) {
+            // Kept in case the loop can't start the request: async_get() consumes its handler
+            // either way.
+            completion_handler const done = j.done;
+            std::error_code const erc = w.loop->async_get (
+                j.host, j.port, j.path,
+                [this, d = std::move (j.done)] (std::error_code const e,
+                                                response_parser const & response) {
+                    if (d) {
+                        d (e, response);
+                    }
+                    this->finished ();
+                },
+                std::move (j.body));
+            if (erc) {
+                if (done) {
+                    done (erc, response_parser{});
+                }
+                this->finished ();
+            }
+            j = job{};
+        }
+
+        // finished
+        // ~~~~~~~~
+        void runtime::finished () {
+            if (outstanding_.fetch_sub (1U) == 1U) {
+                std::lock_guard<std::mutex> const lock{mutex_};
+                idle_.notify_all ();
+            }
+        }
+
+    } // end namespace http
+} // end namespace pstore
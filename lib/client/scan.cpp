@@ -0,0 +1,89 @@
+#include "client/scan.hpp"
+
+#include <cstring>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__) && defined(__GNUC__)
+#    define CLIENT_SCAN_X86 1
+#    include <immintrin.h>
+#else
+#    define CLIENT_SCAN_X86 0
+#endif
+
+namespace {
+
+    char const * find_either_scalar (char const * first, char const * last, char a,
+                                     char b) noexcept {
+        for (; first != last; ++first) {
+            if (*first == a || *first == b) {
+                break;
+            }
+        }
+        return first;
+    }
+
+#if CLIENT_SCAN_X86
+    char const * find_either_sse2 (char const * first, char const * last, char a,
+                                   char b) noexcept {
+        __m128i const va = _mm_set1_epi8 (a);
+        __m128i const vb = _mm_set1_epi8 (b);
+        for (; last - first >= 16; first += 16) {
+            __m128i const v = _mm_loadu_si128 (reinterpret_cast<__m128i const *> (first));
+            auto const mask = static_cast<unsigned> (
+                _mm_movemask_epi8 (_mm_or_si128 (_mm_cmpeq_epi8 (v, va), _mm_cmpeq_epi8 (v, vb))));
+            if (mask != 0U) {
+                return first + __builtin_ctz (mask);
+            }
+        }
+        return find_either_scalar (first, last, a, b);
+    }
+
+    __attribute__ ((target ("avx2"))) char const *
+    find_either_avx2 (char const * first, char const * last, char a, char b) noexcept {
+        __m256i const va = _mm256_set1_epi8 (a);
+        __m256i const vb = _mm256_set1_epi8 (b);
+        for (; last - first >= 32; first += 32) {
+            __m256i const v = _mm256_loadu_si256 (reinterpret_cast<__m256i const *> (first));
+            auto const mask = static_cast<unsigned> (_mm256_movemask_epi8 (
+                _mm256_or_si256 (_mm256_cmpeq_epi8 (v, va), _mm256_cmpeq_epi8 (v, vb))));
+            if (mask != 0U) {
+                return first + __builtin_ctz (mask);
+            }
+        }
+        return find_either_sse2 (first, last, a, b);
+    }
+
+    using find_either_fn = char const * (*) (char const *, char const *, char, char) noexcept;
+
+    find_either_fn select_find_either () noexcept {
+        __builtin_cpu_init ();
+        return __builtin_cpu_supports ("avx2") ? &find_either_avx2 : &find_either_sse2;
+    }
+#endif // CLIENT_SCAN_X86
+
+} // end anonymous namespace
+
+namespace pstore {
+    namespace http {
+
+        // find byte
+        // ~~~~~~~~~
+        char const * find_byte (char const * first, char const * last, char c) noexcept {
+            auto const * const r =
+                std::memchr (first, c, static_cast<std::size_t> (last - first));
+            return r == nullptr ? last : static_cast<char const *> (r);
+        }
+
+        // find either
+        // ~~~~~~~~~~~
+        char const * find_either (char const * first, char const * last, char a,
+                                  char b) noexcept {
+#if CLIENT_SCAN_X86
+            static find_either_fn const fn = select_find_either ();
+            return fn (first, last, a, b);
+#else
+            return find_either_scalar (first, last, a, b);
+#endif
+        }
+
+    } // end namespace http
+} // end namespace pstore
@@ -0,0 +1,227 @@
+#include "client/socket_options.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+
+#include <linux/errqueue.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+namespace {
+
+    using namespace pstore;
+
+    std::error_code last_error () noexcept { return {errno, std::generic_category ()}; }
+
+    std::error_code set_option (socket_descriptor const & fd, int const level, int const name,
+                                int const value) noexcept {
+        if (::setsockopt (fd.native_handle (), level, name, &value, sizeof (value)) != 0) {
+            return last_error ();
+        }
+        return {};
+    }
+
+    std::error_code set_timeout (socket_descriptor const & fd, int const name,
+                                 std::chrono::milliseconds const timeout) noexcept {
+        timeval tv{};
+        tv.tv_sec = static_cast<time_t> (timeout.count () / 1000);
+        tv.tv_usec = static_cast<suseconds_t> (timeout.count () % 1000 * 1000);
+        if (::setsockopt (fd.native_handle (), SOL_SOCKET, name, &tv, sizeof (tv)) != 0) {
+            return last_error ();
+        }
+        return {};
+    }
+
+    // Sets an option which older kernels may not have.
+    std::error_code set_optional (socket_descriptor const & fd, int const level, int const name,
+                                  int const value) noexcept {
+        std::error_code const erc = set_option (fd, level, name, value);
+        if (erc == std::errc::no_protocol_option || erc == std::errc::operation_not_supported ||
+            erc == std::errc::invalid_argument) {
+            return {};
+        }
+        return erc;
+    }
+
+    bool zero_copy_enabled (socket_descriptor const & fd) noexcept {
+        int value = 0;
+        socklen_t length = sizeof (value);
+        return ::getsockopt (fd.native_handle (), SOL_SOCKET, SO_ZEROCOPY, &value, &length) == 0 &&
+               value != 0;
+    }
+
+} // end anonymous namespace
+
+namespace pstore {
+    namespace http {
+
+        // configure socket
+        // ~~~~~~~~~~~~~~~~
+        std::error_code configure_socket (socket_descriptor const & fd,
+                                          socket_options const & opts) {
+            std::error_code erc;
+            if (opts.no_delay) {
+                erc = set_option (fd, IPPROTO_TCP, TCP_NODELAY, 1);
+            }
+            // The buffers must be sized before connecting for the window scale to suit them.
+            if (!erc && opts.receive_buffer > 0) {
+                erc = set_option (fd, SOL_SOCKET, SO_RCVBUF, opts.receive_buffer);
+            }
+            if (!erc && opts.send_buffer > 0) {
+                erc = set_option (fd, SOL_SOCKET, SO_SNDBUF, opts.send_buffer);
+            }
+            if (!erc && opts.quick_ack) {
+                erc = set_optional (fd, IPPROTO_TCP, TCP_QUICKACK, 1);
+            }
+            if (!erc && opts.fast_open) {
+                erc = set_optional (fd, IPPROTO_TCP, TCP_FASTOPEN_CONNECT, 1);
+            }
+            if (!erc && opts.zero_copy) {
+                erc = set_optional (fd, SOL_SOCKET, SO_ZEROCOPY, 1);
+            }
+            if (!erc && opts.receive_timeout.count () > 0) {
+                erc = set_timeout (fd, SO_RCVTIMEO, opts.receive_timeout);
+            }
+            if (!erc && opts.send_timeout.count () > 0) {
+                erc = set_timeout (fd, SO_SNDTIMEO, opts.send_timeout);
+            }
+            return erc;
+        }
+
+        // send all
+        // ~~~~~~~~
+        std::error_code send_all (socket_descriptor const & fd, gsl::span<char const> const data) {
+            char const * first = data.data ();
+            char const * const last = first + data.size ();
+            while (first != last) {
+                ssize_t const r = ::send (fd.native_handle (), first,
+                                          static_cast<std::size_t> (last - first), MSG_NOSIGNAL);
+                if (r < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    // A blocking socket reports that its send timeout has expired as EAGAIN.
+                    return errno == EAGAIN || errno == EWOULDBLOCK
+                               ? std::make_error_code (std::errc::timed_out)
+                               : last_error ();
+                }
+                first += r;
+            }
+            return {};
+        }
+
+        // zero copy sender
+        // ~~~~~~~~~~~~~~~~
+        zero_copy_sender::zero_copy_sender (socket_descriptor const & fd)
+                : fd_{fd}
+                , enabled_{zero_copy_enabled (fd)} {}
+
+        std::error_code zero_copy_sender::send (gsl::span<char const> const data,
+                                                std::shared_ptr<void const> owner) {
+            // Release what we can first: this also keeps the error queue short.
+            if (std::error_code const erc = this->reap ()) {
+                return erc;
+            }
+            if (!enabled_ || static_cast<std::size_t> (data.size ()) < zero_copy_threshold) {
+                return send_all (fd_, data);
+            }
+            char const * first = data.data ();
+            char const * const last = first + data.size ();
+            pending_send p{next_, 0, 0, std::move (owner)};
+            while (first != last) {
+                ssize_t const r =
+                    ::send (fd_.native_handle (), first, static_cast<std::size_t> (last - first),
+                            MSG_NOSIGNAL | MSG_ZEROCOPY);
+                if (r < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    if (errno == ENOBUFS) {
+                        // The socket has reached its limit of pinned pages: copy the rest.
+                        auto const rest = static_cast<std::ptrdiff_t> (last - first);
+                        std::error_code const erc = send_all (fd_, gsl::make_span (first, rest));
+                        first = last;
+                        if (erc) {
+                            return erc;
+                        }
+                        break;
+                    }
+                    // The pages already sent are still in use: keep the owner until they are
+                    // reported.
+                    std::error_code const erc = errno == EAGAIN || errno == EWOULDBLOCK
+                                                    ? std::make_error_code (std::errc::timed_out)
+                                                    : last_error ();
+                    if (p.sends > 0U) {
+                        pending_.push_back (std::move (p));
+                    }
+                    return erc;
+                }
+                // The kernel numbers each successful zero-copy send on the socket.
+                ++next_;
+                ++p.sends;
+                ++p.outstanding;
+                first += r;
+            }
+            if (p.sends > 0U) {
+                pending_.push_back (std::move (p));
+            }
+            return {};
+        }
+
+        std::error_code zero_copy_sender::reap () {
+            while (!pending_.empty ()) {
+                alignas (cmsghdr) std::array<char, CMSG_SPACE (sizeof (sock_extended_err))> control;
+                msghdr msg{};
+                msg.msg_control = control.data ();
+                msg.msg_controllen = control.size ();
+                if (::recvmsg (fd_.native_handle (), &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    return errno == EAGAIN || errno == EWOULDBLOCK ? std::error_code{}
+                                                                   : last_error ();
+                }
+                for (cmsghdr const * cm = CMSG_FIRSTHDR (&msg); cm != nullptr;
+                     cm = CMSG_NXTHDR (&msg, const_cast<cmsghdr *> (cm))) {
+                    if (!((cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) ||
+                          (cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR))) {
+                        continue;
+                    }
+                    sock_extended_err err;
+                    std::memcpy (&err, CMSG_DATA (cm), sizeof (err));
+                    if (err.ee_origin == SO_EE_ORIGIN_ZEROCOPY) {
+                        // The notification covers the range of sends [ee_info, ee_data].
+                        this->completed (err.ee_info, err.ee_data);
+                    } else if (err.ee_errno != 0) {
+                        return {static_cast<int> (err.ee_errno), std::generic_category ()};
+                    }
+                }
+            }
+            return {};
+        }
+
+        void zero_copy_sender::completed (std::uint32_t const lo, std::uint32_t const hi) {
+            // Ranges normally arrive in order but needn't. Each send is reported exactly once,
+            // so a buffer's count of outstanding sends falls by the number of its sends that
+            // the range covers. The sequence numbers are 32 bits and wrap.
+            for (pending_send & p : pending_) {
+                for (std::uint32_t ctr = 0; ctr < p.sends; ++ctr) {
+                    if (p.first + ctr - lo <= hi - lo) {
+                        --p.outstanding;
+                    }
+                }
+            }
+            pending_.erase (std::remove_if (std::begin (pending_), std::end (pending_),
+                                            [] (pending_send const & p) {
+                                                return p.outstanding == 0U;
+                                            }),
+                            std::end (pending_));
+        }
+
+    } // end namespace http
+} // end namespace pstore
@@ -0,0 +1,214 @@
+#include "client/timer_wheel.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <limits>
+#include <utility>
+
+namespace pstore {
+    namespace http {
+
+        timer_wheel::timer_wheel (clock::time_point const now, clock::duration const tick)
+                : start_{now}
+                , tick_{tick} {
+            assert (tick.count () > 0);
+            for (auto & level : heads_) {
+                level.fill (npos);
+            }
+        }
+
+        // to tick
+        // ~~~~~~~
+        std::uint64_t timer_wheel::to_tick (clock::time_point const t,
+                                            bool const round_up) const noexcept {
+            if (t <= start_) {
+                return 0;
+            }
+            auto const d = static_cast<std::uint64_t> ((t - start_).count ());
+            auto const tick = static_cast<std::uint64_t> (tick_.count ());
+            return d / tick + ((round_up && d % tick != 0U) ? 1U : 0U);
+        }
+
+        // schedule
+        // ~~~~~~~~
+        auto timer_wheel::schedule (clock::time_point const when, callback cb) -> handle {
+            std::uint32_t index;
+            if (free_.empty ()) {
+                assert (nodes_.size () < npos);
+                index = static_cast<std::uint32_t> (nodes_.size ());
+                nodes_.emplace_back ();
+            } else {
+                index = free_.back ();
+                free_.pop_back ();
+            }
+            node & n = nodes_[index];
+            // A timer which is already due fires on the next tick.
+            n.expiry = std::max (this->to_tick (when, true), current_ + 1U);
+            n.cb = std::move (cb);
+            ++n.generation;
+            this->place (index);
+            ++size_;
+            return (std::uint64_t{n.generation} << 32U) | (std::uint64_t{index} + 1U);
+        }
+
+        // cancel
+        // ~~~~~~
+        bool timer_wheel::cancel (handle const h) noexcept {
+            if (h == 0U) {
+                return false;
+            }
+            auto const index = static_cast<std::uint32_t> ((h & 0xFFFFFFFFU) - 1U);
+            if (index >= nodes_.size ()) {
+                return false;
+            }
+            node & n = nodes_[index];
+            if (n.level == npos || n.generation != static_cast<std::uint32_t> (h >> 32U)) {
+                return false;
+            }
+            this->unlink (index);
+            this->release (index);
+            return true;
+        }
+
+        // advance
+        // ~~~~~~~
+        std::size_t timer_wheel::advance (clock::time_point const now) {
+            std::uint64_t const target = this->to_tick (now, false);
+            std::size_t fired = 0;
+            while (current_ < target) {
+                if (size_ == 0U) {
+                    current_ = target;
+                    break;
+                }
+                if (occupied_[0] == 0U) {
+                    // Nothing can expire before the next cascade, so skip to it.
+                    std::uint64_t const boundary = (current_ | slot_mask) + 1U;
+                    if (boundary > target) {
+                        current_ = target;
+                        break;
+                    }
+                    current_ = boundary - 1U;
+                }
+                ++current_;
+                if ((current_ & slot_mask) == 0U) {
+                    this->cascade ();
+                }
+                fired += this->expire (static_cast<std::uint32_t> (current_ & slot_mask));
+            }
+            return fired;
+        }
+
+        // next expiry
+        // ~~~~~~~~~~~
+        auto timer_wheel::next_expiry () const noexcept -> maybe<clock::time_point> {
+            if (size_ == 0U) {
+                return {};
+            }
+            // Timers cascade from level 1 at the next multiple of 64 ticks and may be due soon
+            // after it, so the answer is never later than that.
+            std::uint64_t tick = (current_ | slot_mask) + 1U;
+            if (occupied_[0] != 0U) {
+                // The first occupied slot after the current one.
+                auto const shift = static_cast<unsigned> ((current_ + 1U) & slot_mask);
+                std::uint64_t const rotated =
+                    shift == 0U ? occupied_[0]
+                                : (occupied_[0] >> shift) | (occupied_[0] << (slots - shift));
+                auto const first = static_cast<std::uint64_t> (__builtin_ctzll (rotated));
+                tick = std::min (tick, current_ + 1U + first);
+            }
+            return maybe<clock::time_point>{start_ +
+                                             tick_ * static_cast<clock::duration::rep> (tick)};
+        }
+
+        // place
+        // ~~~~~
+        void timer_wheel::place (std::uint32_t const index) {
+            node & n = nodes_[index];
+            constexpr std::uint64_t range = std::uint64_t{1} << (slot_bits * levels);
+            // A timer beyond the range of the wheel is parked in the furthest slot. It is placed
+            // again each time that slot cascades.
+            std::uint64_t const at = std::min (n.expiry, current_ + range - 1U);
+            std::uint64_t const delta = at - current_;
+            unsigned level = 0;
+            while (level + 1U < levels &&
+                   delta >= (std::uint64_t{1} << (slot_bits * (level + 1U)))) {
+                ++level;
+            }
+            auto const slot = static_cast<std::uint32_t> ((at >> (slot_bits * level)) & slot_mask);
+            n.level = level;
+            n.slot = slot;
+            n.prev = npos;
+            n.next = heads_[level][slot];
+            if (n.next != npos) {
+                nodes_[n.next].prev = index;
+            }
+            heads_[level][slot] = index;
+            occupied_[level] |= std::uint64_t{1} << slot;
+        }
+
+        // unlink
+        // ~~~~~~
+        void timer_wheel::unlink (std::uint32_t const index) noexcept {
+            node & n = nodes_[index];
+            if (n.prev != npos) {
+                nodes_[n.prev].next = n.next;
+            } else {
+                heads_[n.level][n.slot] = n.next;
+                if (n.next == npos) {
+                    occupied_[n.level] &= ~(std::uint64_t{1} << n.slot);
+                }
+            }
+            if (n.next != npos) {
+                nodes_[n.next].prev = n.prev;
+            }
+            n.prev = n.next = npos;
+            n.level = npos;
+        }
+
+        // release
+        // ~~~~~~~
+        void timer_wheel::release (std::uint32_t const index) noexcept {
+            nodes_[index].cb = nullptr;
+            free_.push_back (index);
+            --size_;
+        }
+
+        // cascade
+        // ~~~~~~~
+        void timer_wheel::cascade () {
+            for (unsigned level = 1; level < levels; ++level) {
+                auto const slot =
+                    static_cast<std::uint32_t> ((current_ >> (slot_bits * level)) & slot_mask);
+                std::uint32_t index = heads_[level][slot];
+                heads_[level][slot] = npos;
+                occupied_[level] &= ~(std::uint64_t{1} << slot);
+                while (index != npos) {
+                    std::uint32_t const next = nodes_[index].next;
+                    this->place (index);
+                    index = next;
+                }
+                if (slot != 0U) {
+                    break;
+                }
+            }
+        }
+
+        // expire
+        // ~~~~~~
+        std::size_t timer_wheel::expire (std::uint32_t const slot) {
+            std::size_t fired = 0;
+            // The list is re-read after each callback because it may cancel other timers.
+            // A callback can't add to this slot: any timer it schedules is due no sooner than
+            // the next tick.
+            for (std::uint32_t index = heads_[0][slot]; index != npos; index = heads_[0][slot]) {
+                this->unlink (index);
+                callback cb = std::move (nodes_[index].cb);
+                this->release (index);
+                ++fired;
+                cb ();
+            }
+            return fired;
+        }
+
+    } // end namespace http
+} // end namespace pstore
@@ -0,0 +1,81 @@
+#include "client/trace.hpp"
+
+namespace pstore {
+    namespace http {
+
+        // phase name
+        // ~~~~~~~~~~
+        char const * phase_name (phase const p) noexcept {
+            switch (p) {
+            case phase::resolve: return "resolve";
+            case phase::connect: return "connect";
+            case phase::send: return "send";
+            case phase::status_line: return "status-line";
+            case phase::headers: return "headers";
+            case phase::body: return "body";
+            }
+            return "unknown";
+        }
+
+        // counters registry
+        // ~~~~~~~~~~~~~~~~~
+        void counters_registry::add (request_trace const & trace) noexcept {
+            constexpr auto relaxed = std::memory_order_relaxed;
+            requests_.fetch_add (1U, relaxed);
+            if (trace.error) {
+                errors_.fetch_add (1U, relaxed);
+            }
+            bytes_sent_.fetch_add (trace.bytes_sent, relaxed);
+            bytes_received_.fetch_add (trace.bytes_received, relaxed);
+            sends_.fetch_add (trace.sends, relaxed);
+            refills_.fetch_add (trace.refills, relaxed);
+            for (auto ctr = std::size_t{0}; ctr < phase_count; ++ctr) {
+                auto const d = std::chrono::duration_cast<std::chrono::nanoseconds> (
+                    trace.duration (static_cast<phase> (ctr)));
+                time_[ctr].fetch_add (d.count (), relaxed);
+            }
+        }
+
+        auto counters_registry::snapshot () const noexcept -> counters {
+            constexpr auto relaxed = std::memory_order_relaxed;
+            counters result;
+            result.requests = requests_.load (relaxed);
+            result.errors = errors_.load (relaxed);
+            result.bytes_sent = bytes_sent_.load (relaxed);
+            result.bytes_received = bytes_received_.load (relaxed);
+            result.sends = sends_.load (relaxed);
+            result.refills = refills_.load (relaxed);
+            for (auto ctr = std::size_t{0}; ctr < phase_count; ++ctr) {
+                result.time[ctr] = std::chrono::nanoseconds{time_[ctr].load (relaxed)};
+            }
+            return result;
+        }
+
+        void counters_registry::reset () noexcept {
+            constexpr auto relaxed = std::memory_order_relaxed;
+            requests_.store (0U, relaxed);
+            errors_.store (0U, relaxed);
+            bytes_sent_.store (0U, relaxed);
+            bytes_received_.store (0U, relaxed);
+            sends_.store (0U, relaxed);
+            refills_.store (0U, relaxed);
+            for (auto & t : time_) {
+                t.store (0, relaxed);
+            }
+        }
+
+        // tracer
+        // ~~~~~~
+        void tracer::finish (std::error_code const erc) {
+            trace_.error = erc;
+            if (registry_ != nullptr) {
+                registry_->add (trace_);
+            }
+            if (sink_) {
+                sink_ (trace_);
+            }
+            trace_ = request_trace{};
+        }
+
+    } // end namespace http
+} // end namespace pstore
@@ -0,0 +1,1340 @@
+#include "client/uring_loop.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <limits>
+#include <mutex>
+#include <string_view>
+
+#include <linux/io_uring.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "client/happy_eyeballs.hpp"
+
+namespace {
+
+    std::error_code last_error () noexcept { return {errno, std::generic_category ()}; }
+
+    // io_uring calls return a negated errno value in a completion's result.
+    std::error_code result_error (std::int32_t const res) noexcept {
+        return {-res, std::generic_category ()};
+    }
+
+    // There is no C library wrapper for the io_uring system calls.
+    int io_uring_setup (unsigned const entries, io_uring_params * const params) noexcept {
+        return static_cast<int> (::syscall (__NR_io_uring_setup, entries, params));
+    }
+    int io_uring_enter (int const fd, unsigned const to_submit, unsigned const min_complete,
+                        unsigned const flags, void const * const arg,
+                        std::size_t const arg_size) noexcept {
+        return static_cast<int> (
+            ::syscall (__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, arg_size));
+    }
+    int io_uring_register (int const fd, unsigned const opcode, void const * const arg,
+                           unsigned const nr_args) noexcept {
+        return static_cast<int> (::syscall (__NR_io_uring_register, fd, opcode, arg, nr_args));
+    }
+
+    // The ring indices are shared with the kernel.
+    template <typename T>
+    T load_acquire (T const * const p) noexcept {
+        return __atomic_load_n (p, __ATOMIC_ACQUIRE);
+    }
+    template <typename T>
+    void store_release (T * const p, T const v) noexcept {
+        __atomic_store_n (p, v, __ATOMIC_RELEASE);
+    }
+
+    // mapping
+    // ~~~~~~~
+    // Owns a region created by mmap().
+    class mapping {
+    public:
+        mapping () noexcept = default;
+        mapping (void * const addr, std::size_t const size) noexcept
+                : addr_{addr}
+                , size_{size} {}
+        mapping (mapping && other) noexcept
+                : addr_{other.addr_}
+                , size_{other.size_} {
+            other.addr_ = MAP_FAILED;
+        }
+        mapping (mapping const &) = delete;
+        ~mapping () noexcept {
+            if (addr_ != MAP_FAILED) {
+                ::munmap (addr_, size_);
+            }
+        }
+
+        mapping & operator= (mapping && other) noexcept {
+            if (&other != this) {
+                this->~mapping ();
+                addr_ = other.addr_;
+                size_ = other.size_;
+                other.addr_ = MAP_FAILED;
+            }
+            return *this;
+        }
+        mapping & operator= (mapping const &) = delete;
+
+        bool valid () const noexcept { return addr_ != MAP_FAILED; }
+        char * get () const noexcept { return static_cast<char *> (addr_); }
+
+    private:
+        void * addr_ = MAP_FAILED;
+        std::size_t size_ = 0;
+    };
+
+    // The provided-buffer group from which receives take their buffers.
+    constexpr std::uint16_t buffer_group = 0;
+
+    constexpr bool is_power_of_two (unsigned const n) noexcept {
+        return n != 0U && (n & (n - 1U)) == 0U;
+    }
+
+} // end anonymous namespace
+
+namespace pstore {
+    namespace http {
+
+        // The operation for which a completion is reported is held in the low bits of its
+        // user_data; the remaining bits are the address of the connection.
+        enum class uring_loop::op : std::uint8_t { connect = 1, send, recv, wake, cancel };
+        constexpr std::uint64_t op_mask = 0x7;
+
+        // ring
+        // ~~~~
+        /// The submission and completion queues shared with the kernel and the receive
+        /// buffers registered with it.
+        struct uring_loop::ring {
+            static error_or<std::unique_ptr<ring>> create (options const & opts);
+
+            /// Returns the next free submission queue entry, cleared, or null if the queue
+            /// is full and can't be flushed.
+            io_uring_sqe * get_sqe () noexcept;
+            /// Passes the queued entries to the kernel and waits for at least \p min_complete
+            /// completions or, if \p timeout is not null, until it expires.
+            int submit (unsigned min_complete,
+                        __kernel_timespec const * timeout = nullptr) noexcept;
+
+            char * buffer (std::uint16_t const bid) const noexcept {
+                return buffers.get () + std::size_t{bid} * buffer_size;
+            }
+            /// Returns a receive buffer to the kernel. It becomes available to receives once
+            /// publish_buffers() is called.
+            void provide (std::uint16_t bid) noexcept;
+            void publish_buffers () noexcept { store_release (&buf_ring->tail, buf_tail); }
+
+            /// Places \p fd in fixed-file slot \p slot. -1 empties the slot.
+            std::error_code update_file (unsigned slot, int fd) noexcept;
+
+            /// socket_descriptor is used simply as the owner of the ring's file descriptor.
+            socket_descriptor fd;
+            mapping queues;
+            mapping sqe_map;
+            mapping buf_map;
+
+            unsigned * sq_tail = nullptr;
+            unsigned const * sq_head = nullptr;
+            unsigned sq_mask = 0;
+            unsigned sq_entries = 0;
+            io_uring_sqe * sqes = nullptr;
+            /// The tail including entries which have not yet been published to the kernel.
+            unsigned local_tail = 0;
+            /// The number of entries published but not yet consumed by the kernel.
+            unsigned to_submit = 0;
+
+            unsigned * cq_head = nullptr;
+            unsigned const * cq_tail = nullptr;
+            unsigned cq_mask = 0;
+            io_uring_cqe const * cqes = nullptr;
+
+            io_uring_buf_ring * buf_ring = nullptr;
+            unsigned buf_mask = 0;
+            std::uint16_t buf_tail = 0;
+            std::unique_ptr<char[]> buffers;
+            std::size_t buffer_size = 0;
+        };
+
+        error_or<std::unique_ptr<uring_loop::ring>>
+        uring_loop::ring::create (options const & opts) {
+            using return_type = error_or<std::unique_ptr<ring>>;
+            if (!is_power_of_two (opts.buffers) || opts.buffers > 32768U ||
+                opts.buffer_size == 0U ||
+                opts.buffer_size > std::numeric_limits<std::uint32_t>::max ()) {
+                return return_type{std::make_error_code (std::errc::invalid_argument)};
+            }
+            auto result = std::make_unique<ring> ();
+
+            io_uring_params params{};
+            // Completions are only ever reaped by the thread which submits, so there is no
+            // need for the kernel to interrupt it to run completion work.
+            params.flags = IORING_SETUP_COOP_TASKRUN;
+            result->fd.reset (io_uring_setup (opts.entries, &params));
+            if (!result->fd.valid () && errno == EINVAL) {
+                // A kernel older than 5.19.
+                params = io_uring_params{};
+                result->fd.reset (io_uring_setup (opts.entries, &params));
+            }
+            if (!result->fd.valid ()) {
+                return return_type{last_error ()};
+            }
+            unsigned const required = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_EXT_ARG;
+            if ((params.features & required) != required) {
+                return return_type{std::make_error_code (std::errc::not_supported)};
+            }
+            int const rfd = result->fd.native_handle ();
+
+            // The submission and completion rings share a single mapping.
+            std::size_t const size =
+                std::max (params.sq_off.array + params.sq_entries * sizeof (unsigned),
+                          params.cq_off.cqes + params.cq_entries * sizeof (io_uring_cqe));
+            result->queues = mapping{::mmap (nullptr, size, PROT_READ | PROT_WRITE,
+                                             MAP_SHARED | MAP_POPULATE, rfd, IORING_OFF_SQ_RING),
+                                     size};
+            std::size_t const sqes_size = params.sq_entries * sizeof (io_uring_sqe);
+            result->sqe_map = mapping{::mmap (nullptr, sqes_size, PROT_READ | PROT_WRITE,
+                                              MAP_SHARED | MAP_POPULATE, rfd, IORING_OFF_SQES),
+                                      sqes_size};
+            if (!result->queues.valid () || !result->sqe_map.valid ()) {
+                return return_type{last_error ()};
+            }
+            char * const base = result->queues.get ();
+            result->sq_head = reinterpret_cast<unsigned const *> (base + params.sq_off.head);
+            result->sq_tail = reinterpret_cast<unsigned *> (base + params.sq_off.tail);
+            result->sq_mask = *reinterpret_cast<unsigned const *> (base + params.sq_off.ring_mask);
+            result->sq_entries = params.sq_entries;
+            result->sqes = reinterpret_cast<io_uring_sqe *> (result->sqe_map.get ());
+            result->local_tail = *result->sq_tail;
+            // Submission queue entries are always used in order.
+            auto * const array = reinterpret_cast<unsigned *> (base + params.sq_off.array);
+            for (auto ctr = 0U; ctr < params.sq_entries; ++ctr) {
+                array[ctr] = ctr;
+            }
+            result->cq_head = reinterpret_cast<unsigned *> (base + params.cq_off.head);
+            result->cq_tail = reinterpret_cast<unsigned const *> (base + params.cq_off.tail);
+            result->cq_mask = *reinterpret_cast<unsigned const *> (base + params.cq_off.ring_mask);
+            result->cqes = reinterpret_cast<io_uring_cqe const *> (base + params.cq_off.cqes);
+
+            // An empty fixed-file table. Slots are filled as connections are made.
+            std::vector<int> const files (opts.max_connections, -1);
+            if (io_uring_register (rfd, IORING_REGISTER_FILES, files.data (),
+                                   static_cast<unsigned> (files.size ())) != 0) {
+                return return_type{last_error ()};
+            }
+
+            // The ring of receive buffers (Linux 5.19 and later).
+            std::size_t const ring_size = opts.buffers * sizeof (io_uring_buf);
+            result->buf_map =
+                mapping{::mmap (nullptr, ring_size, PROT_READ | PROT_WRITE,
+                                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0),
+                        ring_size};
+            if (!result->buf_map.valid ()) {
+                return return_type{last_error ()};
+            }
+            result->buf_ring = reinterpret_cast<io_uring_buf_ring *> (result->buf_map.get ());
+            io_uring_buf_reg reg{};
+            reg.ring_addr = reinterpret_cast<std::uintptr_t> (result->buf_ring);
+            reg.ring_entries = opts.buffers;
+            reg.bgid = buffer_group;
+            if (io_uring_register (rfd, IORING_REGISTER_PBUF_RING, &reg, 1) != 0) {
+                return return_type{errno == EINVAL
+                                       ? std::make_error_code (std::errc::not_supported)
+                                       : last_error ()};
+            }
+            result->buf_mask = opts.buffers - 1U;
+            result->buffer_size = opts.buffer_size;
+            result->buffers.reset (new char[opts.buffers * opts.buffer_size]);
+            for (auto bid = 0U; bid < opts.buffers; ++bid) {
+                result->provide (static_cast<std::uint16_t> (bid));
+            }
+            result->publish_buffers ();
+            return return_type{std::move (result)};
+        }
+
+        io_uring_sqe * uring_loop::ring::get_sqe () noexcept {
+            if (local_tail - load_acquire (sq_head) >= sq_entries) {
+                // The queue is full: hand what we have to the kernel now.
+                if (this->submit (0) < 0 || local_tail - load_acquire (sq_head) >= sq_entries) {
+                    return nullptr;
+                }
+            }
+            io_uring_sqe * const sqe = &sqes[local_tail & sq_mask];
+            std::memset (sqe, 0, sizeof (*sqe));
+            ++local_tail;
+            return sqe;
+        }
+
+        int uring_loop::ring::submit (unsigned const min_complete,
+                                      __kernel_timespec const * const timeout) noexcept {
+            to_submit += local_tail - *sq_tail;
+            store_release (sq_tail, local_tail);
+            if (to_submit == 0U && min_complete == 0U) {
+                return 0;
+            }
+            unsigned flags = min_complete > 0U ? IORING_ENTER_GETEVENTS : 0U;
+            io_uring_getevents_arg arg{};
+            void const * argp = nullptr;
+            if (timeout != nullptr) {
+                arg.ts = reinterpret_cast<std::uintptr_t> (timeout);
+                argp = &arg;
+                flags |= IORING_ENTER_EXT_ARG;
+            }
+            int const r = io_uring_enter (fd.native_handle (), to_submit, min_complete, flags,
+                                          argp, argp == nullptr ? 0U : sizeof (arg));
+            if (r > 0) {
+                to_submit -= static_cast<unsigned> (r);
+            }
+            return r;
+        }
+
+        void uring_loop::ring::provide (std::uint16_t const bid) noexcept {
+            // Not buf_ring->bufs: compiled as C++, the header's flexible array member doesn't
+            // start at offset 0 as it does for the kernel.
+            io_uring_buf & b = reinterpret_cast<io_uring_buf *> (buf_ring)[buf_tail & buf_mask];
+            b.addr = reinterpret_cast<std::uintptr_t> (this->buffer (bid));
+            b.len = static_cast<std::uint32_t> (buffer_size);
+            b.bid = bid;
+            ++buf_tail;
+        }
+
+        std::error_code uring_loop::ring::update_file (unsigned const slot, int fd_) noexcept {
+            io_uring_files_update update{};
+            update.offset = slot;
+            update.fds = reinterpret_cast<std::uintptr_t> (&fd_);
+            if (io_uring_register (fd.native_handle (), IORING_REGISTER_FILES_UPDATE, &update,
+                                   1) < 0) {
+                return last_error ();
+            }
+            return {};
+        }
+
+        // connection
+        // ~~~~~~~~~~
+        struct uring_loop::connection {
+            enum class phase { resolving, connecting, sending, receiving, idle };
+
+            connection (unsigned const s, std::string && k)
+                    : slot{s}
+                    , key{std::move (k)} {}
+
+            /// The connection's fixed-file slot.
+            unsigned const slot;
+            /// The host:port to which the connection is made.
+            std::string const key;
+            socket_descriptor fd;
+            phase state = phase::resolving;
+
+            /// The addresses to try, in the order in which they are to be tried.
+            address_list addresses;
+            /// The index of the next address to try if the current connection attempt fails.
+            std::size_t next_address = 0;
+
+            /// The request being made on this connection or null if the connection is idle.
+            std::shared_ptr<exchange> ex;
+            /// The number of bytes of the request that have been sent.
+            std::size_t sent = 0;
+            response_parser parser;
+            /// When this attempt at the request started.
+            timer_wheel::clock::time_point started;
+            /// When the connection attempts began and the connection was established, and
+            /// when the last of the request was sent. These are kept for request_options::trace.
+            timer_wheel::clock::time_point connect_started;
+            timer_wheel::clock::time_point connected;
+            timer_wheel::clock::time_point sent_at;
+            /// The deadline for the current phase (or, while the connection is idle, for its
+            /// expiry) or 0.
+            timer_wheel::handle timer = 0;
+            /// When the connection last became idle.
+            timer_wheel::clock::time_point idle_since;
+
+            /// True if the connection was reused from the idle list for this request.
+            bool reused = false;
+            /// True once any part of the response has arrived.
+            bool received = false;
+            /// True while a receive is armed.
+            bool receiving = false;
+            /// The number of this connection's operations in the ring (or lookups in progress).
+            /// The connection can't be freed until this reaches zero.
+            unsigned pending = 0;
+            /// Set once the connection is no longer usable.
+            bool retired = false;
+            /// Set if the connection's slot was given to another connection before its
+            /// operations finished.
+            bool detached = false;
+        };
+
+        // exchange
+        // ~~~~~~~~
+        /// A request and its response. The request is normally made on a single connection,
+        /// but a hedged request may be in progress on two at once.
+        struct uring_loop::exchange : std::enable_shared_from_this<exchange> {
+            void remove (connection const * const c) noexcept {
+                if (attempts[0] == c) {
+                    attempts[0] = attempts[1];
+                    attempts[1] = nullptr;
+                } else if (attempts[1] == c) {
+                    attempts[1] = nullptr;
+                }
+            }
+
+            std::string host;
+            std::string port;
+            /// host:port.
+            std::string key;
+            std::string request;
+            completion_handler done;
+            body_handler body;
+            request_options opts;
+            /// The connections on which the request is being made. attempts[0] is null only
+            /// once the exchange has finished.
+            std::array<connection *, 2> attempts{{nullptr, nullptr}};
+            /// The timers for the whole exchange and for hedging, or 0.
+            timer_wheel::handle deadline = 0;
+            timer_wheel::handle hedge = 0;
+        };
+
+        // latency history
+        // ~~~~~~~~~~~~~~~
+        /// The most recent times to first byte of the requests to a host:port.
+        class uring_loop::latency_history {
+        public:
+            void add (timer_wheel::clock::duration const d) noexcept {
+                samples_[next_] = d;
+                next_ = (next_ + 1U) % capacity;
+                size_ = std::min (size_ + 1U, capacity);
+            }
+            /// The \p p percentile of the recorded times or nothing if there are too few of
+            /// them for the answer to mean much.
+            maybe<timer_wheel::clock::duration> percentile (double const p) const {
+                if (size_ < minimum) {
+                    return {};
+                }
+                std::array<timer_wheel::clock::duration, capacity> sorted;
+                auto const last = std::copy_n (std::begin (samples_), size_, std::begin (sorted));
+                auto const nth = std::begin (sorted) +
+                                 static_cast<std::ptrdiff_t> (
+                                     std::clamp (p, 0.0, 1.0) * static_cast<double> (size_ - 1U));
+                std::nth_element (std::begin (sorted), nth, last);
+                return maybe<timer_wheel::clock::duration>{*nth};
+            }
+
+        private:
+            static constexpr std::size_t capacity = 128;
+            static constexpr std::size_t minimum = 16;
+            std::array<timer_wheel::clock::duration, capacity> samples_;
+            std::size_t size_ = 0;
+            std::size_t next_ = 0;
+        };
+
+        // mailbox
+        // ~~~~~~~
+        /// Functions posted to the loop from other threads. A read of the eventfd is kept in
+        /// the ring so that posting wakes run_once().
+        struct uring_loop::mailbox {
+            explicit mailbox (int efd) noexcept
+                    : event_fd{efd} {}
+
+            socket_descriptor event_fd;
+            std::mutex mutex;
+            std::vector<std::function<void ()>> queue;
+            /// Receives the eventfd's counter.
+            std::uint64_t count = 0;
+        };
+
+        namespace {
+
+            std::uint64_t user_data (void const * const p, std::uint8_t const o) noexcept {
+                return reinterpret_cast<std::uintptr_t> (p) | o;
+            }
+
+        } // end anonymous namespace
+
+        // supported
+        // ~~~~~~~~~
+        bool uring_loop::supported () noexcept {
+            static bool const result = [] () {
+                options opts;
+                opts.entries = 2;
+                opts.max_connections = 1;
+                opts.buffers = 1;
+                opts.buffer_size = 1;
+                return static_cast<bool> (ring::create (opts));
+            }();
+            return result;
+        }
+
+        // create
+        // ~~~~~~
+        error_or<std::unique_ptr<uring_loop>> uring_loop::create (std::shared_ptr<resolver> r) {
+            return create (options{}, std::move (r));
+        }
+
+        error_or<std::unique_ptr<uring_loop>> uring_loop::create (options const & opts,
+                                                                  std::shared_ptr<resolver> r) {
+            using return_type = error_or<std::unique_ptr<uring_loop>>;
+            error_or<std::unique_ptr<ring>> rg = ring::create (opts);
+            if (!rg) {
+                return return_type{rg.get_error ()};
+            }
+            // The eventfd blocks: io_uring waits for it to become readable.
+            auto mb = std::make_shared<mailbox> (::eventfd (0, EFD_CLOEXEC));
+            if (!mb->event_fd.valid ()) {
+                return return_type{last_error ()};
+            }
+            if (!r) {
+                r = std::make_shared<resolver> ();
+            }
+            std::unique_ptr<uring_loop> result{
+                new uring_loop (std::move (*rg), std::move (mb), std::move (r), opts)};
+            if (std::error_code const erc = result->submit_wake ()) {
+                return return_type{erc};
+            }
+            return return_type{std::move (result)};
+        }
+
+        uring_loop::uring_loop (std::unique_ptr<ring> && rg, std::shared_ptr<mailbox> && mb,
+                                std::shared_ptr<resolver> && r, options const & opts)
+                : ring_{std::move (rg)}
+                , mailbox_{std::move (mb)}
+                , resolver_{std::move (r)}
+                , socket_options_{opts.socket}
+                , slots_ (opts.max_connections)
+                , max_idle_per_host_{opts.max_idle_per_host}
+                , idle_timeout_{opts.idle_timeout} {
+            free_slots_.reserve (opts.max_connections);
+            for (auto slot = opts.max_connections; slot > 0U; --slot) {
+                free_slots_.push_back (slot - 1U);
+            }
+        }
+
+        uring_loop::~uring_loop () noexcept = default;
+
+        // post
+        // ~~~~
+        void uring_loop::post (std::weak_ptr<mailbox> const & mb, std::function<void ()> f) {
+            // The loop may have been destroyed while a lookup was in progress.
+            if (std::shared_ptr<mailbox> const m = mb.lock ()) {
+                {
+                    std::lock_guard<std::mutex> const lock{m->mutex};
+                    m->queue.push_back (std::move (f));
+                }
+                std::uint64_t const one = 1;
+                (void) ::write (m->event_fd.native_handle (), &one, sizeof (one));
+            }
+        }
+
+        // wake
+        // ~~~~
+        void uring_loop::wake () const noexcept {
+            std::uint64_t const one = 1;
+            (void) ::write (mailbox_->event_fd.native_handle (), &one, sizeof (one));
+        }
+
+        // drain mailbox
+        // ~~~~~~~~~~~~~
+        void uring_loop::drain_mailbox () {
+            std::vector<std::function<void ()>> work;
+            {
+                std::lock_guard<std::mutex> const lock{mailbox_->mutex};
+                work.swap (mailbox_->queue);
+            }
+            for (auto const & f : work) {
+                f ();
+            }
+        }
+
+        // async get
+        // ~~~~~~~~~
+        std::error_code uring_loop::async_get (std::string const & host, std::string const & port,
+                                               std::string const & path, completion_handler done,
+                                               body_handler body) {
+            return this->async_get (host, port, path, request_options{}, std::move (done),
+                                    std::move (body));
+        }
+
+        std::error_code uring_loop::async_get (std::string const & host, std::string const & port,
+                                               std::string const & path,
+                                               request_options const & opts,
+                                               completion_handler done, body_handler body) {
+            static constexpr auto method = std::string_view{"GET"};
+            auto ex = std::make_shared<exchange> ();
+            ex->host = host;
+            ex->port = port;
+            ex->key = host + ':' + port;
+            builder_.start (method, path).host (host, port).finish ().copy_to (ex->request);
+            ex->done = std::move (done);
+            ex->body = std::move (body);
+            ex->opts = opts;
+
+            error_or<connection *> const eo_c = this->attach (ex);
+            if (!eo_c) {
+                return eo_c.get_error ();
+            }
+            connection & c = **eo_c;
+            if (std::error_code const erc = this->begin (c)) {
+                this->drop (c);
+                return erc;
+            }
+            ++in_flight_;
+
+            auto const now = timer_wheel::clock::now ();
+            exchange * const e = ex.get ();
+            if (opts.total.count () > 0) {
+                ex->deadline = timers_.schedule (now + opts.total, [this, e] {
+                    e->deadline = 0;
+                    this->finish (*e, std::make_error_code (std::errc::timed_out),
+                                  response_parser{});
+                });
+            }
+            if (opts.hedge && is_idempotent (method)) {
+                ex->hedge = timers_.schedule (now + this->hedge_delay (ex->key, opts),
+                                              [this, e] { this->on_hedge (*e); });
+            }
+            return {};
+        }
+
+        // attach
+        // ~~~~~~
+        auto uring_loop::attach (std::shared_ptr<exchange> const & ex) -> error_or<connection *> {
+            using return_type = error_or<connection *>;
+            connection * c = nullptr;
+            auto const pos = idle_.find (ex->key);
+            if (pos != idle_.end () && !pos->second.empty ()) {
+                c = pos->second.back ();
+                pos->second.pop_back ();
+                if (pos->second.empty ()) {
+                    idle_.erase (pos);
+                }
+                timers_.cancel (c->timer);
+                c->timer = 0;
+                c->reused = true;
+            } else {
+                error_or<connection *> const eo_c = this->new_connection (ex->key);
+                if (!eo_c) {
+                    return eo_c;
+                }
+                c = *eo_c;
+            }
+            c->ex = ex;
+            c->sent = 0;
+            // Only one attempt receives a response, so only one parser passes the body on.
+            c->parser = ex->body ? response_parser{[e = ex.get ()] (gsl::span<char const> s) {
+                e->body (s);
+            }}
+                                 : response_parser{};
+            c->started = timer_wheel::clock::now ();
+            c->received = false;
+            ex->attempts[ex->attempts[0] == nullptr ? 0 : 1] = c;
+            return return_type{c};
+        }
+
+        // begin
+        // ~~~~~
+        std::error_code uring_loop::begin (connection & c) {
+            request_options const & opts = c.ex->opts;
+            if (c.reused) {
+                c.state = connection::phase::sending;
+                this->arm (c, opts.first_byte);
+                return this->submit_send (c);
+            }
+            if (!c.addresses.empty ()) {
+                return this->start_connect (c);
+            }
+
+            maybe<resolver::result_type> const cached = resolver_->cached (c.ex->host, c.ex->port);
+            if (cached) {
+                // A cache hit: start connecting straight away.
+                if (!*cached) {
+                    return cached->get_error ();
+                }
+                c.addresses = interleave_families (***cached);
+                return this->start_connect (c);
+            }
+
+            // Resolve on the resolver's threads and continue on this one. The connection is
+            // kept until the lookup finishes even if the request times out first.
+            ++c.pending;
+            this->arm (c, opts.resolve);
+            std::weak_ptr<mailbox> mb = mailbox_;
+            connection * const cp = &c;
+            resolver_->resolve_async (c.ex->host, c.ex->port,
+                                      [this, mb, cp] (resolver::result_type const & r) {
+                                          post (mb, [this, cp, r] { this->on_resolved (*cp, r); });
+                                      });
+            return {};
+        }
+
+        // on resolved
+        // ~~~~~~~~~~~
+        void uring_loop::on_resolved (connection & c, resolver::result_type const & r) {
+            --c.pending;
+            if (!c.retired) {
+                std::error_code erc = r.get_error ();
+                if (!erc) {
+                    c.addresses = interleave_families (**r);
+                    erc = this->start_connect (c);
+                }
+                if (erc) {
+                    this->complete (c, erc, false);
+                }
+            }
+            this->release_if_unused (c);
+        }
+
+        // start connect
+        // ~~~~~~~~~~~~~
+        std::error_code uring_loop::start_connect (connection & c) {
+            if (c.next_address == 0U) {
+                // The limit covers every address.
+                this->arm (c, c.ex->opts.connect);
+                c.connect_started = timer_wheel::clock::now ();
+            }
+            std::error_code erc = std::make_error_code (std::errc::address_not_available);
+            while (c.next_address < c.addresses.size ()) {
+                address const & addr = c.addresses[c.next_address++];
+                // The kernel drives the connection asynchronously so the socket can block.
+                c.fd.reset (::socket (addr.family (), SOCK_STREAM | SOCK_CLOEXEC, 0));
+                if (!c.fd.valid ()) {
+                    erc = last_error ();
+                    continue;
+                }
+                if ((erc = configure_socket (c.fd, socket_options_))) {
+                    continue;
+                }
+                if ((erc = ring_->update_file (c.slot, c.fd.native_handle ()))) {
+                    return erc;
+                }
+                c.state = connection::phase::connecting;
+                return this->submit_connect (c);
+            }
+            return erc;
+        }
+
+        // run once
+        // ~~~~~~~~
+        error_or<std::size_t> uring_loop::run_once (std::chrono::milliseconds const timeout) {
+            using return_type = error_or<std::size_t>;
+            using clock = timer_wheel::clock;
+            // Wait no longer than the time until the next timer is due.
+            clock::duration limit = timeout;
+            if (maybe<clock::time_point> const next = timers_.next_expiry ()) {
+                clock::duration const until = std::max (*next - clock::now (), clock::duration{0});
+                if (limit.count () < 0 || until < limit) {
+                    limit = until;
+                }
+            }
+            __kernel_timespec ts{};
+            __kernel_timespec const * wait = nullptr;
+            if (limit.count () > 0) {
+                auto const secs = std::chrono::duration_cast<std::chrono::seconds> (limit);
+                ts.tv_sec = secs.count ();
+                ts.tv_nsec =
+                    std::chrono::duration_cast<std::chrono::nanoseconds> (limit - secs).count ();
+                wait = &ts;
+            }
+            if (ring_->submit (limit.count () == 0 ? 0U : 1U, wait) < 0 && errno != EINTR &&
+                errno != ETIME && errno != EBUSY) {
+                return return_type{last_error ()};
+            }
+
+            std::size_t handled = 0;
+            unsigned head = *ring_->cq_head;
+            unsigned tail = load_acquire (ring_->cq_tail);
+            while (head != tail) {
+                io_uring_cqe const cqe = ring_->cqes[head & ring_->cq_mask];
+                // Release the entry before handling it: the handler may submit more work.
+                store_release (ring_->cq_head, ++head);
+                this->on_completion (cqe.user_data, cqe.res, cqe.flags);
+                ++handled;
+                if (head == tail) {
+                    tail = load_acquire (ring_->cq_tail);
+                }
+            }
+            ring_->publish_buffers ();
+            handled += timers_.advance (clock::now ());
+            return return_type{handled};
+        }
+
+        // run
+        // ~~~
+        std::error_code uring_loop::run () {
+            while (this->in_flight () > 0U) {
+                error_or<std::size_t> const r = this->run_once (std::chrono::milliseconds{-1});
+                if (!r) {
+                    return r.get_error ();
+                }
+            }
+            return {};
+        }
+
+        // on completion
+        // ~~~~~~~~~~~~~
+        void uring_loop::on_completion (std::uint64_t const user_data, std::int32_t const res,
+                                        std::uint32_t const flags) {
+            static_assert (alignof (connection) > op_mask, "user_data needs spare low bits");
+            auto const o = static_cast<op> (user_data & op_mask);
+            if (o == op::wake) {
+                this->drain_mailbox ();
+                // If the read can't be resubmitted, the resolver's results are picked up
+                // whenever some other completion arrives.
+                (void) this->submit_wake ();
+                return;
+            }
+            auto & c = *reinterpret_cast<connection *> (user_data & ~op_mask);
+            switch (o) {
+            case op::connect:
+                --c.pending;
+                this->on_connect (c, res);
+                break;
+            case op::send:
+                --c.pending;
+                this->on_send (c, res);
+                break;
+            case op::recv:
+                if ((flags & IORING_CQE_F_MORE) == 0U) {
+                    --c.pending;
+                    c.receiving = false;
+                }
+                this->on_recv (c, res, flags);
+                break;
+            case op::cancel: --c.pending; break;
+            case op::wake: break;
+            }
+            this->release_if_unused (c);
+        }
+
+        // on connect
+        // ~~~~~~~~~~
+        void uring_loop::on_connect (connection & c, std::int32_t const res) {
+            if (c.retired) {
+                return;
+            }
+            std::error_code erc;
+            if (res < 0) {
+                // Move on to the next address, if there is one.
+                erc = c.next_address < c.addresses.size () ? this->start_connect (c)
+                                                            : result_error (res);
+            } else {
+                c.state = connection::phase::sending;
+                c.connected = timer_wheel::clock::now ();
+                this->arm (c, c.ex->opts.first_byte);
+                erc = this->submit_recv (c);
+                if (!erc) {
+                    erc = this->submit_send (c);
+                }
+            }
+            if (erc) {
+                this->complete (c, erc, false);
+            }
+        }
+
+        // on send
+        // ~~~~~~~
+        void uring_loop::on_send (connection & c, std::int32_t const res) {
+            if (c.retired) {
+                return;
+            }
+            std::error_code erc;
+            if (res < 0) {
+                if (res == -EINTR || res == -EAGAIN) {
+                    erc = this->submit_send (c);
+                } else if (this->retry (c)) {
+                    return;
+                } else {
+                    erc = result_error (res);
+                }
+            } else {
+                c.sent += static_cast<std::size_t> (res);
+                if (c.sent < c.ex->request.length ()) {
+                    erc = this->submit_send (c);
+                } else {
+                    c.sent_at = timer_wheel::clock::now ();
+                    if (c.state == connection::phase::sending) {
+                        c.state = connection::phase::receiving;
+                    }
+                }
+            }
+            if (erc) {
+                this->complete (c, erc, false);
+            }
+        }
+
+        // on recv
+        // ~~~~~~~
+        void uring_loop::on_recv (connection & c, std::int32_t const res,
+                                  std::uint32_t const flags) {
+            if (res > 0 && (flags & IORING_CQE_F_BUFFER) != 0U) {
+                auto const bid = static_cast<std::uint16_t> (flags >> IORING_CQE_BUFFER_SHIFT);
+                if (!c.retired) {
+                    auto const size = static_cast<std::size_t> (res);
+                    if (std::error_code const erc = this->on_data (c, ring_->buffer (bid), size)) {
+                        this->complete (c, erc, false);
+                    }
+                }
+                // The parser has kept whatever it needs, so the buffer can be reused at once.
+                ring_->provide (bid);
+            } else if (c.retired) {
+                return;
+            } else if (res == 0) {
+                // The peer closed the connection.
+                if (c.state == connection::phase::idle) {
+                    this->retire (c);
+                } else if (!this->retry (c)) {
+                    this->complete (c, c.parser.eof (), false);
+                }
+                return;
+            } else if (res == -EINVAL && multishot_ && !c.received) {
+                // The kernel doesn't support multishot receive (Linux 6.0): fall back to
+                // rearming a single-shot receive after each completion.
+                multishot_ = false;
+            } else if (res != -ENOBUFS) {
+                // ENOBUFS means that every buffer was in use; they are returned as soon as
+                // their data has been parsed, so the receive is simply rearmed.
+                if (c.state == connection::phase::idle) {
+                    this->retire (c);
+                } else if (!this->retry (c)) {
+                    this->complete (c, result_error (res), false);
+                }
+                return;
+            }
+            if (!c.receiving && !c.retired) {
+                if (std::error_code const erc = this->submit_recv (c)) {
+                    if (c.state == connection::phase::idle) {
+                        this->retire (c);
+                    } else {
+                        this->complete (c, erc, false);
+                    }
+                }
+            }
+        }
+
+        // on data
+        // ~~~~~~~
+        std::error_code uring_loop::on_data (connection & c, char const * const first,
+                                             std::size_t const size) {
+            if (c.state == connection::phase::idle) {
+                // Nothing should arrive between responses.
+                this->retire (c);
+                return {};
+            }
+            if (!c.received) {
+                c.received = true;
+                this->on_first_byte (c);
+            }
+            error_or<std::size_t> const consumed = c.parser.parse (first, first + size);
+            if (!consumed) {
+                return consumed.get_error ();
+            }
+            if (c.parser.complete ()) {
+                // The connection can be reused only if the whole request has been sent and
+                // nothing follows the response.
+                bool const reusable = *consumed == size &&
+                                      c.state == connection::phase::receiving &&
+                                      keep_alive (c.parser.http_version (), c.parser.headers ());
+                this->complete (c, std::error_code{}, reusable);
+            }
+            return {};
+        }
+
+        // on first byte
+        // ~~~~~~~~~~~~~
+        void uring_loop::on_first_byte (connection & c) {
+            exchange & ex = *c.ex;
+            this->arm (c, ex.opts.body);
+            auto const now = timer_wheel::clock::now ();
+            auto & history = latency_[c.key];
+            if (!history) {
+                history = std::make_unique<latency_history> ();
+            }
+            history->add (now - c.started);
+            if (request_trace * const t = ex.opts.trace) {
+                auto const record = [t] (phase const p, timer_wheel::clock::time_point const b,
+                                         timer_wheel::clock::time_point const e) {
+                    t->begin[static_cast<std::size_t> (p)] = b;
+                    t->end[static_cast<std::size_t> (p)] = e;
+                };
+                auto const sent = c.sent_at < c.started ? now : c.sent_at;
+                if (!c.reused) {
+                    record (phase::connect, c.connect_started, c.connected);
+                }
+                record (phase::send, c.reused ? c.started : c.connected, sent);
+                record (phase::status_line, sent, now);
+                record (phase::body, now, now);
+            }
+            // This attempt has won: the other, if there is one, is abandoned.
+            timers_.cancel (ex.hedge);
+            ex.hedge = 0;
+            if (connection * const other = ex.attempts[ex.attempts[0] == &c ? 1 : 0]) {
+                this->drop (*other);
+            }
+        }
+
+        // complete
+        // ~~~~~~~~
+        void uring_loop::complete (connection & c, std::error_code const erc,
+                                   bool const reusable) {
+            std::shared_ptr<exchange> const ex = std::move (c.ex);
+            timers_.cancel (c.timer);
+            c.timer = 0;
+            // The handler may start another request on this connection, so it is given the
+            // parser's results rather than the parser itself.
+            response_parser const response = std::move (c.parser);
+            if (reusable) {
+                this->make_idle (c);
+            } else {
+                this->retire (c);
+            }
+            if (!ex) {
+                return;
+            }
+            ex->remove (&c);
+            if (erc && ex->attempts[0] != nullptr) {
+                // Another attempt may yet succeed.
+                return;
+            }
+            this->finish (*ex, erc, response);
+        }
+
+        // finish
+        // ~~~~~~
+        void uring_loop::finish (exchange & ex, std::error_code const erc,
+                                 response_parser const & response) {
+            // Dropping the attempts may release the last references to the exchange.
+            std::shared_ptr<exchange> const keep = ex.shared_from_this ();
+            timers_.cancel (ex.deadline);
+            timers_.cancel (ex.hedge);
+            ex.deadline = ex.hedge = 0;
+            while (ex.attempts[0] != nullptr) {
+                this->drop (*ex.attempts[0]);
+            }
+            if (request_trace * const t = ex.opts.trace) {
+                t->error = erc;
+                if (t->started (phase::body)) {
+                    t->end[static_cast<std::size_t> (phase::body)] = timer_wheel::clock::now ();
+                }
+            }
+            assert (in_flight_ > 0U);
+            --in_flight_;
+            completion_handler const done = std::move (ex.done);
+            ex.done = nullptr;
+            if (done) {
+                done (erc, response);
+            }
+        }
+
+        // retry
+        // ~~~~~
+        bool uring_loop::retry (connection & c) {
+            // The server may have closed an idle connection just as we reused it. GET is
+            // idempotent so the request can safely be sent again.
+            if (!c.reused || c.received) {
+                return false;
+            }
+            error_or<connection *> const eo_n = this->new_connection (std::string{c.key});
+            if (!eo_n) {
+                return false;
+            }
+            connection & n = **eo_n;
+            n.addresses = c.addresses;
+            n.ex = std::move (c.ex);
+            std::replace (std::begin (n.ex->attempts), std::end (n.ex->attempts), &c, &n);
+            n.parser = std::move (c.parser);
+            n.started = c.started;
+            this->retire (c);
+            if (std::error_code const erc = this->start_connect (n)) {
+                this->complete (n, erc, false);
+                this->release_if_unused (n);
+            }
+            return true;
+        }
+
+        // drop
+        // ~~~~
+        void uring_loop::drop (connection & c) {
+            if (c.ex) {
+                c.ex->remove (&c);
+                c.ex.reset ();
+            }
+            this->retire (c);
+            this->release_if_unused (c);
+        }
+
+        // arm
+        // ~~~
+        void uring_loop::arm (connection & c, std::chrono::milliseconds const limit) {
+            timers_.cancel (c.timer);
+            c.timer = limit.count () > 0
+                          ? timers_.schedule (timer_wheel::clock::now () + limit,
+                                              [this, &c] { this->on_timeout (c); })
+                          : 0;
+        }
+
+        // on timeout
+        // ~~~~~~~~~~
+        void uring_loop::on_timeout (connection & c) {
+            c.timer = 0;
+            this->complete (c, std::make_error_code (std::errc::timed_out), false);
+            this->release_if_unused (c);
+        }
+
+        // on hedge
+        // ~~~~~~~~
+        void uring_loop::on_hedge (exchange & ex) {
+            ex.hedge = 0;
+            connection const & first = *ex.attempts[0];
+            if (first.addresses.empty ()) {
+                // Still waiting for the host name lookup: a second attempt would wait too.
+                return;
+            }
+            error_or<connection *> const eo_c = this->attach (first.ex);
+            if (!eo_c) {
+                return;
+            }
+            connection & c = **eo_c;
+            if (!c.reused) {
+                // Start with the address after the one that the first attempt is using.
+                c.addresses = first.addresses;
+                std::rotate (std::begin (c.addresses),
+                             std::begin (c.addresses) +
+                                 static_cast<std::ptrdiff_t> (first.next_address %
+                                                              first.addresses.size ()),
+                             std::end (c.addresses));
+            }
+            if (this->begin (c)) {
+                // The first attempt carries on alone.
+                this->drop (c);
+            }
+        }
+
+        // hedge delay
+        // ~~~~~~~~~~~
+        timer_wheel::clock::duration uring_loop::hedge_delay (std::string const & key,
+                                                              request_options const & opts) const {
+            auto const pos = latency_.find (key);
+            if (pos != latency_.end ()) {
+                if (maybe<timer_wheel::clock::duration> const d =
+                        pos->second->percentile (opts.hedge_percentile)) {
+                    return *d;
+                }
+            }
+            return opts.hedge_delay;
+        }
+
+        // submit connect
+        // ~~~~~~~~~~~~~~
+        std::error_code uring_loop::submit_connect (connection & c) {
+            io_uring_sqe * const sqe = ring_->get_sqe ();
+            if (sqe == nullptr) {
+                return std::make_error_code (std::errc::resource_unavailable_try_again);
+            }
+            address const & addr = c.addresses[c.next_address - 1U];
+            sqe->opcode = IORING_OP_CONNECT;
+            sqe->flags = IOSQE_FIXED_FILE;
+            sqe->fd = static_cast<std::int32_t> (c.slot);
+            sqe->addr = reinterpret_cast<std::uintptr_t> (addr.get ());
+            sqe->off = addr.length;
+            sqe->user_data = user_data (&c, static_cast<std::uint8_t> (op::connect));
+            ++c.pending;
+            return {};
+        }
+
+        // submit send
+        // ~~~~~~~~~~~
+        std::error_code uring_loop::submit_send (connection & c) {
+            io_uring_sqe * const sqe = ring_->get_sqe ();
+            if (sqe == nullptr) {
+                return std::make_error_code (std::errc::resource_unavailable_try_again);
+            }
+            sqe->opcode = IORING_OP_SEND;
+            sqe->flags = IOSQE_FIXED_FILE;
+            sqe->fd = static_cast<std::int32_t> (c.slot);
+            std::string const & request = c.ex->request;
+            sqe->addr = reinterpret_cast<std::uintptr_t> (request.data () + c.sent);
+            sqe->len = static_cast<std::uint32_t> (request.length () - c.sent);
+            sqe->msg_flags = MSG_NOSIGNAL;
+            sqe->user_data = user_data (&c, static_cast<std::uint8_t> (op::send));
+            ++c.pending;
+            return {};
+        }
+
+        // submit recv
+        // ~~~~~~~~~~~
+        std::error_code uring_loop::submit_recv (connection & c) {
+            io_uring_sqe * const sqe = ring_->get_sqe ();
+            if (sqe == nullptr) {
+                return std::make_error_code (std::errc::resource_unavailable_try_again);
+            }
+            sqe->opcode = IORING_OP_RECV;
+            sqe->flags = IOSQE_FIXED_FILE | IOSQE_BUFFER_SELECT;
+            sqe->fd = static_cast<std::int32_t> (c.slot);
+            sqe->buf_group = buffer_group;
+            if (multishot_) {
+                sqe->ioprio = IORING_RECV_MULTISHOT;
+            }
+            sqe->user_data = user_data (&c, static_cast<std::uint8_t> (op::recv));
+            c.receiving = true;
+            ++c.pending;
+            return {};
+        }
+
+        // submit wake
+        // ~~~~~~~~~~~
+        std::error_code uring_loop::submit_wake () {
+            io_uring_sqe * const sqe = ring_->get_sqe ();
+            if (sqe == nullptr) {
+                return std::make_error_code (std::errc::resource_unavailable_try_again);
+            }
+            sqe->opcode = IORING_OP_READ;
+            sqe->fd = mailbox_->event_fd.native_handle ();
+            sqe->addr = reinterpret_cast<std::uintptr_t> (&mailbox_->count);
+            sqe->len = sizeof (mailbox_->count);
+            sqe->user_data = user_data (nullptr, static_cast<std::uint8_t> (op::wake));
+            return {};
+        }
+
+        // submit cancel
+        // ~~~~~~~~~~~~~
+        std::error_code uring_loop::submit_cancel (connection & c) {
+            io_uring_sqe * const sqe = ring_->get_sqe ();
+            if (sqe == nullptr) {
+                return std::make_error_code (std::errc::resource_unavailable_try_again);
+            }
+            sqe->opcode = IORING_OP_ASYNC_CANCEL;
+            sqe->addr = user_data (&c, static_cast<std::uint8_t> (op::connect));
+            sqe->user_data = user_data (&c, static_cast<std::uint8_t> (op::cancel));
+            ++c.pending;
+            return {};
+        }
+
+        // new connection
+        // ~~~~~~~~~~~~~~
+        auto uring_loop::new_connection (std::string const & key) -> error_or<connection *> {
+            using return_type = error_or<connection *>;
+            if (free_slots_.empty () && !this->evict_idle ()) {
+                return return_type{std::make_error_code (std::errc::too_many_files_open)};
+            }
+            unsigned const slot = free_slots_.back ();
+            free_slots_.pop_back ();
+            slots_[slot] = std::make_unique<connection> (slot, std::string{key});
+            return return_type{slots_[slot].get ()};
+        }
+
+        // make idle
+        // ~~~~~~~~~
+        void uring_loop::make_idle (connection & c) {
+            std::vector<connection *> & list = idle_[c.key];
+            if (list.size () >= max_idle_per_host_) {
+                if (list.empty ()) {
+                    idle_.erase (c.key);
+                }
+                this->retire (c);
+                return;
+            }
+            c.state = connection::phase::idle;
+            c.idle_since = timer_wheel::clock::now ();
+            list.push_back (&c);
+            if (idle_timeout_.count () > 0) {
+                c.timer = timers_.schedule (c.idle_since + idle_timeout_, [this, &c] {
+                    c.timer = 0;
+                    this->retire (c);
+                    this->release_if_unused (c);
+                });
+            }
+        }
+
+        // evict idle
+        // ~~~~~~~~~~
+        bool uring_loop::evict_idle () {
+            // Each list is ordered from least to most recently used, so the oldest connection
+            // is at the front of one of them.
+            connection * lru = nullptr;
+            for (auto const & kvp : idle_) {
+                connection * const c = kvp.second.front ();
+                if (lru == nullptr || c->idle_since < lru->idle_since) {
+                    lru = c;
+                }
+            }
+            if (lru == nullptr) {
+                return false;
+            }
+            connection & c = *lru;
+            this->retire (c);
+            if (c.pending == 0U) {
+                this->release_if_unused (c);
+                return true;
+            }
+            // The connection's receive completes once the kernel sees the shutdown, but the
+            // slot is wanted now. Operations hold their own reference to the file, so the slot
+            // can be emptied as soon as the kernel has taken every queued entry.
+            if (ring_->submit (0) < 0 || ring_->to_submit != 0U ||
+                ring_->update_file (c.slot, -1)) {
+                return false;
+            }
+            c.detached = true;
+            detached_.push_back (std::move (slots_[c.slot]));
+            free_slots_.push_back (c.slot);
+            return true;
+        }
+
+        // retire
+        // ~~~~~~
+        void uring_loop::retire (connection & c) {
+            if (c.retired) {
+                return;
+            }
+            c.retired = true;
+            timers_.cancel (c.timer);
+            c.timer = 0;
+            if (c.state == connection::phase::idle) {
+                auto const pos = idle_.find (c.key);
+                if (pos != idle_.end ()) {
+                    auto & list = pos->second;
+                    list.erase (std::remove (std::begin (list), std::end (list), &c),
+                                std::end (list));
+                    if (list.empty ()) {
+                        idle_.erase (pos);
+                    }
+                }
+            }
+            if (c.state == connection::phase::connecting && c.pending > 0U) {
+                // Shutting down the socket doesn't end a connect which is still waiting for the
+                // peer. If the cancellation can't be queued, the connect runs its course.
+                (void) this->submit_cancel (c);
+            }
+            if (c.fd.valid ()) {
+                // Any receive still armed completes once the socket has been shut down.
+                ::shutdown (c.fd.native_handle (), SHUT_RDWR);
+            }
+        }
+
+        // release if unused
+        // ~~~~~~~~~~~~~~~~~
+        void uring_loop::release_if_unused (connection & c) {
+            if (!c.retired || c.pending > 0U) {
+                return;
+            }
+            if (c.detached) {
+                detached_.erase (std::find_if (std::begin (detached_), std::end (detached_),
+                                               [&c] (std::unique_ptr<connection> const & d) {
+                                                   return d.get () == &c;
+                                               }));
+                return;
+            }
+            unsigned const slot = c.slot;
+            if (c.fd.valid ()) {
+                (void) ring_->update_file (slot, -1);
+            }
+            slots_[slot].reset ();
+            free_slots_.push_back (slot);
+        }
+
+    } // end namespace http
+} // end namespace pstore
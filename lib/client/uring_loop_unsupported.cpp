@@ -0,0 +1,57 @@
+// Built in place of uring_loop.cpp when the kernel headers predate the io_uring features that
+// the loop needs (multishot receive and provided-buffer rings, from Linux 6.0). The loop can't
+// be created, so callers take their event_loop or blocking fallbacks.
+#include "client/uring_loop.hpp"
+
+namespace pstore {
+    namespace http {
+
+        struct uring_loop::ring {};
+        struct uring_loop::connection {};
+        struct uring_loop::mailbox {};
+        class uring_loop::latency_history {};
+
+        namespace {
+
+            std::error_code not_supported () noexcept {
+                return std::make_error_code (std::errc::not_supported);
+            }
+
+        } // end anonymous namespace
+
+        bool uring_loop::supported () noexcept { return false; }
+
+        error_or<std::unique_ptr<uring_loop>> uring_loop::create (std::shared_ptr<resolver> r) {
+            return create (options{}, std::move (r));
+        }
+
+        error_or<std::unique_ptr<uring_loop>> uring_loop::create (options const &,
+                                                                  std::shared_ptr<resolver>) {
+            return error_or<std::unique_ptr<uring_loop>>{not_supported ()};
+        }
+
+        uring_loop::~uring_loop () noexcept = default;
+
+        // No loop can exist, so none of the remaining members can be called.
+        std::error_code uring_loop::async_get (std::string const &, std::string const &,
+                                               std::string const &, completion_handler,
+                                               body_handler) {
+            return not_supported ();
+        }
+
+        std::error_code uring_loop::async_get (std::string const &, std::string const &,
+                                               std::string const &, request_options const &,
+                                               completion_handler, body_handler) {
+            return not_supported ();
+        }
+
+        error_or<std::size_t> uring_loop::run_once (std::chrono::milliseconds) {
+            return error_or<std::size_t>{not_supported ()};
+        }
+
+        std::error_code uring_loop::run () { return not_supported (); }
+
+        void uring_loop::wake () const noexcept {}
+
+    } // end namespace http
+} // end namespace pstore
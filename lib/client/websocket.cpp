@@ -0,0 +1,360 @@
+#include "client/websocket.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cctype>
+#include <cerrno>
+#include <cstring>
+
+#include <sys/random.h>
+#include <sys/socket.h>
+
+#include "pstore/http/buffered_reader.hpp"
+
+#include "client/client.hpp"
+#include "client/header_field.hpp"
+#include "client/response_parser.hpp"
+#include "client/socket_options.hpp"
+
+namespace {
+
+    using pstore::http::details::equal_ci;
+
+    // Does the comma-separated list \p value include \p token?
+    bool has_token (std::string_view value, std::string_view token) noexcept {
+        for (;;) {
+            auto const comma = value.find (',');
+            if (equal_ci (pstore::http::details::trim_ows (value.substr (0, comma)), token)) {
+                return true;
+            }
+            if (comma == std::string_view::npos) {
+                return false;
+            }
+            value.remove_prefix (comma + 1U);
+        }
+    }
+
+    std::error_code last_error () noexcept { return {errno, std::generic_category ()}; }
+
+    std::error_code protocol_error () noexcept {
+        return std::make_error_code (std::errc::protocol_error);
+    }
+
+} // end anonymous namespace
+
+namespace pstore {
+    namespace http {
+
+        websocket::websocket (socket_descriptor && fd)
+                : fd_{std::move (fd)}
+                , buffer_{new std::array<std::uint8_t, buffer_size>} {}
+
+        // connect
+        // ~~~~~~~
+        error_or<websocket> websocket::connect (socket_descriptor && fd, std::string const & host,
+                                                std::string const & port,
+                                                std::string const & path) {
+            using return_type = error_or<websocket>;
+            websocket result{std::move (fd)};
+            std::string const key = request_key ();
+            if (std::error_code const erc = http_ws_get (result.fd_, host, port, path, key)) {
+                return return_type{erc};
+            }
+            if (std::error_code const erc = result.read_handshake (key)) {
+                return return_type{erc};
+            }
+            return return_type{std::move (result)};
+        }
+
+        // read handshake
+        // ~~~~~~~~~~~~~~
+        std::error_code websocket::read_handshake (std::string const & key) {
+            response_parser parser;
+            while (!parser.head_complete ()) {
+                std::size_t const wanted = end_ - pos_ + 1U;
+                if (wanted > buffer_size) {
+                    // The parser hasn't consumed a whole buffer: one line of the head is longer
+                    // than we are prepared to hold.
+                    return std::make_error_code (std::errc::message_size);
+                }
+                if (std::error_code const erc = this->fill (wanted)) {
+                    return erc;
+                }
+                auto const * const first = reinterpret_cast<char const *> (buffer_->data ());
+                error_or<std::size_t> const consumed = parser.parse (first + pos_, first + end_);
+                if (!consumed) {
+                    return consumed.get_error ();
+                }
+                pos_ += *consumed;
+            }
+            // Anything left in the buffer is the start of the first frame.
+
+            if (parser.status_code () != http_status_code::switching_protocols) {
+                return protocol_error ();
+            }
+            auto const & headers = parser.headers ();
+            auto const header = [&headers] (known_header const h) {
+                return headers.find (h).value_or (std::string_view{});
+            };
+            if (!equal_ci (header (known_header::upgrade), "websocket") ||
+                !has_token (header (known_header::connection), "upgrade") ||
+                header (known_header::sec_websocket_accept) != ws::accept_key (key)) {
+                return protocol_error ();
+            }
+            return {};
+        }
+
+        // fill
+        // ~~~~
+        std::error_code websocket::fill (std::size_t const n) {
+            assert (n <= buffer_size);
+            if (end_ - pos_ >= n) {
+                return {};
+            }
+            if (pos_ > 0) {
+                std::memmove (buffer_->data (), buffer_->data () + pos_, end_ - pos_);
+                end_ -= pos_;
+                pos_ = 0;
+            }
+            while (end_ < n) {
+                ssize_t const r =
+                    ::recv (fd_.native_handle (), buffer_->data () + end_, buffer_size - end_, 0);
+                if (r < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    return last_error ();
+                }
+                if (r == 0) {
+                    return details::out_of_data_error ();
+                }
+                end_ += static_cast<std::size_t> (r);
+            }
+            return {};
+        }
+
+        // read frame header
+        // ~~~~~~~~~~~~~~~~~
+        error_or<ws::frame_header> websocket::read_frame_header () {
+            using return_type = error_or<ws::frame_header>;
+            ws::frame_header header;
+            for (auto wanted = std::size_t{2};; ++wanted) {
+                if (std::error_code const erc = this->fill (wanted)) {
+                    return return_type{erc};
+                }
+                error_or<std::size_t> const size = ws::decode_frame_header (
+                    buffer_->data () + pos_, buffer_->data () + end_, header);
+                if (!size) {
+                    return return_type{size.get_error ()};
+                }
+                if (*size > 0) {
+                    pos_ += *size;
+                    return return_type{header};
+                }
+            }
+        }
+
+        // read payload
+        // ~~~~~~~~~~~~
+        std::error_code websocket::read_payload (std::uint8_t * out, std::size_t length) {
+            // Small payloads are read through the buffer so that a single recv() may pick up
+            // several frames. The rest of a large payload goes straight to its destination.
+            if (length <= buffer_size / 4U) {
+                if (std::error_code const erc = this->fill (length)) {
+                    return erc;
+                }
+            }
+            std::size_t const available = std::min (end_ - pos_, length);
+            std::memcpy (out, buffer_->data () + pos_, available);
+            pos_ += available;
+            out += available;
+            length -= available;
+
+            while (length > 0) {
+                ssize_t const r = ::recv (fd_.native_handle (), out, length, MSG_WAITALL);
+                if (r < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    return last_error ();
+                }
+                if (r == 0) {
+                    return details::out_of_data_error ();
+                }
+                out += r;
+                length -= static_cast<std::size_t> (r);
+            }
+            return {};
+        }
+
+        // receive
+        // ~~~~~~~
+        auto websocket::receive (gsl::span<char> const buffer) -> error_or<message> {
+            using return_type = error_or<message>;
+            if (close_received_) {
+                return return_type{std::make_error_code (std::errc::not_connected)};
+            }
+            auto * const out = reinterpret_cast<std::uint8_t *> (buffer.data ());
+            auto const capacity = static_cast<std::size_t> (buffer.size ());
+            std::size_t size = 0;
+            bool started = false;
+            ws::opcode type = ws::opcode::text;
+            for (;;) {
+                error_or<ws::frame_header> const eh = this->read_frame_header ();
+                if (!eh) {
+                    return return_type{eh.get_error ()};
+                }
+                ws::frame_header const & header = *eh;
+                // A client must fail the connection if a server masks a frame (RFC 6455
+                // section 5.1).
+                if (header.masked) {
+                    return return_type{protocol_error ()};
+                }
+                // decode_frame_header() guarantees that control payloads are small.
+                auto const length = static_cast<std::size_t> (header.payload_length);
+
+                if (ws::is_control (header.op)) {
+                    std::array<std::uint8_t, ws::max_control_payload> payload;
+                    if (std::error_code const erc = this->read_payload (payload.data (), length)) {
+                        return return_type{erc};
+                    }
+                    if (header.op == ws::opcode::ping) {
+                        if (!close_sent_) {
+                            auto const * const p = reinterpret_cast<char const *> (payload.data ());
+                            if (std::error_code const erc =
+                                    this->send_frame (ws::opcode::pong, {p, p + length})) {
+                                return return_type{erc};
+                            }
+                        }
+                    } else if (header.op == ws::opcode::close) {
+                        if (length == 1) {
+                            return return_type{protocol_error ()};
+                        }
+                        close_received_ = true;
+                        message m{ws::opcode::close, 0, ws::close_code::no_status};
+                        if (length >= 2) {
+                            m.code = static_cast<ws::close_code> (payload[0] << 8U | payload[1]);
+                            m.size = std::min (length - 2U, capacity);
+                            std::memcpy (out, payload.data () + 2, m.size);
+                        }
+                        // Echo the status code to complete the closing handshake.
+                        if (!close_sent_) {
+                            if (std::error_code const erc = this->close (
+                                    m.code == ws::close_code::no_status ? ws::close_code::normal
+                                                                        : m.code)) {
+                                return return_type{erc};
+                            }
+                        }
+                        return return_type{m};
+                    }
+                    // Pongs are ignored.
+                    continue;
+                }
+
+                // A message is a text or binary frame followed, if it isn't final, by
+                // continuation frames.
+                if ((header.op == ws::opcode::continuation) != started) {
+                    return return_type{protocol_error ()};
+                }
+                if (!started) {
+                    type = header.op;
+                    started = true;
+                }
+                if (header.payload_length > capacity - size) {
+                    return return_type{std::make_error_code (std::errc::message_size)};
+                }
+                if (std::error_code const erc = this->read_payload (out + size, length)) {
+                    return return_type{erc};
+                }
+                size += length;
+                if (header.fin) {
+                    return return_type{message{type, size, ws::close_code::normal}};
+                }
+            }
+        }
+
+        // next mask
+        // ~~~~~~~~~
+        error_or<std::uint32_t> websocket::next_mask () {
+            using return_type = error_or<std::uint32_t>;
+            if (mask_pos_ == masks_.size ()) {
+                auto * const first = reinterpret_cast<std::uint8_t *> (masks_.data ());
+                std::size_t const size = sizeof (masks_);
+                for (std::size_t filled = 0; filled < size;) {
+                    ssize_t const r = ::getrandom (first + filled, size - filled, 0);
+                    if (r < 0) {
+                        if (errno == EINTR) {
+                            continue;
+                        }
+                        return return_type{last_error ()};
+                    }
+                    filled += static_cast<std::size_t> (r);
+                }
+                mask_pos_ = 0;
+            }
+            return return_type{masks_[mask_pos_++]};
+        }
+
+        // send frame
+        // ~~~~~~~~~~
+        std::error_code websocket::send_frame (ws::opcode const op,
+                                               gsl::span<char const> const payload,
+                                               bool const fin) {
+            if (close_sent_) {
+                return std::make_error_code (std::errc::not_connected);
+            }
+            auto const length = static_cast<std::size_t> (payload.size ());
+            if (ws::is_control (op) && (length > ws::max_control_payload || !fin)) {
+                return std::make_error_code (std::errc::invalid_argument);
+            }
+
+            error_or<std::uint32_t> const key = this->next_mask ();
+            if (!key) {
+                return key.get_error ();
+            }
+            ws::frame_header header;
+            header.fin = fin;
+            header.op = op;
+            header.masked = true;
+            header.payload_length = length;
+            std::memcpy (header.mask.data (), &*key, header.mask.size ());
+
+            // The buffer only grows so that, in the steady state, sending doesn't allocate.
+            if (send_buffer_.size () < ws::max_header_size + length) {
+                send_buffer_.resize (ws::max_header_size + length);
+            }
+            std::uint8_t * const first = send_buffer_.data ();
+            std::size_t const header_size = ws::encode_frame_header (header, first);
+            auto const * const p = reinterpret_cast<std::uint8_t const *> (payload.data ());
+            ws::mask_copy (p, p + length, first + header_size, header.mask);
+
+            if (op == ws::opcode::close) {
+                close_sent_ = true;
+            }
+            return this->write_all (first, first + header_size + length);
+        }
+
+        // close
+        // ~~~~~
+        std::error_code websocket::close (ws::close_code const code, std::string_view reason) {
+            std::array<char, ws::max_control_payload> payload;
+            auto const c = static_cast<std::uint16_t> (code);
+            payload[0] = static_cast<char> (c >> 8U);
+            payload[1] = static_cast<char> (c & 0xFFU);
+            reason = reason.substr (0, payload.size () - 2U);
+            std::copy (std::begin (reason), std::end (reason), payload.data () + 2);
+            return this->send_frame (
+                ws::opcode::close,
+                gsl::make_span (payload.data (), payload.data () + 2 + reason.length ()));
+        }
+
+        // write all
+        // ~~~~~~~~~
+        std::error_code websocket::write_all (std::uint8_t const * first,
+                                              std::uint8_t const * const last) {
+            return send_all (fd_, gsl::make_span (reinterpret_cast<char const *> (first),
+                                                  reinterpret_cast<char const *> (last)));
+        }
+
+    } // end namespace http
+} // end namespace pstore
@@ -0,0 +1,307 @@
+#include "client/ws_frame.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+
+#include "pstore/support/base64.hpp"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__) && defined(__GNUC__)
+#    define CLIENT_MASK_X86 1
+#    include <immintrin.h>
+#else
+#    define CLIENT_MASK_X86 0
+#endif
+
+namespace {
+
+    using pstore::http::ws::masking_key;
+
+    // The key rotated so that its first byte applies to the first byte of the input.
+    masking_key rotate (masking_key const & key, std::size_t const offset) noexcept {
+        masking_key result;
+        for (auto ctr = std::size_t{0}; ctr < result.size (); ++ctr) {
+            result[ctr] = key[(offset + ctr) % key.size ()];
+        }
+        return result;
+    }
+
+    void mask_copy_scalar (std::uint8_t const * first, std::uint8_t const * last,
+                           std::uint8_t * out, masking_key const & key) noexcept {
+        for (auto ctr = std::size_t{0}; first != last; ++first, ++out, ++ctr) {
+            *out = *first ^ key[ctr % key.size ()];
+        }
+    }
+
+#if CLIENT_MASK_X86
+    // Since 16 and 32 are multiples of 4, the key's alignment against the input is the same
+    // after every vector and the scalar tail can start again from key[0].
+    std::uint32_t key_word (masking_key const & key) noexcept {
+        std::uint32_t word;
+        std::memcpy (&word, key.data (), sizeof (word));
+        return word;
+    }
+
+    void mask_copy_sse2 (std::uint8_t const * first, std::uint8_t const * last,
+                         std::uint8_t * out, masking_key const & key) noexcept {
+        __m128i const k = _mm_set1_epi32 (static_cast<int> (key_word (key)));
+        for (; last - first >= 16; first += 16, out += 16) {
+            __m128i const v = _mm_loadu_si128 (reinterpret_cast<__m128i const *> (first));
+            _mm_storeu_si128 (reinterpret_cast<__m128i *> (out), _mm_xor_si128 (v, k));
+        }
+        mask_copy_scalar (first, last, out, key);
+    }
+
+    __attribute__ ((target ("avx2"))) void mask_copy_avx2 (std::uint8_t const * first,
+                                                           std::uint8_t const * last,
+                                                           std::uint8_t * out,
+                                                           masking_key const & key) noexcept {
+        __m256i const k = _mm256_set1_epi32 (static_cast<int> (key_word (key)));
+        for (; last - first >= 32; first += 32, out += 32) {
+            __m256i const v = _mm256_loadu_si256 (reinterpret_cast<__m256i const *> (first));
+            _mm256_storeu_si256 (reinterpret_cast<__m256i *> (out), _mm256_xor_si256 (v, k));
+        }
+        mask_copy_sse2 (first, last, out, key);
+    }
+
+    using mask_copy_fn = void (*) (std::uint8_t const *, std::uint8_t const *, std::uint8_t *,
+                                   masking_key const &) noexcept;
+
+    mask_copy_fn select_mask_copy () noexcept {
+        __builtin_cpu_init ();
+        return __builtin_cpu_supports ("avx2") ? &mask_copy_avx2 : &mask_copy_sse2;
+    }
+#endif // CLIENT_MASK_X86
+
+    // sha1
+    // ~~~~
+    /// SHA-1 (FIPS 180-4). It is used only to compute the handshake's accept key, for which
+    /// its weaknesses are irrelevant.
+    class sha1 {
+    public:
+        using digest = std::array<std::uint8_t, 20>;
+
+        sha1 & update (std::uint8_t const * first, std::uint8_t const * last) noexcept;
+        digest finish () noexcept;
+
+    private:
+        static constexpr std::uint32_t rol (std::uint32_t const x, unsigned const n) noexcept {
+            return (x << n) | (x >> (32U - n));
+        }
+        void block () noexcept;
+
+        std::array<std::uint32_t, 5> h_{
+            {0x67452301U, 0xEFCDAB89U, 0x98BADCFEU, 0x10325476U, 0xC3D2E1F0U}};
+        std::array<std::uint8_t, 64> block_{};
+        std::size_t used_ = 0;
+        std::uint64_t length_ = 0;
+    };
+
+    sha1 & sha1::update (std::uint8_t const * first, std::uint8_t const * last) noexcept {
+        for (; first != last; ++first) {
+            block_[used_++] = *first;
+            length_ += 8U;
+            if (used_ == block_.size ()) {
+                this->block ();
+            }
+        }
+        return *this;
+    }
+
+    auto sha1::finish () noexcept -> digest {
+        std::uint64_t const length = length_;
+        std::uint8_t const pad = 0x80;
+        this->update (&pad, &pad + 1);
+        std::uint8_t const zero = 0;
+        while (used_ != 56) {
+            this->update (&zero, &zero + 1);
+        }
+        std::array<std::uint8_t, 8> be;
+        for (auto ctr = std::size_t{0}; ctr < be.size (); ++ctr) {
+            be[ctr] = static_cast<std::uint8_t> (length >> (56U - 8U * ctr));
+        }
+        this->update (be.data (), be.data () + be.size ());
+
+        digest result;
+        for (auto ctr = std::size_t{0}; ctr < result.size (); ++ctr) {
+            result[ctr] = static_cast<std::uint8_t> (h_[ctr / 4] >> (24U - 8U * (ctr % 4)));
+        }
+        return result;
+    }
+
+    void sha1::block () noexcept {
+        std::array<std::uint32_t, 80> w;
+        for (auto t = std::size_t{0}; t < 16; ++t) {
+            w[t] = static_cast<std::uint32_t> (block_[t * 4]) << 24U |
+                   static_cast<std::uint32_t> (block_[t * 4 + 1]) << 16U |
+                   static_cast<std::uint32_t> (block_[t * 4 + 2]) << 8U |
+                   static_cast<std::uint32_t> (block_[t * 4 + 3]);
+        }
+        for (auto t = std::size_t{16}; t < 80; ++t) {
+            w[t] = rol (w[t - 3] ^ w[t - 8] ^ w[t - 14] ^ w[t - 16], 1);
+        }
+        std::uint32_t a = h_[0], b = h_[1], c = h_[2], d = h_[3], e = h_[4];
+        for (auto t = std::size_t{0}; t < 80; ++t) {
+            std::uint32_t f, k;
+            if (t < 20) {
+                f = (b & c) | (~b & d);
+                k = 0x5A827999U;
+            } else if (t < 40) {
+                f = b ^ c ^ d;
+                k = 0x6ED9EBA1U;
+            } else if (t < 60) {
+                f = (b & c) | (b & d) | (c & d);
+                k = 0x8F1BBCDCU;
+            } else {
+                f = b ^ c ^ d;
+                k = 0xCA62C1D6U;
+            }
+            std::uint32_t const temp = rol (a, 5) + f + e + k + w[t];
+            e = d;
+            d = c;
+            c = rol (b, 30);
+            b = a;
+            a = temp;
+        }
+        h_[0] += a;
+        h_[1] += b;
+        h_[2] += c;
+        h_[3] += d;
+        h_[4] += e;
+        used_ = 0;
+    }
+
+} // end anonymous namespace
+
+namespace pstore {
+    namespace http {
+        namespace ws {
+
+            // decode frame header
+            // ~~~~~~~~~~~~~~~~~~~
+            error_or<std::size_t> decode_frame_header (std::uint8_t const * const first,
+                                                       std::uint8_t const * const last,
+                                                       frame_header & header) noexcept {
+                using return_type = error_or<std::size_t>;
+                auto const available = static_cast<std::size_t> (last - first);
+                if (available < 2) {
+                    return return_type{std::size_t{0}};
+                }
+                auto const bad = [] () {
+                    return return_type{std::make_error_code (std::errc::protocol_error)};
+                };
+
+                std::uint8_t const b0 = first[0];
+                std::uint8_t const b1 = first[1];
+                // No extensions are negotiated so the RSV bits must be clear.
+                if ((b0 & 0x70U) != 0U) {
+                    return bad ();
+                }
+                auto const op = static_cast<opcode> (b0 & 0x0FU);
+                switch (op) {
+                case opcode::continuation:
+                case opcode::text:
+                case opcode::binary:
+                case opcode::close:
+                case opcode::ping:
+                case opcode::pong: break;
+                default: return bad ();
+                }
+
+                std::size_t size = 2;
+                std::uint64_t length = b1 & 0x7FU;
+                if (length == 126) {
+                    size += 2;
+                } else if (length == 127) {
+                    size += 8;
+                }
+                bool const masked = (b1 & 0x80U) != 0U;
+                if (masked) {
+                    size += 4;
+                }
+                if (available < size) {
+                    return return_type{std::size_t{0}};
+                }
+
+                if (length >= 126) {
+                    std::size_t const bytes = length == 126 ? 2 : 8;
+                    length = 0;
+                    for (auto ctr = std::size_t{0}; ctr < bytes; ++ctr) {
+                        length = (length << 8U) | first[2 + ctr];
+                    }
+                    // The length must use the shortest encoding and the most significant bit
+                    // of a 64-bit length must be 0.
+                    if ((bytes == 2 && length < 126) || (bytes == 8 && length <= 0xFFFF) ||
+                        (length >> 63U) != 0U) {
+                        return bad ();
+                    }
+                }
+                bool const fin = (b0 & 0x80U) != 0U;
+                if (is_control (op) && (!fin || length > max_control_payload)) {
+                    return bad ();
+                }
+
+                header.fin = fin;
+                header.op = op;
+                header.masked = masked;
+                header.payload_length = length;
+                if (masked) {
+                    std::memcpy (header.mask.data (), first + size - 4, header.mask.size ());
+                }
+                return return_type{size};
+            }
+
+            // encode frame header
+            // ~~~~~~~~~~~~~~~~~~~
+            std::size_t encode_frame_header (frame_header const & header,
+                                             std::uint8_t * const out) noexcept {
+                std::uint8_t * pos = out;
+                *(pos++) = static_cast<std::uint8_t> ((header.fin ? 0x80U : 0U) |
+                                                      static_cast<std::uint8_t> (header.op));
+                std::uint8_t const mask_bit = header.masked ? 0x80U : 0U;
+                std::uint64_t const length = header.payload_length;
+                if (length < 126) {
+                    *(pos++) = static_cast<std::uint8_t> (mask_bit | length);
+                } else {
+                    std::size_t const bytes = length <= 0xFFFF ? 2 : 8;
+                    *(pos++) = static_cast<std::uint8_t> (mask_bit | (bytes == 2 ? 126U : 127U));
+                    for (auto ctr = bytes; ctr > 0; --ctr) {
+                        *(pos++) = static_cast<std::uint8_t> (length >> (8U * (ctr - 1)));
+                    }
+                }
+                if (header.masked) {
+                    pos = std::copy (std::begin (header.mask), std::end (header.mask), pos);
+                }
+                return static_cast<std::size_t> (pos - out);
+            }
+
+            // mask copy
+            // ~~~~~~~~~
+            void mask_copy (std::uint8_t const * first, std::uint8_t const * last,
+                            std::uint8_t * out, masking_key const & key,
+                            std::size_t offset) noexcept {
+                masking_key const k = rotate (key, offset);
+#if CLIENT_MASK_X86
+                static mask_copy_fn const fn = select_mask_copy ();
+                fn (first, last, out, k);
+#else
+                mask_copy_scalar (first, last, out, k);
+#endif
+            }
+
+            // accept key
+            // ~~~~~~~~~~
+            std::string accept_key (std::string_view const key) {
+                static constexpr char guid[] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+                auto const * const k = reinterpret_cast<std::uint8_t const *> (key.data ());
+                auto const * const g = reinterpret_cast<std::uint8_t const *> (guid);
+                sha1::digest const digest =
+                    sha1{}.update (k, k + key.size ()).update (g, g + sizeof (guid) - 1).finish ();
+                std::string result;
+                to_base64 (std::begin (digest), std::end (digest), std::back_inserter (result));
+                return result;
+            }
+
+        } // end namespace ws
+    }     // end namespace http
+} // end namespace pstore
@@ -0,0 +1,173 @@
+#include "client/batch.hpp"
+
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+using namespace pstore;
+
+namespace {
+
+    /// Reads every request from a manifest whose contents are \p text.
+    std::vector<http::batch_request> read_manifest (std::string const & text) {
+        std::string name = "/tmp/manifest_XXXXXX";
+        int const fd = ::mkstemp (&name[0]);
+        EXPECT_NE (fd, -1);
+        ::unlink (name.c_str ());
+        EXPECT_EQ (::write (fd, text.data (), text.size ()), static_cast<ssize_t> (text.size ()));
+        ::lseek (fd, 0, SEEK_SET);
+
+        std::vector<http::batch_request> result;
+        {
+            http::manifest_reader reader{fd};
+            for (;;) {
+                error_or<maybe<http::batch_request>> next = reader.next ();
+                EXPECT_TRUE (next);
+                if (!next || !*next) {
+                    break;
+                }
+                result.push_back (std::move (**next));
+            }
+        }
+        ::close (fd);
+        return result;
+    }
+
+} // end anonymous namespace
+
+TEST (ManifestReader, Members) {
+    auto const requests = read_manifest (
+        R"({"id": "a", "method": "PUT", "url": "http://h:8080/p", "headers": {"X-A": "1", )"
+        R"("X-B": "2"}, "body": "b\"c", "output": "out", "other": [1, 2.5, true, null, {}]})"
+        "\n");
+    ASSERT_EQ (requests.size (), 1U);
+    http::batch_request const & r = requests[0];
+    EXPECT_FALSE (r.error);
+    EXPECT_EQ (r.line, 1U);
+    EXPECT_EQ (r.id, "a");
+    EXPECT_EQ (r.method, "PUT");
+    EXPECT_EQ (r.url, "http://h:8080/p");
+    using header = std::pair<std::string, std::string>;
+    EXPECT_EQ (r.headers, (std::vector<header>{{"X-A", "1"}, {"X-B", "2"}}));
+    EXPECT_EQ (r.body, "b\"c");
+    EXPECT_EQ (r.output, "out");
+}
+
+TEST (ManifestReader, Defaults) {
+    auto const requests = read_manifest (R"({"url": "http://h/"})"
+                                         "\n");
+    ASSERT_EQ (requests.size (), 1U);
+    EXPECT_FALSE (requests[0].error);
+    EXPECT_EQ (requests[0].method, "GET");
+    EXPECT_TRUE (requests[0].id.empty ());
+    EXPECT_TRUE (requests[0].output.empty ());
+}
+
+TEST (ManifestReader, BlankLines) {
+    auto const requests = read_manifest ("\n"
+                                         R"({"url": "http://a/"})"
+                                         "\n \t\r\n\n"
+                                         R"({"url": "http://b/"})"
+                                         "\n\n");
+    ASSERT_EQ (requests.size (), 2U);
+    EXPECT_EQ (requests[0].url, "http://a/");
+    EXPECT_EQ (requests[0].line, 2U);
+    EXPECT_EQ (requests[1].url, "http://b/");
+    EXPECT_EQ (requests[1].line, 5U);
+}
+
+TEST (ManifestReader, FinalLineWithoutNewline) {
+    auto const requests = read_manifest (R"({"url": "http://a/"})"
+                                         "\n"
+                                         R"({"url": "http://b/"})");
+    ASSERT_EQ (requests.size (), 2U);
+    EXPECT_FALSE (requests[1].error);
+    EXPECT_EQ (requests[1].url, "http://b/");
+}
+
+TEST (ManifestReader, Empty) {
+    EXPECT_TRUE (read_manifest ("").empty ());
+    EXPECT_TRUE (read_manifest ("\n  \n").empty ());
+}
+
+// A bad line is reported and doesn't stop the lines after it from being read.
+TEST (ManifestReader, BadJson) {
+    auto const requests = read_manifest ("{\"url\": \n"
+                                         "not json\n"
+                                         R"({"url": "http://a/"} x)"
+                                         "\n"
+                                         R"({"url": "http://b/"})"
+                                         "\n");
+    ASSERT_EQ (requests.size (), 4U);
+    EXPECT_TRUE (requests[0].error);
+    EXPECT_TRUE (requests[1].error);
+    EXPECT_TRUE (requests[2].error);
+    EXPECT_FALSE (requests[3].error);
+    EXPECT_EQ (requests[3].url, "http://b/");
+    EXPECT_EQ (requests[3].line, 4U);
+}
+
+TEST (ManifestReader, NonStringMembers) {
+    for (char const * const line :
+         {R"({"url": 1})", R"({"url": "http://a/", "method": true})",
+          R"({"url": "http://a/", "id": null})", R"({"url": "http://a/", "body": 1.5})",
+          R"({"url": ["http://a/"]})", R"({"url": "http://a/", "headers": "X: 1"})",
+          R"({"url": "http://a/", "headers": {"X": 1}})",
+          R"({"url": "http://a/", "headers": {"X": {}}})", R"(["http://a/"])", R"("http://a/")",
+          R"({"id": "no url"})"}) {
+        auto const requests = read_manifest (std::string{line} + "\n");
+        ASSERT_EQ (requests.size (), 1U) << line;
+        EXPECT_EQ (requests[0].error, std::make_error_code (std::errc::invalid_argument)) << line;
+    }
+}
+
+TEST (ManifestReader, MethodIsUpperCased) {
+    auto const requests = read_manifest (R"({"url": "http://a/", "method": "head"})"
+                                         "\n");
+    ASSERT_EQ (requests.size (), 1U);
+    EXPECT_FALSE (requests[0].error);
+    EXPECT_EQ (requests[0].method, "HEAD");
+}
+
+TEST (ManifestReader, HostHeaderIsDropped) {
+    auto const requests =
+        read_manifest (R"({"url": "http://a/", "headers": {"X-A": "1", "hOST": "b"}})"
+                       "\n");
+    ASSERT_EQ (requests.size (), 1U);
+    EXPECT_FALSE (requests[0].error);
+    using header = std::pair<std::string, std::string>;
+    EXPECT_EQ (requests[0].headers, (std::vector<header>{{"X-A", "1"}}));
+}
+
+// Nothing in a manifest line may end the request head early or add lines to it.
+TEST (ManifestReader, BadHeadText) {
+    for (char const * const line :
+         {R"({"url": "http://a/", "method": "GET /x HTTP/1.1\r\nX: y\r\n"})",
+          R"({"url": "http://a/", "method": ""})",
+          R"({"url": "http://a/ HTTP/1.1\r\nX: y"})",
+          R"({"url": "http://a/", "headers": {"X-A": "1\r\nX-B: 2"}})",
+          R"({"url": "http://a/", "headers": {"X-A": "1\n"}})",
+          R"({"url": "http://a/", "headers": {"X-A": "1\u0000"}})",
+          R"({"url": "http://a/", "headers": {"X-A: 1\r\nX-B": "2"}})",
+          R"({"url": "http://a/", "headers": {"": "1"}})"}) {
+        auto const requests = read_manifest (std::string{line} + "\n");
+        ASSERT_EQ (requests.size (), 1U) << line;
+        EXPECT_EQ (requests[0].error, std::make_error_code (std::errc::invalid_argument)) << line;
+    }
+}
+
+// A line longer than the reader's buffer is fed to the parser in pieces.
+TEST (ManifestReader, LongLine) {
+    std::string const body (100U * 1024U, 'x');
+    auto const requests =
+        read_manifest (R"({"url": "http://a/", "body": ")" + body + "\"}\n" +
+                       R"({"url": "http://b/"})");
+    ASSERT_EQ (requests.size (), 2U);
+    EXPECT_FALSE (requests[0].error);
+    EXPECT_EQ (requests[0].body, body);
+    EXPECT_EQ (requests[1].url, "http://b/");
+}
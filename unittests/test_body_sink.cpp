@@ -0,0 +1,165 @@
+#include "client/body_sink.hpp"
+#include "client/trace.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+using namespace pstore;
+
+namespace {
+
+    /// A connected pair of sockets. The test writes to peer and the sink reads from fd.
+    class BodySink : public testing::Test {
+    protected:
+        void SetUp () override {
+            std::array<int, 2> fds;
+            ASSERT_EQ (::socketpair (AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds.data ()), 0);
+            fd_.reset (fds[0]);
+            peer_.reset (fds[1]);
+        }
+
+        /// Sends \p body from the peer and closes its end.
+        void send (std::string const & body) {
+            ASSERT_EQ (::send (peer_.native_handle (), body.data (), body.size (), 0),
+                       static_cast<ssize_t> (body.size ()));
+            peer_.reset ();
+        }
+
+        /// Creates an empty temporary file, opened with \p flags in addition to O_RDWR.
+        socket_descriptor temporary_file (int const flags) {
+            std::string name = "/tmp/body_sink_XXXXXX";
+            int const fd = ::mkstemp (&name[0]);
+            EXPECT_NE (fd, -1);
+            ::unlink (name.c_str ());
+            if (flags != 0) {
+                EXPECT_EQ (::fcntl (fd, F_SETFL, ::fcntl (fd, F_GETFL) | flags), 0);
+            }
+            return socket_descriptor{fd};
+        }
+
+        /// Moves everything from the socket to \p sink with transfer().
+        template <typename Sink>
+        std::error_code transfer_all (Sink & sink) {
+            for (;;) {
+                error_or<std::size_t> const moved = sink.transfer (fd_, 7U);
+                if (!moved) {
+                    return moved.get_error ();
+                }
+                if (*moved == 0U) {
+                    return {};
+                }
+            }
+        }
+
+        static std::string contents (socket_descriptor const & fd) {
+            std::string result;
+            std::array<char, 256> buffer;
+            ssize_t r;
+            for (off_t offset = 0; (r = ::pread (fd.native_handle (), buffer.data (),
+                                                 buffer.size (), offset)) > 0;
+                 offset += r) {
+                result.append (buffer.data (), static_cast<std::size_t> (r));
+            }
+            return result;
+        }
+
+        socket_descriptor fd_;
+        socket_descriptor peer_;
+    };
+
+} // end anonymous namespace
+
+TEST_F (BodySink, FdSinkToFile) {
+    socket_descriptor file = this->temporary_file (0);
+    this->send ("hello, world");
+    http::fd_sink sink{file.native_handle ()};
+    ASSERT_FALSE (this->transfer_all (sink));
+    EXPECT_EQ (contents (file), "hello, world");
+}
+
+// splice() can't write to a file opened with O_APPEND, so the body must be copied instead.
+TEST_F (BodySink, FdSinkAppends) {
+    socket_descriptor file = this->temporary_file (O_APPEND);
+    ASSERT_EQ (::write (file.native_handle (), "log: ", 5), 5);
+    this->send ("hello, world");
+    http::fd_sink sink{file.native_handle ()};
+    ASSERT_FALSE (this->transfer_all (sink));
+    EXPECT_EQ (contents (file), "log: hello, world");
+}
+
+TEST_F (BodySink, FdSinkCommit) {
+    socket_descriptor file = this->temporary_file (0);
+    http::fd_sink sink{file.native_handle ()};
+    std::string const data = "abc";
+    ASSERT_FALSE (sink.commit (gsl::make_span (data.data (), data.size ())));
+    EXPECT_EQ (contents (file), "abc");
+}
+
+TEST_F (BodySink, FileRangeSinkLimit) {
+    socket_descriptor file = this->temporary_file (0);
+    http::file_range_sink sink{file.native_handle (), 2U, 5U};
+    std::string const data = "abc";
+    ASSERT_FALSE (sink.commit (gsl::make_span (data.data (), data.size ())));
+    EXPECT_EQ (sink.offset (), 5U);
+    EXPECT_EQ (sink.commit (gsl::make_span (data.data (), 1U)),
+               std::make_error_code (std::errc::file_too_large));
+    EXPECT_EQ (contents (file), std::string ("\0\0abc", 5));
+}
+
+TEST_F (BodySink, BufferSinkTransfer) {
+    std::string const body (60000U, 'x');
+    this->send (body);
+    http::buffer_sink sink;
+    sink.expect (body.size ());
+    EXPECT_GE (sink.capacity (), body.size ());
+    ASSERT_FALSE (this->transfer_all (sink));
+    EXPECT_EQ (std::string (sink.data (), sink.size ()), body);
+}
+
+TEST_F (BodySink, BufferSinkMaxSize) {
+    http::buffer_sink sink{0U, 4U, 8U};
+    std::string const data = "0123456789";
+    ASSERT_FALSE (sink.commit (gsl::make_span (data.data (), 8U)));
+    EXPECT_EQ (sink.commit (gsl::make_span (data.data (), 1U)),
+               std::make_error_code (std::errc::message_size));
+    EXPECT_EQ (sink.size (), 8U);
+}
+
+TEST_F (BodySink, BufferSinkPrepareInPlace) {
+    http::buffer_sink sink;
+    gsl::span<char> const space = sink.prepare (3U);
+    ASSERT_GE (space.size (), 3);
+    std::copy_n ("xyz", 3, space.data ());
+    ASSERT_FALSE (sink.commit (space.first (3)));
+    EXPECT_EQ (std::string (sink.data (), sink.size ()), "xyz");
+}
+
+// Data moved by transfer() never passes through the reader's refiller, so the traced sink must
+// report it.
+TEST_F (BodySink, TracedSinkCountsTransfer) {
+    std::string const body (1000U, 'x');
+    this->send (body);
+    http::buffer_sink sink;
+    http::tracer t{nullptr};
+    http::traced_sink<http::buffer_sink, http::tracer> traced{sink, t};
+    ASSERT_FALSE (this->transfer_all (traced));
+    EXPECT_EQ (std::string (sink.data (), sink.size ()), body);
+    EXPECT_EQ (t.current ().bytes_received, body.size ());
+    EXPECT_GE (t.current ().refills, 2U);
+}
+
+TEST (TracedSink, TransferOnlyIfWrappedSinkHasIt) {
+    using callback = http::callback_sink<void (*) (gsl::span<char const>)>;
+    EXPECT_TRUE ((http::details::has_transfer<
+                  http::traced_sink<http::buffer_sink, http::null_tracer>>::value));
+    EXPECT_FALSE (
+        (http::details::has_transfer<http::traced_sink<callback, http::null_tracer>>::value));
+}
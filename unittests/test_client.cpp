@@ -0,0 +1,269 @@
+#include "client/client.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <limits>
+#include <string>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+using namespace pstore;
+
+namespace {
+
+    std::string const max_size = std::to_string (std::numeric_limits<std::size_t>::max ());
+
+    /// Returns a refiller which stands in for the socket, delivering \p response at most
+    /// \p max bytes at a time.
+    auto make_refiller (std::string const & response, std::size_t & pos,
+                        std::size_t const max = std::numeric_limits<std::size_t>::max ()) {
+        return [&response, &pos, max] (socket_descriptor & fd,
+                                       gsl::span<std::uint8_t> const & span) {
+            auto const n = std::min ({static_cast<std::size_t> (span.size ()),
+                                      response.size () - pos, max});
+            std::memcpy (span.data (), response.data () + pos, n);
+            pos += n;
+            return error_or_n<socket_descriptor &, gsl::span<std::uint8_t>::iterator>{
+                std::in_place, fd, span.begin () + static_cast<std::ptrdiff_t> (n)};
+        };
+    }
+
+    /// Reads the head of \p response with read_final_head().
+    error_or<http::status_line> final_head (std::string const & response,
+                                            http::header_block & headers) {
+        std::size_t pos = 0;
+        auto reader = http::make_socket_reader (make_refiller (response, pos), 64U);
+        socket_descriptor fd;
+        return http::read_final_head (reader, fd, headers);
+    }
+
+} // end anonymous namespace
+
+TEST (ParseContentLength, Simple) {
+    maybe<std::size_t> const length = http::parse_content_length ("1234");
+    ASSERT_TRUE (length);
+    EXPECT_EQ (*length, 1234U);
+}
+
+TEST (ParseContentLength, Whitespace) {
+    maybe<std::size_t> const length = http::parse_content_length (" \t42 ");
+    ASSERT_TRUE (length);
+    EXPECT_EQ (*length, 42U);
+}
+
+TEST (ParseContentLength, Maximum) {
+    maybe<std::size_t> const length = http::parse_content_length (max_size);
+    ASSERT_TRUE (length);
+    EXPECT_EQ (*length, std::numeric_limits<std::size_t>::max ());
+}
+
+TEST (ParseContentLength, Overflow) {
+    EXPECT_FALSE (http::parse_content_length (max_size + "0"));
+    EXPECT_FALSE (http::parse_content_length ("99999999999999999999999999"));
+}
+
+TEST (ParseContentLength, Malformed) {
+    EXPECT_FALSE (http::parse_content_length (""));
+    EXPECT_FALSE (http::parse_content_length ("  "));
+    EXPECT_FALSE (http::parse_content_length ("-1"));
+    EXPECT_FALSE (http::parse_content_length ("+1"));
+    EXPECT_FALSE (http::parse_content_length ("0x10"));
+    EXPECT_FALSE (http::parse_content_length ("1 2"));
+}
+
+TEST (ParseContentLength, IdenticalList) {
+    maybe<std::size_t> const length = http::parse_content_length ("10, 10,10");
+    ASSERT_TRUE (length);
+    EXPECT_EQ (*length, 10U);
+}
+
+TEST (ParseContentLength, MismatchedList) {
+    EXPECT_FALSE (http::parse_content_length ("10, 11"));
+    EXPECT_FALSE (http::parse_content_length ("10,"));
+    EXPECT_FALSE (http::parse_content_length (",10"));
+}
+
+TEST (ParseChunkSize, Hex) {
+    maybe<std::size_t> const size = http::parse_chunk_size ("1aF");
+    ASSERT_TRUE (size);
+    EXPECT_EQ (*size, 0x1AFU);
+}
+
+TEST (ParseChunkSize, Zero) {
+    maybe<std::size_t> const size = http::parse_chunk_size ("0");
+    ASSERT_TRUE (size);
+    EXPECT_EQ (*size, 0U);
+}
+
+TEST (ParseChunkSize, Extension) {
+    maybe<std::size_t> const a = http::parse_chunk_size ("10;name=value");
+    ASSERT_TRUE (a);
+    EXPECT_EQ (*a, 16U);
+    maybe<std::size_t> const b = http::parse_chunk_size ("10 ; name");
+    ASSERT_TRUE (b);
+    EXPECT_EQ (*b, 16U);
+}
+
+TEST (ParseChunkSize, Malformed) {
+    EXPECT_FALSE (http::parse_chunk_size (""));
+    EXPECT_FALSE (http::parse_chunk_size (";ext"));
+    EXPECT_FALSE (http::parse_chunk_size ("g"));
+    EXPECT_FALSE (http::parse_chunk_size ("-1"));
+}
+
+TEST (ParseChunkSize, Overflow) {
+    std::string const digits (sizeof (std::size_t) * 2U, 'f');
+    maybe<std::size_t> const size = http::parse_chunk_size (digits);
+    ASSERT_TRUE (size);
+    EXPECT_EQ (*size, std::numeric_limits<std::size_t>::max ());
+    EXPECT_FALSE (http::parse_chunk_size (digits + "f"));
+    EXPECT_FALSE (http::parse_chunk_size ("1" + std::string (sizeof (std::size_t) * 2U, '0')));
+}
+
+TEST (ParseStatusLine, ReasonPhraseIsAView) {
+    std::string const line = "HTTP/1.1 404 Not Found";
+    error_or<http::status_line> const status = http::parse_status_line (line);
+    ASSERT_TRUE (status) << status.get_error ().message ();
+    EXPECT_EQ (status->http_version (), "HTTP/1.1");
+    EXPECT_EQ (status->status_code (), http::http_status_code::not_found);
+    EXPECT_EQ (status->reason_phrase (), "Not Found");
+    EXPECT_EQ (status->reason_phrase ().data (), line.data () + 13);
+}
+
+TEST (ParseStatusLine, EmptyReasonPhrase) {
+    error_or<http::status_line> const status = http::parse_status_line ("HTTP/1.0 200");
+    ASSERT_TRUE (status) << status.get_error ().message ();
+    EXPECT_EQ (status->http_version (), "HTTP/1.0");
+    EXPECT_EQ (status->reason_phrase (), "");
+}
+
+TEST (ParseStatusLine, Malformed) {
+    for (char const * const line :
+         {"HTTP/1.1 999 Nope", "HTTP/1.1 2x0 OK", "HTTP/11 200 OK", "HTTP/1.1  200 OK",
+          "HTTP/1.1 200_OK", "http/1.1 200 OK"}) {
+        error_or<http::status_line> const status = http::parse_status_line (line);
+        ASSERT_FALSE (status) << line;
+        EXPECT_EQ (status.get_error (), std::make_error_code (std::errc::bad_message)) << line;
+    }
+}
+
+// A status line which arrives in pieces is gathered in the reader's buffer.
+TEST (ReadStatusLine, SplitAcrossReads) {
+    std::string const response = "HTTP/1.1 200 All Good\r\nX-A: 1\r\n\r\n";
+    std::size_t pos = 0;
+    auto reader = http::make_socket_reader (make_refiller (response, pos, 5U), 64U);
+    socket_descriptor fd;
+    auto const eo_status = http::read_status_line (reader, fd);
+    ASSERT_TRUE (eo_status) << eo_status.get_error ().message ();
+    http::status_line const & status = std::get<http::status_line> (*eo_status);
+    EXPECT_EQ (status.status_code (), http::http_status_code::ok);
+    EXPECT_EQ (status.reason_phrase (), "All Good");
+    // The rest of the response is still there to be read.
+    auto const eo_line = reader.gets (fd);
+    ASSERT_TRUE (eo_line);
+    maybe<std::string> const & line = std::get<1> (*eo_line);
+    ASSERT_TRUE (line);
+    EXPECT_EQ (*line, "X-A: 1");
+}
+
+TEST (ReadStatusLine, LongerThanBuffer) {
+    std::string const response = "HTTP/1.1 200 " + std::string (100U, 'x') + "\r\n\r\n";
+    std::size_t pos = 0;
+    auto reader = http::make_socket_reader (make_refiller (response, pos), 64U);
+    socket_descriptor fd;
+    auto const eo_status = http::read_status_line (reader, fd);
+    ASSERT_FALSE (eo_status);
+    EXPECT_EQ (eo_status.get_error (), std::make_error_code (std::errc::message_size));
+}
+
+// The reason phrase returned by read_final_head() outlives the reads of the headers.
+TEST (ReadFinalHead, ReasonPhrase) {
+    std::string const response = "HTTP/1.1 200 Fine Thanks\r\n" +
+                                 std::string ("X-Filler: " + std::string (40U, 'f') + "\r\n") +
+                                 "X-Filler: 2\r\n\r\n";
+    http::header_block headers;
+    error_or<http::status_line> const status = final_head (response, headers);
+    ASSERT_TRUE (status) << status.get_error ().message ();
+    EXPECT_EQ (status->http_version (), "HTTP/1.1");
+    EXPECT_EQ (status->reason_phrase (), "Fine Thanks");
+}
+
+TEST (ReadFinalHead, SkipsInterimResponses) {
+    std::string response;
+    for (auto ctr = 0U; ctr < http::max_interim_responses; ++ctr) {
+        response += "HTTP/1.1 100 Continue\r\nX-Interim: 1\r\n\r\n";
+    }
+    response += "HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n";
+    http::header_block headers;
+    error_or<http::status_line> const status = final_head (response, headers);
+    ASSERT_TRUE (status) << status.get_error ().message ();
+    EXPECT_EQ (status->status_code (), http::http_status_code::ok);
+    // Only the final response's headers are kept.
+    EXPECT_FALSE (headers.contains ("x-interim"));
+    EXPECT_TRUE (headers.contains (http::known_header::content_length));
+}
+
+TEST (ReadFinalHead, TooManyInterimResponses) {
+    std::string response;
+    for (auto ctr = 0U; ctr <= http::max_interim_responses; ++ctr) {
+        response += "HTTP/1.1 100 Continue\r\n\r\n";
+    }
+    response += "HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n";
+    http::header_block headers;
+    error_or<http::status_line> const status = final_head (response, headers);
+    ASSERT_FALSE (status);
+    EXPECT_EQ (status.get_error (), std::make_error_code (std::errc::bad_message));
+}
+
+TEST (ReadFinalHead, SwitchingProtocolsIsFinal) {
+    http::header_block headers;
+    error_or<http::status_line> const status =
+        final_head ("HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\n\r\n", headers);
+    ASSERT_TRUE (status) << status.get_error ().message ();
+    EXPECT_EQ (status->status_code (), http::http_status_code::switching_protocols);
+}
+
+TEST (Trace, GetHostInfo) {
+    http::tracer t{nullptr};
+    error_or<addrinfo *> const info = http::get_host_info ("127.0.0.1", "80", t);
+    ASSERT_TRUE (info) << info.get_error ().message ();
+    ::freeaddrinfo (*info);
+    EXPECT_TRUE (t.current ().started (http::phase::resolve));
+    EXPECT_FALSE (t.current ().started (http::phase::connect));
+}
+
+TEST (Trace, HttpGet) {
+    std::array<int, 2> fds;
+    ASSERT_EQ (::socketpair (AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds.data ()), 0);
+    socket_descriptor fd{fds[0]};
+    socket_descriptor peer{fds[1]};
+    http::tracer t{nullptr};
+    ASSERT_FALSE (http::http_get (fd, "h", "80", "/p", t));
+    std::string const expected = "GET /p HTTP/1.1\r\nHost: h:80\r\n\r\n";
+    std::array<char, 64> buffer;
+    EXPECT_EQ (::recv (peer.native_handle (), buffer.data (), buffer.size (), 0),
+               static_cast<ssize_t> (expected.size ()));
+    EXPECT_EQ (std::string (buffer.data (), expected.size ()), expected);
+    EXPECT_TRUE (t.current ().started (http::phase::send));
+    EXPECT_EQ (t.current ().bytes_sent, expected.size ());
+    EXPECT_GE (t.current ().sends, 1U);
+}
+
+TEST (Trace, ReadReply) {
+    std::string const response = "HTTP/1.1 204 No Content\r\n\r\n";
+    std::size_t pos = 0;
+    http::tracer t{nullptr};
+    auto reader = http::make_socket_reader (
+        http::traced_refiller (t, make_refiller (response, pos)), 64U);
+    socket_descriptor fd;
+    http::header_block headers;
+    error_or<http::status_line> const status = http::read_final_head (reader, fd, headers, t);
+    ASSERT_TRUE (status) << status.get_error ().message ();
+    EXPECT_TRUE (http::read_reply (reader, fd, status->status_code (), headers, t));
+    EXPECT_TRUE (t.current ().started (http::phase::body));
+    EXPECT_EQ (t.current ().bytes_received, response.size ());
+}
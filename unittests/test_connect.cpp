@@ -0,0 +1,504 @@
+#include "client/event_loop.hpp"
+#include "client/happy_eyeballs.hpp"
+#include "client/uring_loop.hpp"
+
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#include "test_helpers.hpp"
+
+using namespace pstore;
+using namespace std::chrono_literals;
+
+using test_helpers::ipv4;
+using test_helpers::listen_on;
+
+namespace {
+
+    using clock = std::chrono::steady_clock;
+
+    // server
+    // ~~~~~~
+    /// Answers every request made to it with a short 200 response.
+    class server {
+    public:
+        enum class mode {
+            /// Closes each connection after one response, saying so.
+            close,
+            /// Keeps each connection open for further requests.
+            keep_alive,
+            /// Closes each connection after one response without saying so, as a server
+            /// whose idle timeout expires at once would.
+            drop,
+        };
+
+        explicit server (mode const m = mode::close)
+                : mode_{m} {
+            fd_ = listen_on ("127.0.0.1", 16, address_);
+            if (fd_.valid ()) {
+                thread_ = std::thread{[this] { this->run (); }};
+            }
+        }
+        server (server const &) = delete;
+        server & operator= (server const &) = delete;
+        ~server () noexcept {
+            done_ = true;
+            if (thread_.joinable ()) {
+                thread_.join ();
+            }
+        }
+
+        bool valid () const noexcept { return fd_.valid (); }
+        http::address const & address () const noexcept { return address_; }
+        /// The number of connections that have been accepted.
+        unsigned accepted () const noexcept { return accepted_; }
+
+    private:
+        /// Waits for \p fd to become readable, giving up if the server is being destroyed.
+        bool wait (socket_descriptor const & fd) const {
+            while (!done_) {
+                pollfd pfd{fd.native_handle (), POLLIN, 0};
+                if (::poll (&pfd, 1, 50) > 0) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        /// Reads a request from \p conn and answers it.
+        /// \returns False if the client closed the connection.
+        bool serve (socket_descriptor const & conn) const {
+            std::string request;
+            std::array<char, 1024> buffer;
+            while (request.find ("\r\n\r\n") == std::string::npos) {
+                if (!this->wait (conn)) {
+                    return false;
+                }
+                ssize_t const r =
+                    ::recv (conn.native_handle (), buffer.data (), buffer.size (), 0);
+                if (r <= 0) {
+                    return false;
+                }
+                request.append (buffer.data (), static_cast<std::size_t> (r));
+            }
+            std::string const response =
+                std::string{"HTTP/1.1 200 OK\r\n"
+                            "Content-Length: 2\r\n"} +
+                (mode_ == mode::close ? "Connection: close\r\n" : "") + "\r\nok";
+            ::send (conn.native_handle (), response.data (), response.size (), MSG_NOSIGNAL);
+            return true;
+        }
+
+        void run () {
+            while (this->wait (fd_)) {
+                socket_descriptor conn{::accept (fd_.native_handle (), nullptr, nullptr)};
+                if (!conn.valid ()) {
+                    continue;
+                }
+                ++accepted_;
+                while (this->serve (conn) && mode_ == mode::keep_alive) {
+                }
+            }
+        }
+
+        mode const mode_;
+        socket_descriptor fd_;
+        http::address address_;
+        std::atomic<bool> done_{false};
+        std::atomic<unsigned> accepted_{0};
+        std::thread thread_;
+    };
+
+    // blackhole
+    // ~~~~~~~~~
+    /// An address which silently ignores connection attempts, as a host behind a firewall
+    /// that drops packets would. It is a listening socket whose accept queue is full: the
+    /// kernel drops any further SYNs.
+    class blackhole {
+    public:
+        blackhole () {
+            fd_ = listen_on ("127.0.0.2", 0, address_);
+            if (!fd_.valid ()) {
+                return;
+            }
+            for (socket_descriptor & f : fillers_) {
+                f.reset (::socket (AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0));
+                ::connect (f.native_handle (), address_.get (), address_.length);
+            }
+            std::this_thread::sleep_for (50ms);
+        }
+
+        /// True if a connection attempt to the address does not complete promptly.
+        bool works () const {
+            if (!fd_.valid ()) {
+                return false;
+            }
+            socket_descriptor probe{
+                ::socket (AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)};
+            if (::connect (probe.native_handle (), address_.get (), address_.length) == 0 ||
+                errno != EINPROGRESS) {
+                return false;
+            }
+            pollfd pfd{probe.native_handle (), POLLOUT, 0};
+            return ::poll (&pfd, 1, 100) == 0;
+        }
+
+        http::address const & address () const noexcept { return address_; }
+
+    private:
+        socket_descriptor fd_;
+        http::address address_;
+        std::array<socket_descriptor, 2> fillers_;
+    };
+
+    /// Returns an address on which nothing is listening.
+    http::address refusing () {
+        http::address addr;
+        listen_on ("127.0.0.1", 1, addr);
+        return addr;
+    }
+
+    std::chrono::milliseconds since (clock::time_point const start) {
+        return std::chrono::duration_cast<std::chrono::milliseconds> (clock::now () - start);
+    }
+
+    /// Makes \p count requests to \p srv one after another, each being started by the
+    /// completion of the one before, so that each may reuse the previous one's connection.
+    void sequential_gets (server const & srv, unsigned const count) {
+        auto r = std::make_shared<http::resolver> ();
+        r->pin ("server.test", "80", {srv.address ()});
+        error_or<std::unique_ptr<http::event_loop>> loop = http::event_loop::create (r);
+        ASSERT_TRUE (loop) << loop.get_error ().message ();
+        http::event_loop & l = **loop;
+
+        unsigned completed = 0;
+        std::string body;
+        std::function<void (std::error_code, http::response_parser const &)> done;
+        auto const get = [&] {
+            return l.async_get ("server.test", "80", "/", done,
+                                [&body] (gsl::span<char const> const data) {
+                                    body.append (data.data (),
+                                                 static_cast<std::size_t> (data.size ()));
+                                });
+        };
+        done = [&] (std::error_code const erc, http::response_parser const &) {
+            EXPECT_FALSE (erc) << erc.message ();
+            if (!erc && ++completed < count) {
+                EXPECT_FALSE (get ());
+            }
+        };
+        ASSERT_FALSE (get ());
+        std::error_code const erc = l.run ();
+        ASSERT_FALSE (erc) << erc.message ();
+        EXPECT_EQ (completed, count);
+        std::string expected;
+        for (auto ctr = 0U; ctr < count; ++ctr) {
+            expected += "ok";
+        }
+        EXPECT_EQ (body, expected);
+    }
+
+    /// Makes a single request to \p host with \p l and waits for it to complete.
+    std::error_code uring_get (http::uring_loop & l, char const * const host) {
+        std::error_code result = std::make_error_code (std::errc::operation_in_progress);
+        std::string body;
+        std::error_code const erc = l.async_get (
+            host, "80", "/",
+            [&result] (std::error_code const e, http::response_parser const &) { result = e; },
+            [&body] (gsl::span<char const> const data) {
+                body.append (data.data (), static_cast<std::size_t> (data.size ()));
+            });
+        if (erc) {
+            return erc;
+        }
+        if (std::error_code const run_erc = l.run ()) {
+            return run_erc;
+        }
+        EXPECT_EQ (body, "ok");
+        return result;
+    }
+
+    class Connect : public testing::Test {
+    protected:
+        void SetUp () override {
+            ASSERT_TRUE (server_.valid ());
+            if (!hole_.works ()) {
+                GTEST_SKIP () << "Can't make an address which drops connection attempts";
+            }
+        }
+
+        server server_;
+        blackhole hole_;
+    };
+
+} // end anonymous namespace
+
+TEST_F (Connect, RacingSkipsBlackhole) {
+    http::happy_eyeballs_options opts;
+    opts.attempt_delay = 100ms;
+    auto const start = clock::now ();
+    error_or<socket_descriptor> const fd =
+        http::connect_racing ({hole_.address (), server_.address ()}, opts);
+    ASSERT_TRUE (fd) << fd.get_error ().message ();
+    // The second attempt starts after attempt_delay, not after the first one gives up.
+    EXPECT_GE (since (start), 100ms);
+    EXPECT_LT (since (start), 1000ms);
+}
+
+TEST_F (Connect, RacingTimeout) {
+    http::happy_eyeballs_options opts;
+    opts.timeout = 300ms;
+    auto const start = clock::now ();
+    error_or<socket_descriptor> const fd = http::connect_racing ({hole_.address ()}, opts);
+    ASSERT_FALSE (fd);
+    EXPECT_EQ (fd.get_error (), std::make_error_code (std::errc::timed_out));
+    EXPECT_GE (since (start), 300ms);
+    EXPECT_LT (since (start), 1000ms);
+}
+
+TEST_F (Connect, RacingMovesOnAfterRefusal) {
+    http::happy_eyeballs_options opts;
+    opts.attempt_delay = 10s;
+    auto const start = clock::now ();
+    error_or<socket_descriptor> const fd =
+        http::connect_racing ({refusing (), server_.address ()}, opts);
+    ASSERT_TRUE (fd) << fd.get_error ().message ();
+    // A failed attempt doesn't wait for attempt_delay.
+    EXPECT_LT (since (start), 1000ms);
+}
+
+TEST_F (Connect, EventLoopSkipsBlackhole) {
+    auto r = std::make_shared<http::resolver> ();
+    r->pin ("race.test", "80", {hole_.address (), server_.address ()});
+    r->pin ("hole.test", "80", {hole_.address ()});
+    r->pin ("refused.test", "80", {refusing ()});
+
+    http::happy_eyeballs_options opts;
+    opts.attempt_delay = 100ms;
+    opts.timeout = 300ms;
+    error_or<std::unique_ptr<http::event_loop>> loop = http::event_loop::create (r, opts);
+    ASSERT_TRUE (loop) << loop.get_error ().message ();
+
+    auto const start = clock::now ();
+    struct outcome {
+        bool done = false;
+        std::error_code erc;
+        std::chrono::milliseconds elapsed{0};
+        std::string body;
+    };
+    outcome race;
+    outcome hole;
+    outcome refused;
+    auto const get = [&] (char const * const host, outcome & out) {
+        return (*loop)->async_get (
+            host, "80", "/",
+            [&out, start] (std::error_code const erc, http::response_parser const &) {
+                out.done = true;
+                out.erc = erc;
+                out.elapsed = since (start);
+            },
+            [&out] (gsl::span<char const> const data) {
+                out.body.append (data.data (), static_cast<std::size_t> (data.size ()));
+            });
+    };
+    ASSERT_FALSE (get ("race.test", race));
+    ASSERT_FALSE (get ("hole.test", hole));
+    ASSERT_FALSE (get ("refused.test", refused));
+    std::error_code const erc = (*loop)->run ();
+    ASSERT_FALSE (erc) << erc.message ();
+
+    ASSERT_TRUE (race.done);
+    EXPECT_FALSE (race.erc) << race.erc.message ();
+    EXPECT_EQ (race.body, "ok");
+    EXPECT_GE (race.elapsed, 100ms);
+    EXPECT_LT (race.elapsed, 300ms);
+
+    ASSERT_TRUE (hole.done);
+    EXPECT_EQ (hole.erc, std::make_error_code (std::errc::timed_out));
+    EXPECT_GE (hole.elapsed, 300ms);
+    EXPECT_LT (hole.elapsed, 1000ms);
+
+    ASSERT_TRUE (refused.done);
+    EXPECT_TRUE (refused.erc);
+    EXPECT_LT (refused.elapsed, 100ms);
+}
+
+TEST_F (Connect, EventLoopConnectDeadline) {
+    auto r = std::make_shared<http::resolver> ();
+    r->pin ("hole.test", "80", {hole_.address ()});
+    error_or<std::unique_ptr<http::event_loop>> loop = http::event_loop::create (r);
+    ASSERT_TRUE (loop) << loop.get_error ().message ();
+
+    http::event_loop::request_options opts;
+    opts.connect = 300ms;
+    auto const start = clock::now ();
+    bool done = false;
+    std::error_code erc;
+    ASSERT_FALSE ((*loop)->async_get (
+        "hole.test", "80", "/", opts,
+        [&] (std::error_code const e, http::response_parser const &) {
+            done = true;
+            erc = e;
+        }));
+    ASSERT_FALSE ((*loop)->run ());
+    ASSERT_TRUE (done);
+    EXPECT_EQ (erc, std::make_error_code (std::errc::timed_out));
+    EXPECT_GE (since (start), 300ms);
+    EXPECT_LT (since (start), 1000ms);
+}
+
+TEST (EventLoop, ReusesConnections) {
+    server srv{server::mode::keep_alive};
+    ASSERT_TRUE (srv.valid ());
+    sequential_gets (srv, 5U);
+    EXPECT_EQ (srv.accepted (), 1U);
+}
+
+TEST (EventLoop, HonoursConnectionClose) {
+    server srv{server::mode::close};
+    ASSERT_TRUE (srv.valid ());
+    sequential_gets (srv, 3U);
+    EXPECT_EQ (srv.accepted (), 3U);
+}
+
+// The server closes each connection after its response, so every reused connection fails: each
+// request must still succeed on a new one.
+TEST (EventLoop, ReplacesClosedConnections) {
+    server srv{server::mode::drop};
+    ASSERT_TRUE (srv.valid ());
+    sequential_gets (srv, 3U);
+    EXPECT_EQ (srv.accepted (), 3U);
+}
+
+TEST (EventLoop, ExpiresIdleConnections) {
+    server srv{server::mode::keep_alive};
+    ASSERT_TRUE (srv.valid ());
+    auto r = std::make_shared<http::resolver> ();
+    r->pin ("server.test", "80", {srv.address ()});
+    http::event_loop::idle_options idle;
+    idle.idle_timeout = 50ms;
+    error_or<std::unique_ptr<http::event_loop>> loop = http::event_loop::create (r, {}, idle);
+    ASSERT_TRUE (loop) << loop.get_error ().message ();
+    http::event_loop & l = **loop;
+
+    auto const get = [&l] {
+        std::error_code result = std::make_error_code (std::errc::operation_in_progress);
+        EXPECT_FALSE (l.async_get (
+            "server.test", "80", "/",
+            [&result] (std::error_code const e, http::response_parser const &) { result = e; }));
+        EXPECT_FALSE (l.run ());
+        return result;
+    };
+    EXPECT_FALSE (get ());
+    EXPECT_FALSE (get ());
+    EXPECT_EQ (srv.accepted (), 1U);
+    for (auto const start = clock::now (); since (start) < 100ms;) {
+        ASSERT_TRUE (l.run_once (20ms));
+    }
+    EXPECT_FALSE (get ());
+    EXPECT_EQ (srv.accepted (), 2U);
+}
+
+TEST (EventLoop, LimitsIdleConnectionsPerHost) {
+    server srv{server::mode::keep_alive};
+    ASSERT_TRUE (srv.valid ());
+    auto r = std::make_shared<http::resolver> ();
+    r->pin ("server.test", "80", {srv.address ()});
+    http::event_loop::idle_options idle;
+    idle.max_idle_per_host = 0;
+    error_or<std::unique_ptr<http::event_loop>> loop = http::event_loop::create (r, {}, idle);
+    ASSERT_TRUE (loop) << loop.get_error ().message ();
+
+    for (auto ctr = 0; ctr < 2; ++ctr) {
+        std::error_code result = std::make_error_code (std::errc::operation_in_progress);
+        EXPECT_FALSE ((*loop)->async_get (
+            "server.test", "80", "/",
+            [&result] (std::error_code const e, http::response_parser const &) { result = e; }));
+        EXPECT_FALSE ((*loop)->run ());
+        EXPECT_FALSE (result) << result.message ();
+    }
+    EXPECT_EQ (srv.accepted (), 2U);
+}
+
+// With every slot in use by an idle connection, a request to another host takes the slot of the
+// least recently used one.
+TEST (UringLoop, EvictsIdleConnections) {
+    if (!http::uring_loop::supported ()) {
+        GTEST_SKIP () << "io_uring is not available";
+    }
+    server a{server::mode::keep_alive};
+    server b{server::mode::keep_alive};
+    server c{server::mode::keep_alive};
+    ASSERT_TRUE (a.valid () && b.valid () && c.valid ());
+    auto r = std::make_shared<http::resolver> ();
+    r->pin ("a.test", "80", {a.address ()});
+    r->pin ("b.test", "80", {b.address ()});
+    r->pin ("c.test", "80", {c.address ()});
+    http::uring_loop::options opts;
+    opts.max_connections = 2;
+    error_or<std::unique_ptr<http::uring_loop>> loop = http::uring_loop::create (opts, r);
+    ASSERT_TRUE (loop) << loop.get_error ().message ();
+
+    for (char const * const host : {"a.test", "b.test", "c.test", "b.test", "a.test"}) {
+        std::error_code const erc = uring_get (**loop, host);
+        EXPECT_FALSE (erc) << host << ": " << erc.message ();
+    }
+    // c.test's request evicted a.test's connection; b.test's was reused.
+    EXPECT_EQ (a.accepted (), 2U);
+    EXPECT_EQ (b.accepted (), 1U);
+    EXPECT_EQ (c.accepted (), 1U);
+}
+
+TEST (UringLoop, ExpiresIdleConnections) {
+    if (!http::uring_loop::supported ()) {
+        GTEST_SKIP () << "io_uring is not available";
+    }
+    server srv{server::mode::keep_alive};
+    ASSERT_TRUE (srv.valid ());
+    auto r = std::make_shared<http::resolver> ();
+    r->pin ("server.test", "80", {srv.address ()});
+    http::uring_loop::options opts;
+    opts.idle_timeout = 50ms;
+    error_or<std::unique_ptr<http::uring_loop>> loop = http::uring_loop::create (opts, r);
+    ASSERT_TRUE (loop) << loop.get_error ().message ();
+    http::uring_loop & l = **loop;
+
+    EXPECT_FALSE (uring_get (l, "server.test"));
+    EXPECT_FALSE (uring_get (l, "server.test"));
+    EXPECT_EQ (srv.accepted (), 1U);
+    for (auto const start = clock::now (); since (start) < 150ms;) {
+        ASSERT_TRUE (l.run_once (50ms));
+    }
+    EXPECT_FALSE (uring_get (l, "server.test"));
+    EXPECT_EQ (srv.accepted (), 2U);
+}
+
+TEST (UringLoop, LimitsIdleConnectionsPerHost) {
+    if (!http::uring_loop::supported ()) {
+        GTEST_SKIP () << "io_uring is not available";
+    }
+    server srv{server::mode::keep_alive};
+    ASSERT_TRUE (srv.valid ());
+    auto r = std::make_shared<http::resolver> ();
+    r->pin ("server.test", "80", {srv.address ()});
+    http::uring_loop::options opts;
+    opts.max_idle_per_host = 0;
+    error_or<std::unique_ptr<http::uring_loop>> loop = http::uring_loop::create (opts, r);
+    ASSERT_TRUE (loop) << loop.get_error ().message ();
+
+    EXPECT_FALSE (uring_get (**loop, "server.test"));
+    EXPECT_FALSE (uring_get (**loop, "server.test"));
+    EXPECT_EQ (srv.accepted (), 2U);
+}
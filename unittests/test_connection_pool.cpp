@@ -0,0 +1,152 @@
+#include "client/connection_pool.hpp"
+
+#include <chrono>
+#include <string>
+#include <thread>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include <gtest/gtest.h>
+
+using namespace pstore;
+using namespace std::chrono_literals;
+
+namespace {
+
+    /// A socket listening on an ephemeral loopback port. Connections complete in the listen
+    /// backlog without being accepted, which is all that the pool needs.
+    class ConnectionPool : public testing::Test {
+    protected:
+        void SetUp () override {
+            listener_.reset (::socket (AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0));
+            ASSERT_TRUE (listener_.valid ());
+            sockaddr_in addr{};
+            addr.sin_family = AF_INET;
+            addr.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+            socklen_t length = sizeof (addr);
+            auto * const sa = reinterpret_cast<sockaddr *> (&addr);
+            ASSERT_EQ (::bind (listener_.native_handle (), sa, length), 0);
+            ASSERT_EQ (::listen (listener_.native_handle (), 64), 0);
+            ASSERT_EQ (::getsockname (listener_.native_handle (), sa, &length), 0);
+            port_ = std::to_string (ntohs (addr.sin_port));
+        }
+
+        static http::connection_pool::options no_timer () {
+            http::connection_pool::options opts;
+            opts.eviction_interval = http::connection_pool::clock::duration::zero ();
+            return opts;
+        }
+
+        error_or<http::connection_pool::lease> acquire (http::connection_pool & pool) {
+            return pool.acquire ("127.0.0.1", port_);
+        }
+        std::size_t idle (http::connection_pool const & pool) const {
+            return pool.idle_count ("127.0.0.1", port_);
+        }
+        std::size_t active (http::connection_pool const & pool) const {
+            return pool.active_count ("127.0.0.1", port_);
+        }
+
+        socket_descriptor listener_;
+        std::string port_;
+    };
+
+} // end anonymous namespace
+
+TEST_F (ConnectionPool, ReusesIdleConnections) {
+    http::connection_pool pool{no_timer ()};
+    auto first = this->acquire (pool);
+    ASSERT_TRUE (first);
+    EXPECT_FALSE (first->reused ());
+    EXPECT_EQ (this->active (pool), 1U);
+    int const handle = first->socket ().native_handle ();
+    pool.release (std::move (*first), true);
+    EXPECT_EQ (this->active (pool), 0U);
+    EXPECT_EQ (this->idle (pool), 1U);
+
+    auto second = this->acquire (pool);
+    ASSERT_TRUE (second);
+    EXPECT_TRUE (second->reused ());
+    EXPECT_EQ (second->socket ().native_handle (), handle);
+    EXPECT_EQ (this->idle (pool), 0U);
+}
+
+TEST_F (ConnectionPool, UnusableConnectionsAreClosed) {
+    http::connection_pool pool{no_timer ()};
+    auto l = this->acquire (pool);
+    ASSERT_TRUE (l);
+    pool.release (std::move (*l), false);
+    EXPECT_EQ (this->idle (pool), 0U);
+    EXPECT_EQ (this->active (pool), 0U);
+
+    // A lease destroyed without being released gives up its slot.
+    {
+        auto dropped = this->acquire (pool);
+        ASSERT_TRUE (dropped);
+        EXPECT_EQ (this->active (pool), 1U);
+    }
+    EXPECT_EQ (this->active (pool), 0U);
+}
+
+TEST_F (ConnectionPool, PerHostLimit) {
+    auto opts = no_timer ();
+    opts.max_total_per_host = 2U;
+    http::connection_pool pool{opts};
+    auto a = this->acquire (pool);
+    auto b = this->acquire (pool);
+    ASSERT_TRUE (a);
+    ASSERT_TRUE (b);
+    auto c = this->acquire (pool);
+    ASSERT_FALSE (c);
+    EXPECT_EQ (c.get_error (), std::make_error_code (std::errc::resource_unavailable_try_again));
+
+    pool.release (std::move (*a), true);
+    auto d = this->acquire (pool);
+    ASSERT_TRUE (d);
+    EXPECT_TRUE (d->reused ());
+    EXPECT_EQ (this->active (pool), 2U);
+}
+
+TEST_F (ConnectionPool, IdleLimit) {
+    auto opts = no_timer ();
+    opts.max_idle_per_host = 1U;
+    http::connection_pool pool{opts};
+    auto a = this->acquire (pool);
+    auto b = this->acquire (pool);
+    ASSERT_TRUE (a);
+    ASSERT_TRUE (b);
+    pool.release (std::move (*a), true);
+    pool.release (std::move (*b), true);
+    EXPECT_EQ (this->idle (pool), 1U);
+}
+
+TEST_F (ConnectionPool, EvictIdle) {
+    auto opts = no_timer ();
+    opts.idle_timeout = 1s;
+    http::connection_pool pool{opts};
+    auto l = this->acquire (pool);
+    ASSERT_TRUE (l);
+    pool.release (std::move (*l), true);
+    auto const now = http::connection_pool::clock::now ();
+    EXPECT_EQ (pool.evict_idle (now), 0U);
+    EXPECT_EQ (this->idle (pool), 1U);
+    EXPECT_EQ (pool.evict_idle (now + 2s), 1U);
+    EXPECT_EQ (this->idle (pool), 0U);
+}
+
+TEST_F (ConnectionPool, EvictionTimer) {
+    http::connection_pool::options opts;
+    opts.idle_timeout = 20ms;
+    opts.eviction_interval = 10ms;
+    http::connection_pool pool{opts};
+    auto l = this->acquire (pool);
+    ASSERT_TRUE (l);
+    pool.release (std::move (*l), true);
+    auto const deadline = std::chrono::steady_clock::now () + 5s;
+    while (this->idle (pool) > 0U && std::chrono::steady_clock::now () < deadline) {
+        std::this_thread::sleep_for (10ms);
+    }
+    EXPECT_EQ (this->idle (pool), 0U);
+}
@@ -0,0 +1,100 @@
+#include "client/content_coding.hpp"
+
+#include <string>
+#include <vector>
+
+#include <zlib.h>
+
+#include <gtest/gtest.h>
+
+using namespace pstore;
+using http::content_coding;
+
+namespace {
+
+    /// Compresses \p text with zlib's deflate. \p window_bits selects the format: 15 for zlib,
+    /// -15 for raw deflate, and 31 for gzip.
+    std::string compress (std::string const & text, int const window_bits) {
+        z_stream z{};
+        EXPECT_EQ (deflateInit2 (&z, Z_BEST_COMPRESSION, Z_DEFLATED, window_bits, 8,
+                                 Z_DEFAULT_STRATEGY),
+                   Z_OK);
+        std::string out (deflateBound (&z, static_cast<uLong> (text.size ())), '\0');
+        z.next_in = reinterpret_cast<Bytef *> (const_cast<char *> (text.data ()));
+        z.avail_in = static_cast<uInt> (text.size ());
+        z.next_out = reinterpret_cast<Bytef *> (&out[0]);
+        z.avail_out = static_cast<uInt> (out.size ());
+        EXPECT_EQ (deflate (&z, Z_FINISH), Z_STREAM_END);
+        out.resize (z.total_out);
+        deflateEnd (&z);
+        return out;
+    }
+
+    /// A highly compressible text: long runs decode from a few input bytes into far more
+    /// output than a small output buffer holds.
+    std::string sample (int const runs = 64, std::size_t const run_length = 4096) {
+        std::string text;
+        for (int ctr = 0; ctr < runs; ++ctr) {
+            text += std::to_string (ctr);
+            text += std::string (run_length + static_cast<std::size_t> (ctr),
+                                 static_cast<char> ('a' + ctr % 26));
+        }
+        return text;
+    }
+
+    class ContentCoding : public testing::TestWithParam<int> {};
+
+} // end anonymous namespace
+
+// The input can be used up while zlib still holds output that didn't fit in the buffer. For
+// raw deflate data, that happens when the last input byte completes a match (some of these
+// texts end that way): the inflater must go on draining the output with no more input.
+TEST_P (ContentCoding, DrainsPendingOutput) {
+    content_coding const coding = GetParam () > 15 ? content_coding::gzip : content_coding::deflate;
+    for (int runs = 1; runs < 100; ++runs) {
+        std::string const text = sample (runs, 100U);
+        std::string const compressed = compress (text, GetParam ());
+        for (std::size_t const chunk : {std::size_t{1}, std::size_t{7}, std::size_t{4096}}) {
+            http::buffer_sink out;
+            http::inflate_sink<http::buffer_sink> sink{out, coding, chunk};
+            // The compressed body arrives in a single piece, as the final chunk of a body would.
+            ASSERT_FALSE (sink.commit (gsl::make_span (
+                compressed.data (), static_cast<std::ptrdiff_t> (compressed.size ()))))
+                << "runs " << runs << " chunk " << chunk;
+            EXPECT_FALSE (sink.finish ()) << "runs " << runs << " chunk " << chunk;
+            ASSERT_EQ (std::string (out.data (), out.size ()), text)
+                << "runs " << runs << " chunk " << chunk;
+        }
+    }
+}
+
+TEST_P (ContentCoding, TruncatedStream) {
+    std::string const compressed = compress (sample (), GetParam ());
+    content_coding const coding = GetParam () > 15 ? content_coding::gzip : content_coding::deflate;
+    http::buffer_sink out;
+    http::inflate_sink<http::buffer_sink> sink{out, coding, 1024};
+    ASSERT_FALSE (sink.commit (gsl::make_span (
+        compressed.data (), static_cast<std::ptrdiff_t> (compressed.size () / 2U))));
+    EXPECT_EQ (sink.finish (), std::make_error_code (std::errc::bad_message));
+}
+
+TEST (ContentCoding, InflaterSmallOutput) {
+    std::string const text = sample ();
+    std::string const compressed = compress (text, -15);
+    http::inflater inf{content_coding::deflate};
+    std::string result;
+    std::vector<char> out (7);
+    gsl::span<char const> in =
+        gsl::make_span (compressed.data (), static_cast<std::ptrdiff_t> (compressed.size ()));
+    while (!inf.done ()) {
+        auto const r = inf.inflate (in, gsl::make_span (out.data (), 7));
+        ASSERT_TRUE (r) << r.get_error ().message ();
+        auto const [consumed, produced] = *r;
+        ASSERT_TRUE (consumed > 0U || produced > 0U) << "stuck after " << result.size ();
+        in = in.subspan (static_cast<std::ptrdiff_t> (consumed));
+        result.append (out.data (), produced);
+    }
+    EXPECT_EQ (result, text);
+}
+
+INSTANTIATE_TEST_SUITE_P (Formats, ContentCoding, testing::Values (15, -15, 31));
@@ -0,0 +1,172 @@
+#include "client/coro.hpp"
+
+#include <optional>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "client/request_builder.hpp"
+
+#include "test_helpers.hpp"
+
+using namespace pstore;
+namespace coro = pstore::http::coro;
+
+namespace {
+
+    std::string response (std::string const & body) {
+        return "HTTP/1.1 200 OK\r\nContent-Length: " + std::to_string (body.length ()) +
+               "\r\nX-Test: yes\r\nConnection: close\r\n\r\n" + body;
+    }
+
+    /// The outcome of one fetch.
+    struct result {
+        std::error_code erc = std::make_error_code (std::errc::operation_in_progress);
+        http::http_status_code status{};
+        std::string header;
+        std::string body;
+    };
+
+    /// Fetches \p path from 127.0.0.1:\p port, recording the outcome in \p out.
+    coro::task<> fetch (coro::reactor & r, std::string port, std::string path, result & out) {
+        error_or<http::shared_address_list> const addrs =
+            co_await coro::resolve (r, "127.0.0.1", port);
+        if (!addrs) {
+            out.erc = addrs.get_error ();
+            co_return;
+        }
+        error_or<socket_descriptor> fd = co_await coro::connect (r, *addrs);
+        if (!fd) {
+            out.erc = fd.get_error ();
+            co_return;
+        }
+        coro::stream s{r, std::move (*fd)};
+        std::string request;
+        http::request_builder ()
+            .start ("GET", path)
+            .host ("127.0.0.1", port)
+            .header ("Connection", "close")
+            .finish ()
+            .copy_to (request);
+        if (std::error_code const erc =
+                co_await coro::send_request (r, s.socket (), std::move (request))) {
+            out.erc = erc;
+            co_return;
+        }
+        http::header_block headers;
+        error_or<http::status_line> const status = co_await coro::read_final_head (s, headers);
+        if (!status) {
+            out.erc = status.get_error ();
+            co_return;
+        }
+        error_or<std::size_t> const length = co_await coro::read_body (
+            s, status->status_code (), headers, [&out] (gsl::span<char const> const data) {
+                out.body.append (data.data (), static_cast<std::size_t> (data.size ()));
+            });
+        if (!length) {
+            out.erc = length.get_error ();
+            co_return;
+        }
+        out.erc = std::error_code{};
+        out.status = status->status_code ();
+        out.header = std::string{headers.find ("x-test").value_or ("")};
+    }
+
+    /// Adds the numbers from 1 to \p n, one nested task for each.
+    coro::task<unsigned> sum (unsigned const n) {
+        if (n == 0U) {
+            co_return 0U;
+        }
+        unsigned const rest = co_await sum (n - 1U);
+        co_return n + rest;
+    }
+
+    coro::task<> store_sum (unsigned const n, unsigned & out) { out = co_await sum (n); }
+
+    class Coro : public testing::Test {
+    protected:
+        void SetUp () override {
+            error_or<coro::reactor> eo = coro::reactor::create ();
+            ASSERT_TRUE (eo) << eo.get_error ().message ();
+            reactor_.emplace (std::move (*eo));
+        }
+
+        coro::reactor & reactor () { return *reactor_; }
+
+    private:
+        std::optional<coro::reactor> reactor_;
+    };
+
+} // end anonymous namespace
+
+TEST_F (Coro, FetchOverLoopback) {
+    test_helpers::loopback_server server{[] (std::string const & head) {
+        return response (head.substr (0, head.find ('\r')));
+    }};
+    coro::reactor & r = this->reactor ();
+    result out;
+    r.spawn (fetch (r, server.port (), "/path", out));
+    EXPECT_EQ (r.pending (), 1U);
+    ASSERT_FALSE (r.run ());
+    EXPECT_EQ (r.pending (), 0U);
+    ASSERT_FALSE (out.erc) << out.erc.message ();
+    EXPECT_EQ (out.status, http::http_status_code::ok);
+    EXPECT_EQ (out.header, "yes");
+    EXPECT_EQ (out.body, "GET /path HTTP/1.1");
+}
+
+// Several fetches share the reactor's thread.
+TEST_F (Coro, ConcurrentFetches) {
+    test_helpers::loopback_server server{[] (std::string const &) { return response ("ok"); }};
+    coro::reactor & r = this->reactor ();
+    std::vector<result> results (8);
+    for (result & out : results) {
+        r.spawn (fetch (r, server.port (), "/", out));
+    }
+    EXPECT_EQ (r.pending (), results.size ());
+    ASSERT_FALSE (r.run ());
+    for (result const & out : results) {
+        EXPECT_FALSE (out.erc) << out.erc.message ();
+        EXPECT_EQ (out.body, "ok");
+    }
+}
+
+TEST_F (Coro, ConnectionRefused) {
+    std::string port;
+    // Find a port on which nothing is listening.
+    test_helpers::listen_on_loopback (1, port);
+    coro::reactor & r = this->reactor ();
+    result out;
+    r.spawn (fetch (r, port, "/", out));
+    ASSERT_FALSE (r.run ());
+    EXPECT_EQ (out.erc, std::make_error_code (std::errc::connection_refused));
+}
+
+// Each task's result is passed back to the task which awaited it.
+TEST_F (Coro, NestedTasks) {
+    coro::reactor & r = this->reactor ();
+    unsigned out = 0;
+    r.spawn (store_sum (100U, out));
+    ASSERT_FALSE (r.run ());
+    EXPECT_EQ (out, 5050U);
+}
+
+// Once the first fetch has filled the thread's frame pool, later ones take no more memory
+// from the heap.
+TEST_F (Coro, FramesAreReused) {
+    test_helpers::loopback_server server{[] (std::string const &) { return response ("ok"); }};
+    coro::reactor & r = this->reactor ();
+    result first;
+    r.spawn (fetch (r, server.port (), "/", first));
+    ASSERT_FALSE (r.run ());
+    ASSERT_FALSE (first.erc) << first.erc.message ();
+
+    std::size_t const blocks = coro::frame_pool::heap_blocks ();
+    result second;
+    r.spawn (fetch (r, server.port (), "/", second));
+    ASSERT_FALSE (r.run ());
+    ASSERT_FALSE (second.erc) << second.erc.message ();
+    EXPECT_EQ (coro::frame_pool::heap_blocks (), blocks);
+}
@@ -0,0 +1,266 @@
+#include "client/download.hpp"
+
+#include <array>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#include "test_helpers.hpp"
+
+using namespace pstore;
+
+namespace {
+
+    // server
+    // ~~~~~~
+    /// Serves a single resource, honoring Range headers unless told otherwise. Records the
+    /// Range and If-Range headers of each request.
+    class server {
+    public:
+        struct options {
+            std::string body;
+            /// If false, the server ignores Range and always sends the whole body.
+            bool ranges = true;
+            std::string etag;
+            std::string last_modified;
+            /// If true, the first request for a range other than the probe for the first
+            /// byte is cut short after half of its body.
+            bool drop_once = false;
+            /// If true, requests for any range other than the first byte are answered with the
+            /// whole body, as if the resource had changed and If-Range didn't match.
+            bool changed = false;
+        };
+        struct request {
+            std::string range;
+            std::string if_range;
+        };
+
+        explicit server (options const & opts)
+                : options_{opts}
+                , http_{[this] (std::string const & head) { return this->respond (head); }} {}
+
+        std::string const & port () const noexcept { return http_.port (); }
+        std::vector<request> requests () const {
+            std::lock_guard<std::mutex> const lock{mutex_};
+            return requests_;
+        }
+
+    private:
+        std::string validators () const {
+            std::string result;
+            if (!options_.etag.empty ()) {
+                result += "ETag: " + options_.etag + "\r\n";
+            }
+            if (!options_.last_modified.empty ()) {
+                result += "Last-Modified: " + options_.last_modified + "\r\n";
+            }
+            return result;
+        }
+
+        std::string respond (std::string const & head) {
+            using test_helpers::loopback_server;
+            request const req{loopback_server::find_header (head, "Range"),
+                              loopback_server::find_header (head, "If-Range")};
+            {
+                std::lock_guard<std::mutex> const lock{mutex_};
+                requests_.push_back (req);
+            }
+
+            std::string const & body = options_.body;
+            std::size_t first = 0;
+            std::size_t last = 0;
+            bool const probe = req.range == "bytes=0-0";
+            if (!options_.ranges || req.range.empty () || (options_.changed && !probe) ||
+                std::sscanf (req.range.c_str (), "bytes=%zu-%zu", &first, &last) != 2) {
+                return "HTTP/1.1 200 OK\r\nContent-Length: " + std::to_string (body.length ()) +
+                       "\r\n" + this->validators () + "Connection: close\r\n\r\n" + body;
+            }
+            std::string const part = body.substr (first, last - first + 1U);
+            std::string const header =
+                "HTTP/1.1 206 Partial Content\r\nContent-Length: " +
+                std::to_string (part.length ()) + "\r\nContent-Range: bytes " +
+                std::to_string (first) + '-' + std::to_string (last) + '/' +
+                std::to_string (body.length ()) + "\r\n" + this->validators () +
+                "Connection: close\r\n\r\n";
+            if (!probe && options_.drop_once && !dropped_) {
+                dropped_ = true;
+                return header + part.substr (0, part.length () / 2U);
+            }
+            return header + part;
+        }
+
+        options const options_;
+        bool dropped_ = false;
+        mutable std::mutex mutex_;
+        std::vector<request> requests_;
+        // Last, so that the server's thread stops before the members that it uses are
+        // destroyed.
+        test_helpers::loopback_server http_;
+    };
+
+    /// A body long enough to be split into several ranges.
+    std::string make_body () {
+        std::string body;
+        for (auto ctr = 0; body.length () < 1000U; ++ctr) {
+            body += std::to_string (ctr) + ',';
+        }
+        return body;
+    }
+
+    class Download : public testing::Test {
+    protected:
+        void SetUp () override {
+            std::string name = "/tmp/download_XXXXXX";
+            file_.reset (::mkstemp (&name[0]));
+            ASSERT_TRUE (file_.valid ());
+            ::unlink (name.c_str ());
+        }
+
+        error_or<http::download_result> download (server const & s,
+                                                  http::download_options const & opts) {
+            return http::http_download ("127.0.0.1", s.port (), "/file",
+                                        file_.native_handle (), opts);
+        }
+
+        /// Returns the contents of the output file.
+        std::string contents () const {
+            std::string result;
+            std::array<char, 256> buffer;
+            for (off_t offset = 0;;) {
+                ssize_t const r =
+                    ::pread (file_.native_handle (), buffer.data (), buffer.size (), offset);
+                if (r <= 0) {
+                    return result;
+                }
+                result.append (buffer.data (), static_cast<std::size_t> (r));
+                offset += r;
+            }
+        }
+
+        static http::download_options split (unsigned const connections) {
+            http::download_options opts;
+            opts.connections = connections;
+            opts.min_range_size = 10;
+            return opts;
+        }
+
+        socket_descriptor file_;
+    };
+
+} // end anonymous namespace
+
+// A server which ignores Range answers the probe with the whole body.
+TEST_F (Download, ProbeFallsBackOn200) {
+    server::options opts;
+    opts.body = make_body ();
+    opts.ranges = false;
+    server s{opts};
+    error_or<http::download_result> const result = this->download (s, split (4U));
+    ASSERT_TRUE (result) << result.get_error ().message ();
+    EXPECT_EQ (result->size, opts.body.length ());
+    EXPECT_EQ (result->ranges, 1U);
+    EXPECT_EQ (this->contents (), opts.body);
+    EXPECT_EQ (s.requests ().size (), 1U);
+}
+
+TEST_F (Download, SplitsRanges) {
+    server::options opts;
+    opts.body = make_body ();
+    opts.etag = "\"v1\"";
+    server s{opts};
+    error_or<http::download_result> const result = this->download (s, split (4U));
+    ASSERT_TRUE (result) << result.get_error ().message ();
+    EXPECT_EQ (result->size, opts.body.length ());
+    EXPECT_EQ (result->ranges, 4U);
+    EXPECT_EQ (result->resumes, 0U);
+    EXPECT_EQ (this->contents (), opts.body);
+
+    // The probe followed by one request for each range. Together, the ranges cover everything
+    // after the first byte.
+    std::vector<server::request> const requests = s.requests ();
+    ASSERT_EQ (requests.size (), 5U);
+    EXPECT_EQ (requests[0].range, "bytes=0-0");
+    EXPECT_EQ (requests[0].if_range, "");
+    std::size_t covered = 0;
+    for (auto it = requests.begin () + 1; it != requests.end (); ++it) {
+        std::size_t first = 0;
+        std::size_t last = 0;
+        ASSERT_EQ (std::sscanf (it->range.c_str (), "bytes=%zu-%zu", &first, &last), 2);
+        covered += last - first + 1U;
+        EXPECT_EQ (it->if_range, opts.etag);
+    }
+    EXPECT_EQ (covered, opts.body.length () - 1U);
+}
+
+// A range whose connection is lost is resumed from the first byte not yet received.
+TEST_F (Download, ResumesAfterDrop) {
+    server::options opts;
+    opts.body = make_body ();
+    opts.drop_once = true;
+    server s{opts};
+    error_or<http::download_result> const result = this->download (s, split (1U));
+    ASSERT_TRUE (result) << result.get_error ().message ();
+    EXPECT_EQ (result->ranges, 1U);
+    EXPECT_EQ (result->resumes, 1U);
+    EXPECT_EQ (this->contents (), opts.body);
+
+    std::vector<server::request> const requests = s.requests ();
+    ASSERT_EQ (requests.size (), 3U);
+    auto const last = std::to_string (opts.body.length () - 1U);
+    EXPECT_EQ (requests[1].range, "bytes=1-" + last);
+    // Half of the first attempt's body arrived.
+    auto const resume = 1U + (opts.body.length () - 1U) / 2U;
+    EXPECT_EQ (requests[2].range, "bytes=" + std::to_string (resume) + '-' + last);
+}
+
+// If-Range needs a strong validator: a weak entity-tag is passed over for Last-Modified.
+TEST_F (Download, WeakEtagNotUsedForIfRange) {
+    server::options opts;
+    opts.body = make_body ();
+    opts.etag = "W/\"v1\"";
+    opts.last_modified = "Wed, 21 Oct 2015 07:28:00 GMT";
+    server s{opts};
+    error_or<http::download_result> const result = this->download (s, split (2U));
+    ASSERT_TRUE (result) << result.get_error ().message ();
+    EXPECT_EQ (this->contents (), opts.body);
+
+    std::vector<server::request> const requests = s.requests ();
+    ASSERT_EQ (requests.size (), 3U);
+    EXPECT_EQ (requests[1].if_range, opts.last_modified);
+    EXPECT_EQ (requests[2].if_range, opts.last_modified);
+}
+
+TEST_F (Download, WeakEtagAloneSendsNoIfRange) {
+    server::options opts;
+    opts.body = make_body ();
+    opts.etag = "W/\"v1\"";
+    server s{opts};
+    error_or<http::download_result> const result = this->download (s, split (1U));
+    ASSERT_TRUE (result) << result.get_error ().message ();
+    EXPECT_EQ (this->contents (), opts.body);
+
+    std::vector<server::request> const requests = s.requests ();
+    ASSERT_EQ (requests.size (), 2U);
+    EXPECT_EQ (requests[1].if_range, "");
+}
+
+// A 200 response to a range request means that the resource has changed. The download fails
+// without asking again.
+TEST_F (Download, ResourceChangedFailsAtOnce) {
+    server::options opts;
+    opts.body = make_body ();
+    opts.etag = "\"v1\"";
+    opts.changed = true;
+    server s{opts};
+    error_or<http::download_result> const result = this->download (s, split (1U));
+    ASSERT_FALSE (result);
+    EXPECT_EQ (result.get_error (), (std::error_code{ESTALE, std::generic_category ()}));
+    EXPECT_EQ (s.requests ().size (), 2U);
+}
@@ -0,0 +1,304 @@
+#include "client/event_loop.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+
+#include <gtest/gtest.h>
+
+#include "test_helpers.hpp"
+
+using namespace pstore;
+using namespace std::chrono_literals;
+
+namespace {
+
+    // server
+    // ~~~~~~
+    /// A server listening on an ephemeral loopback port. It accepts one connection at a time,
+    /// reads a request head from it, sends the response in pieces of at most chunk bytes and
+    /// then closes the connection or, if hold is true, waits for the client to close it.
+    class server {
+    public:
+        explicit server (std::string response, std::size_t const chunk = 0,
+                         bool const hold = false)
+                : response_{std::move (response)}
+                , chunk_{chunk == 0U ? response_.size () : chunk}
+                , hold_{hold} {
+            fd_.reset (::socket (AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0));
+            sockaddr_in addr{};
+            addr.sin_family = AF_INET;
+            addr.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+            socklen_t length = sizeof (addr);
+            auto * const sa = reinterpret_cast<sockaddr *> (&addr);
+            if (!fd_.valid () || ::bind (fd_.native_handle (), sa, length) != 0 ||
+                ::listen (fd_.native_handle (), 16) != 0 ||
+                ::getsockname (fd_.native_handle (), sa, &length) != 0) {
+                fd_.reset ();
+                return;
+            }
+            port_ = std::to_string (ntohs (addr.sin_port));
+            thread_ = std::thread{[this] { this->run (); }};
+        }
+        server (server const &) = delete;
+        server & operator= (server const &) = delete;
+        ~server () noexcept {
+            done_ = true;
+            if (thread_.joinable ()) {
+                thread_.join ();
+            }
+        }
+
+        bool valid () const noexcept { return fd_.valid (); }
+        std::string const & port () const noexcept { return port_; }
+
+    private:
+        /// Waits for \p fd to become readable, giving up if the server is being destroyed.
+        bool wait (socket_descriptor const & fd) const {
+            while (!done_) {
+                pollfd pfd{fd.native_handle (), POLLIN, 0};
+                if (::poll (&pfd, 1, 50) > 0) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        void serve (socket_descriptor const & conn) const {
+            std::string head;
+            std::array<char, 1024> buffer;
+            while (head.find ("\r\n\r\n") == std::string::npos) {
+                if (!this->wait (conn)) {
+                    return;
+                }
+                ssize_t const r = ::recv (conn.native_handle (), buffer.data (), buffer.size (), 0);
+                if (r <= 0) {
+                    return;
+                }
+                head.append (buffer.data (), static_cast<std::size_t> (r));
+            }
+            for (std::size_t pos = 0; pos < response_.size (); pos += chunk_) {
+                if (pos > 0U) {
+                    // Give the client time to read each piece on its own.
+                    std::this_thread::sleep_for (2ms);
+                }
+                std::size_t const n = std::min (chunk_, response_.size () - pos);
+                ::send (conn.native_handle (), response_.data () + pos, n, MSG_NOSIGNAL);
+            }
+            if (hold_) {
+                // Keep the connection open until the client closes it.
+                this->wait (conn);
+            }
+        }
+
+        void run () {
+            while (this->wait (fd_)) {
+                socket_descriptor conn{::accept (fd_.native_handle (), nullptr, nullptr)};
+                if (conn.valid ()) {
+                    this->serve (conn);
+                }
+            }
+        }
+
+        std::string const response_;
+        std::size_t const chunk_;
+        bool const hold_;
+        socket_descriptor fd_;
+        std::string port_;
+        std::thread thread_;
+        std::atomic<bool> done_{false};
+    };
+
+    std::string const ok = "HTTP/1.1 200 OK\r\nContent-Length: 5\r\nConnection: close\r\n\r\nhello";
+
+    /// The outcome of one request.
+    struct result {
+        bool done = false;
+        std::error_code erc;
+        http::http_status_code status{};
+        std::string body;
+    };
+
+    std::unique_ptr<http::event_loop> create_loop () {
+        error_or<std::unique_ptr<http::event_loop>> eo = http::event_loop::create ();
+        EXPECT_TRUE (eo) << eo.get_error ().message ();
+        return eo ? std::move (*eo) : nullptr;
+    }
+
+    /// Starts a GET request for "/" from 127.0.0.1:\p port whose outcome is recorded in \p r.
+    std::error_code get (http::event_loop & loop, std::string const & port, result & r,
+                         http::event_loop::request_options const & opts = {}) {
+        return loop.async_get (
+            "127.0.0.1", port, "/", opts,
+            [&r] (std::error_code const erc, http::response_parser const & parser) {
+                r.done = true;
+                r.erc = erc;
+                if (!erc) {
+                    r.status = parser.status_code ();
+                }
+            },
+            [&r] (gsl::span<char const> const data) {
+                r.body.append (data.data (), static_cast<std::size_t> (data.size ()));
+            });
+    }
+
+} // end anonymous namespace
+
+TEST (EventLoop, Get) {
+    std::unique_ptr<http::event_loop> loop = create_loop ();
+    ASSERT_NE (loop, nullptr);
+    server s{ok};
+    ASSERT_TRUE (s.valid ());
+    result r;
+    ASSERT_FALSE (get (*loop, s.port (), r));
+    EXPECT_EQ (loop->in_flight (), 1U);
+    ASSERT_FALSE (loop->run ());
+    EXPECT_EQ (loop->in_flight (), 0U);
+    ASSERT_TRUE (r.done);
+    ASSERT_FALSE (r.erc) << r.erc.message ();
+    EXPECT_EQ (r.status, http::http_status_code::ok);
+    EXPECT_EQ (r.body, "hello");
+}
+
+// Many requests share the loop's thread.
+TEST (EventLoop, ConcurrentRequests) {
+    std::unique_ptr<http::event_loop> loop = create_loop ();
+    ASSERT_NE (loop, nullptr);
+    server s{ok};
+    ASSERT_TRUE (s.valid ());
+    // Fewer than the server's listen backlog, so that no connection attempt is dropped.
+    std::vector<result> results (12);
+    for (result & r : results) {
+        ASSERT_FALSE (get (*loop, s.port (), r));
+    }
+    EXPECT_EQ (loop->in_flight (), results.size ());
+    ASSERT_FALSE (loop->run ());
+    for (result const & r : results) {
+        ASSERT_TRUE (r.done);
+        EXPECT_FALSE (r.erc) << r.erc.message ();
+        EXPECT_EQ (r.body, "hello");
+    }
+}
+
+// A response which arrives a few bytes at a time is parsed as it comes.
+TEST (EventLoop, ShortReads) {
+    std::unique_ptr<http::event_loop> loop = create_loop ();
+    ASSERT_NE (loop, nullptr);
+    std::string const body (1000U, 'b');
+    server s{"HTTP/1.1 200 OK\r\nContent-Length: 1000\r\nConnection: close\r\n\r\n" + body, 7U};
+    ASSERT_TRUE (s.valid ());
+    result r;
+    ASSERT_FALSE (get (*loop, s.port (), r));
+    ASSERT_FALSE (loop->run ());
+    ASSERT_FALSE (r.erc) << r.erc.message ();
+    EXPECT_EQ (r.body, body);
+}
+
+TEST (EventLoop, BodyEndsAtClose) {
+    std::unique_ptr<http::event_loop> loop = create_loop ();
+    ASSERT_NE (loop, nullptr);
+    server s{"HTTP/1.1 200 OK\r\nConnection: close\r\n\r\nuntil close"};
+    ASSERT_TRUE (s.valid ());
+    result r;
+    ASSERT_FALSE (get (*loop, s.port (), r));
+    ASSERT_FALSE (loop->run ());
+    ASSERT_FALSE (r.erc) << r.erc.message ();
+    EXPECT_EQ (r.body, "until close");
+}
+
+TEST (EventLoop, TruncatedBody) {
+    std::unique_ptr<http::event_loop> loop = create_loop ();
+    ASSERT_NE (loop, nullptr);
+    server s{"HTTP/1.1 200 OK\r\nContent-Length: 10\r\nConnection: close\r\n\r\nshort"};
+    ASSERT_TRUE (s.valid ());
+    result r;
+    ASSERT_FALSE (get (*loop, s.port (), r));
+    ASSERT_FALSE (loop->run ());
+    ASSERT_TRUE (r.done);
+    EXPECT_TRUE (r.erc);
+}
+
+TEST (EventLoop, ConnectionRefused) {
+    std::unique_ptr<http::event_loop> loop = create_loop ();
+    ASSERT_NE (loop, nullptr);
+    std::string port;
+    {
+        // Find a port on which nothing is listening.
+        server s{ok};
+        ASSERT_TRUE (s.valid ());
+        port = s.port ();
+    }
+    result r;
+    ASSERT_FALSE (get (*loop, port, r));
+    ASSERT_FALSE (loop->run ());
+    ASSERT_TRUE (r.done);
+    EXPECT_EQ (r.erc, std::make_error_code (std::errc::connection_refused));
+}
+
+// A server which never answers is abandoned once the first_byte deadline has passed.
+TEST (EventLoop, FirstByteDeadline) {
+    std::unique_ptr<http::event_loop> loop = create_loop ();
+    ASSERT_NE (loop, nullptr);
+    // The kernel completes connections in the listener's backlog, but none is accepted.
+    std::string port;
+    socket_descriptor const listener = test_helpers::listen_on_loopback (4, port);
+    ASSERT_TRUE (listener.valid ());
+    http::event_loop::request_options opts;
+    opts.first_byte = 100ms;
+    result r;
+    auto const start = std::chrono::steady_clock::now ();
+    ASSERT_FALSE (get (*loop, port, r, opts));
+    ASSERT_FALSE (loop->run ());
+    auto const elapsed = std::chrono::steady_clock::now () - start;
+    ASSERT_TRUE (r.done);
+    EXPECT_EQ (r.erc, std::make_error_code (std::errc::timed_out));
+    EXPECT_GE (elapsed, 100ms);
+    EXPECT_LT (elapsed, 1000ms);
+}
+
+// Once the response has started, the body deadline replaces the first_byte one.
+TEST (EventLoop, BodyDeadline) {
+    std::unique_ptr<http::event_loop> loop = create_loop ();
+    ASSERT_NE (loop, nullptr);
+    server s{"HTTP/1.1 200 OK\r\nContent-Length: 10\r\n\r\nshort", 0U, true};
+    ASSERT_TRUE (s.valid ());
+    http::event_loop::request_options opts;
+    opts.first_byte = 10s;
+    opts.body = 100ms;
+    result r;
+    auto const start = std::chrono::steady_clock::now ();
+    ASSERT_FALSE (get (*loop, s.port (), r, opts));
+    ASSERT_FALSE (loop->run ());
+    auto const elapsed = std::chrono::steady_clock::now () - start;
+    ASSERT_TRUE (r.done);
+    EXPECT_EQ (r.erc, std::make_error_code (std::errc::timed_out));
+    EXPECT_EQ (r.body, "short");
+    EXPECT_GE (elapsed, 100ms);
+    EXPECT_LT (elapsed, 1000ms);
+}
+
+TEST (EventLoop, TotalDeadline) {
+    std::unique_ptr<http::event_loop> loop = create_loop ();
+    ASSERT_NE (loop, nullptr);
+    server s{"HTTP/1.1 200 OK\r\nContent-Length: 10\r\n\r\nshort", 0U, true};
+    ASSERT_TRUE (s.valid ());
+    http::event_loop::request_options opts;
+    opts.total = 100ms;
+    result r;
+    ASSERT_FALSE (get (*loop, s.port (), r, opts));
+    ASSERT_FALSE (loop->run ());
+    ASSERT_TRUE (r.done);
+    EXPECT_EQ (r.erc, std::make_error_code (std::errc::timed_out));
+    EXPECT_EQ (loop->in_flight (), 0U);
+}
@@ -0,0 +1,125 @@
+#include "client/header_block.hpp"
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+using namespace pstore;
+using http::header_block;
+using http::known_header;
+
+namespace {
+
+    std::vector<std::pair<std::string, std::string>> fields (header_block const & block) {
+        std::vector<std::pair<std::string, std::string>> result;
+        for (http::header_field const f : block) {
+            result.emplace_back (f.name, f.value);
+        }
+        return result;
+    }
+
+} // end anonymous namespace
+
+TEST (HeaderBlock, Empty) {
+    header_block const block;
+    EXPECT_TRUE (block.empty ());
+    EXPECT_EQ (block.size (), 0U);
+    EXPECT_FALSE (block.find (known_header::content_length));
+    EXPECT_FALSE (block.find ("x-anything"));
+    EXPECT_EQ (block.begin (), block.end ());
+}
+
+TEST (HeaderBlock, KnownHeader) {
+    header_block block;
+    block.add ("Content-Length", "42");
+    EXPECT_TRUE (block.contains (known_header::content_length));
+    maybe<std::string_view> const v = block.find (known_header::content_length);
+    ASSERT_TRUE (v);
+    EXPECT_EQ (*v, "42");
+    // Known headers can also be found by name.
+    maybe<std::string_view> const by_name = block.find ("CONTENT-length");
+    ASSERT_TRUE (by_name);
+    EXPECT_EQ (*by_name, "42");
+}
+
+TEST (HeaderBlock, OtherHeaderIsCaseInsensitive) {
+    header_block block;
+    block.add ("X-Custom", "Value");
+    maybe<std::string_view> const v = block.find ("x-CUSTOM");
+    ASSERT_TRUE (v);
+    // Names are lower-cased; values are untouched.
+    EXPECT_EQ (*v, "Value");
+    EXPECT_EQ (fields (block), (std::vector<std::pair<std::string, std::string>>{
+                                   {"x-custom", "Value"}}));
+}
+
+TEST (HeaderBlock, AddCombinesRepeats) {
+    header_block block;
+    block.add ("Cache-Control", "no-cache");
+    block.add ("X-A", "1");
+    block.add ("cache-control", "no-store");
+    block.add ("x-a", "2");
+    EXPECT_EQ (block.size (), 2U);
+    EXPECT_EQ (*block.find (known_header::cache_control), "no-cache, no-store");
+    EXPECT_EQ (*block.find ("x-a"), "1, 2");
+}
+
+TEST (HeaderBlock, SetReplaces) {
+    header_block block;
+    block.add ("ETag", "\"a\"");
+    block.add ("X-B", "1");
+    block.set ("etag", "\"b\"");
+    block.set ("X-b", "2");
+    block.set ("X-C", "3");
+    EXPECT_EQ (block.size (), 3U);
+    EXPECT_EQ (*block.find (known_header::etag), "\"b\"");
+    EXPECT_EQ (*block.find ("x-b"), "2");
+    EXPECT_EQ (*block.find ("x-c"), "3");
+}
+
+TEST (HeaderBlock, IterationOrder) {
+    header_block block;
+    block.add ("B", "2");
+    block.add ("Age", "1");
+    block.add ("A", "3");
+    EXPECT_EQ (fields (block), (std::vector<std::pair<std::string, std::string>>{
+                                   {"b", "2"}, {"age", "1"}, {"a", "3"}}));
+}
+
+TEST (HeaderBlock, ClearForgetsEverything) {
+    header_block block;
+    block.add ("Content-Length", "1");
+    block.add ("X-Y", "z");
+    block.clear ();
+    EXPECT_TRUE (block.empty ());
+    EXPECT_FALSE (block.contains (known_header::content_length));
+    EXPECT_FALSE (block.contains ("x-y"));
+    block.add ("Content-Length", "2");
+    EXPECT_EQ (*block.find (known_header::content_length), "2");
+}
+
+TEST (HeaderBlock, ManyFields) {
+    // Enough fields (and text) to make the arena and field list reallocate.
+    header_block block;
+    for (int ctr = 0; ctr < 200; ++ctr) {
+        block.add ("X-Field-" + std::to_string (ctr), std::string (ctr, 'v'));
+    }
+    block.add ("Upgrade", "websocket");
+    EXPECT_EQ (block.size (), 201U);
+    for (int ctr = 0; ctr < 200; ++ctr) {
+        maybe<std::string_view> const v = block.find ("x-field-" + std::to_string (ctr));
+        ASSERT_TRUE (v) << ctr;
+        EXPECT_EQ (*v, std::string (ctr, 'v'));
+    }
+    EXPECT_EQ (*block.find (known_header::upgrade), "websocket");
+}
+
+TEST (HeaderBlock, LookupKnownHeader) {
+    maybe<known_header> const h = http::lookup_known_header ("Transfer-Encoding");
+    ASSERT_TRUE (h);
+    EXPECT_EQ (*h, known_header::transfer_encoding);
+    EXPECT_EQ (http::known_header_name (*h), "transfer-encoding");
+    EXPECT_FALSE (http::lookup_known_header ("transfer-encodin"));
+}
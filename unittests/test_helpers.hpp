@@ -0,0 +1,153 @@
+#ifndef CLIENT_UNITTESTS_TEST_HELPERS_HPP
+#define CLIENT_UNITTESTS_TEST_HELPERS_HPP
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <thread>
+#include <utility>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+
+#include "pstore/os/descriptor.hpp"
+
+#include "client/resolver.hpp"
+
+namespace test_helpers {
+
+    /// Returns the IPv4 address \p ip with port \p port.
+    inline pstore::http::address ipv4 (char const * const ip, std::uint16_t const port) {
+        pstore::http::address a;
+        std::memset (&a.storage, 0, sizeof (a.storage));
+        auto * const sin = reinterpret_cast<sockaddr_in *> (&a.storage);
+        sin->sin_family = AF_INET;
+        sin->sin_port = htons (port);
+        ::inet_pton (AF_INET, ip, &sin->sin_addr);
+        a.length = sizeof (sockaddr_in);
+        return a;
+    }
+
+    /// Returns the port of the IPv4 address \p a.
+    inline std::uint16_t port_of (pstore::http::address const & a) {
+        return ntohs (reinterpret_cast<sockaddr_in const *> (&a.storage)->sin_port);
+    }
+
+    /// Creates a socket listening on an ephemeral port of \p ip. On return, \p addr holds the
+    /// address to which the socket is bound. The result is invalid if any step fails.
+    inline pstore::socket_descriptor listen_on (char const * const ip, int const backlog,
+                                                pstore::http::address & addr) {
+        pstore::socket_descriptor fd{::socket (AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0)};
+        addr = ipv4 (ip, 0);
+        if (!fd.valid () || ::bind (fd.native_handle (), addr.get (), addr.length) != 0 ||
+            ::listen (fd.native_handle (), backlog) != 0 ||
+            ::getsockname (fd.native_handle (), reinterpret_cast<sockaddr *> (&addr.storage),
+                           &addr.length) != 0) {
+            fd.reset ();
+        }
+        return fd;
+    }
+
+    /// Creates a socket listening on an ephemeral port of 127.0.0.1 and sets \p port to the
+    /// port number as a string.
+    inline pstore::socket_descriptor listen_on_loopback (int const backlog, std::string & port) {
+        pstore::http::address addr;
+        pstore::socket_descriptor fd = listen_on ("127.0.0.1", backlog, addr);
+        port = fd.valid () ? std::to_string (port_of (addr)) : std::string{};
+        return fd;
+    }
+
+    // loopback server
+    // ~~~~~~~~~~~~~~~
+    /// A server listening on an ephemeral port of 127.0.0.1. It accepts one connection at a
+    /// time, reads a request head from it, sends whatever the handler returns and closes the
+    /// connection. The handler runs on the server's thread.
+    class loopback_server {
+    public:
+        /// Called with a request's head (the request line and headers, ending with the blank
+        /// line). Returns the bytes to be sent in reply.
+        using handler = std::function<std::string (std::string const & head)>;
+
+        explicit loopback_server (handler h)
+                : handler_{std::move (h)} {
+            fd_ = listen_on_loopback (16, port_);
+            if (fd_.valid ()) {
+                thread_ = std::thread{[this] { this->run (); }};
+            }
+        }
+        loopback_server (loopback_server const &) = delete;
+        loopback_server & operator= (loopback_server const &) = delete;
+        ~loopback_server () noexcept {
+            done_ = true;
+            if (thread_.joinable ()) {
+                thread_.join ();
+            }
+        }
+
+        std::string const & port () const noexcept { return port_; }
+
+        /// Returns the value of the header \p name in the request head \p head or an empty
+        /// string if there isn't one. Names are matched exactly.
+        static std::string find_header (std::string const & head, std::string const & name) {
+            std::string const field = "\r\n" + name + ": ";
+            auto const start = head.find (field);
+            if (start == std::string::npos) {
+                return {};
+            }
+            auto const first = start + field.length ();
+            return head.substr (first, head.find ("\r\n", first) - first);
+        }
+
+    private:
+        /// Waits for \p fd to become readable, giving up if the server is being destroyed.
+        bool wait (pstore::socket_descriptor const & fd) const {
+            while (!done_) {
+                pollfd pfd{fd.native_handle (), POLLIN, 0};
+                if (::poll (&pfd, 1, 50) > 0) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        void serve (pstore::socket_descriptor const & conn) {
+            std::string head;
+            std::array<char, 1024> buffer;
+            while (head.find ("\r\n\r\n") == std::string::npos) {
+                if (!this->wait (conn)) {
+                    return;
+                }
+                ssize_t const r = ::recv (conn.native_handle (), buffer.data (), buffer.size (), 0);
+                if (r <= 0) {
+                    return;
+                }
+                head.append (buffer.data (), static_cast<std::size_t> (r));
+            }
+            std::string const response = handler_ (head);
+            ::send (conn.native_handle (), response.data (), response.size (), MSG_NOSIGNAL);
+        }
+
+        void run () {
+            while (this->wait (fd_)) {
+                pstore::socket_descriptor conn{::accept (fd_.native_handle (), nullptr, nullptr)};
+                if (conn.valid ()) {
+                    this->serve (conn);
+                }
+            }
+        }
+
+        handler const handler_;
+        pstore::socket_descriptor fd_;
+        std::string port_;
+        std::thread thread_;
+        std::atomic<bool> done_{false};
+    };
+
+} // end namespace test_helpers
+
+#endif // CLIENT_UNITTESTS_TEST_HELPERS_HPP
@@ -0,0 +1,267 @@
+#include "client/pipeline.hpp"
+
+#include <array>
+#include <atomic>
+#include <limits>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+
+#include <gtest/gtest.h>
+
+using namespace pstore;
+
+namespace {
+
+    // server
+    // ~~~~~~
+    /// A pipelining server which answers each request with its path as the body. The
+    /// connections it accepts follow a script: each entry gives the number of requests that the
+    /// connection answers before the server closes it. Connections beyond the end of the script
+    /// answer everything.
+    class server {
+    public:
+        /// A script entry for a connection which answers its first request with garbage.
+        static constexpr std::size_t garbage = std::numeric_limits<std::size_t>::max ();
+        static constexpr std::size_t unlimited = garbage - 1U;
+
+        /// A script entry for a connection which waits for \p n requests, writes all of their
+        /// responses at once without asking to close the connection and then resets it.
+        static constexpr std::size_t reset_after (std::size_t const n) noexcept {
+            return reset_bit | n;
+        }
+
+        explicit server (std::vector<std::size_t> script)
+                : script_{std::move (script)} {
+            fd_.reset (::socket (AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0));
+            sockaddr_in addr{};
+            addr.sin_family = AF_INET;
+            addr.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+            socklen_t length = sizeof (addr);
+            auto * const sa = reinterpret_cast<sockaddr *> (&addr);
+            if (::bind (fd_.native_handle (), sa, length) == 0 &&
+                ::listen (fd_.native_handle (), 16) == 0 &&
+                ::getsockname (fd_.native_handle (), sa, &length) == 0) {
+                port_ = std::to_string (ntohs (addr.sin_port));
+                thread_ = std::thread{[this] { this->run (); }};
+            }
+        }
+        server (server const &) = delete;
+        server & operator= (server const &) = delete;
+        ~server () noexcept {
+            done_ = true;
+            if (thread_.joinable ()) {
+                thread_.join ();
+            }
+        }
+
+        std::string const & port () const noexcept { return port_; }
+        /// The number of connections that have been accepted.
+        unsigned accepted () const noexcept { return accepted_; }
+        /// The number of responses that have been sent.
+        unsigned answered () const noexcept { return answered_; }
+
+    private:
+        static constexpr std::size_t reset_bit = std::size_t{1}
+                                                 << (std::numeric_limits<std::size_t>::digits - 2);
+
+        static std::string response (std::string const & path, bool const last) {
+            return "HTTP/1.1 200 OK\r\nContent-Length: " + std::to_string (path.length ()) +
+                   "\r\n" + (last ? "Connection: close\r\n" : "") + "\r\n" + path;
+        }
+
+        /// Waits for \p fd to become readable, giving up if the server is being destroyed.
+        bool wait (socket_descriptor const & fd) const {
+            while (!done_) {
+                pollfd pfd{fd.native_handle (), POLLIN, 0};
+                if (::poll (&pfd, 1, 50) > 0) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        /// Returns the path of the next request on \p conn or an empty string if the client
+        /// closed the connection.
+        std::string next_request (socket_descriptor const & conn, std::string & pending) {
+            std::array<char, 1024> buffer;
+            std::string::size_type end;
+            while ((end = pending.find ("\r\n\r\n")) == std::string::npos) {
+                if (!this->wait (conn)) {
+                    return {};
+                }
+                ssize_t const r =
+                    ::recv (conn.native_handle (), buffer.data (), buffer.size (), 0);
+                if (r <= 0) {
+                    return {};
+                }
+                pending.append (buffer.data (), static_cast<std::size_t> (r));
+            }
+            auto const first = pending.find (' ') + 1U;
+            std::string path = pending.substr (first, pending.find (' ', first) - first);
+            pending.erase (0, end + 4U);
+            return path;
+        }
+
+        static void send (socket_descriptor const & conn, std::string const & s) {
+            ::send (conn.native_handle (), s.data (), s.size (), MSG_NOSIGNAL);
+        }
+
+        /// Closes the sending side of \p conn and waits for the client to close its end, so
+        /// that unread requests don't cause a reset which might discard the responses.
+        void close (socket_descriptor const & conn) const {
+            ::shutdown (conn.native_handle (), SHUT_WR);
+            std::array<char, 1024> buffer;
+            while (this->wait (conn) &&
+                   ::recv (conn.native_handle (), buffer.data (), buffer.size (), 0) > 0) {
+            }
+        }
+
+        /// Answers \p n requests in a single write and then resets \p conn.
+        void serve_and_reset (socket_descriptor & conn, std::size_t const n) {
+            std::string pending;
+            std::string responses;
+            for (std::size_t ctr = 0U; ctr < n; ++ctr) {
+                std::string const path = this->next_request (conn, pending);
+                if (path.empty ()) {
+                    return;
+                }
+                responses += response (path, false);
+            }
+            // Counted first: the client may finish as soon as it has the responses.
+            answered_ += static_cast<unsigned> (n);
+            send (conn, responses);
+            // Closing with a zero linger time sends RST rather than FIN.
+            linger const l{1, 0};
+            ::setsockopt (conn.native_handle (), SOL_SOCKET, SO_LINGER, &l, sizeof (l));
+            conn.reset ();
+        }
+
+        void serve (socket_descriptor const & conn, std::size_t const limit) {
+            std::string pending;
+            for (std::size_t answered = 0U;; ++answered) {
+                std::string const path = this->next_request (conn, pending);
+                if (path.empty ()) {
+                    return;
+                }
+                if (limit == garbage) {
+                    send (conn, "this is not a status line\r\n\r\n");
+                    break;
+                }
+                if (answered == limit) {
+                    break;
+                }
+                bool const last = answered + 1U == limit;
+                ++answered_;
+                send (conn, response (path, last));
+                if (last) {
+                    break;
+                }
+            }
+            this->close (conn);
+        }
+
+        void run () {
+            while (this->wait (fd_)) {
+                socket_descriptor conn{::accept (fd_.native_handle (), nullptr, nullptr)};
+                if (!conn.valid ()) {
+                    continue;
+                }
+                unsigned const index = accepted_++;
+                std::size_t const entry = index < script_.size () ? script_[index] : unlimited;
+                if (entry < unlimited && (entry & reset_bit) != 0U) {
+                    this->serve_and_reset (conn, entry & ~reset_bit);
+                } else {
+                    this->serve (conn, entry);
+                }
+            }
+        }
+
+        std::vector<std::size_t> const script_;
+        socket_descriptor fd_;
+        std::string port_;
+        std::thread thread_;
+        std::atomic<bool> done_{false};
+        std::atomic<unsigned> accepted_{0};
+        std::atomic<unsigned> answered_{0};
+    };
+
+    std::vector<std::string> const paths{"/0", "/1", "/2", "/3", "/4"};
+
+    /// Fetches paths from \p s, checking that the responses arrive in order.
+    std::error_code fetch (server const & s, std::size_t & received,
+                           http::pipeline_options const & options = {}) {
+        received = 0U;
+        return http::http_get_pipelined (
+            "127.0.0.1", s.port (), paths, options,
+            [&received] (std::size_t const index, http::status_line const &,
+                         http::header_block const &, std::string const & body) {
+                EXPECT_EQ (index, received);
+                EXPECT_EQ (body, paths[index]);
+                ++received;
+            });
+    }
+
+} // end anonymous namespace
+
+TEST (Pipeline, OneConnection) {
+    server s{{}};
+    std::size_t received;
+    EXPECT_FALSE (fetch (s, received));
+    EXPECT_EQ (received, paths.size ());
+    EXPECT_EQ (s.accepted (), 1U);
+}
+
+// Requests left unanswered when the server closes the connection are sent again.
+TEST (Pipeline, ReplaysAfterClose) {
+    server s{{2U}};
+    std::size_t received;
+    EXPECT_FALSE (fetch (s, received));
+    EXPECT_EQ (received, paths.size ());
+    EXPECT_EQ (s.accepted (), 2U);
+}
+
+TEST (Pipeline, ReplaysAfterDrop) {
+    server s{{0U, 0U}};
+    std::size_t received;
+    EXPECT_FALSE (fetch (s, received));
+    EXPECT_EQ (received, paths.size ());
+    EXPECT_EQ (s.accepted (), 3U);
+}
+
+TEST (Pipeline, GivesUpAfterRepeatedDrops) {
+    server s{{0U, 0U, 0U, 0U, 0U}};
+    http::pipeline_options options;
+    options.max_replays = 2U;
+    std::size_t received;
+    EXPECT_EQ (fetch (s, received, options), std::make_error_code (std::errc::connection_aborted));
+    EXPECT_EQ (received, 0U);
+    EXPECT_EQ (s.accepted (), 3U);
+}
+
+// A response that can't be understood is an error: sending the requests again won't help.
+TEST (Pipeline, ProtocolErrorIsNotReplayed) {
+    server s{{server::garbage}};
+    std::size_t received;
+    EXPECT_EQ (fetch (s, received), std::make_error_code (std::errc::bad_message));
+    EXPECT_EQ (received, 0U);
+    EXPECT_EQ (s.accepted (), 1U);
+}
+
+// Responses which arrived before a request couldn't be sent are read rather than asked for
+// again.
+TEST (Pipeline, ReadsResponsesAfterSendFails) {
+    server s{{server::reset_after (2U)}};
+    http::pipeline_options options;
+    options.depth = 2U;
+    std::size_t received;
+    EXPECT_FALSE (fetch (s, received, options));
+    EXPECT_EQ (received, paths.size ());
+    EXPECT_EQ (s.accepted (), 2U);
+    EXPECT_EQ (s.answered (), paths.size ());
+}
@@ -0,0 +1,110 @@
+#include "client/request_builder.hpp"
+
+#include <array>
+#include <string>
+#include <thread>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+using namespace pstore;
+
+namespace {
+
+    std::string serialize (http::request_builder const & b) {
+        std::string result;
+        b.copy_to (result);
+        return result;
+    }
+
+    /// Reads from \p fd until the peer closes its end.
+    std::string receive_all (socket_descriptor const & fd) {
+        std::string result;
+        std::array<char, 4096> buffer;
+        ssize_t r;
+        while ((r = ::recv (fd.native_handle (), buffer.data (), buffer.size (), 0)) > 0) {
+            result.append (buffer.data (), static_cast<std::size_t> (r));
+        }
+        return result;
+    }
+
+} // end anonymous namespace
+
+TEST (RequestBuilder, Serializes) {
+    http::request_builder b;
+    b.start ("GET", "/index.html")
+        .host ("example.com", "80")
+        .header ("Accept", "*/*")
+        .header_ref ("Accept-Encoding", "gzip")
+        .finish ();
+    std::string const expected = "GET /index.html HTTP/1.1\r\n"
+                                 "Host: example.com:80\r\n"
+                                 "Accept: */*\r\n"
+                                 "Accept-Encoding: gzip\r\n"
+                                 "\r\n";
+    EXPECT_EQ (serialize (b), expected);
+    EXPECT_EQ (b.size (), expected.size ());
+}
+
+TEST (RequestBuilder, HeaderRefIsNotCopied) {
+    std::string value = "one";
+    http::request_builder b;
+    b.start ("GET", "/").header_ref ("X", value).finish ();
+    value[0] = 'O';
+    EXPECT_EQ (serialize (b), "GET / HTTP/1.1\r\nX: One\r\n\r\n");
+}
+
+TEST (RequestBuilder, StartDiscardsPreviousRequest) {
+    http::request_builder b{0U};
+    b.start ("GET", "/first").header ("A", "1").finish ();
+    b.start ("HEAD", "/second").finish ();
+    EXPECT_EQ (serialize (b), "HEAD /second HTTP/1.1\r\n\r\n");
+}
+
+TEST (RequestBuilder, Send) {
+    std::array<int, 2> fds;
+    ASSERT_EQ (::socketpair (AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds.data ()), 0);
+    socket_descriptor fd{fds[0]};
+    socket_descriptor peer{fds[1]};
+
+    // A value larger than the socket buffer forces partial writes.
+    std::string const big (1024U * 1024U, 'v');
+    http::request_builder b;
+    b.start ("GET", "/").header ("A", "1").header_ref ("Big", big).header ("B", "2").finish ();
+    std::string expected;
+    b.copy_to (expected);
+
+    std::string received;
+    std::thread reader{[&] { received = receive_all (peer); }};
+    http::tracer t{nullptr};
+    std::error_code const erc = b.send (fd, t);
+    fd.reset ();
+    reader.join ();
+
+    ASSERT_FALSE (erc) << erc.message ();
+    EXPECT_EQ (received, expected);
+    EXPECT_EQ (t.current ().bytes_sent, expected.size ());
+    EXPECT_GE (t.current ().sends, 1U);
+}
+
+TEST (RequestBuilder, SendToClosedPeer) {
+    std::array<int, 2> fds;
+    ASSERT_EQ (::socketpair (AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds.data ()), 0);
+    socket_descriptor fd{fds[0]};
+    ::close (fds[1]);
+    http::request_builder b;
+    b.start ("GET", "/").finish ();
+    // MSG_NOSIGNAL turns SIGPIPE into an error.
+    EXPECT_EQ (b.send (fd), std::make_error_code (std::errc::broken_pipe));
+}
+
+TEST (IsIdempotent, Methods) {
+    for (char const * const m : {"GET", "HEAD", "PUT", "DELETE", "OPTIONS", "TRACE"}) {
+        EXPECT_TRUE (http::is_idempotent (m)) << m;
+    }
+    for (char const * const m : {"POST", "PATCH", "CONNECT", "get", ""}) {
+        EXPECT_FALSE (http::is_idempotent (m)) << m;
+    }
+}
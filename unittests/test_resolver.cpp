@@ -0,0 +1,143 @@
+#include "client/resolver.hpp"
+
+#include <chrono>
+#include <future>
+#include <thread>
+
+#include <gtest/gtest.h>
+
+#include "client/client.hpp"
+
+#include "test_helpers.hpp"
+
+using namespace pstore;
+using namespace std::chrono_literals;
+
+using test_helpers::ipv4;
+using test_helpers::port_of;
+
+TEST (Resolver, PositiveTtl) {
+    http::resolver::options opts;
+    opts.positive_ttl = 100ms;
+    http::resolver r{opts};
+    EXPECT_FALSE (r.cached ("localhost", "80"));
+    http::resolver::result_type const first = r.resolve ("localhost", "80");
+    ASSERT_TRUE (first) << first.get_error ().message ();
+    EXPECT_FALSE ((*first)->empty ());
+
+    maybe<http::resolver::result_type> const hit = r.cached ("localhost", "80");
+    ASSERT_TRUE (hit);
+    ASSERT_TRUE (*hit);
+    // A hit returns the very same list rather than looking the name up again.
+    EXPECT_EQ (**hit, *first);
+
+    std::this_thread::sleep_for (200ms);
+    EXPECT_FALSE (r.cached ("localhost", "80"));
+    http::resolver::result_type const second = r.resolve ("localhost", "80");
+    ASSERT_TRUE (second);
+    EXPECT_NE (*second, *first);
+}
+
+TEST (Resolver, KeyIncludesPort) {
+    http::resolver r;
+    ASSERT_TRUE (r.resolve ("localhost", "80"));
+    EXPECT_TRUE (r.cached ("localhost", "80"));
+    EXPECT_FALSE (r.cached ("localhost", "81"));
+}
+
+// A name which doesn't exist is remembered for negative_ttl. In an environment with no
+// working DNS, the lookup fails with a transient error instead, which must not be cached.
+TEST (Resolver, NegativeTtl) {
+    http::resolver::options opts;
+    opts.negative_ttl = 100ms;
+    http::resolver r{opts};
+    http::resolver::result_type const result = r.resolve ("no-such-host.invalid", "80");
+    ASSERT_FALSE (result);
+    maybe<http::resolver::result_type> const hit = r.cached ("no-such-host.invalid", "80");
+    if (result.get_error () == http::make_gai_error_code (EAI_NONAME)) {
+        ASSERT_TRUE (hit);
+        ASSERT_FALSE (*hit);
+        EXPECT_EQ (hit->get_error (), result.get_error ());
+        std::this_thread::sleep_for (200ms);
+        EXPECT_FALSE (r.cached ("no-such-host.invalid", "80"));
+    } else {
+        EXPECT_FALSE (hit) << result.get_error ().message ();
+    }
+}
+
+TEST (Resolver, Pin) {
+    http::resolver r;
+    r.pin ("pinned.test", "80", http::address_list{ipv4 ("127.0.0.2", 8080)});
+    http::resolver::result_type const result = r.resolve ("pinned.test", "80");
+    ASSERT_TRUE (result);
+    ASSERT_EQ ((*result)->size (), 1U);
+    EXPECT_EQ (port_of ((*result)->front ()), 8080U);
+
+    // A cached result is delivered before resolve_async() returns.
+    bool called = false;
+    r.resolve_async ("pinned.test", "80", [&] (http::resolver::result_type const & res) {
+        called = true;
+        EXPECT_EQ (*res, *result);
+    });
+    EXPECT_TRUE (called);
+
+    r.clear ();
+    EXPECT_FALSE (r.cached ("pinned.test", "80"));
+}
+
+// A lookup which is in progress when a name is pinned doesn't replace the pinned addresses.
+TEST (Resolver, PinDuringLookup) {
+    http::resolver::options opts;
+    opts.worker_threads = 1U;
+    http::resolver r{opts};
+
+    // Hold the only worker in a callback so that the next lookup stays pending.
+    std::promise<void> gate;
+    std::shared_future<void> const open = gate.get_future ().share ();
+    r.resolve_async ("localhost", "80",
+                     [open] (http::resolver::result_type const &) { open.wait (); });
+
+    std::promise<http::resolver::result_type> pinned;
+    r.resolve_async ("localhost", "81", [&pinned] (http::resolver::result_type const & res) {
+        pinned.set_value (res);
+    });
+    r.pin ("localhost", "81", http::address_list{ipv4 ("127.0.0.2", 8080)});
+    std::future<http::resolver::result_type> f = pinned.get_future ();
+    ASSERT_EQ (f.wait_for (0s), std::future_status::ready);
+    http::resolver::result_type const result = f.get ();
+    ASSERT_TRUE (result);
+    EXPECT_EQ (port_of ((*result)->front ()), 8080U);
+
+    // The worker handles its queue in order: when this lookup completes, so has the one for
+    // the pinned name.
+    std::promise<void> done;
+    r.resolve_async ("localhost", "82",
+                     [&done] (http::resolver::result_type const &) { done.set_value (); });
+    gate.set_value ();
+    ASSERT_EQ (done.get_future ().wait_for (10s), std::future_status::ready);
+
+    maybe<http::resolver::result_type> const cached = r.cached ("localhost", "81");
+    ASSERT_TRUE (cached);
+    ASSERT_TRUE (*cached);
+    ASSERT_EQ ((**cached)->size (), 1U);
+    EXPECT_EQ (port_of ((**cached)->front ()), 8080U);
+}
+
+TEST (Resolver, AsyncRequestsShareALookup) {
+    http::resolver r;
+    std::promise<http::resolver::result_type> p1;
+    std::promise<http::resolver::result_type> p2;
+    r.resolve_async ("localhost", "80",
+                     [&p1] (http::resolver::result_type const & res) { p1.set_value (res); });
+    r.resolve_async ("localhost", "80",
+                     [&p2] (http::resolver::result_type const & res) { p2.set_value (res); });
+    std::future<http::resolver::result_type> f1 = p1.get_future ();
+    std::future<http::resolver::result_type> f2 = p2.get_future ();
+    ASSERT_EQ (f1.wait_for (10s), std::future_status::ready);
+    ASSERT_EQ (f2.wait_for (10s), std::future_status::ready);
+    http::resolver::result_type const r1 = f1.get ();
+    http::resolver::result_type const r2 = f2.get ();
+    ASSERT_TRUE (r1);
+    ASSERT_TRUE (r2);
+    EXPECT_EQ (*r1, *r2);
+}
@@ -0,0 +1,235 @@
+#include "client/response_cache.hpp"
+
+#include <atomic>
+#include <cstdlib>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#include "test_helpers.hpp"
+
+using namespace pstore;
+
+namespace {
+
+    http::cache_policy policy (char const * const cache_control, char const * const age = nullptr) {
+        http::header_block headers;
+        headers.add ("cache-control", cache_control);
+        if (age != nullptr) {
+            headers.add ("age", age);
+        }
+        return http::parse_cache_policy (headers);
+    }
+
+} // end anonymous namespace
+
+TEST (CachePolicy, MaxAgeLessAge) {
+    http::cache_policy const p = policy ("max-age=100", "30");
+    EXPECT_TRUE (p.storable);
+    EXPECT_EQ (p.lifetime, std::chrono::seconds{70});
+    // A response that is already older than max-age is stale.
+    EXPECT_EQ (policy ("max-age=100", "130").lifetime, std::chrono::seconds{0});
+}
+
+TEST (CachePolicy, NoMaxAge) {
+    http::header_block headers;
+    http::cache_policy const p = http::parse_cache_policy (headers);
+    EXPECT_TRUE (p.storable);
+    EXPECT_EQ (p.lifetime, std::chrono::seconds{0});
+}
+
+TEST (CachePolicy, NoStore) {
+    http::cache_policy const p = policy ("max-age=60, No-Store");
+    EXPECT_FALSE (p.storable);
+}
+
+TEST (CachePolicy, NoCache) {
+    http::cache_policy const p = policy ("no-cache, max-age=60");
+    EXPECT_TRUE (p.storable);
+    EXPECT_EQ (p.lifetime, std::chrono::seconds{0});
+}
+
+// This is a private cache: private doesn't prevent storage.
+TEST (CachePolicy, Private) {
+    http::cache_policy const p = policy ("private, max-age=\"60\"");
+    EXPECT_TRUE (p.storable);
+    EXPECT_EQ (p.lifetime, std::chrono::seconds{60});
+}
+
+// Entries are keyed by URL alone, so a response which varies by request header is not stored.
+TEST (CachePolicy, Vary) {
+    http::header_block headers;
+    headers.add ("cache-control", "max-age=60");
+    headers.add ("vary", "Accept-Encoding");
+    EXPECT_FALSE (http::parse_cache_policy (headers).storable);
+}
+
+namespace {
+
+    // server
+    // ~~~~~~
+    /// Serves "hello" with the given Cache-Control and an ETag, answering a request with a
+    /// matching If-None-Match with 304.
+    class server {
+    public:
+        explicit server (std::string cache_control)
+                : cache_control_{std::move (cache_control)}
+                , http_{[this] (std::string const & head) { return this->respond (head); }} {}
+
+        std::string const & port () const noexcept { return http_.port (); }
+        /// The number of requests received.
+        unsigned requests () const noexcept { return requests_; }
+        /// The number of requests answered with 304.
+        unsigned not_modified () const noexcept { return not_modified_; }
+
+        static constexpr char const * etag = "\"v1\"";
+        static constexpr char const * body = "hello";
+
+    private:
+        std::string respond (std::string const & head) {
+            ++requests_;
+            std::string const validators =
+                "Cache-Control: " + cache_control_ + "\r\nETag: " + etag + "\r\n";
+            if (test_helpers::loopback_server::find_header (head, "If-None-Match") == etag) {
+                ++not_modified_;
+                return "HTTP/1.1 304 Not Modified\r\n" + validators + "Connection: close\r\n\r\n";
+            }
+            return "HTTP/1.1 200 OK\r\nContent-Length: 5\r\n" + validators +
+                   "Connection: close\r\n\r\n" + body;
+        }
+
+        std::string const cache_control_;
+        std::atomic<unsigned> requests_{0};
+        std::atomic<unsigned> not_modified_{0};
+        // Last, so that the server's thread stops before the members that it uses are
+        // destroyed.
+        test_helpers::loopback_server http_;
+    };
+
+    /// Provides the path of a cache database in a temporary directory.
+    class ResponseCache : public testing::Test {
+    protected:
+        void SetUp () override {
+            std::string dir = "/tmp/response_cache_XXXXXX";
+            ASSERT_NE (::mkdtemp (&dir[0]), nullptr);
+            dir_ = dir;
+            path_ = dir_ + "/cache.db";
+        }
+        void TearDown () override {
+            ::unlink (path_.c_str ());
+            ::rmdir (dir_.c_str ());
+        }
+
+        std::unique_ptr<http::response_cache> open (http::cache_limits const & limits = {}) {
+            error_or<std::unique_ptr<http::response_cache>> eo_cache =
+                http::response_cache::open (path_, limits);
+            EXPECT_TRUE (eo_cache) << eo_cache.get_error ().message ();
+            return eo_cache ? std::move (*eo_cache) : nullptr;
+        }
+
+        struct result {
+            http::cache_outcome outcome;
+            std::string body;
+            http::header_block headers;
+        };
+        static result get (http::response_cache & cache, server const & s,
+                           char const * const path = "/r") {
+            result r;
+            error_or<http::response_cache::response> const eo = cache.get (
+                "127.0.0.1", s.port (), path, r.headers, [&r] (gsl::span<char const> data) {
+                    r.body.append (data.data (), static_cast<std::size_t> (data.size ()));
+                });
+            EXPECT_TRUE (eo) << eo.get_error ().message ();
+            if (eo) {
+                EXPECT_EQ (eo->status, http::http_status_code::ok);
+                r.outcome = eo->outcome;
+            }
+            return r;
+        }
+
+        std::string dir_;
+        std::string path_;
+    };
+
+} // end anonymous namespace
+
+TEST_F (ResponseCache, MissThenHit) {
+    server s{"max-age=60"};
+    {
+        std::unique_ptr<http::response_cache> cache = this->open ();
+        ASSERT_NE (cache, nullptr);
+        result const first = get (*cache, s);
+        EXPECT_EQ (first.outcome, http::cache_outcome::miss);
+        EXPECT_EQ (first.body, server::body);
+        // The caller sees the headers as they were received.
+        EXPECT_TRUE (first.headers.contains (http::known_header::connection));
+        EXPECT_EQ (cache->snapshot ().stores, 1U);
+
+        result const second = get (*cache, s);
+        EXPECT_EQ (second.outcome, http::cache_outcome::hit);
+        EXPECT_EQ (second.body, server::body);
+        // The stored headers describe the resource rather than the message.
+        EXPECT_FALSE (second.headers.contains (http::known_header::connection));
+        EXPECT_EQ (second.headers.find (http::known_header::etag).value_or (""),
+                   std::string_view{server::etag});
+        EXPECT_EQ (cache->snapshot ().hits, 1U);
+    }
+    // The entry survives in the file.
+    std::unique_ptr<http::response_cache> reopened = this->open ();
+    ASSERT_NE (reopened, nullptr);
+    EXPECT_EQ (get (*reopened, s).outcome, http::cache_outcome::hit);
+    EXPECT_EQ (s.requests (), 1U);
+}
+
+TEST_F (ResponseCache, StaleEntryRevalidated) {
+    server s{"no-cache"};
+    std::unique_ptr<http::response_cache> cache = this->open ();
+    ASSERT_NE (cache, nullptr);
+    EXPECT_EQ (get (*cache, s).outcome, http::cache_outcome::miss);
+
+    result const second = get (*cache, s);
+    EXPECT_EQ (second.outcome, http::cache_outcome::revalidated);
+    EXPECT_EQ (second.body, server::body);
+    EXPECT_EQ (s.requests (), 2U);
+    EXPECT_EQ (s.not_modified (), 1U);
+    EXPECT_EQ (cache->snapshot ().revalidations, 1U);
+}
+
+TEST_F (ResponseCache, BodyLargerThanLimitIsNotStored) {
+    server s{"max-age=60"};
+    http::cache_limits limits;
+    limits.max_body_size = 4U;
+    std::unique_ptr<http::response_cache> cache = this->open (limits);
+    ASSERT_NE (cache, nullptr);
+    for (auto ctr = 0; ctr < 2; ++ctr) {
+        result const r = get (*cache, s);
+        EXPECT_EQ (r.outcome, http::cache_outcome::miss);
+        EXPECT_EQ (r.body, server::body);
+    }
+    EXPECT_EQ (cache->snapshot ().stores, 0U);
+    EXPECT_EQ (s.requests (), 2U);
+}
+
+TEST_F (ResponseCache, FullFileStoresNothing) {
+    server s{"max-age=60"};
+    {
+        std::unique_ptr<http::response_cache> cache = this->open ();
+        ASSERT_NE (cache, nullptr);
+        EXPECT_EQ (get (*cache, s, "/a").outcome, http::cache_outcome::miss);
+        EXPECT_EQ (cache->snapshot ().stores, 1U);
+    }
+    // The file now holds an entry and is larger than the limit.
+    http::cache_limits limits;
+    limits.max_file_size = 1U;
+    std::unique_ptr<http::response_cache> cache = this->open (limits);
+    ASSERT_NE (cache, nullptr);
+    EXPECT_EQ (get (*cache, s, "/b").outcome, http::cache_outcome::miss);
+    EXPECT_EQ (get (*cache, s, "/b").outcome, http::cache_outcome::miss);
+    EXPECT_EQ (cache->snapshot ().stores, 0U);
+    // What the cache already holds is still served.
+    EXPECT_EQ (get (*cache, s, "/a").outcome, http::cache_outcome::hit);
+}
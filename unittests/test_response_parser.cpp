@@ -0,0 +1,187 @@
+#include "client/response_parser.hpp"
+
+#include <algorithm>
+#include <string>
+
+#include <gtest/gtest.h>
+
+using namespace pstore;
+
+namespace {
+
+    // Collects the body delivered by a response_parser.
+    class ResponseParser : public testing::TestWithParam<std::size_t> {
+    protected:
+        ResponseParser ()
+                : parser_{[this] (gsl::span<char const> const data) {
+                    body_.append (data.data (), static_cast<std::size_t> (data.size ()));
+                }} {}
+
+        /// Passes \p text to the parser in pieces of at most GetParam() bytes (or all at once
+        /// if it's 0), as a series of short reads would.
+        /// \returns The number of bytes that the parser consumed.
+        error_or<std::size_t> feed (std::string const & text) {
+            std::size_t const step = GetParam () == 0U ? text.size () : GetParam ();
+            std::size_t consumed = 0;
+            for (std::size_t pos = 0; pos < text.size () && !parser_.complete ();) {
+                std::size_t const n = std::min (step, text.size () - pos);
+                error_or<std::size_t> const r =
+                    parser_.parse (text.data () + pos, text.data () + pos + n);
+                if (!r) {
+                    return r;
+                }
+                consumed += *r;
+                pos += n;
+            }
+            return error_or<std::size_t>{consumed};
+        }
+
+        std::string body_;
+        http::response_parser parser_;
+    };
+
+} // end anonymous namespace
+
+TEST_P (ResponseParser, ContentLength) {
+    std::string const response = "HTTP/1.1 200 OK\r\n"
+                                 "Content-Length: 5\r\n"
+                                 "X-Extra: a\r\n"
+                                 "\r\n"
+                                 "hello";
+    error_or<std::size_t> const r = this->feed (response);
+    ASSERT_TRUE (r) << r.get_error ().message ();
+    EXPECT_EQ (*r, response.size ());
+    EXPECT_TRUE (parser_.complete ());
+    EXPECT_EQ (parser_.http_version (), "HTTP/1.1");
+    EXPECT_EQ (parser_.status_code (), http::http_status_code::ok);
+    EXPECT_EQ (parser_.reason_phrase (), "OK");
+    maybe<std::string_view> const extra = parser_.headers ().find ("x-extra");
+    ASSERT_TRUE (extra);
+    EXPECT_EQ (*extra, "a");
+    EXPECT_EQ (body_, "hello");
+}
+
+TEST_P (ResponseParser, LeavesTheNextResponse) {
+    std::string const first = "HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nab";
+    std::string const second = "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n";
+    error_or<std::size_t> const r = parser_.parse (first.data (), first.data () + first.size ());
+    ASSERT_TRUE (r);
+    EXPECT_EQ (*r, first.size ());
+    std::string const both = first + second;
+    parser_.reset ();
+    body_.clear ();
+    error_or<std::size_t> const r2 = parser_.parse (both.data (), both.data () + both.size ());
+    ASSERT_TRUE (r2);
+    EXPECT_EQ (*r2, first.size ());
+    parser_.reset ();
+    error_or<std::size_t> const r3 = this->feed (second);
+    ASSERT_TRUE (r3);
+    EXPECT_TRUE (parser_.complete ());
+    EXPECT_EQ (parser_.status_code (), http::http_status_code::not_found);
+}
+
+TEST_P (ResponseParser, Chunked) {
+    std::string const response = "HTTP/1.1 200 OK\r\n"
+                                 "Transfer-Encoding: chunked\r\n"
+                                 "Content-Length: 1000\r\n"
+                                 "\r\n"
+                                 "5;ext=1\r\nhello\r\n"
+                                 "7\r\n, world\r\n"
+                                 "0\r\n"
+                                 "Checksum: xyz\r\n"
+                                 "\r\n";
+    error_or<std::size_t> const r = this->feed (response);
+    ASSERT_TRUE (r) << r.get_error ().message ();
+    EXPECT_EQ (*r, response.size ());
+    EXPECT_TRUE (parser_.complete ());
+    EXPECT_EQ (body_, "hello, world");
+    maybe<std::string_view> const checksum = parser_.trailers ().find ("checksum");
+    ASSERT_TRUE (checksum);
+    EXPECT_EQ (*checksum, "xyz");
+}
+
+TEST_P (ResponseParser, BadChunkSize) {
+    std::string const response = "HTTP/1.1 200 OK\r\n"
+                                 "Transfer-Encoding: chunked\r\n"
+                                 "\r\n"
+                                 "zz\r\n";
+    error_or<std::size_t> const r = this->feed (response);
+    ASSERT_FALSE (r);
+    EXPECT_EQ (r.get_error (), std::make_error_code (std::errc::bad_message));
+}
+
+TEST_P (ResponseParser, MissingChunkTerminator) {
+    std::string const response = "HTTP/1.1 200 OK\r\n"
+                                 "Transfer-Encoding: chunked\r\n"
+                                 "\r\n"
+                                 "2\r\nabX\r\n";
+    EXPECT_FALSE (this->feed (response));
+}
+
+TEST_P (ResponseParser, UnsupportedTransferCoding) {
+    std::string const response = "HTTP/1.1 200 OK\r\n"
+                                 "Transfer-Encoding: gzip, chunked\r\n"
+                                 "\r\n";
+    error_or<std::size_t> const r = this->feed (response);
+    ASSERT_FALSE (r);
+    EXPECT_EQ (r.get_error (), std::make_error_code (std::errc::not_supported));
+}
+
+TEST_P (ResponseParser, BadContentLength) {
+    EXPECT_FALSE (this->feed ("HTTP/1.1 200 OK\r\nContent-Length: 1, 2\r\n\r\n"));
+}
+
+TEST_P (ResponseParser, InterimResponses) {
+    std::string const response = "HTTP/1.1 100 Continue\r\n\r\n"
+                                 "HTTP/1.1 100 Continue\r\nLink: </a.css>\r\n\r\n"
+                                 "HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok";
+    error_or<std::size_t> const r = this->feed (response);
+    ASSERT_TRUE (r) << r.get_error ().message ();
+    EXPECT_TRUE (parser_.complete ());
+    EXPECT_EQ (parser_.status_code (), http::http_status_code::ok);
+    EXPECT_FALSE (parser_.headers ().contains ("link"));
+    EXPECT_EQ (body_, "ok");
+}
+
+TEST_P (ResponseParser, NoContent) {
+    std::string const response = "HTTP/1.1 204 No Content\r\nContent-Length: 10\r\n\r\n";
+    error_or<std::size_t> const r = this->feed (response);
+    ASSERT_TRUE (r);
+    EXPECT_TRUE (parser_.complete ());
+    EXPECT_TRUE (body_.empty ());
+}
+
+TEST_P (ResponseParser, BodyToEof) {
+    error_or<std::size_t> const r = this->feed ("HTTP/1.0 200 OK\r\n\r\nuntil close");
+    ASSERT_TRUE (r);
+    EXPECT_TRUE (parser_.head_complete ());
+    EXPECT_FALSE (parser_.complete ());
+    EXPECT_FALSE (parser_.eof ());
+    EXPECT_TRUE (parser_.complete ());
+    EXPECT_EQ (body_, "until close");
+}
+
+TEST_P (ResponseParser, TruncatedBody) {
+    error_or<std::size_t> const r =
+        this->feed ("HTTP/1.1 200 OK\r\nContent-Length: 10\r\n\r\nshort");
+    ASSERT_TRUE (r);
+    EXPECT_FALSE (parser_.complete ());
+    EXPECT_TRUE (parser_.eof ());
+}
+
+TEST_P (ResponseParser, MalformedHeader) {
+    EXPECT_FALSE (this->feed ("HTTP/1.1 200 OK\r\nno colon here\r\n\r\n"));
+}
+
+TEST_P (ResponseParser, HeadTooLarge) {
+    std::string const response = "HTTP/1.1 200 OK\r\nX-Big: " +
+                                 std::string (http::response_parser::max_head_size, 'a') +
+                                 "\r\n\r\n";
+    error_or<std::size_t> const r = this->feed (response);
+    ASSERT_FALSE (r);
+    EXPECT_EQ (r.get_error (), std::make_error_code (std::errc::message_size));
+}
+
+// Each test is run with the response arriving all at once and as a series of short reads which
+// split lines, CRLFs and chunk headers.
+INSTANTIATE_TEST_SUITE_P (Splits, ResponseParser, testing::Values (0U, 1U, 3U, 7U));
@@ -0,0 +1,216 @@
+#include "client/runtime.hpp"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "client/mpmc_queue.hpp"
+
+#include "test_helpers.hpp"
+
+using namespace pstore;
+
+TEST (MpmcQueue, FirstInFirstOut) {
+    http::mpmc_queue<int> q{4};
+    EXPECT_EQ (q.size (), 0U);
+    int value = 0;
+    EXPECT_FALSE (q.pop (value));
+    // Several laps around the ring.
+    for (int lap = 0; lap < 3; ++lap) {
+        for (int v = 0; v < 3; ++v) {
+            int in = lap * 10 + v;
+            EXPECT_TRUE (q.push (in));
+        }
+        EXPECT_EQ (q.size (), 3U);
+        for (int v = 0; v < 3; ++v) {
+            ASSERT_TRUE (q.pop (value));
+            EXPECT_EQ (value, lap * 10 + v);
+        }
+        EXPECT_FALSE (q.pop (value));
+    }
+}
+
+TEST (MpmcQueue, PushToFullQueueFails) {
+    http::mpmc_queue<std::unique_ptr<int>> q{2};
+    for (int v = 0; v < 2; ++v) {
+        auto p = std::make_unique<int> (v);
+        EXPECT_TRUE (q.push (p));
+        EXPECT_EQ (p, nullptr);
+    }
+    auto extra = std::make_unique<int> (2);
+    EXPECT_FALSE (q.push (extra));
+    // A value that couldn't be pushed is left with the caller.
+    ASSERT_NE (extra, nullptr);
+    EXPECT_EQ (*extra, 2);
+
+    std::unique_ptr<int> out;
+    ASSERT_TRUE (q.pop (out));
+    EXPECT_EQ (*out, 0);
+    EXPECT_TRUE (q.push (extra));
+}
+
+// Every value pushed by a group of producers is popped exactly once by a group of consumers.
+TEST (MpmcQueue, ManyProducersAndConsumers) {
+    constexpr int producers = 4;
+    constexpr int consumers = 4;
+    constexpr int per_producer = 20000;
+    http::mpmc_queue<int> q{64};
+    std::vector<std::atomic<int>> seen (producers * per_producer);
+    std::atomic<int> popped{0};
+
+    std::vector<std::thread> threads;
+    for (int p = 0; p < producers; ++p) {
+        threads.emplace_back ([&q, p] {
+            for (int v = p * per_producer; v < (p + 1) * per_producer; ++v) {
+                int in = v;
+                while (!q.push (in)) {
+                    std::this_thread::yield ();
+                }
+            }
+        });
+    }
+    for (int c = 0; c < consumers; ++c) {
+        threads.emplace_back ([&] {
+            int value;
+            while (popped.load () < producers * per_producer) {
+                if (q.pop (value)) {
+                    ++seen[static_cast<std::size_t> (value)];
+                    ++popped;
+                } else {
+                    std::this_thread::yield ();
+                }
+            }
+        });
+    }
+    for (std::thread & t : threads) {
+        t.join ();
+    }
+    EXPECT_EQ (q.size (), 0U);
+    for (std::atomic<int> const & s : seen) {
+        ASSERT_EQ (s.load (), 1);
+    }
+}
+
+namespace {
+
+    /// Records the outcome of a group of requests. Handlers run on the runtime's workers.
+    class results {
+    public:
+        http::runtime::completion_handler
+        handler (http::runtime const & rt, http::runtime::completion_handler then = nullptr) {
+            return [this, &rt, then] (std::error_code const erc,
+                                      http::response_parser const & response) {
+                {
+                    std::lock_guard<std::mutex> const lock{mutex_};
+                    if (erc) {
+                        errors_.push_back (erc);
+                    }
+                    workers_.insert (rt.current_worker ());
+                    ++completed_;
+                }
+                if (then) {
+                    then (erc, response);
+                }
+            };
+        }
+
+        unsigned completed () const {
+            std::lock_guard<std::mutex> const lock{mutex_};
+            return completed_;
+        }
+        std::vector<std::error_code> errors () const {
+            std::lock_guard<std::mutex> const lock{mutex_};
+            return errors_;
+        }
+        /// The indices of the workers on which the handlers ran.
+        std::set<std::size_t> workers () const {
+            std::lock_guard<std::mutex> const lock{mutex_};
+            return workers_;
+        }
+
+    private:
+        mutable std::mutex mutex_;
+        unsigned completed_ = 0;
+        std::vector<std::error_code> errors_;
+        std::set<std::size_t> workers_;
+    };
+
+    std::string ok (std::string const &) {
+        return "HTTP/1.1 200 OK\r\nContent-Length: 2\r\nConnection: close\r\n\r\nok";
+    }
+
+    http::runtime::options two_workers () {
+        http::runtime::options opts;
+        opts.threads = 2;
+        opts.pin = false;
+        return opts;
+    }
+
+    std::unique_ptr<http::runtime> create (http::runtime::options const & opts) {
+        error_or<std::unique_ptr<http::runtime>> eo = http::runtime::create (opts);
+        EXPECT_TRUE (eo) << eo.get_error ().message ();
+        return eo ? std::move (*eo) : nullptr;
+    }
+
+} // end anonymous namespace
+
+TEST (Runtime, CapacityMustBeAPowerOfTwo) {
+    http::runtime::options opts = two_workers ();
+    opts.queue_capacity = 100;
+    error_or<std::unique_ptr<http::runtime>> const eo = http::runtime::create (opts);
+    ASSERT_FALSE (eo);
+    EXPECT_EQ (eo.get_error (), std::make_error_code (std::errc::invalid_argument));
+}
+
+// Requests submitted from outside the runtime are spread across the workers.
+TEST (Runtime, SpreadsRequests) {
+    test_helpers::loopback_server server{ok};
+    std::unique_ptr<http::runtime> rt = create (two_workers ());
+    ASSERT_NE (rt, nullptr);
+    EXPECT_EQ (rt->threads (), 2U);
+    EXPECT_EQ (rt->current_worker (), rt->threads ());
+
+    results r;
+    for (auto ctr = 0; ctr < 4; ++ctr) {
+        ASSERT_FALSE (rt->submit ("127.0.0.1", server.port (), "/", r.handler (*rt)));
+    }
+    rt->wait ();
+    EXPECT_EQ (r.completed (), 4U);
+    EXPECT_TRUE (r.errors ().empty ());
+    EXPECT_EQ (r.workers (), (std::set<std::size_t>{0U, 1U}));
+    EXPECT_EQ (rt->stolen (), 0U);
+}
+
+// Follow-on requests submitted by a handler go to its worker's queue. That worker can start
+// only one at a time, so its queue backs up and the idle worker steals from it.
+TEST (Runtime, IdleWorkerSteals) {
+    test_helpers::loopback_server server{ok};
+    http::runtime::options opts = two_workers ();
+    opts.max_in_flight = 1;
+    opts.steal_threshold = 0;
+    std::unique_ptr<http::runtime> rt = create (opts);
+    ASSERT_NE (rt, nullptr);
+
+    constexpr auto follow_on = 8U;
+    results first;
+    results rest;
+    ASSERT_FALSE (rt->submit (
+        "127.0.0.1", server.port (), "/",
+        first.handler (*rt, [&] (std::error_code, http::response_parser const &) {
+            for (auto ctr = 0U; ctr < follow_on; ++ctr) {
+                EXPECT_FALSE (rt->submit ("127.0.0.1", server.port (), "/", rest.handler (*rt)));
+            }
+        })));
+    rt->wait ();
+    EXPECT_TRUE (first.errors ().empty ());
+    EXPECT_TRUE (rest.errors ().empty ());
+    EXPECT_EQ (rest.completed (), follow_on);
+    EXPECT_GT (rt->stolen (), 0U);
+    EXPECT_EQ (rest.workers ().size (), 2U);
+}
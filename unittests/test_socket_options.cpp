@@ -0,0 +1,195 @@
+#include "client/socket_options.hpp"
+
+#include <array>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+#include <gtest/gtest.h>
+
+#include "pstore/http/net_txrx.hpp"
+
+#include "client/socket_reader.hpp"
+
+using namespace pstore;
+using namespace std::chrono_literals;
+
+namespace {
+
+    int get_option (socket_descriptor const & fd, int const level, int const name) {
+        int value = -1;
+        socklen_t length = sizeof (value);
+        EXPECT_EQ (::getsockopt (fd.native_handle (), level, name, &value, &length), 0);
+        return value;
+    }
+
+    socket_descriptor tcp_socket () {
+        return socket_descriptor{::socket (AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0)};
+    }
+
+    /// A client socket, configured with \p opts, connected to a loopback listener.
+    class SocketOptions : public testing::Test {
+    protected:
+        void connect (http::socket_options const & opts) {
+            listener_ = tcp_socket ();
+            sockaddr_in addr{};
+            addr.sin_family = AF_INET;
+            addr.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+            socklen_t length = sizeof (addr);
+            auto * const sa = reinterpret_cast<sockaddr *> (&addr);
+            ASSERT_EQ (::bind (listener_.native_handle (), sa, length), 0);
+            ASSERT_EQ (::listen (listener_.native_handle (), 1), 0);
+            ASSERT_EQ (::getsockname (listener_.native_handle (), sa, &length), 0);
+
+            client_ = tcp_socket ();
+            ASSERT_FALSE (http::configure_socket (client_, opts));
+            ASSERT_EQ (::connect (client_.native_handle (), sa, length), 0);
+            server_.reset (::accept (listener_.native_handle (), nullptr, nullptr));
+            ASSERT_TRUE (server_.valid ());
+        }
+
+        socket_descriptor listener_;
+        socket_descriptor client_;
+        socket_descriptor server_;
+    };
+
+} // end anonymous namespace
+
+TEST (ConfigureSocket, Defaults) {
+    socket_descriptor const fd = tcp_socket ();
+    ASSERT_FALSE (http::configure_socket (fd, http::socket_options{}));
+    EXPECT_NE (get_option (fd, IPPROTO_TCP, TCP_NODELAY), 0);
+}
+
+TEST (ConfigureSocket, Nagle) {
+    socket_descriptor const fd = tcp_socket ();
+    http::socket_options opts;
+    opts.no_delay = false;
+    ASSERT_FALSE (http::configure_socket (fd, opts));
+    EXPECT_EQ (get_option (fd, IPPROTO_TCP, TCP_NODELAY), 0);
+}
+
+TEST (ConfigureSocket, BufferSizes) {
+    socket_descriptor const fd = tcp_socket ();
+    http::socket_options opts;
+    opts.receive_buffer = 64 * 1024;
+    opts.send_buffer = 32 * 1024;
+    ASSERT_FALSE (http::configure_socket (fd, opts));
+    // Linux doubles the requested size to allow for its bookkeeping.
+    EXPECT_GE (get_option (fd, SOL_SOCKET, SO_RCVBUF), opts.receive_buffer);
+    EXPECT_GE (get_option (fd, SOL_SOCKET, SO_SNDBUF), opts.send_buffer);
+}
+
+// Fast Open, quick ACK and zero-copy are optional: asking for them never fails.
+TEST (ConfigureSocket, OptionalFeatures) {
+    socket_descriptor const fd = tcp_socket ();
+    http::socket_options opts;
+    opts.quick_ack = true;
+    opts.fast_open = true;
+    opts.zero_copy = true;
+    EXPECT_FALSE (http::configure_socket (fd, opts));
+}
+
+TEST (ConfigureSocket, Timeouts) {
+    socket_descriptor const fd = tcp_socket ();
+    http::socket_options opts;
+    opts.receive_timeout = 2s;
+    opts.send_timeout = 1s;
+    ASSERT_FALSE (http::configure_socket (fd, opts));
+    // The kernel rounds the timeouts to its clock tick, so only the seconds are compared.
+    timeval tv{};
+    socklen_t length = sizeof (tv);
+    ASSERT_EQ (::getsockopt (fd.native_handle (), SOL_SOCKET, SO_RCVTIMEO, &tv, &length), 0);
+    EXPECT_EQ (tv.tv_sec, 2);
+    ASSERT_EQ (::getsockopt (fd.native_handle (), SOL_SOCKET, SO_SNDTIMEO, &tv, &length), 0);
+    EXPECT_EQ (tv.tv_sec, 1);
+}
+
+// A blocking read from a server which sends nothing gives up once the receive timeout has
+// passed.
+TEST_F (SocketOptions, ReceiveTimeout) {
+    http::socket_options opts;
+    opts.receive_timeout = 100ms;
+    this->connect (opts);
+    auto reader = http::make_socket_reader (http::net::refiller);
+    auto const start = std::chrono::steady_clock::now ();
+    error_or<std::size_t> const got = reader.fill (client_);
+    auto const elapsed = std::chrono::steady_clock::now () - start;
+    ASSERT_FALSE (got);
+    EXPECT_EQ (got.get_error (), std::make_error_code (std::errc::timed_out));
+    EXPECT_GE (elapsed, 100ms);
+    EXPECT_LT (elapsed, 1000ms);
+}
+
+TEST_F (SocketOptions, SendAll) {
+    this->connect (http::socket_options{});
+    std::string const data (1024U * 1024U, 'd');
+    std::string received;
+    std::thread reader{[&] {
+        std::array<char, 64 * 1024> buffer;
+        ssize_t r;
+        while ((r = ::recv (server_.native_handle (), buffer.data (), buffer.size (), 0)) > 0) {
+            received.append (buffer.data (), static_cast<std::size_t> (r));
+        }
+    }};
+    EXPECT_FALSE (http::send_all (client_, gsl::make_span (data.data (), data.size ())));
+    client_.reset ();
+    reader.join ();
+    EXPECT_EQ (received, data);
+}
+
+// A zero-copy write's owner is held until the kernel reports that it has finished with the
+// data. The sender doesn't wait for that.
+TEST_F (SocketOptions, ZeroCopySender) {
+    http::socket_options opts;
+    opts.zero_copy = true;
+    this->connect (opts);
+    auto data = std::make_shared<std::string const> (4U * http::zero_copy_threshold, 'z');
+    std::weak_ptr<std::string const> const watch = data;
+    std::string received;
+    std::thread reader{[&] {
+        std::array<char, 64 * 1024> buffer;
+        ssize_t r;
+        while ((r = ::recv (server_.native_handle (), buffer.data (), buffer.size (), 0)) > 0) {
+            received.append (buffer.data (), static_cast<std::size_t> (r));
+        }
+    }};
+    http::zero_copy_sender sender{client_};
+    gsl::span<char const> const span = gsl::make_span (data->data (), data->size ());
+    EXPECT_FALSE (sender.send (span, std::move (data)));
+    // Once the peer has the data, the kernel reports that it is finished with it.
+    auto const start = std::chrono::steady_clock::now ();
+    while (sender.pending () > 0U && std::chrono::steady_clock::now () - start < 5s) {
+        EXPECT_FALSE (sender.reap ());
+        std::this_thread::sleep_for (1ms);
+    }
+    EXPECT_EQ (sender.pending (), 0U);
+    EXPECT_TRUE (watch.expired ());
+    client_.reset ();
+    reader.join ();
+    EXPECT_EQ (received, std::string (4U * http::zero_copy_threshold, 'z'));
+}
+
+// Small writes are copied and their owners released at once.
+TEST_F (SocketOptions, ZeroCopySenderCopiesSmallWrites) {
+    http::socket_options opts;
+    opts.zero_copy = true;
+    this->connect (opts);
+    auto data = std::make_shared<std::string const> (100U, 's');
+    std::weak_ptr<std::string const> const watch = data;
+    http::zero_copy_sender sender{client_};
+    gsl::span<char const> const span = gsl::make_span (data->data (), data->size ());
+    EXPECT_FALSE (sender.send (span, std::move (data)));
+    EXPECT_EQ (sender.pending (), 0U);
+    EXPECT_TRUE (watch.expired ());
+    std::array<char, 100> buffer;
+    EXPECT_EQ (::recv (server_.native_handle (), buffer.data (), buffer.size (), MSG_WAITALL),
+               100);
+}
@@ -0,0 +1,153 @@
+#include "client/timer_wheel.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+using namespace pstore;
+using http::timer_wheel;
+
+namespace {
+
+    class TimerWheel : public testing::Test {
+    protected:
+        static timer_wheel::clock::time_point at (std::int64_t const ms) {
+            return start_ + std::chrono::milliseconds{ms};
+        }
+
+        static timer_wheel::clock::time_point const start_;
+        timer_wheel wheel_{start_};
+    };
+
+    timer_wheel::clock::time_point const TimerWheel::start_ = timer_wheel::clock::now ();
+
+} // end anonymous namespace
+
+TEST_F (TimerWheel, Empty) {
+    EXPECT_TRUE (wheel_.empty ());
+    EXPECT_FALSE (wheel_.next_expiry ());
+    EXPECT_EQ (wheel_.advance (at (1000)), 0U);
+}
+
+TEST_F (TimerWheel, FiresOnce) {
+    int fired = 0;
+    wheel_.schedule (at (10), [&fired] () { ++fired; });
+    EXPECT_EQ (wheel_.size (), 1U);
+    EXPECT_EQ (wheel_.advance (at (9)), 0U);
+    EXPECT_EQ (fired, 0);
+    EXPECT_EQ (wheel_.advance (at (10)), 1U);
+    EXPECT_EQ (fired, 1);
+    EXPECT_EQ (wheel_.advance (at (100)), 0U);
+    EXPECT_EQ (fired, 1);
+    EXPECT_TRUE (wheel_.empty ());
+}
+
+TEST_F (TimerWheel, RoundsUp) {
+    int fired = 0;
+    wheel_.schedule (at (5) + std::chrono::microseconds{1}, [&fired] () { ++fired; });
+    wheel_.advance (at (5));
+    EXPECT_EQ (fired, 0);
+    wheel_.advance (at (6));
+    EXPECT_EQ (fired, 1);
+}
+
+TEST_F (TimerWheel, PastDeadlineFiresOnNextTick) {
+    wheel_.advance (at (50));
+    int fired = 0;
+    wheel_.schedule (at (10), [&fired] () { ++fired; });
+    wheel_.advance (at (50));
+    EXPECT_EQ (fired, 0);
+    wheel_.advance (at (51));
+    EXPECT_EQ (fired, 1);
+}
+
+TEST_F (TimerWheel, Cancel) {
+    int fired = 0;
+    timer_wheel::handle const h = wheel_.schedule (at (10), [&fired] () { ++fired; });
+    EXPECT_TRUE (wheel_.cancel (h));
+    EXPECT_FALSE (wheel_.cancel (h));
+    EXPECT_FALSE (wheel_.cancel (0));
+    EXPECT_TRUE (wheel_.empty ());
+    wheel_.advance (at (20));
+    EXPECT_EQ (fired, 0);
+}
+
+TEST_F (TimerWheel, StaleHandle) {
+    timer_wheel::handle const first = wheel_.schedule (at (10), [] () {});
+    wheel_.advance (at (10));
+    // The node is reused by the next timer, but the old handle must not cancel it.
+    int fired = 0;
+    wheel_.schedule (at (20), [&fired] () { ++fired; });
+    EXPECT_FALSE (wheel_.cancel (first));
+    wheel_.advance (at (20));
+    EXPECT_EQ (fired, 1);
+}
+
+TEST_F (TimerWheel, CallbackSchedulesAndCancels) {
+    std::vector<int> order;
+    timer_wheel::handle victim = 0;
+    wheel_.schedule (at (10), [&] () {
+        order.push_back (1);
+        EXPECT_TRUE (wheel_.cancel (victim));
+        wheel_.schedule (at (11), [&order] () { order.push_back (3); });
+    });
+    victim = wheel_.schedule (at (11), [&order] () { order.push_back (2); });
+    // Both ticks are processed by a single call.
+    wheel_.advance (at (20));
+    EXPECT_EQ (order, (std::vector<int>{1, 3}));
+    EXPECT_TRUE (wheel_.empty ());
+}
+
+TEST_F (TimerWheel, NextExpiry) {
+    wheel_.schedule (at (100), [] () {});
+    wheel_.schedule (at (30), [] () {});
+    maybe<timer_wheel::clock::time_point> const next = wheel_.next_expiry ();
+    ASSERT_TRUE (next);
+    EXPECT_LE (*next, at (30));
+    EXPECT_GT (*next, at (0));
+}
+
+// Timers spread over every level of the wheel (and beyond its range) must each fire on the
+// first call to advance() at or after their deadline: never early and never late.
+TEST_F (TimerWheel, Random) {
+    std::mt19937_64 engine{42};
+    std::uniform_int_distribution<std::int64_t> exponent{0, 25};
+    constexpr auto count = 2000U;
+    std::vector<std::int64_t> deadline (count);
+    std::vector<std::int64_t> fired_at (count, -1);
+    std::int64_t now = 0;
+    for (auto ctr = 0U; ctr < count; ++ctr) {
+        deadline[ctr] = std::uniform_int_distribution<std::int64_t>{
+            1, std::int64_t{1} << exponent (engine)}(engine);
+        wheel_.schedule (at (deadline[ctr]), [&fired_at, &now, ctr] () { fired_at[ctr] = now; });
+    }
+    std::int64_t const last = std::int64_t{1} << 25U;
+    while (!wheel_.empty ()) {
+        std::int64_t earliest = last;
+        for (auto ctr = 0U; ctr < count; ++ctr) {
+            if (fired_at[ctr] == -1) {
+                earliest = std::min (earliest, deadline[ctr]);
+            }
+        }
+        maybe<timer_wheel::clock::time_point> const next = wheel_.next_expiry ();
+        ASSERT_TRUE (next);
+        ASSERT_LE (*next, at (earliest));
+
+        std::int64_t const step = std::uniform_int_distribution<std::int64_t>{
+            1, std::int64_t{1} << exponent (engine)}(engine);
+        std::int64_t const prev = now;
+        now = std::min (now + step, last);
+        wheel_.advance (at (now));
+        for (auto ctr = 0U; ctr < count; ++ctr) {
+            if (fired_at[ctr] == now) {
+                ASSERT_GE (now, deadline[ctr]) << "timer " << ctr << " fired early";
+                ASSERT_LT (prev, deadline[ctr]) << "timer " << ctr << " fired late";
+            } else if (fired_at[ctr] == -1) {
+                ASSERT_LT (now, deadline[ctr]) << "timer " << ctr << " did not fire";
+            }
+        }
+    }
+}
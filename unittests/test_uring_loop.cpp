@@ -0,0 +1,148 @@
+#include "client/uring_loop.hpp"
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "test_helpers.hpp"
+
+using namespace pstore;
+using namespace std::chrono_literals;
+
+namespace {
+
+    /// Returns a response whose body is \p body.
+    std::string response (std::string const & body) {
+        return "HTTP/1.1 200 OK\r\nContent-Length: " + std::to_string (body.length ()) +
+               "\r\nX-Test: yes\r\nConnection: close\r\n\r\n" + body;
+    }
+
+    class UringRoundTrip : public testing::Test {
+    protected:
+        void SetUp () override {
+            if (!http::uring_loop::supported ()) {
+                GTEST_SKIP () << "io_uring is not available";
+            }
+        }
+
+        static std::unique_ptr<http::uring_loop>
+        create (http::uring_loop::options const & opts = {}) {
+            error_or<std::unique_ptr<http::uring_loop>> loop = http::uring_loop::create (opts);
+            EXPECT_TRUE (loop) << loop.get_error ().message ();
+            return loop ? std::move (*loop) : nullptr;
+        }
+
+        /// The outcome of one request.
+        struct result {
+            std::error_code erc = std::make_error_code (std::errc::operation_in_progress);
+            http::http_status_code status{};
+            std::string header;
+            std::string body;
+        };
+
+        /// Starts a GET request for "/" from \p port whose outcome is recorded in \p r.
+        static std::error_code
+        get (http::uring_loop & loop, std::string const & port, result & r,
+             http::uring_loop::request_options const & opts = {}) {
+            return loop.async_get (
+                "127.0.0.1", port, "/", opts,
+                [&r] (std::error_code const erc, http::response_parser const & parser) {
+                    r.erc = erc;
+                    if (!erc) {
+                        r.status = parser.status_code ();
+                        r.header = std::string{parser.headers ().find ("x-test").value_or ("")};
+                    }
+                },
+                [&r] (gsl::span<char const> const data) {
+                    r.body.append (data.data (), static_cast<std::size_t> (data.size ()));
+                });
+        }
+    };
+
+} // end anonymous namespace
+
+TEST_F (UringRoundTrip, RoundTrip) {
+    test_helpers::loopback_server server{[] (std::string const &) { return response ("ok"); }};
+    std::unique_ptr<http::uring_loop> loop = create ();
+    ASSERT_NE (loop, nullptr);
+    result r;
+    ASSERT_FALSE (get (*loop, server.port (), r));
+    EXPECT_EQ (loop->in_flight (), 1U);
+    ASSERT_FALSE (loop->run ());
+    EXPECT_EQ (loop->in_flight (), 0U);
+    ASSERT_FALSE (r.erc) << r.erc.message ();
+    EXPECT_EQ (r.status, http::http_status_code::ok);
+    EXPECT_EQ (r.header, "yes");
+    EXPECT_EQ (r.body, "ok");
+}
+
+// A body many times larger than the ring's receive buffers arrives intact as the buffers are
+// returned to the ring and reused.
+TEST_F (UringRoundTrip, BodySpansReceiveBuffers) {
+    std::string body;
+    for (auto ctr = 0; body.length () < 256U * 1024U; ++ctr) {
+        body += std::to_string (ctr) + '\n';
+    }
+    test_helpers::loopback_server server{
+        [&body] (std::string const &) { return response (body); }};
+    http::uring_loop::options opts;
+    opts.buffers = 8;
+    opts.buffer_size = 1024;
+    std::unique_ptr<http::uring_loop> loop = create (opts);
+    ASSERT_NE (loop, nullptr);
+    result r;
+    ASSERT_FALSE (get (*loop, server.port (), r));
+    ASSERT_FALSE (loop->run ());
+    ASSERT_FALSE (r.erc) << r.erc.message ();
+    EXPECT_EQ (r.body, body);
+}
+
+// Requests started together are submitted together and each receives its own response.
+TEST_F (UringRoundTrip, ConcurrentRequests) {
+    test_helpers::loopback_server server{
+        [] (std::string const & head) { return response (head.substr (0, head.find ('\r'))); }};
+    std::unique_ptr<http::uring_loop> loop = create ();
+    ASSERT_NE (loop, nullptr);
+    // Fewer than the server's listen backlog, so that no connection attempt is dropped.
+    std::vector<result> results (12);
+    for (result & r : results) {
+        ASSERT_FALSE (get (*loop, server.port (), r));
+    }
+    EXPECT_EQ (loop->in_flight (), results.size ());
+    ASSERT_FALSE (loop->run ());
+    for (result const & r : results) {
+        EXPECT_FALSE (r.erc) << r.erc.message ();
+        EXPECT_EQ (r.body, "GET / HTTP/1.1");
+    }
+}
+
+TEST_F (UringRoundTrip, ConnectionRefused) {
+    std::string port;
+    // Find a port on which nothing is listening.
+    test_helpers::listen_on_loopback (1, port);
+    std::unique_ptr<http::uring_loop> loop = create ();
+    ASSERT_NE (loop, nullptr);
+    result r;
+    ASSERT_FALSE (get (*loop, port, r));
+    ASSERT_FALSE (loop->run ());
+    EXPECT_EQ (r.erc, std::make_error_code (std::errc::connection_refused));
+}
+
+// A server which accepts the connection but never answers trips the first-byte deadline.
+TEST_F (UringRoundTrip, FirstByteDeadline) {
+    std::string port;
+    // Connections complete in the listen backlog but are never accepted.
+    socket_descriptor const listener = test_helpers::listen_on_loopback (4, port);
+    ASSERT_TRUE (listener.valid ());
+    std::unique_ptr<http::uring_loop> loop = create ();
+    ASSERT_NE (loop, nullptr);
+    http::uring_loop::request_options opts;
+    opts.first_byte = 50ms;
+    result r;
+    ASSERT_FALSE (get (*loop, port, r, opts));
+    ASSERT_FALSE (loop->run ());
+    EXPECT_EQ (r.erc, std::make_error_code (std::errc::timed_out));
+}
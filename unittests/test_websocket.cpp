@@ -0,0 +1,142 @@
+#include "client/websocket.hpp"
+
+#include <array>
+#include <set>
+#include <string>
+#include <thread>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+using namespace pstore;
+using namespace pstore::http;
+
+namespace {
+
+    /// Plays the server's part of the opening handshake on \p fd, adding \p extra to the
+    /// response's header fields, then sends \p frames.
+    void serve (int const fd, std::string const & frames, std::string const & extra) {
+        std::string request;
+        std::array<char, 1024> buffer;
+        while (request.find ("\r\n\r\n") == std::string::npos) {
+            ssize_t const r = ::recv (fd, buffer.data (), buffer.size (), 0);
+            if (r <= 0) {
+                return;
+            }
+            request.append (buffer.data (), static_cast<std::size_t> (r));
+        }
+        static constexpr char field[] = "Sec-WebSocket-Key: ";
+        auto const start = request.find (field);
+        if (start == std::string::npos) {
+            return;
+        }
+        auto const first = start + sizeof (field) - 1U;
+        std::string const key = request.substr (first, request.find ("\r\n", first) - first);
+        std::string const response = "HTTP/1.1 101 Switching Protocols\r\n"
+                                     "Upgrade: websocket\r\n"
+                                     "Connection: Upgrade\r\n" +
+                                     extra + "Sec-WebSocket-Accept: " +
+                                     ws::accept_key (key) + "\r\n\r\n" + frames;
+        ::send (fd, response.data (), response.size (), MSG_NOSIGNAL);
+    }
+
+    class WebSocket : public testing::Test {
+    protected:
+        /// Connects a websocket to a peer which completes the handshake and then sends
+        /// \p frames. \p extra is added to the handshake response's header fields.
+        error_or<websocket> connect (std::string const & frames, std::string const & extra = "") {
+            std::array<int, 2> fds;
+            if (::socketpair (AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds.data ()) != 0) {
+                return error_or<websocket>{std::error_code{errno, std::generic_category ()}};
+            }
+            server_.reset (fds[1]);
+            std::thread peer{
+                [this, &frames, &extra] { serve (server_.native_handle (), frames, extra); }};
+            error_or<websocket> result =
+                websocket::connect (socket_descriptor{fds[0]}, "example.test", "80", "/");
+            peer.join ();
+            return result;
+        }
+
+        socket_descriptor server_;
+    };
+
+} // end anonymous namespace
+
+TEST_F (WebSocket, UnmaskedMessage) {
+    error_or<websocket> ws = this->connect (std::string{"\x81\x02hi", 4});
+    ASSERT_TRUE (ws) << ws.get_error ().message ();
+    std::array<char, 16> buffer;
+    error_or<websocket::message> const m = ws->receive (gsl::make_span (buffer));
+    ASSERT_TRUE (m) << m.get_error ().message ();
+    EXPECT_EQ (m->type, ws::opcode::text);
+    EXPECT_EQ (std::string (buffer.data (), m->size), "hi");
+}
+
+// A handshake response head which is too large is rejected rather than overrunning the
+// buffer.
+TEST_F (WebSocket, OversizedHandshake) {
+    error_or<websocket> ws =
+        this->connect ("", "X-Filler: " + std::string (100U * 1024U, 'x') + "\r\n");
+    ASSERT_FALSE (ws);
+    EXPECT_EQ (ws.get_error (), std::make_error_code (std::errc::message_size));
+}
+
+// A client must fail the connection if a server sends a masked frame.
+TEST_F (WebSocket, MaskedFrameIsAnError) {
+    // "hi" masked with the key 1, 2, 3, 4.
+    error_or<websocket> ws =
+        this->connect (std::string{"\x81\x82\x01\x02\x03\x04\x69\x6b", 8});
+    ASSERT_TRUE (ws) << ws.get_error ().message ();
+    std::array<char, 16> buffer;
+    error_or<websocket::message> const m = ws->receive (gsl::make_span (buffer));
+    ASSERT_FALSE (m);
+    EXPECT_EQ (m.get_error (), std::make_error_code (std::errc::protocol_error));
+}
+
+TEST_F (WebSocket, MaskedControlFrameIsAnError) {
+    error_or<websocket> ws = this->connect (std::string{"\x89\x80\x01\x02\x03\x04", 6});
+    ASSERT_TRUE (ws) << ws.get_error ().message ();
+    std::array<char, 16> buffer;
+    error_or<websocket::message> const m = ws->receive (gsl::make_span (buffer));
+    ASSERT_FALSE (m);
+    EXPECT_EQ (m.get_error (), std::make_error_code (std::errc::protocol_error));
+}
+
+// Every frame the client sends is masked, each with a different key. More frames are sent than
+// are fetched from the kernel at once.
+TEST_F (WebSocket, FramesHaveFreshMasks) {
+    error_or<websocket> ws = this->connect ({});
+    ASSERT_TRUE (ws) << ws.get_error ().message ();
+    constexpr auto frames = 200U;
+    for (auto ctr = 0U; ctr < frames; ++ctr) {
+        ASSERT_FALSE (ws->send_text ("x"));
+    }
+
+    std::string received;
+    std::array<char, 4096> buffer;
+    // Each frame is a 6 byte header followed by the one byte payload.
+    while (received.size () < frames * 7U) {
+        ssize_t const r = ::recv (server_.native_handle (), buffer.data (), buffer.size (), 0);
+        ASSERT_GT (r, 0);
+        received.append (buffer.data (), static_cast<std::size_t> (r));
+    }
+    std::set<ws::masking_key> keys;
+    auto const * first = reinterpret_cast<std::uint8_t const *> (received.data ());
+    auto const * const last = first + received.size ();
+    while (first != last) {
+        ws::frame_header header;
+        error_or<std::size_t> const size = ws::decode_frame_header (first, last, header);
+        ASSERT_TRUE (size);
+        ASSERT_GT (*size, 0U);
+        EXPECT_TRUE (header.masked);
+        EXPECT_EQ (header.payload_length, 1U);
+        EXPECT_EQ (first[*size] ^ header.mask[0], 'x');
+        keys.insert (header.mask);
+        first += *size + 1U;
+    }
+    // Keys are random, so a repeat among 200 of them is possible but vanishingly unlikely.
+    EXPECT_GE (keys.size (), frames - 1U);
+}
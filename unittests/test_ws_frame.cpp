@@ -0,0 +1,148 @@
+#include "client/ws_frame.hpp"
+
+#include <array>
+#include <cstdint>
+#include <numeric>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+using namespace pstore;
+using namespace pstore::http;
+
+namespace {
+
+    using bytes = std::vector<std::uint8_t>;
+
+    error_or<std::size_t> decode (bytes const & b, ws::frame_header & header) {
+        return ws::decode_frame_header (b.data (), b.data () + b.size (), header);
+    }
+
+    bytes encode (ws::frame_header const & header) {
+        bytes b (ws::max_header_size);
+        b.resize (ws::encode_frame_header (header, b.data ()));
+        return b;
+    }
+
+} // end anonymous namespace
+
+TEST (WsFrame, DecodeSmall) {
+    ws::frame_header header;
+    error_or<std::size_t> const r = decode ({0x81, 0x05}, header);
+    ASSERT_TRUE (r);
+    EXPECT_EQ (*r, 2U);
+    EXPECT_TRUE (header.fin);
+    EXPECT_EQ (header.op, ws::opcode::text);
+    EXPECT_FALSE (header.masked);
+    EXPECT_EQ (header.payload_length, 5U);
+}
+
+TEST (WsFrame, DecodeMasked) {
+    ws::frame_header header;
+    error_or<std::size_t> const r = decode ({0x02, 0x83, 1, 2, 3, 4}, header);
+    ASSERT_TRUE (r);
+    EXPECT_EQ (*r, 6U);
+    EXPECT_FALSE (header.fin);
+    EXPECT_EQ (header.op, ws::opcode::binary);
+    EXPECT_TRUE (header.masked);
+    EXPECT_EQ (header.mask, (ws::masking_key{{1, 2, 3, 4}}));
+    EXPECT_EQ (header.payload_length, 3U);
+}
+
+TEST (WsFrame, DecodeIncomplete) {
+    bytes const full{0x82, 0xFF, 0, 0, 0, 1, 0, 0, 0, 0, 9, 8, 7, 6};
+    for (std::size_t size = 0; size < full.size (); ++size) {
+        ws::frame_header header;
+        error_or<std::size_t> const r =
+            ws::decode_frame_header (full.data (), full.data () + size, header);
+        ASSERT_TRUE (r) << "size " << size;
+        EXPECT_EQ (*r, 0U) << "size " << size;
+    }
+    ws::frame_header header;
+    error_or<std::size_t> const r = decode (full, header);
+    ASSERT_TRUE (r);
+    EXPECT_EQ (*r, full.size ());
+    EXPECT_EQ (header.payload_length, std::uint64_t{1} << 32U);
+}
+
+TEST (WsFrame, RejectsReservedBits) {
+    ws::frame_header header;
+    EXPECT_FALSE (decode ({0xC1, 0x00}, header));
+    EXPECT_FALSE (decode ({0x91, 0x00}, header));
+}
+
+TEST (WsFrame, RejectsReservedOpcodes) {
+    ws::frame_header header;
+    EXPECT_FALSE (decode ({0x83, 0x00}, header));
+    EXPECT_FALSE (decode ({0x8B, 0x00}, header));
+}
+
+TEST (WsFrame, RejectsBadControlFrames) {
+    ws::frame_header header;
+    // A fragmented ping.
+    EXPECT_FALSE (decode ({0x09, 0x00}, header));
+    // A close frame with a 126 byte payload.
+    EXPECT_FALSE (decode ({0x88, 0x7E, 0x00, 0x7E}, header));
+    // The largest permitted control payload.
+    EXPECT_TRUE (decode ({0x8A, 0x7D}, header));
+}
+
+TEST (WsFrame, RejectsNonMinimalLengths) {
+    ws::frame_header header;
+    EXPECT_FALSE (decode ({0x82, 0x7E, 0x00, 0x7D}, header));
+    EXPECT_FALSE (decode ({0x82, 0x7F, 0, 0, 0, 0, 0, 0, 0xFF, 0xFF}, header));
+    EXPECT_FALSE (decode ({0x82, 0x7F, 0x80, 0, 0, 0, 0, 0, 0, 0}, header));
+}
+
+TEST (WsFrame, RoundTrip) {
+    for (std::uint64_t const length :
+         {std::uint64_t{0}, std::uint64_t{125}, std::uint64_t{126}, std::uint64_t{0xFFFF},
+          std::uint64_t{0x10000}, std::uint64_t{1} << 40U}) {
+        for (bool const masked : {false, true}) {
+            ws::frame_header in;
+            in.fin = length % 2U == 0U;
+            in.op = ws::opcode::binary;
+            in.masked = masked;
+            in.mask = {{0xDE, 0xAD, 0xBE, 0xEF}};
+            in.payload_length = length;
+            bytes const b = encode (in);
+
+            ws::frame_header out;
+            error_or<std::size_t> const r = decode (b, out);
+            ASSERT_TRUE (r) << "length " << length;
+            EXPECT_EQ (*r, b.size ());
+            EXPECT_EQ (out.fin, in.fin);
+            EXPECT_EQ (out.op, in.op);
+            EXPECT_EQ (out.masked, in.masked);
+            EXPECT_EQ (out.payload_length, in.payload_length);
+            if (masked) {
+                EXPECT_EQ (out.mask, in.mask);
+            }
+        }
+    }
+}
+
+TEST (WsFrame, MaskMatchesScalar) {
+    ws::masking_key const key{{0x12, 0x34, 0x56, 0x78}};
+    bytes in (131);
+    std::iota (in.begin (), in.end (), std::uint8_t{0});
+    // Every offset and length up to beyond the vector widths, so that each of the SIMD and
+    // scalar paths is exercised.
+    for (std::size_t offset = 0; offset < 4; ++offset) {
+        for (std::size_t size = 0; size <= in.size (); ++size) {
+            bytes out (size);
+            ws::mask_copy (in.data (), in.data () + size, out.data (), key, offset);
+            for (std::size_t ctr = 0; ctr < size; ++ctr) {
+                ASSERT_EQ (out[ctr], in[ctr] ^ key[(offset + ctr) % 4U])
+                    << "offset " << offset << " size " << size << " byte " << ctr;
+            }
+            ws::apply_mask (out.data (), out.data () + size, key, offset);
+            ASSERT_TRUE (std::equal (out.begin (), out.end (), in.begin ()));
+        }
+    }
+}
+
+TEST (WsFrame, AcceptKey) {
+    // The example from RFC 6455 section 1.3.
+    EXPECT_EQ (ws::accept_key ("dGhlIHNhbXBsZSBub25jZQ=="), "s3pPLMBiTxaQ9kYGzzhZRbK+xOo=");
+}
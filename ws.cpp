@@ -1,7 +1,9 @@
 // Standard library
 #include <cassert>
+#include <cstdlib>
 #include <cstring>
 #include <iostream>
+#include <vector>
 
 // Platform
 #include <unistd.h>
@@ -17,6 +19,7 @@
 
 // client
 #include "client/client.hpp"
+#include "client/websocket.hpp"
 
 int main (int argc, char ** argv) {
 
@@ -27,19 +30,23 @@ int main (int argc, char ** argv) {
         std::cout << *sc << '\n';
     }
 
-    if (argc != 4) {
-        std::cerr << "USAGE: " << argv[0] << " <hostname> <port> <request path>\n";
+    if (argc != 4 && argc != 5) {
+        std::cerr << "USAGE: " << argv[0]
+                  << " <hostname> <port> <request path> [<messages to print>]\n";
         return EXIT_FAILURE;
     }
 
-    std::unordered_map<std::string, std::string> jar; // cookie jar.
-
     // Establish connection with <hostname>:<port>
     auto const host = std::string{argv[1]};
     auto const port = std::string{argv[2]};
     auto const path = std::string{argv[3]};
+    auto const messages = argc == 5 ? std::strtoul (argv[4], nullptr, 10) : 0UL;
+    // A WebSocket may wait indefinitely for its next message, so only connecting is
+    // time-limited.
     pstore::error_or<pstore::socket_descriptor> eo_socket =
-        pstore::http::get_host_info (host, port) >>= pstore::http::establish_connection;
+        pstore::http::get_host_info (host, port) >>= [] (addrinfo * const info) {
+            return pstore::http::establish_connection_with (info, pstore::http::socket_options{});
+        };
     if (!eo_socket) {
         std::cerr << "Failed to connect to: " << host << ':' << port << ' ' << path << " ("
                   << eo_socket.get_error ().message () << ")\n";
@@ -47,47 +54,47 @@ int main (int argc, char ** argv) {
     }
     pstore::socket_descriptor & clientfd = *eo_socket;
 
-    // Send an HTTP GET request.
-
-    std::string const ws_key = pstore::http::request_key ();
-    std::error_code const erc = pstore::http::http_ws_get (clientfd, host, port, path, ws_key);
-    if (erc) {
-        std::cerr << "Failed to send: " << erc.message () << ")\n";
+    // Upgrade the connection.
+    pstore::error_or<pstore::http::websocket> eo_ws =
+        pstore::http::websocket::connect (std::move (clientfd), host, port, path);
+    if (!eo_ws) {
+        std::cerr << "WebSocket handshake failed: " << eo_ws.get_error ().message () << '\n';
         return EXIT_FAILURE;
     }
+    pstore::http::websocket & ws = *eo_ws;
+
+    // Print the requested number of messages, then close the connection.
+    std::vector<char> buffer (1024 * 1024);
+    for (auto ctr = 0UL; ctr < messages; ++ctr) {
+        pstore::error_or<pstore::http::websocket::message> const m = ws.receive (buffer);
+        if (!m) {
+            std::cerr << "Failed to receive: " << m.get_error ().message () << '\n';
+            return EXIT_FAILURE;
+        }
+        if (m->type == pstore::http::ws::opcode::close) {
+            std::cout << "closed: " << static_cast<unsigned> (m->code) << '\n';
+            return EXIT_SUCCESS;
+        }
+        std::cout << "message: ";
+        std::cout.write (buffer.data (), static_cast<std::streamsize> (m->size));
+        std::cout << '\n';
+    }
 
-    // Get the server's reply.
-    auto reader = pstore::http::make_buffered_reader<pstore::socket_descriptor &> (
-        pstore::http::net::refiller);
-    pstore::error_or_n<pstore::socket_descriptor &, pstore::http::status_line> eri =
-        read_status_line (reader, std::ref (clientfd));
-    if (!eri) {
-        std::cerr << "Failed to read: " << eri.get_error ().message () << '\n';
+    if (std::error_code const erc = ws.close ()) {
+        std::cerr << "Failed to close: " << erc.message () << '\n';
         return EXIT_FAILURE;
     }
-
-    clientfd = std::move (std::get<0> (*eri));
-    auto const & request = std::get<pstore::http::status_line> (*eri);
-    std::cout << "http-version: " << request.http_version () << '\n'
-              << "status-code: " << request.status_code () << '\n'
-              << "reason-phrase: " << request.reason_phrase () << '\n';
-
-    // Scan the HTTP headers and dump the server's response.
-
-    PSTORE_ASSERT (clientfd.valid ());
-    std::unordered_map<std::string, std::string> headers;
-    pstore::error_or<pstore::socket_descriptor> const err = read_headers (
-        reader, std::ref (clientfd),
-        [&] (pstore::http::header_info io, std::string const & key, std::string const & value) {
-            std::cout << "header: " << key << '=' << value << '\n';
-            headers[key] = value;
-            return io.handler (key, value);
-        },
-        pstore::http::header_info ()) >>=
-        [&] (pstore::socket_descriptor & io2, pstore::http::header_info const & header_contents) {
-            return pstore::http::read_reply (reader, io2, header_contents,
-                                             pstore::http::content_length (headers));
-        };
+    // Wait for the server's close frame, discarding any messages which precede it.
+    for (;;) {
+        pstore::error_or<pstore::http::websocket::message> const m = ws.receive (buffer);
+        if (!m) {
+            std::cerr << "Failed to receive: " << m.get_error ().message () << '\n';
+            return EXIT_FAILURE;
+        }
+        if (m->type == pstore::http::ws::opcode::close) {
+            break;
+        }
+    }
 
     return EXIT_SUCCESS;
 }